@@ -0,0 +1,121 @@
+#include <algorithm>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "Exchange/Matcher/MatchingEngine.hpp"
+
+/// Replays the same synthetic order flow through a single MEOrderBook once per self-trade prevention mode and reports the rdtsc
+/// cycles spent per client request (matching plus publishing the outputs).
+/// Buy orders only ever come from even client ids and sell orders from odd ones, so no client can cross itself - this measures
+/// what having self-trade prevention enabled costs the add path when it never triggers, each mode's mean is also reported relative to NONE.
+/// What the modes do when it does trigger is checked by Tests/MEOrderBookSTPTest. Build with NDEBUG, otherwise the per request logging
+/// is most of what gets measured.
+
+using namespace Exchange;
+
+constexpr size_t NUM_REQUESTS = 200 * 1000;
+constexpr size_t NUM_RUNS = 3;
+constexpr ClientId NUM_CLIENTS = 8;
+constexpr Price MID_PRICE = 1000;
+
+auto generateRequests() -> std::vector<MEClientRequest>
+{
+  std::mt19937 rng(42);
+  std::vector<MEClientRequest> requests;
+  requests.reserve(NUM_REQUESTS);
+  std::array<OrderId, NUM_CLIENTS> next_order_id = {};
+
+  for (size_t i = 0; i < NUM_REQUESTS; ++i)
+  {
+    const auto side = (rng() % 2 ? Side::BUY : Side::SELL);
+    const auto client_id = static_cast<ClientId>(2 * (rng() % (NUM_CLIENTS / 2)) + (side == Side::SELL));
+    auto &order_id = next_order_id[client_id];
+
+    if (order_id && rng() % 10 < 4)
+    {
+      requests.push_back({ClientRequestType::CANCEL, client_id, 0, static_cast<OrderId>(rng() % order_id), side, Price_INVALID,
+                          Quantity_INVALID, OrderType::INVALID, TimeInForce::INVALID});
+      continue;
+    }
+
+    // mostly passive orders around the mid with the occasional aggressive order sweeping a few levels.
+    const auto offset = static_cast<Price>(rng() % 20) - (rng() % 10 ? 0 : 25);
+    const auto price = (side == Side::BUY ? MID_PRICE - 1 - offset : MID_PRICE + 1 + offset);
+    requests.push_back({ClientRequestType::NEW, client_id, 0, order_id++, side, price, static_cast<Quantity>(1 + rng() % 100),
+                        OrderType::LIMIT, TimeInForce::DAY});
+  }
+
+  return requests;
+}
+
+auto runBenchmark(const std::vector<MEClientRequest> &requests, STPMode stp_mode) -> uint64_t
+{
+  ClientRequestLFQueue client_requests(ME_MAX_CLIENT_UPDATES);
+  ClientResponseLFQueue client_responses(ME_MAX_CLIENT_UPDATES);
+  MEMarketUpdateLFQueue market_updates(ME_MAX_MARKET_UPDATES);
+
+  MatchingEngineCfg cfg;
+  cfg.stp_mode_ = stp_mode;
+
+  // ME_MAX_TICKERS shards and shard 0 means this engine only allocates the order book for ticker 0, and it is never started.
+  auto matching_engine = new MatchingEngine(&client_requests, &client_responses, &market_updates, 0, ME_MAX_TICKERS, -1, cfg, nullptr, "", 0);
+
+  std::vector<uint64_t> cycles;
+  cycles.reserve(requests.size());
+  size_t num_trades = 0;
+
+  for (const auto &request : requests)
+  {
+    const auto start = Common::rdtsc();
+    matching_engine->processClientRequest(&request);
+    matching_engine->publishOutputs();
+    cycles.push_back(Common::rdtsc() - start);
+
+    while (client_responses.size())
+      client_responses.updateReadIndex();
+    for (auto market_update = market_updates.getNextToRead(); market_update; market_update = market_updates.getNextToRead())
+    {
+      num_trades += (market_update->type_ == MarketUpdateType::TRADE);
+      market_updates.updateReadIndex();
+    }
+  }
+
+  delete matching_engine;
+
+  std::sort(cycles.begin(), cycles.end());
+  uint64_t total = 0;
+  for (const auto c : cycles)
+    total += c;
+
+  std::cout << "stp-mode:" << stpModeToString(stp_mode)
+            << " requests:" << cycles.size()
+            << " trades:" << num_trades
+            << " mean:" << total / cycles.size()
+            << " p50:" << cycles[cycles.size() / 2]
+            << " p90:" << cycles[cycles.size() * 9 / 10]
+            << " p99:" << cycles[cycles.size() * 99 / 100]
+            << " p99.9:" << cycles[cycles.size() * 999 / 1000]
+            << " (rdtsc cycles)" << std::endl;
+  return total / cycles.size();
+}
+
+int main(int, char **)
+{
+#if !defined(NDEBUG)
+  std::cout << "Built without NDEBUG, the numbers below are dominated by logging." << std::endl;
+#endif
+  const auto requests = generateRequests();
+
+  for (size_t run = 0; run < NUM_RUNS; ++run)
+  {
+    const auto none_mean = runBenchmark(requests, STPMode::NONE);
+    for (auto mode = static_cast<int>(STPMode::NONE) + 1; mode < static_cast<int>(STPMode::MAX); ++mode)
+    {
+      const auto mean = runBenchmark(requests, static_cast<STPMode>(mode));
+      std::cout << "  vs NONE mean:" << static_cast<int64_t>(mean) - static_cast<int64_t>(none_mean) << " (rdtsc cycles)" << std::endl;
+    }
+  }
+
+  return 0;
+}
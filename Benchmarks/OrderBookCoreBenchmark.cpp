@@ -0,0 +1,273 @@
+#include <algorithm>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "Common/HugePages.hpp"
+#include "Common/OrderBookCore.hpp"
+#include "Common/PerfCounters.hpp"
+#include "Common/PerfUtils.hpp"
+#include "Exchange/Matcher/MatchingEngineOrder.hpp"
+#include "Trading/Strategy/MarketOrder.hpp"
+
+/// Runs the same add / cancel flow through OrderBookCore with the order storage of both order books and every combination of price
+/// ladder layout and aggregate tracking, and reports the rdtsc cycles per add, per cancel, per top of book read (best price and its
+/// quantity, done after every add and cancel) and per sweep (walking every order in the top SWEEP_LEVELS levels of both sides the way a
+/// matching sweep does, every SWEEP_INTERVAL operations). Where perf counters are available it also reports the L1D, LLC and dTLB read
+/// misses per operation over the whole run.
+/// Prices are spread over MAX_PRICE_LEVELS / 2 ticks on each side and weighted towards the top of the book, so the ladder gets deep
+/// enough for where a new level goes to matter. "MEOrder AoS" is MEOrder as it was before MEOrderStore - one ~80 byte struct per order
+/// with pointer links in a MemPool - for comparison.
+
+constexpr size_t NUM_OPERATIONS = 2 * 1000 * 1000;
+constexpr size_t NUM_RUNS = 3;
+constexpr size_t MAX_LIVE_ORDERS = 100 * 1000;
+constexpr size_t SWEEP_LEVELS = 1;
+constexpr size_t SWEEP_INTERVAL = 100;
+constexpr Common::Price MID_PRICE = 10 * 1000;
+constexpr Common::Price MAX_OFFSET = ME_MAX_PRICE_LEVELS / 2 - 1;
+
+struct Operation
+{
+  bool add_ = false;
+  Common::Side side_ = Common::Side::INVALID;
+  Common::Price price_ = Common::Price_INVALID;
+  Common::Quantity quantity_ = 0;
+  size_t cancel_index_ = 0; // which live order to cancel, a position in the vector of live orders.
+};
+
+auto generateOperations() -> std::vector<Operation>
+{
+  std::mt19937 rng(42);
+  std::geometric_distribution<Common::Price> offset_distribution(0.02);
+  std::vector<Operation> operations;
+  operations.reserve(NUM_OPERATIONS);
+
+  size_t num_live = 0;
+  for (size_t i = 0; i < NUM_OPERATIONS; ++i)
+  {
+    // slightly more adds than cancels, so the book fills up to MAX_LIVE_ORDERS over the first half of the run and stays around there.
+    if (num_live && (num_live == MAX_LIVE_ORDERS || rng() % 100 < 45))
+    {
+      operations.push_back({false, Common::Side::INVALID, Common::Price_INVALID, 0, rng() % num_live--});
+      continue;
+    }
+    const auto side = (rng() % 2 ? Common::Side::BUY : Common::Side::SELL);
+    const auto offset = 1 + std::min(offset_distribution(rng), MAX_OFFSET - 1);
+    operations.push_back({true, side, (side == Common::Side::BUY ? MID_PRICE - offset : MID_PRICE + offset),
+                          static_cast<Common::Quantity>(1 + rng() % 100), 0});
+    ++num_live;
+  }
+
+  return operations;
+}
+
+template<typename BookPolicy, typename LadderT, bool TrackAggregates>
+struct BenchmarkPolicy : BookPolicy
+{
+  typedef LadderT Ladder;
+  static constexpr bool TRACK_AGGREGATES = TrackAggregates;
+};
+
+/// MEOrder with its links, laid out the way MEOrderBook used to keep its orders.
+struct AoSMEOrder
+{
+  Common::TickerId ticker_id_ = Common::TickerId_INVALID;
+  Common::ClientId client_id_ = Common::ClientId_INVALID;
+  Common::OrderId client_order_id_ = Common::OrderId_INVALID;
+  Common::OrderId market_order_id_ = Common::OrderId_INVALID;
+  Common::Side side_ = Common::Side::INVALID;
+  Common::Price price_ = Common::Price_INVALID;
+  Common::Quantity quantity_ = Common::Quantity_INVALID;
+  Common::Priority priority_ = Common::Priority_INVALID;
+
+  AoSMEOrder *prev_order_ = nullptr;
+  AoSMEOrder *next_order_ = nullptr;
+
+  AoSMEOrder() = default;
+
+  AoSMEOrder(Common::TickerId ticker_id, Common::ClientId client_id, Common::OrderId client_order_id, Common::OrderId market_order_id,
+             Common::Side side, Common::Price price, Common::Quantity quantity, Common::Priority priority) noexcept
+      : ticker_id_(ticker_id)
+      , client_id_(client_id)
+      , client_order_id_(client_order_id)
+      , market_order_id_(market_order_id)
+      , side_(side)
+      , price_(price)
+      , quantity_(quantity)
+      , priority_(priority) {}
+};
+
+struct AoSMEOrdersAtPrice
+{
+  Common::Side side_ = Common::Side::INVALID;
+  Common::Price price_ = Common::Price_INVALID;
+  uint64_t total_quantity_ = 0;
+  uint32_t num_orders_ = 0;
+  AoSMEOrder *first_me_order_ = nullptr;
+  AoSMEOrdersAtPrice *prev_entry_ = nullptr;
+  AoSMEOrdersAtPrice *next_entry_ = nullptr;
+
+  AoSMEOrdersAtPrice() = default;
+
+  AoSMEOrdersAtPrice(Common::Side side, Common::Price price, AoSMEOrder *first_me_order, AoSMEOrdersAtPrice *prev_entry,
+                     AoSMEOrdersAtPrice *next_entry)
+      : side_(side)
+      , price_(price)
+      , first_me_order_(first_me_order)
+      , prev_entry_(prev_entry)
+      , next_entry_(next_entry) {}
+};
+
+struct AoSMEOrderBookPolicy : Exchange::MEOrderBookPolicy
+{
+  typedef Common::PooledOrderStore<AoSMEOrder> OrderStore;
+  typedef AoSMEOrdersAtPrice OrdersAtPrice;
+
+  static auto firstOrder(AoSMEOrdersAtPrice *orders_at_price) noexcept -> AoSMEOrder *&
+  {
+    return orders_at_price->first_me_order_;
+  }
+};
+
+auto newOrder(auto *core, const Operation &operation)
+{
+  if constexpr (std::is_same_v<typename std::remove_reference_t<decltype(*core)>::OrderStore, Common::PooledOrderStore<Trading::MarketOrder>>)
+    return core->allocateOrder(0, operation.side_, operation.price_, operation.quantity_, 0, nullptr, nullptr);
+  else
+    return core->allocateOrder(0, 0, 0, 0, operation.side_, operation.price_, operation.quantity_, 0);
+}
+
+auto report(const std::string &name, std::vector<uint64_t> &cycles)
+{
+  std::sort(cycles.begin(), cycles.end());
+  uint64_t total = 0;
+  for (const auto c : cycles)
+    total += c;
+
+  std::cout << " " << name << " mean:" << total / std::max<size_t>(cycles.size(), 1)
+            << " p50:" << cycles[cycles.size() / 2]
+            << " p99:" << cycles[cycles.size() * 99 / 100];
+}
+
+template<typename Policy>
+auto runBenchmark(const std::string &name, const std::vector<Operation> &operations) -> void
+{
+  auto core = new Common::OrderBookCore<Policy>();
+  const auto &orders = core->orders();
+
+  std::vector<typename Common::OrderBookCore<Policy>::OrderHandle> live_orders;
+  live_orders.reserve(MAX_LIVE_ORDERS);
+  std::vector<uint64_t> add_cycles, cancel_cycles, top_cycles, sweep_cycles;
+  add_cycles.reserve(operations.size());
+  cancel_cycles.reserve(operations.size());
+  top_cycles.reserve(operations.size());
+  sweep_cycles.reserve(operations.size() / SWEEP_INTERVAL + 1);
+  uint64_t checksum = 0;
+
+  Common::CacheMissCounters counters;
+  counters.start();
+
+  for (size_t i = 0; i < operations.size(); ++i)
+  {
+    const auto &operation = operations[i];
+    if (operation.add_)
+    {
+      auto order = newOrder(core, operation);
+      const auto start = Common::rdtsc();
+      core->addOrder(order);
+      add_cycles.push_back(Common::rdtsc() - start);
+      live_orders.push_back(order);
+    } else
+    {
+      auto order = live_orders[operation.cancel_index_];
+      live_orders[operation.cancel_index_] = live_orders.back();
+      live_orders.pop_back();
+      const auto start = Common::rdtsc();
+      core->removeOrder(order);
+      cancel_cycles.push_back(Common::rdtsc() - start);
+    }
+
+    const auto start = Common::rdtsc();
+    for (const auto side : {Common::Side::BUY, Common::Side::SELL})
+    {
+      const auto best_orders_by_price = core->bestOrdersByPrice(side);
+      if (best_orders_by_price)
+        checksum += best_orders_by_price->price_ + core->levelQuantity(best_orders_by_price);
+    }
+    top_cycles.push_back(Common::rdtsc() - start);
+
+    if (i % SWEEP_INTERVAL == 0)
+    {
+      const auto sweep_start = Common::rdtsc();
+      for (const auto side : {Common::Side::BUY, Common::Side::SELL})
+      {
+        const auto best_orders_by_price = core->bestOrdersByPrice(side);
+        auto orders_at_price = best_orders_by_price;
+        for (size_t level = 0; level < SWEEP_LEVELS && orders_at_price; ++level)
+        {
+          auto order = Policy::firstOrder(orders_at_price);
+          do
+          {
+            checksum += orders.quantity(order);
+            order = orders.next(order);
+          } while (order != Policy::firstOrder(orders_at_price));
+          orders_at_price = (orders_at_price->next_entry_ == best_orders_by_price ? nullptr : orders_at_price->next_entry_);
+        }
+      }
+      sweep_cycles.push_back(Common::rdtsc() - sweep_start);
+    }
+  }
+  counters.stop();
+
+  for (auto order : live_orders)
+    core->removeOrder(order);
+  delete core;
+
+  std::cout << name;
+  report("add", add_cycles);
+  report("cancel", cancel_cycles);
+  report("top-of-book", top_cycles);
+  report("sweep", sweep_cycles);
+  std::cout << " checksum:" << checksum << " (rdtsc cycles)";
+  if (counters.available())
+  {
+    std::cout << " misses/op l1d:" << static_cast<double>(counters.count(Common::CacheMissCounters::L1D_READ_MISSES)) / operations.size()
+              << " llc:" << static_cast<double>(counters.count(Common::CacheMissCounters::LLC_READ_MISSES)) / operations.size()
+              << " dtlb:" << static_cast<double>(counters.count(Common::CacheMissCounters::DTLB_READ_MISSES)) / operations.size();
+  }
+  std::cout << std::endl;
+}
+
+int main(int, char **)
+{
+  // ANCHOR_HUGE_PAGES=OFF|2M|1G as for the exchange, to compare the order storage on small and huge pages.
+  Common::HugePageCfg huge_page_cfg;
+  const auto huge_pages_env = std::getenv("ANCHOR_HUGE_PAGES");
+  if (huge_pages_env)
+    huge_page_cfg.mode_ = Common::stringToHugePageMode(huge_pages_env);
+  ASSERT(huge_page_cfg.mode_ != Common::HugePageMode::INVALID && huge_page_cfg.mode_ != Common::HugePageMode::MAX,
+         "Invalid ANCHOR_HUGE_PAGES:" + std::string(huge_pages_env ? huge_pages_env : ""));
+  Common::setHugePageCfg(huge_page_cfg);
+  std::cout << huge_page_cfg.toString() << std::endl;
+
+  const auto operations = generateOperations();
+  if (!Common::CacheMissCounters().available())
+    std::cout << "perf counters unavailable, only reporting cycles." << std::endl;
+
+  for (size_t run = 0; run < NUM_RUNS; ++run)
+  {
+    runBenchmark<BenchmarkPolicy<Exchange::MEOrderBookPolicy, Common::LinkedLadder, false>>("MEOrder linked", operations);
+    runBenchmark<BenchmarkPolicy<Exchange::MEOrderBookPolicy, Common::LinkedLadder, true>>("MEOrder linked+aggregates", operations);
+    runBenchmark<BenchmarkPolicy<Exchange::MEOrderBookPolicy, Common::BitmapLadder, false>>("MEOrder bitmap", operations);
+    runBenchmark<BenchmarkPolicy<Exchange::MEOrderBookPolicy, Common::BitmapLadder, true>>("MEOrder bitmap+aggregates", operations);
+    runBenchmark<AoSMEOrderBookPolicy>("MEOrder AoS bitmap+aggregates", operations);
+    runBenchmark<BenchmarkPolicy<Trading::MarketOrderBookPolicy, Common::LinkedLadder, false>>("MarketOrder linked", operations);
+    runBenchmark<BenchmarkPolicy<Trading::MarketOrderBookPolicy, Common::LinkedLadder, true>>("MarketOrder linked+aggregates", operations);
+    runBenchmark<BenchmarkPolicy<Trading::MarketOrderBookPolicy, Common::BitmapLadder, false>>("MarketOrder bitmap", operations);
+    runBenchmark<BenchmarkPolicy<Trading::MarketOrderBookPolicy, Common::BitmapLadder, true>>("MarketOrder bitmap+aggregates", operations);
+  }
+
+  return 0;
+}
@@ -0,0 +1,192 @@
+#include "HugePages.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <vector>
+
+#include <linux/mman.h>
+#include <sys/mman.h>
+
+#include "Macros.hpp"
+#include "Topology.hpp"
+
+namespace Common
+{
+  namespace
+  {
+    struct HugePageMapping
+    {
+      std::string name_;
+      void *ptr_ = nullptr;
+      size_t bytes_ = 0;        // what was asked for.
+      size_t mapped_bytes_ = 0; // rounded up to the page size.
+      PageBacking backing_ = PageBacking::INVALID;
+      int node_ = -1; // NUMA node it is bound to, -1 for the default first touch policy.
+      bool prefaulted_ = false;
+      bool locked_ = false;
+      int lock_errno_ = 0;
+    };
+
+    HugePageCfg huge_page_cfg;
+
+    // allocations and frees happen at startup and shutdown (and when a new client connects), never on the critical path.
+    std::mutex huge_page_mappings_mutex;
+
+    /// Never destroyed, so structures freed during static destruction can still find their mapping.
+    auto hugePageMappings() -> std::vector<HugePageMapping> &
+    {
+      static auto mappings = new std::vector<HugePageMapping>();
+      return *mappings;
+    }
+
+    auto roundUp(size_t bytes, size_t page_size) noexcept
+    {
+      return (bytes + page_size - 1) / page_size * page_size;
+    }
+
+    auto thpEnabled() -> bool
+    {
+      std::ifstream enabled("/sys/kernel/mm/transparent_hugepage/enabled");
+      std::string mode;
+      std::getline(enabled, mode);
+      return (!mode.empty() && mode.find("[never]") == std::string::npos);
+    }
+
+    auto mapHugetlb(size_t mapped_bytes, int page_size_flag) noexcept -> void *
+    {
+      auto ptr = mmap(nullptr, mapped_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | page_size_flag, -1, 0);
+      return (ptr == MAP_FAILED ? nullptr : ptr);
+    }
+
+    /// Small page mapping aligned to 2 MiB, so transparent huge pages can cover all of it.
+    auto mapAligned(size_t mapped_bytes) -> void *
+    {
+      const auto padded_bytes = mapped_bytes + HUGE_PAGE_2M_SIZE;
+      auto ptr = mmap(nullptr, padded_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      ASSERT(ptr != MAP_FAILED, "mmap() failed for:" + std::to_string(padded_bytes) + " bytes error:" + std::string(strerror(errno)));
+
+      const auto start = reinterpret_cast<uintptr_t>(ptr);
+      const auto aligned_start = roundUp(start, HUGE_PAGE_2M_SIZE);
+      if (aligned_start != start)
+        munmap(ptr, aligned_start - start);
+      const auto tail_bytes = (start + padded_bytes) - (aligned_start + mapped_bytes);
+      if (tail_bytes)
+        munmap(reinterpret_cast<void *>(aligned_start + mapped_bytes), tail_bytes);
+
+      return reinterpret_cast<void *>(aligned_start);
+    }
+  }
+
+  auto setHugePageCfg(const HugePageCfg &cfg) noexcept -> void
+  {
+    huge_page_cfg = cfg;
+  }
+
+  auto hugePageCfg() noexcept -> const HugePageCfg &
+  {
+    return huge_page_cfg;
+  }
+
+  auto allocateHugePages(size_t bytes, const char *name, bool prefault) -> void *
+  {
+    HugePageMapping mapping;
+    mapping.name_ = name;
+    mapping.bytes_ = bytes;
+
+    // try the largest page size allowed first, a hugetlb mmap() fails right away if the pool does not have enough free pages.
+    const auto mode = huge_page_cfg.mode_;
+    const auto use_hugetlb = (prefault && !huge_page_cfg.fork_safe_);
+    if (use_hugetlb && mode == HugePageMode::HUGE_1G && bytes >= HUGE_PAGE_1G_SIZE)
+    {
+      mapping.mapped_bytes_ = roundUp(bytes, HUGE_PAGE_1G_SIZE);
+      if ((mapping.ptr_ = mapHugetlb(mapping.mapped_bytes_, MAP_HUGE_1GB)))
+        mapping.backing_ = PageBacking::HUGETLB_1G;
+    }
+    if (use_hugetlb && !mapping.ptr_ && mode != HugePageMode::OFF && bytes >= HUGE_PAGE_2M_SIZE)
+    {
+      mapping.mapped_bytes_ = roundUp(bytes, HUGE_PAGE_2M_SIZE);
+      if ((mapping.ptr_ = mapHugetlb(mapping.mapped_bytes_, MAP_HUGE_2MB)))
+        mapping.backing_ = PageBacking::HUGETLB_2M;
+    }
+    if (!mapping.ptr_)
+    {
+      const auto use_thp = (mode != HugePageMode::OFF && bytes >= HUGE_PAGE_2M_SIZE && thpEnabled());
+      mapping.mapped_bytes_ = roundUp(std::max<size_t>(bytes, 1), use_thp ? HUGE_PAGE_2M_SIZE : SMALL_PAGE_SIZE);
+      mapping.ptr_ = mapAligned(mapping.mapped_bytes_);
+      mapping.backing_ = (use_thp && madvise(mapping.ptr_, mapping.mapped_bytes_, MADV_HUGEPAGE) == 0 ?
+                          PageBacking::THP : PageBacking::SMALL_PAGES);
+    }
+
+    // has to happen before the first touch to decide where the pages go.
+    const auto node = currentMemoryNode();
+    if (node >= 0 && bindToNode(mapping.ptr_, mapping.mapped_bytes_, node))
+      mapping.node_ = node;
+
+    if (prefault)
+    {
+      // the memory is zero filled already, writing a zero to every page only faults it in.
+      const auto page_size = (mapping.backing_ == PageBacking::HUGETLB_1G ? HUGE_PAGE_1G_SIZE :
+                              mapping.backing_ == PageBacking::SMALL_PAGES ? SMALL_PAGE_SIZE : HUGE_PAGE_2M_SIZE);
+      for (size_t offset = 0; offset < mapping.mapped_bytes_; offset += page_size)
+        static_cast<volatile char *>(mapping.ptr_)[offset] = 0;
+      mapping.prefaulted_ = true;
+
+      if (huge_page_cfg.lock_)
+      {
+        mapping.locked_ = (mlock(mapping.ptr_, mapping.mapped_bytes_) == 0);
+        mapping.lock_errno_ = (mapping.locked_ ? 0 : errno);
+      }
+    }
+
+    auto ptr = mapping.ptr_;
+    {
+      std::lock_guard<std::mutex> lock(huge_page_mappings_mutex);
+      hugePageMappings().push_back(std::move(mapping));
+    }
+
+    return ptr;
+  }
+
+  auto deallocateHugePages(void *ptr) noexcept -> void
+  {
+    std::lock_guard<std::mutex> lock(huge_page_mappings_mutex);
+    auto &mappings = hugePageMappings();
+    for (auto itr = mappings.begin(); itr != mappings.end(); ++itr)
+    {
+      if (itr->ptr_ == ptr)
+      {
+        munmap(itr->ptr_, itr->mapped_bytes_); // also drops the mlock().
+        mappings.erase(itr);
+        return;
+      }
+    }
+    ASSERT(false, "deallocateHugePages() called with memory it did not allocate.");
+  }
+
+  auto hugePageReport() -> std::string
+  {
+    std::string report = huge_page_cfg.toString() + "\n";
+    {
+      std::lock_guard<std::mutex> lock(huge_page_mappings_mutex);
+      for (const auto &mapping : hugePageMappings())
+      {
+        report += "  " + mapping.name_ + " bytes:" + std::to_string(mapping.bytes_) + " mapped:" + std::to_string(mapping.mapped_bytes_) +
+                  " backing:" + pageBackingToString(mapping.backing_) + " node:" + std::to_string(mapping.node_) + " prefaulted:" + std::to_string(mapping.prefaulted_) +
+                  " locked:" + std::to_string(mapping.locked_) +
+                  (mapping.lock_errno_ ? " mlock error:" + std::string(strerror(mapping.lock_errno_)) : "") + "\n";
+      }
+    }
+
+    std::ifstream smaps("/proc/self/smaps_rollup");
+    for (std::string line; std::getline(smaps, line); )
+    {
+      if (line.rfind("AnonHugePages:", 0) == 0)
+        report += "  process " + line + "\n";
+    }
+
+    return report;
+  }
+}
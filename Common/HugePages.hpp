@@ -0,0 +1,168 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace Common
+{
+  constexpr size_t SMALL_PAGE_SIZE = 4 * 1024;
+  constexpr size_t HUGE_PAGE_2M_SIZE = 2 * 1024 * 1024;
+  constexpr size_t HUGE_PAGE_1G_SIZE = 1024 * 1024 * 1024;
+
+  /// Largest page size allocateHugePages() tries before falling back to smaller ones.
+  enum class HugePageMode : int8_t {
+    INVALID = 0,
+    OFF = 1,     // plain 4 KiB pages only.
+    HUGE_2M = 2, // 2 MiB hugetlbfs pages, then transparent huge pages.
+    HUGE_1G = 3, // 1 GiB hugetlbfs pages for allocations of at least 1 GiB, then the same as HUGE_2M.
+    MAX = 4
+  };
+
+  inline auto hugePageModeToString(HugePageMode mode) -> std::string {
+    switch (mode) {
+      case HugePageMode::OFF:
+        return "OFF";
+      case HugePageMode::HUGE_2M:
+        return "2M";
+      case HugePageMode::HUGE_1G:
+        return "1G";
+      case HugePageMode::INVALID:
+        return "INVALID";
+      case HugePageMode::MAX:
+        return "MAX";
+    }
+    return "UNKNOWN";
+  }
+
+  inline auto stringToHugePageMode(const std::string &str) -> HugePageMode
+  {
+    for (auto i = static_cast<int>(HugePageMode::INVALID); i <= static_cast<int>(HugePageMode::MAX); ++i)
+    {
+      const auto mode = static_cast<HugePageMode>(i);
+      if (hugePageModeToString(mode) == str)
+        return mode;
+    }
+    return HugePageMode::INVALID;
+  }
+
+  /// What an allocation actually ended up on.
+  enum class PageBacking : int8_t {
+    INVALID = 0,
+    SMALL_PAGES = 1, // 4 KiB pages - huge pages were off, the allocation was under 2 MiB or transparent huge pages are disabled.
+    THP = 2,         // madvise(MADV_HUGEPAGE), the kernel backs what it can with 2 MiB pages when the memory is touched.
+    HUGETLB_2M = 3,
+    HUGETLB_1G = 4,
+    MAX = 5
+  };
+
+  inline auto pageBackingToString(PageBacking backing) -> std::string {
+    switch (backing) {
+      case PageBacking::SMALL_PAGES:
+        return "SMALL_PAGES";
+      case PageBacking::THP:
+        return "THP";
+      case PageBacking::HUGETLB_2M:
+        return "HUGETLB_2M";
+      case PageBacking::HUGETLB_1G:
+        return "HUGETLB_1G";
+      case PageBacking::INVALID:
+        return "INVALID";
+      case PageBacking::MAX:
+        return "MAX";
+    }
+    return "UNKNOWN";
+  }
+
+  /// Process wide, set once at startup before the structures using it are created.
+  /// lock_ mlock()s every pre-faulted allocation, which needs a large enough RLIMIT_MEMLOCK (or CAP_IPC_LOCK) - if mlock() fails the
+  /// allocation is still used, unlocked, and hugePageReport() says so.
+  /// fork_safe_ keeps every allocation off hugetlb pages, for processes that fork() children which read their memory. Once the parent
+  /// writes to a MAP_PRIVATE hugetlb page the child shares, the copy needs a free page from the pool, and if there is none the kernel
+  /// takes the page away from the child, which gets SIGBUS when it touches it. Transparent huge pages fall back to small pages instead.
+  struct HugePageCfg
+  {
+    HugePageMode mode_ = HugePageMode::HUGE_2M;
+    bool lock_ = false;
+    bool fork_safe_ = false;
+
+    auto toString() const
+    {
+      return "HugePageCfg[mode:" + hugePageModeToString(mode_) + " lock:" + std::to_string(lock_) + " fork-safe:" + std::to_string(fork_safe_) + "]";
+    }
+  };
+
+  auto setHugePageCfg(const HugePageCfg &cfg) noexcept -> void;
+
+  auto hugePageCfg() noexcept -> const HugePageCfg &;
+
+  /// Map bytes of zero filled, page aligned anonymous memory, on the largest page size HugePageCfg allows that the kernel hands out, and
+  /// remember it under name for hugePageReport(). Allocations under 2 MiB always get 4 KiB pages.
+  /// Inside a MemoryNodeScope the memory is bound to that NUMA node.
+  /// prefault touches every page now (and mlocks it if HugePageCfg::lock_) so the first write on the critical path does not page fault -
+  /// leave it off for large sparsely used structures where that would commit memory that is never used. Those never go on hugetlb pages,
+  /// which would take the whole size out of the pool up front, but on transparent huge pages that are only backed as they are touched.
+  auto allocateHugePages(size_t bytes, const char *name, bool prefault) -> void *;
+
+  /// Unmap memory from allocateHugePages(), ptr has to be what it returned.
+  auto deallocateHugePages(void *ptr) noexcept -> void;
+
+  /// One line per live allocation - name, size, backing, NUMA node and whether it is locked - followed by the process' AnonHugePages,
+  /// how much of the THP backed memory the kernel really put on huge pages.
+  auto hugePageReport() -> std::string;
+
+  /// Standard allocator on top of allocateHugePages(), for the std::vector storage of pools, queues and buffers.
+  /// Meant for containers sized once at startup, every allocate() is an mmap().
+  template<typename T>
+  class HugePageAllocator
+  {
+  public:
+    typedef T value_type;
+
+    explicit HugePageAllocator(const char *name, bool prefault = true) noexcept
+        : name_(name)
+        , prefault_(prefault) {}
+
+    template<typename U>
+    HugePageAllocator(const HugePageAllocator<U> &other) noexcept
+        : name_(other.name())
+        , prefault_(other.prefault()) {}
+
+    auto allocate(size_t n) -> T *
+    {
+      return static_cast<T *>(allocateHugePages(n * sizeof(T), name_, prefault_));
+    }
+
+    auto deallocate(T *ptr, size_t) noexcept -> void
+    {
+      deallocateHugePages(ptr);
+    }
+
+    auto name() const noexcept
+    {
+      return name_;
+    }
+
+    auto prefault() const noexcept
+    {
+      return prefault_;
+    }
+
+    // any instance can free what another one allocated.
+    template<typename U>
+    auto operator==(const HugePageAllocator<U> &) const noexcept
+    {
+      return true;
+    }
+
+    template<typename U>
+    auto operator!=(const HugePageAllocator<U> &) const noexcept
+    {
+      return false;
+    }
+
+  private:
+    const char *name_ = nullptr;
+    bool prefault_ = true;
+  };
+}
@@ -0,0 +1,304 @@
+#include "IoUring.hpp"
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "HugePages.hpp"
+
+namespace Common
+{
+  namespace
+  {
+    constexpr uint16_t BUFFER_GROUP = 0;
+
+    /// Deferred task running (COOP_TASKRUN) means completions only get posted while this thread is in the kernel, rather than the kernel
+    /// interrupting it whenever a packet comes in - IORING_SQ_TASKRUN tells poll() when there is something to pick up. Older kernels
+    /// reject the flags, they get the plain ring.
+    auto setupRing(io_uring_params &params) noexcept -> int
+    {
+      params = {};
+      params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_COOP_TASKRUN | IORING_SETUP_TASKRUN_FLAG;
+      params.cq_entries = IO_URING_ENTRIES * 8; // multishot recvs and accepts complete many times per submission.
+      auto fd = static_cast<int>(syscall(SYS_io_uring_setup, IO_URING_ENTRIES, &params));
+      if (fd < 0 && errno == EINVAL)
+      {
+        params = {};
+        params.flags = IORING_SETUP_CQSIZE;
+        params.cq_entries = IO_URING_ENTRIES * 8;
+        fd = static_cast<int>(syscall(SYS_io_uring_setup, IO_URING_ENTRIES, &params));
+      }
+      return fd;
+    }
+
+    auto mapRing(int fd, size_t size, off_t offset) -> void *
+    {
+      const auto ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, offset);
+      ASSERT(ptr != MAP_FAILED, "io_uring mmap() failed offset:" + std::to_string(offset) + " error:" + std::string(std::strerror(errno)));
+      return ptr;
+    }
+
+    /// Whether the ring knows the accept, recv and send opcodes, through IORING_REGISTER_PROBE.
+    auto probeOps(int fd) noexcept -> bool
+    {
+      alignas(io_uring_probe) char storage[sizeof(io_uring_probe) + IORING_OP_LAST * sizeof(io_uring_probe_op)] = {};
+      const auto probe = reinterpret_cast<io_uring_probe *>(storage);
+      if (syscall(SYS_io_uring_register, fd, IORING_REGISTER_PROBE, probe, IORING_OP_LAST) < 0)
+        return false;
+
+      for (const auto op : {IORING_OP_ACCEPT, IORING_OP_RECV, IORING_OP_SEND})
+      {
+        if (op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED))
+          return false;
+      }
+      return true;
+    }
+
+    /// Registers a single entry provided buffer ring and arms a multishot recv on a socket pair with a byte already waiting in it -
+    /// neither of which IORING_REGISTER_PROBE can tell about. A kernel without provided buffer rings fails the registration, one without
+    /// multishot recv fails the recv with -EINVAL or completes it without IORING_CQE_F_MORE.
+    auto probeMultishotRecv(int fd, const io_uring_params &params) noexcept -> bool
+    {
+      constexpr size_t PAGE_SIZE = 4096;
+      const auto page = mmap(nullptr, PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (page == MAP_FAILED)
+        return false;
+      const auto buf_ring = static_cast<io_uring_buf *>(page);
+      buf_ring[0].addr = reinterpret_cast<uint64_t>(static_cast<char *>(page) + PAGE_SIZE / 2);
+      buf_ring[0].len = PAGE_SIZE / 2;
+      buf_ring[0].bid = 0;
+      buf_ring[0].resv = 1; // the tail.
+
+      io_uring_buf_reg reg{};
+      reg.ring_addr = reinterpret_cast<uint64_t>(buf_ring);
+      reg.ring_entries = 1;
+      reg.bgid = BUFFER_GROUP;
+      auto supported = !syscall(SYS_io_uring_register, fd, IORING_REGISTER_PBUF_RING, &reg, 1);
+
+      int sockets[2] = {-1, -1};
+      supported = supported && !socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, sockets) && write(sockets[1], "", 1) == 1;
+
+      const auto sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+      const auto cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+      const auto sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+      const auto sq_ring = (supported ? mmap(nullptr, sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, IORING_OFF_SQ_RING) : MAP_FAILED);
+      const auto cq_ring = (supported ? mmap(nullptr, cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, IORING_OFF_CQ_RING) : MAP_FAILED);
+      const auto sqes = (supported ? mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, IORING_OFF_SQES) : MAP_FAILED);
+      supported = (sq_ring != MAP_FAILED && cq_ring != MAP_FAILED && sqes != MAP_FAILED);
+
+      if (supported)
+      {
+        const auto sq = static_cast<char *>(sq_ring);
+        const auto sq_tail = reinterpret_cast<uint32_t *>(sq + params.sq_off.tail);
+        const auto sq_mask = *reinterpret_cast<uint32_t *>(sq + params.sq_off.ring_mask);
+        const auto index = *sq_tail & sq_mask;
+        auto sqe = &static_cast<io_uring_sqe *>(sqes)[index];
+        memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = IORING_OP_RECV;
+        sqe->fd = sockets[0];
+        sqe->ioprio = IORING_RECV_MULTISHOT;
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->buf_group = BUFFER_GROUP;
+        reinterpret_cast<uint32_t *>(sq + params.sq_off.array)[index] = index;
+        std::atomic_ref<uint32_t>(*sq_tail).store(*sq_tail + 1, std::memory_order_release);
+
+        supported = (syscall(SYS_io_uring_enter, fd, 1, 1, IORING_ENTER_GETEVENTS, nullptr, 0) == 1);
+        const auto cq = static_cast<char *>(cq_ring);
+        const auto cq_head = *reinterpret_cast<uint32_t *>(cq + params.cq_off.head);
+        const auto cq_tail = std::atomic_ref<uint32_t>(*reinterpret_cast<uint32_t *>(cq + params.cq_off.tail)).load(std::memory_order_acquire);
+        const auto cq_mask = *reinterpret_cast<uint32_t *>(cq + params.cq_off.ring_mask);
+        const auto &cqe = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes)[cq_head & cq_mask];
+        supported = supported && cq_head != cq_tail && cqe.res > 0 && (cqe.flags & IORING_CQE_F_MORE);
+      }
+
+      // closing the ring afterwards cancels the recv that is still armed.
+      if (sqes != MAP_FAILED)
+        munmap(sqes, sqes_size);
+      if (cq_ring != MAP_FAILED)
+        munmap(cq_ring, cq_ring_size);
+      if (sq_ring != MAP_FAILED)
+        munmap(sq_ring, sq_ring_size);
+      for (const auto socket : sockets)
+      {
+        if (socket >= 0)
+          close(socket);
+      }
+      munmap(page, PAGE_SIZE);
+      return supported;
+    }
+  }
+
+  IoUring::IoUring(const char *name)
+      : name_(name)
+  {
+    io_uring_params params;
+    ring_fd_ = setupRing(params);
+    ASSERT(ring_fd_ >= 0, "io_uring_setup() failed for:" + name_ + " error:" + std::string(std::strerror(errno)));
+    setup_flags_ = params.flags;
+
+    sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+    sq_ring_ = mapRing(ring_fd_, sq_ring_size_, IORING_OFF_SQ_RING);
+    cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    cq_ring_ = mapRing(ring_fd_, cq_ring_size_, IORING_OFF_CQ_RING);
+    sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+    sqes_ = static_cast<io_uring_sqe *>(mapRing(ring_fd_, sqes_size_, IORING_OFF_SQES));
+
+    const auto sq = static_cast<char *>(sq_ring_);
+    sq_head_ = reinterpret_cast<uint32_t *>(sq + params.sq_off.head);
+    sq_tail_ = reinterpret_cast<uint32_t *>(sq + params.sq_off.tail);
+    sq_flags_ = reinterpret_cast<uint32_t *>(sq + params.sq_off.flags);
+    sq_mask_ = *reinterpret_cast<uint32_t *>(sq + params.sq_off.ring_mask);
+    sq_entries_ = params.sq_entries;
+    // SQE i always sits in slot i, so the index array is filled once.
+    const auto sq_array = reinterpret_cast<uint32_t *>(sq + params.sq_off.array);
+    for (uint32_t i = 0; i < sq_entries_; ++i)
+      sq_array[i] = i;
+    sqe_tail_ = *sq_tail_;
+
+    const auto cq = static_cast<char *>(cq_ring_);
+    cq_head_ = reinterpret_cast<uint32_t *>(cq + params.cq_off.head);
+    cq_tail_ = reinterpret_cast<uint32_t *>(cq + params.cq_off.tail);
+    cq_mask_ = *reinterpret_cast<uint32_t *>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+
+    // provided buffers - the kernel picks one per recv completion, so idle connections do not tie up any receive memory.
+    buf_ring_ = static_cast<io_uring_buf *>(allocateHugePages(IO_URING_NUM_BUFFERS * sizeof(io_uring_buf), "IoUring buffer ring", true));
+    buffers_ = static_cast<char *>(allocateHugePages(static_cast<size_t>(IO_URING_NUM_BUFFERS) * IO_URING_BUFFER_SIZE, "IoUring buffers", true));
+
+    io_uring_buf_reg reg{};
+    reg.ring_addr = reinterpret_cast<uint64_t>(buf_ring_);
+    reg.ring_entries = IO_URING_NUM_BUFFERS;
+    reg.bgid = BUFFER_GROUP;
+    ASSERT(!syscall(SYS_io_uring_register, ring_fd_, IORING_REGISTER_PBUF_RING, &reg, 1),
+           "IORING_REGISTER_PBUF_RING failed for:" + name_ + " error:" + std::string(std::strerror(errno)));
+    for (uint32_t bid = 0; bid < IO_URING_NUM_BUFFERS; ++bid)
+      recycleBuffer(bid << IORING_CQE_BUFFER_SHIFT);
+  }
+
+  IoUring::~IoUring()
+  {
+    close(ring_fd_);
+    munmap(sqes_, sqes_size_);
+    munmap(cq_ring_, cq_ring_size_);
+    munmap(sq_ring_, sq_ring_size_);
+    deallocateHugePages(buffers_);
+    deallocateHugePages(buf_ring_);
+  }
+
+  auto IoUring::supported() noexcept -> bool
+  {
+    io_uring_params params;
+    const auto fd = setupRing(params);
+    if (fd < 0)
+      return false;
+    const auto supported = (probeOps(fd) && probeMultishotRecv(fd, params));
+    close(fd);
+    return supported;
+  }
+
+  auto IoUring::nextSqe() noexcept -> io_uring_sqe *
+  {
+    // submission queue full, push what is there now rather than wait for the next poll().
+    if (UNLIKELY(sqe_tail_ - std::atomic_ref<uint32_t>(*sq_head_).load(std::memory_order_acquire) == sq_entries_))
+      enter(sqe_tail_ - *sq_tail_, 0);
+
+    auto sqe = &sqes_[sqe_tail_ & sq_mask_];
+    memset(sqe, 0, sizeof(*sqe));
+    ++sqe_tail_;
+    return sqe;
+  }
+
+  auto IoUring::enter(uint32_t to_submit, uint32_t flags) noexcept -> void
+  {
+    std::atomic_ref<uint32_t>(*sq_tail_).store(sqe_tail_, std::memory_order_release);
+    const auto rc = syscall(SYS_io_uring_enter, ring_fd_, to_submit, 0, flags, nullptr, 0);
+    ++enters_;
+    ASSERT(rc >= 0 || errno == EINTR || errno == EAGAIN || errno == EBUSY,
+           "io_uring_enter() failed for:" + name_ + " error:" + std::string(std::strerror(errno)));
+    if (rc > 0)
+      sqes_submitted_ += rc;
+  }
+
+  auto IoUring::acceptMultishot(int fd, IoOperation *op) noexcept -> void
+  {
+    auto sqe = nextSqe();
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_NONBLOCK;
+    sqe->user_data = reinterpret_cast<uint64_t>(op);
+  }
+
+  auto IoUring::recvMultishot(int fd, IoOperation *op) noexcept -> void
+  {
+    auto sqe = nextSqe();
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = BUFFER_GROUP;
+    sqe->user_data = reinterpret_cast<uint64_t>(op);
+  }
+
+  auto IoUring::send(int fd, const void *data, size_t len, IoOperation *op) noexcept -> void
+  {
+    auto sqe = nextSqe();
+    sqe->opcode = IORING_OP_SEND;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uint64_t>(data);
+    sqe->len = static_cast<uint32_t>(len);
+    // MSG_WAITALL has the kernel retry a short send itself, the completion is then all of len or an error.
+    sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL;
+    sqe->user_data = reinterpret_cast<uint64_t>(op);
+  }
+
+  auto IoUring::recycleBuffer(uint32_t flags) noexcept -> void
+  {
+    const auto bid = static_cast<uint16_t>(flags >> IORING_CQE_BUFFER_SHIFT);
+    auto &buf = buf_ring_[buf_tail_ & (IO_URING_NUM_BUFFERS - 1)];
+    buf.addr = reinterpret_cast<uint64_t>(buffers_ + static_cast<size_t>(bid) * IO_URING_BUFFER_SIZE);
+    buf.len = IO_URING_BUFFER_SIZE;
+    buf.bid = bid;
+    std::atomic_ref<uint16_t>(buf_ring_[0].resv).store(++buf_tail_, std::memory_order_release);
+  }
+
+  auto IoUring::poll() noexcept -> bool
+  {
+    ++polls_;
+    const auto to_submit = sqe_tail_ - *sq_tail_;
+    const auto sq_flags = std::atomic_ref<uint32_t>(*sq_flags_).load(std::memory_order_relaxed);
+    if (to_submit || UNLIKELY(sq_flags & (IORING_SQ_TASKRUN | IORING_SQ_CQ_OVERFLOW)))
+      enter(to_submit, (sq_flags & (IORING_SQ_TASKRUN | IORING_SQ_CQ_OVERFLOW)) ? IORING_ENTER_GETEVENTS : 0);
+
+    auto head = *cq_head_;
+    const auto tail = std::atomic_ref<uint32_t>(*cq_tail_).load(std::memory_order_acquire);
+    if (head == tail)
+      return false;
+
+    for (; head != tail; ++head)
+    {
+      const auto &cqe = cqes_[head & cq_mask_];
+      const auto op = reinterpret_cast<IoOperation *>(cqe.user_data);
+      const auto res = cqe.res;
+      const auto flags = cqe.flags;
+      // hand the slot back first, on_complete_ can prepare new submissions and even push them if the submission queue fills up.
+      std::atomic_ref<uint32_t>(*cq_head_).store(head + 1, std::memory_order_release);
+      ++cqes_reaped_;
+      if (LIKELY(op != nullptr))
+        op->on_complete_(res, flags);
+    }
+    return true;
+  }
+
+  auto IoUring::toString() const -> std::string
+  {
+    return "IoUring[" + name_ + " coop_taskrun:" + std::to_string((setup_flags_ & IORING_SETUP_COOP_TASKRUN) != 0) +
+           " polls:" + std::to_string(polls_) + " enters:" + std::to_string(enters_) + " sqes:" + std::to_string(sqes_submitted_) +
+           " cqes:" + std::to_string(cqes_reaped_) + "]";
+  }
+}
@@ -0,0 +1,183 @@
+#pragma once
+
+#include <coroutine>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <string>
+
+#include <linux/io_uring.h>
+
+#include "Macros.hpp"
+
+namespace Common
+{
+  /// How TCP order entry sockets do their I/O.
+  enum class IoEngineType : int8_t {
+    INVALID = 0,
+    SOCKET = 1,   // non-blocking recvmsg() / send() on every socket every pass, epoll for new connections.
+    IO_URING = 2, // multishot recv and accept into a ring's provided buffers, sends queued and submitted once per pass.
+    MAX = 3
+  };
+
+  inline auto ioEngineTypeToString(IoEngineType type) -> std::string {
+    switch (type) {
+      case IoEngineType::SOCKET:
+        return "SOCKET";
+      case IoEngineType::IO_URING:
+        return "IO_URING";
+      case IoEngineType::INVALID:
+        return "INVALID";
+      case IoEngineType::MAX:
+        return "MAX";
+    }
+    return "UNKNOWN";
+  }
+
+  inline auto stringToIoEngineType(const std::string &str) -> IoEngineType
+  {
+    for (auto i = static_cast<int>(IoEngineType::INVALID); i <= static_cast<int>(IoEngineType::MAX); ++i)
+    {
+      const auto type = static_cast<IoEngineType>(i);
+      if (ioEngineTypeToString(type) == str)
+        return type;
+    }
+    return IoEngineType::INVALID;
+  }
+
+  /// Submission queue slots and provided receive buffers of a ring. Every multishot recv on a ring shares its buffers, a buffer goes back
+  /// to the kernel as soon as its data has been copied into the socket's inbound buffer.
+  constexpr uint32_t IO_URING_ENTRIES = 256;
+  constexpr uint32_t IO_URING_NUM_BUFFERS = 1024; // has to be a power of 2.
+  constexpr uint32_t IO_URING_BUFFER_SIZE = 16 * 1024;
+
+  /// What a submission's user_data points at, on_complete_ runs for every completion of it - a multishot recv or accept completes many
+  /// times. Has to outlive the submission.
+  struct IoOperation
+  {
+    std::function<void(int32_t res, uint32_t flags)> on_complete_ = nullptr;
+  };
+
+  /// Coroutine that runs right away up to its first co_await and frees itself once it returns, for per connection loops like
+  /// while (true) { co_await socket->recv(); ... } that the ring's completions resume.
+  struct IoTask
+  {
+    struct promise_type
+    {
+      auto get_return_object() noexcept
+      {
+        return IoTask{};
+      }
+
+      auto initial_suspend() noexcept
+      {
+        return std::suspend_never{};
+      }
+
+      auto final_suspend() noexcept
+      {
+        return std::suspend_never{};
+      }
+
+      auto return_void() noexcept -> void {}
+
+      auto unhandled_exception() noexcept -> void
+      {
+        std::terminate();
+      }
+    };
+  };
+
+  /// io_uring instance driven by a single polling thread, on the raw syscalls and the mmap()ed rings. Nothing blocks - poll() submits
+  /// whatever was prepared since the last call and dispatches whatever completed, one io_uring_enter() for all the sockets on the ring,
+  /// and none at all when nothing was prepared and nothing arrived.
+  class IoUring final
+  {
+  public:
+    explicit IoUring(const char *name);
+
+    ~IoUring();
+
+    /// Whether this kernel lets the process create a ring and has everything it is used for - the opcodes, provided buffer rings and
+    /// multishot recv, probed for rather than guessed from the version. io_uring can also be disabled through the
+    /// kernel.io_uring_disabled sysctl or blocked by seccomp.
+    static auto supported() noexcept -> bool;
+
+    /// Accepted file descriptors complete op until the listener is closed or the multishot ends (no IORING_CQE_F_MORE), re-arm then.
+    auto acceptMultishot(int fd, IoOperation *op) noexcept -> void;
+
+    /// Each completion with res > 0 carries a provided buffer, see bufferOf() and recycleBuffer(). Re-arm when IORING_CQE_F_MORE is not
+    /// set, which also happens when the ring ran out of buffers (-ENOBUFS).
+    auto recvMultishot(int fd, IoOperation *op) noexcept -> void;
+
+    /// data has to stay untouched until op completes with the number of bytes sent.
+    auto send(int fd, const void *data, size_t len, IoOperation *op) noexcept -> void;
+
+    /// Data of the provided buffer a recv completion with flags landed in.
+    auto bufferOf(uint32_t flags) noexcept -> const char *
+    {
+      return buffers_ + (flags >> IORING_CQE_BUFFER_SHIFT) * IO_URING_BUFFER_SIZE;
+    }
+
+    /// Give that buffer back to the kernel.
+    auto recycleBuffer(uint32_t flags) noexcept -> void;
+
+    /// Submit and dispatch, returns whether anything completed.
+    auto poll() noexcept -> bool;
+
+    /// Counters since construction, read them from the polling thread or after it has exited.
+    auto toString() const -> std::string;
+
+    // Deleted default, copy & move constructors and assignment-operators.
+    IoUring() = delete;
+
+    IoUring(const IoUring &) = delete;
+
+    IoUring(const IoUring &&) = delete;
+
+    IoUring &operator=(const IoUring &) = delete;
+
+    IoUring &operator=(const IoUring &&) = delete;
+
+  private:
+    auto nextSqe() noexcept -> io_uring_sqe *;
+
+    auto enter(uint32_t to_submit, uint32_t flags) noexcept -> void;
+
+    const std::string name_;
+    int ring_fd_ = -1;
+    uint32_t setup_flags_ = 0;
+
+    void *sq_ring_ = nullptr;
+    size_t sq_ring_size_ = 0;
+    void *cq_ring_ = nullptr;
+    size_t cq_ring_size_ = 0;
+    io_uring_sqe *sqes_ = nullptr;
+    size_t sqes_size_ = 0;
+
+    /// Shared with the kernel, the heads and tails are read and written through std::atomic_ref.
+    uint32_t *sq_head_ = nullptr;
+    uint32_t *sq_tail_ = nullptr;
+    uint32_t *sq_flags_ = nullptr;
+    uint32_t sq_mask_ = 0;
+    uint32_t sq_entries_ = 0;
+    uint32_t *cq_head_ = nullptr;
+    uint32_t *cq_tail_ = nullptr;
+    uint32_t cq_mask_ = 0;
+    io_uring_cqe *cqes_ = nullptr;
+
+    /// Prepared but not yet submitted SQEs are the ones between *sq_tail_ and this.
+    uint32_t sqe_tail_ = 0;
+
+    /// The provided buffer ring is an array of io_uring_buf whose first entry's resv field doubles as the tail. Not indexed through
+    /// io_uring_buf_ring::bufs, the header's flexible array wrapper puts that at offset 8 instead of 0 when compiled as C++.
+    io_uring_buf *buf_ring_ = nullptr;
+    char *buffers_ = nullptr;
+    uint16_t buf_tail_ = 0;
+
+    uint64_t enters_ = 0;
+    uint64_t sqes_submitted_ = 0;
+    uint64_t cqes_reaped_ = 0;
+    uint64_t polls_ = 0;
+  };
+}
@@ -5,6 +5,8 @@
 #include <atomic>
 
 #include "Macros.hpp"
+#include "HugePages.hpp"
+#include "WaitStrategy.hpp"
 
 namespace Common 
 {
@@ -12,8 +14,9 @@ namespace Common
   class LFQueue final 
   {
   public:
-    LFQueue(std::size_t num_elems) :
-        store_(num_elems, T()) /* pre-allocation of vector storage. */ {}
+    /// name is what hugePageReport() lists the storage under.
+    LFQueue(std::size_t num_elems, const char *name = "LFQueue") :
+        store_(num_elems, T(), HugePageAllocator<T>(name)) /* pre-allocation of vector storage. */ {}
 
     auto getNextToWriteTo() noexcept 
     {
@@ -24,6 +27,23 @@ namespace Common
     {
       next_write_index_ = (next_write_index_ + 1) % store_.size();
       num_elements_++;
+      if (UNLIKELY(consumer_wait_strategy_))
+        consumer_wait_strategy_->notify();
+    }
+
+    /// Copy n objects into the queue and make all of them visible to the reader with a single update of the element count.
+    auto writeBatch(const T *objs, std::size_t n) noexcept 
+    {
+      auto write_index = next_write_index_.load(std::memory_order_relaxed);
+      for (std::size_t i = 0; i < n; ++i) 
+      {
+        store_[write_index] = objs[i];
+        write_index = (write_index + 1) % store_.size();
+      }
+      next_write_index_.store(write_index, std::memory_order_relaxed);
+      num_elements_ += n;
+      if (UNLIKELY(consumer_wait_strategy_))
+        consumer_wait_strategy_->notify();
     }
 
     auto getNextToRead() const noexcept -> const T * 
@@ -43,6 +63,13 @@ namespace Common
       return num_elements_.load();
     }
 
+    /// Have every write wake the consumer if it is parked, only for consumers that park - see WaitStrategy::afterPoll().
+    /// Set before the producer starts writing.
+    auto setConsumerWaitStrategy(WaitStrategy *wait_strategy) noexcept
+    {
+      consumer_wait_strategy_ = (wait_strategy && wait_strategy->parks() ? wait_strategy : nullptr);
+    }
+
     // Deleted default, copy & move constructors and assignment-operators.
     LFQueue() = delete;
 
@@ -55,12 +82,14 @@ namespace Common
     LFQueue &operator=(const LFQueue &&) = delete;
 
   private:
-    std::vector<T> store_;
+    std::vector<T, HugePageAllocator<T>> store_;
 
     std::atomic<size_t> next_write_index_ = {0};
     std::atomic<size_t> next_read_index_ = {0};
 
     std::atomic<size_t> num_elements_ = {0};
+
+    WaitStrategy *consumer_wait_strategy_ = nullptr;
   };
 }
 
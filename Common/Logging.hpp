@@ -11,6 +11,8 @@
 #include "Types.hpp"
 #include "ThreadUtils.hpp"
 #include "TimeUtils.hpp"
+#include "WaitStrategy.hpp"
+#include "Reactor.hpp"
 
 namespace Common 
 {
@@ -48,60 +50,74 @@ namespace Common
 
   class Logger final {
   public:
-    auto flushQueue() noexcept 
+    /// One pass of the logger thread, writes out everything queued so far and returns whether there was anything.
+    auto flush() noexcept -> bool
     {
-      while (running_) 
+      bool flushed = false;
+      for (auto next = queue_.getNextToRead(); queue_.size() && next; next = queue_.getNextToRead()) 
       {
-        for (auto next = queue_.getNextToRead(); queue_.size() && next; next = queue_.getNextToRead()) 
+        switch (next->type_) 
         {
-          switch (next->type_) 
-          {
-            case LogType::CHAR:
-              file_ << next->u_.c;
-              break;
-            case LogType::INTEGER:
-              file_ << next->u_.i;
-              break;
-            case LogType::LONG_INTEGER:
-              file_ << next->u_.l;
-              break;
-            case LogType::LONG_LONG_INTEGER:
-              file_ << next->u_.ll;
-              break;
-            case LogType::UNSIGNED_INTEGER:
-              file_ << next->u_.u;
-              break;
-            case LogType::UNSIGNED_LONG_INTEGER:
-              file_ << next->u_.ul;
-              break;
-            case LogType::UNSIGNED_LONG_LONG_INTEGER:
-              file_ << next->u_.ull;
-              break;
-            case LogType::FLOAT:
-              file_ << next->u_.f;
-              break;
-            case LogType::DOUBLE:
-              file_ << next->u_.d;
-              break;
-            case LogType::STRING:
-              file_ << next->u_.str;
-              break;
-          }
-          queue_.updateReadIndex();
+          case LogType::CHAR:
+            file_ << next->u_.c;
+            break;
+          case LogType::INTEGER:
+            file_ << next->u_.i;
+            break;
+          case LogType::LONG_INTEGER:
+            file_ << next->u_.l;
+            break;
+          case LogType::LONG_LONG_INTEGER:
+            file_ << next->u_.ll;
+            break;
+          case LogType::UNSIGNED_INTEGER:
+            file_ << next->u_.u;
+            break;
+          case LogType::UNSIGNED_LONG_INTEGER:
+            file_ << next->u_.ul;
+            break;
+          case LogType::UNSIGNED_LONG_LONG_INTEGER:
+            file_ << next->u_.ull;
+            break;
+          case LogType::FLOAT:
+            file_ << next->u_.f;
+            break;
+          case LogType::DOUBLE:
+            file_ << next->u_.d;
+            break;
+          case LogType::STRING:
+            file_ << next->u_.str;
+            break;
         }
+        queue_.updateReadIndex();
+        flushed = true;
+      }
+      if (flushed)
         file_.flush();
+      return flushed;
+    }
 
-        using namespace std::literals::chrono_literals;
-        std::this_thread::sleep_for(10ms);
-      }
+    auto flushQueue() noexcept 
+    {
+      while (running_) 
+        wait_strategy_.afterPoll(flush());
     }
 
     explicit Logger(const std::string &file_name)
-        : file_name_(file_name), queue_(LOG_QUEUE_SIZE) 
+        : file_name_(file_name), queue_(LOG_QUEUE_SIZE, "Logger")
+        , wait_strategy_(waitStrategyType("Common/Logger " + file_name, WaitStrategyType::SPIN_PARK))
     {
+      // the queue does not wake a parked logger, that would put a futex wakeup on the critical path of whichever thread logs next -
+      // a parked logger picks its queue up within the park timeout instead.
       file_.open(file_name);
       ASSERT(file_.is_open(), "Could not open log file:" + file_name);
-      logger_thread_ = createAndStartThread(-1, "Common/Logger " + file_name_, [this]() { flushQueue(); });
+      const auto thread_name = "Common/Logger " + file_name_;
+      if (const auto budget = reactorBudget(thread_name))
+      {
+        reactor_id_ = reactor().add(thread_name, budget, [this]() { return flush(); }, []() { return false; });
+        return;
+      }
+      logger_thread_ = createAndStartThread(-1, thread_name, [this]() { flushQueue(); });
       ASSERT(logger_thread_ != nullptr, "Failed to start Logger thread.");
     }
 
@@ -116,10 +132,17 @@ namespace Common
         std::this_thread::sleep_for(1s);
       }
       running_ = false;
-      logger_thread_->join();
+      if (reactor_id_)
+      {
+        reactor().remove(reactor_id_);
+      } else
+      {
+        wait_strategy_.wakeUp();
+        logger_thread_->join();
+      }
 
       file_.close();
-      std::cerr << Common::getCurrentTimeStr(&time_str) << " Logger for " << file_name_ << " exiting." << std::endl;
+      std::cerr << Common::getCurrentTimeStr(&time_str) << " Logger for " << file_name_ << " exiting. " << wait_strategy_.toString() << std::endl;
     }
 
     auto pushValue(const LogElement &log_element) noexcept 
@@ -245,7 +268,9 @@ namespace Common
 
     LFQueue<LogElement> queue_;
     std::atomic<bool> running_ = {true};
+    WaitStrategy wait_strategy_;
     std::thread *logger_thread_ = nullptr;
+    size_t reactor_id_ = 0; // non-zero when flush() runs in the reactor instead of logger_thread_.
   };
 }
 
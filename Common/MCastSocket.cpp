@@ -8,6 +8,8 @@ namespace Common
   {
     const SocketCfg socket_cfg{ip, iface, port, true, is_listening, false};
     socket_fd_ = createSocket(logger_, socket_cfg);
+    if (xdp_socket_ && socket_fd_ >= 0)
+      xdp_socket_->addPort(ip, port, [this](char *data, size_t len) { onXdpPayload(data, len); });
     return socket_fd_;
   }
 
@@ -18,8 +20,10 @@ namespace Common
   }
 
   /// Remove / Leave membership / subscription to a multicast stream.
-  auto McastSocket::leave(const std::string &, int) -> void 
+  auto McastSocket::leave(const std::string &ip, int port) -> void 
   {
+    if (xdp_socket_)
+      xdp_socket_->removePort(ip, port);
     close(socket_fd_);
     socket_fd_ = -1;
   }
@@ -28,7 +32,9 @@ namespace Common
   auto McastSocket::sendAndRecv() noexcept -> bool 
   {
     // Read data and dispatch callbacks if data is available - non blocking.
-    const ssize_t n_rcv = recv(socket_fd_, inbound_data_.data() + next_rcv_valid_index_, McastBufferSize - next_rcv_valid_index_, MSG_DONTWAIT);
+    // With an XdpSocket the feed's frames never reach the UDP socket.
+    const ssize_t n_rcv = (xdp_socket_ ? 0 :
+                           recv(socket_fd_, inbound_data_.data() + next_rcv_valid_index_, McastBufferSize - next_rcv_valid_index_, MSG_DONTWAIT));
     if (n_rcv > 0) 
     {
       next_rcv_valid_index_ += n_rcv;
@@ -56,5 +62,29 @@ namespace Common
     next_send_valid_index_ += len;
     ASSERT(next_send_valid_index_ < McastBufferSize, "Mcast socket buffer filled up and sendAndRecv() not called.");
   }
-}
 
+  auto McastSocket::onXdpPayload(char *data, size_t len) noexcept -> void
+  {
+    if (LIKELY(!next_rcv_valid_index_))
+    {
+      // the callback reads the payload where it sits in the UMEM frame.
+      rcv_data_ = data;
+      next_rcv_valid_index_ = len;
+      logger_.log("%:% %() % read xdp port socket:% len:%\n", __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str_), socket_fd_,
+                  next_rcv_valid_index_);
+      recv_callback_(this);
+      // a partial message at the end has to outlive the frame.
+      if (UNLIKELY(next_rcv_valid_index_))
+        memcpy(inbound_data_.data(), rcv_data_, next_rcv_valid_index_);
+      rcv_data_ = inbound_data_.data();
+      return;
+    }
+
+    ASSERT(next_rcv_valid_index_ + len <= McastBufferSize, "Mcast socket receive buffer filled up.");
+    memcpy(inbound_data_.data() + next_rcv_valid_index_, data, len);
+    next_rcv_valid_index_ += len;
+    logger_.log("%:% %() % read xdp port socket:% len:%\n", __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str_), socket_fd_,
+                next_rcv_valid_index_);
+    recv_callback_(this);
+  }
+}
@@ -4,6 +4,8 @@
 
 #include "SocketUtils.hpp"
 #include "Logging.hpp"
+#include "HugePages.hpp"
+#include "XdpSocket.hpp"
 
 namespace Common {
   /// Size of send and receive buffers in bytes.
@@ -12,11 +14,9 @@ namespace Common {
   struct McastSocket 
   {
     McastSocket(Logger &logger)
-        : logger_(logger) 
-    {
-      outbound_data_.resize(McastBufferSize);
-      inbound_data_.resize(McastBufferSize);
-    }
+        : outbound_data_(McastBufferSize, 0, HugePageAllocator<char>("McastSocket outbound"))
+        , inbound_data_(McastBufferSize, 0, HugePageAllocator<char>("McastSocket inbound"))
+        , logger_(logger) {}
 
     /// Initialize multicast socket to read from or publish to a stream.
     /// Does not join the multicast stream yet.
@@ -34,19 +34,35 @@ namespace Common {
     /// Copy data to send buffers - does not send them out yet.
     auto send(const void *data, size_t len) noexcept -> void;
 
+    /// Receive through xdp_socket instead - init() adds the group and port to it, leave() removes them again and sendAndRecv() no longer
+    /// reads the UDP socket, which is still created and joined for the IGMP membership. Payloads reach recv_callback_ from
+    /// XdpSocket::poll().
+    auto attach(XdpSocket *xdp_socket) noexcept -> void
+    {
+      xdp_socket_ = xdp_socket;
+    }
+
     int socket_fd_ = -1;
 
     /// Send and receive buffers, typically only one or the other is needed, not both.
-    std::vector<char> outbound_data_;
+    std::vector<char, HugePageAllocator<char>> outbound_data_;
     size_t next_send_valid_index_ = 0;
-    std::vector<char> inbound_data_;
+    std::vector<char, HugePageAllocator<char>> inbound_data_;
     size_t next_rcv_valid_index_ = 0;
+    /// What recv_callback_ reads next_rcv_valid_index_ bytes from - inbound_data_, or the UMEM frame itself for an AF_XDP payload that
+    /// did not have to be appended to a partial message left over from the previous one.
+    char *rcv_data_ = inbound_data_.data();
 
     /// Function wrapper for the method to call when data is read.
     std::function<void(McastSocket *s)> recv_callback_ = nullptr;
 
+    XdpSocket *xdp_socket_ = nullptr;
+
     std::string time_str_;
     Logger &logger_;
+
+  private:
+    auto onXdpPayload(char *data, size_t len) noexcept -> void;
   };
 }
 
@@ -5,14 +5,16 @@
 #include <string>
 
 #include "Macros.hpp"
+#include "HugePages.hpp"
 
 namespace Common 
 {
   template<typename T>
   class MemPool final {
   public:
-    explicit MemPool(std::size_t num_elems) :
-        store_(num_elems, {T(), true}) /* pre-allocation of vector storage. */ 
+    /// name is what hugePageReport() lists the storage under.
+    explicit MemPool(std::size_t num_elems, const char *name = "MemPool") :
+        store_(num_elems, {T(), true}, HugePageAllocator<ObjectBlock>(name)) /* pre-allocation of vector storage. */ 
     {
       ASSERT(reinterpret_cast<const ObjectBlock *>(&(store_[0].object_)) == &(store_[0]), "T object should be first member of ObjectBlock.");
     }
@@ -81,7 +83,8 @@ namespace Common
     // We could've chosen to use a std::array that would allocate the memory on the stack instead of the heap.
     // We would have to measure to see which one yields better performance.
     // It is good to have objects on the stack but performance starts getting worse as the size of the pool increases.
-    std::vector<ObjectBlock> store_;
+    // On huge pages where available so walking a large pool does not miss the TLB on every object.
+    std::vector<ObjectBlock, HugePageAllocator<ObjectBlock>> store_;
 
     size_t next_free_index_ = 0;
   };
@@ -0,0 +1,466 @@
+#pragma once
+
+#include <array>
+#include <bit>
+#include <type_traits>
+
+#include "Macros.hpp"
+#include "MemoryPool.hpp"
+#include "Types.hpp"
+
+namespace Common
+{
+  /// Price ladder layouts for OrderBookCore - how a new price level finds its place among the sorted levels of its side.
+
+  /// Walk the levels from the best one until the first worse one, cheapest when new levels mostly show up close to the top of the book.
+  struct LinkedLadder {};
+
+  /// Also keep an occupancy bit per price slot and side and find the next worse level by scanning those 64 slots at a time, so the cost no
+  /// longer grows with the number of levels ahead of the new one. The result is checked against its neighbours and the walk is used
+  /// instead in the rare case the live prices of a side span more than MAX_PRICE_LEVELS and slot order does not match price order.
+  struct BitmapLadder {};
+
+  /// Order storage for OrderBookCore - orders in a MemPool, linked and referred to by pointer.
+  /// Order needs side_, price_, quantity_, prev_order_ and next_order_.
+  template<typename Order>
+  class PooledOrderStore final
+  {
+  public:
+    typedef Order *Handle;
+    static constexpr Handle NONE = nullptr;
+
+    explicit PooledOrderStore(size_t capacity)
+        : pool_(capacity, "PooledOrderStore") {}
+
+    template<typename... Args>
+    auto allocate(Args... args) noexcept
+    {
+      return pool_.allocate(args...);
+    }
+
+    auto deallocate(Handle order) noexcept
+    {
+      pool_.deallocate(order);
+    }
+
+    auto side(Handle order) const noexcept { return order->side_; }
+
+    auto price(Handle order) const noexcept { return order->price_; }
+
+    auto quantity(Handle order) const noexcept { return order->quantity_; }
+
+    auto setQuantity(Handle order, Quantity quantity) noexcept { order->quantity_ = quantity; }
+
+    auto prev(Handle order) const noexcept { return order->prev_order_; }
+
+    auto next(Handle order) const noexcept { return order->next_order_; }
+
+    auto setPrev(Handle order, Handle prev_order) noexcept { order->prev_order_ = prev_order; }
+
+    auto setNext(Handle order, Handle next_order) noexcept { order->next_order_ = next_order; }
+
+    // Deleted default, copy & move constructors and assignment-operators.
+    PooledOrderStore() = delete;
+
+    PooledOrderStore(const PooledOrderStore &) = delete;
+
+    PooledOrderStore(const PooledOrderStore &&) = delete;
+
+    PooledOrderStore &operator=(const PooledOrderStore &) = delete;
+
+    PooledOrderStore &operator=(const PooledOrderStore &&) = delete;
+
+  private:
+    MemPool<Order> pool_;
+  };
+
+  /// The price levels and order queues MEOrderBook and MarketOrderBook have in common, the Policy selects:
+  ///   OrderStore - where orders live and how they are linked, PooledOrderStore or one with the same interface. Orders are referred to by
+  ///                OrderStore::Handle, OrderStore::NONE is no order.
+  ///   OrdersAtPrice - price level type, with side_, price_, prev_entry_, next_entry_ and a (side, price, first order, prev, next) constructor.
+  ///   firstOrder(orders_at_price) - reference to the first order in the queue of a price level.
+  ///   Ladder - LinkedLadder or BitmapLadder.
+  ///   MAX_PRICE_LEVELS, MAX_ORDERS - capacity of the level and order pools, levels are hashed by price % MAX_PRICE_LEVELS.
+  ///   TRACK_AGGREGATES - keep OrdersAtPrice::total_quantity_ and num_orders_ up to date, or walk the orders in levelQuantity().
+  /// The orders at a price are a circular list in priority order and the levels of each side a circular list best price first.
+  template<typename Policy>
+  class OrderBookCore final
+  {
+  public:
+    using OrderStore = typename Policy::OrderStore;
+    using OrderHandle = typename OrderStore::Handle;
+    using OrdersAtPrice = typename Policy::OrdersAtPrice;
+
+    static constexpr bool BITMAP_LADDER = std::is_same_v<typename Policy::Ladder, BitmapLadder>;
+    static_assert(BITMAP_LADDER || std::is_same_v<typename Policy::Ladder, LinkedLadder>, "Unknown price ladder layout.");
+    static_assert(!BITMAP_LADDER || Policy::MAX_PRICE_LEVELS % 64 == 0, "BitmapLadder needs a whole number of 64 slot words.");
+
+    OrderBookCore()
+        : orders_at_price_pool_(Policy::MAX_PRICE_LEVELS, "OrderBookCore price levels")
+        , order_store_(Policy::MAX_ORDERS) {}
+
+    template<typename... Args>
+    auto allocateOrder(Args... args) noexcept
+    {
+      return order_store_.allocate(args...);
+    }
+
+    auto orders() noexcept -> OrderStore &
+    {
+      return order_store_;
+    }
+
+    auto orders() const noexcept -> const OrderStore &
+    {
+      return order_store_;
+    }
+
+    auto bestOrdersByPrice(Side side) const noexcept -> OrdersAtPrice *
+    {
+      return (side == Side::BUY ? bids_by_price_ : asks_by_price_);
+    }
+
+    auto getOrdersAtPrice(Price price) const noexcept -> OrdersAtPrice *
+    {
+      return price_orders_at_price_.at(priceToIndex(price));
+    }
+
+    /// Quantity resting at a price level.
+    auto levelQuantity(OrdersAtPrice *orders_at_price) const noexcept -> uint64_t
+    {
+      if constexpr (Policy::TRACK_AGGREGATES)
+      {
+        return orders_at_price->total_quantity_;
+      } else
+      {
+        uint64_t quantity = 0;
+        auto order = Policy::firstOrder(orders_at_price);
+        do
+        {
+          quantity += order_store_.quantity(order);
+          order = order_store_.next(order);
+        } while (order != Policy::firstOrder(orders_at_price));
+        return quantity;
+      }
+    }
+
+    /// Queue order at the back of its price level, adding the level if it is a new one.
+    auto addOrder(OrderHandle order) noexcept -> void
+    {
+      const auto price = order_store_.price(order);
+      const auto orders_at_price = getOrdersAtPrice(price);
+
+      if (!orders_at_price)
+      {
+        order_store_.setNext(order, order);
+        order_store_.setPrev(order, order);
+
+        auto new_orders_at_price = orders_at_price_pool_.allocate(order_store_.side(order), price, order, nullptr, nullptr);
+        addOrdersAtPrice(new_orders_at_price);
+      } else
+      {
+        const auto first_order = Policy::firstOrder(orders_at_price);
+        const auto last_order = order_store_.prev(first_order);
+
+        order_store_.setNext(last_order, order);
+        order_store_.setPrev(order, last_order);
+        order_store_.setNext(order, first_order);
+        order_store_.setPrev(first_order, order);
+      }
+
+      if constexpr (Policy::TRACK_AGGREGATES)
+      {
+        auto level = getOrdersAtPrice(price);
+        level->total_quantity_ += order_store_.quantity(order);
+        ++level->num_orders_;
+      }
+    }
+
+    /// Unlink order from its price level, removing the level if it was the last order in it, and free it.
+    auto removeOrder(OrderHandle order) noexcept -> void
+    {
+      auto orders_at_price = getOrdersAtPrice(order_store_.price(order));
+      if constexpr (Policy::TRACK_AGGREGATES)
+      {
+        orders_at_price->total_quantity_ -= order_store_.quantity(order);
+        --orders_at_price->num_orders_;
+      }
+
+      if (order_store_.prev(order) == order)
+      { // only one element.
+        removeOrdersAtPrice(order_store_.side(order), order_store_.price(order));
+      } else
+      { // remove the link.
+        const auto order_before = order_store_.prev(order);
+        const auto order_after = order_store_.next(order);
+        order_store_.setNext(order_before, order_after);
+        order_store_.setPrev(order_after, order_before);
+
+        if (Policy::firstOrder(orders_at_price) == order)
+        {
+          Policy::firstOrder(orders_at_price) = order_after;
+        }
+
+        order_store_.setPrev(order, OrderStore::NONE);
+        order_store_.setNext(order, OrderStore::NONE);
+      }
+
+      order_store_.deallocate(order);
+    }
+
+    /// Change the quantity of a resting order in place, it keeps its queue position.
+    auto setQuantity(OrderHandle order, Quantity quantity) noexcept -> void
+    {
+      if constexpr (Policy::TRACK_AGGREGATES)
+        getOrdersAtPrice(order_store_.price(order))->total_quantity_ += static_cast<uint64_t>(quantity) - order_store_.quantity(order);
+      order_store_.setQuantity(order, quantity);
+    }
+
+    /// Free every order and price level.
+    auto clear() noexcept -> void
+    {
+      for (auto &best_orders_by_price : {&bids_by_price_, &asks_by_price_})
+      {
+        for (auto orders_at_price = *best_orders_by_price; orders_at_price; )
+        {
+          auto order = Policy::firstOrder(orders_at_price);
+          do
+          {
+            const auto next_order = order_store_.next(order);
+            order_store_.deallocate(order);
+            order = next_order;
+          } while (order != Policy::firstOrder(orders_at_price));
+
+          const auto next_orders_at_price = (orders_at_price->next_entry_ == *best_orders_by_price ? nullptr : orders_at_price->next_entry_);
+          price_orders_at_price_.at(priceToIndex(orders_at_price->price_)) = nullptr;
+          orders_at_price_pool_.deallocate(orders_at_price);
+          orders_at_price = next_orders_at_price;
+        }
+        *best_orders_by_price = nullptr;
+      }
+      bid_slots_.fill(0);
+      ask_slots_.fill(0);
+    }
+
+    /// Visits every resting order - bids then asks, best price first and in queue priority order within a price level.
+    template<typename F>
+    auto forEachOrder(F &&f) const noexcept
+    {
+      for (const auto best_orders_by_price : {bids_by_price_, asks_by_price_})
+      {
+        for (auto orders_at_price = best_orders_by_price; orders_at_price; )
+        {
+          auto order = Policy::firstOrder(orders_at_price);
+          do
+          {
+            f(order);
+            order = order_store_.next(order);
+          } while (order != Policy::firstOrder(orders_at_price));
+
+          orders_at_price = (orders_at_price->next_entry_ == best_orders_by_price ? nullptr : orders_at_price->next_entry_);
+        }
+      }
+    }
+
+    // Deleted copy & move constructors and assignment-operators.
+    OrderBookCore(const OrderBookCore &) = delete;
+
+    OrderBookCore(const OrderBookCore &&) = delete;
+
+    OrderBookCore &operator=(const OrderBookCore &) = delete;
+
+    OrderBookCore &operator=(const OrderBookCore &&) = delete;
+
+  private:
+    static constexpr size_t NUM_SLOT_WORDS = (BITMAP_LADDER ? Policy::MAX_PRICE_LEVELS / 64 : 1);
+    typedef std::array<uint64_t, NUM_SLOT_WORDS> PriceSlots;
+
+    MemPool<OrdersAtPrice> orders_at_price_pool_;
+    OrdersAtPrice *bids_by_price_ = nullptr;
+    OrdersAtPrice *asks_by_price_ = nullptr;
+
+    std::array<OrdersAtPrice *, Policy::MAX_PRICE_LEVELS> price_orders_at_price_ = {};
+
+    /// Occupied price slots per side, only used by BitmapLadder.
+    PriceSlots bid_slots_ = {};
+    PriceSlots ask_slots_ = {};
+
+    OrderStore order_store_;
+
+    static auto isBetter(Side side, Price price, Price than_price) noexcept
+    {
+      return (side == Side::BUY ? price > than_price : price < than_price);
+    }
+
+    auto priceToIndex(Price price) const noexcept
+    {
+      return (price % Policy::MAX_PRICE_LEVELS);
+    }
+
+    /// First occupied slot at or after slot, wrapping around.
+    static auto nextOccupiedSlot(const PriceSlots &slots, size_t slot) noexcept -> size_t
+    {
+      const auto bit = slot % 64;
+      for (size_t i = 0; i <= NUM_SLOT_WORDS; ++i)
+      {
+        const auto word_index = (slot / 64 + i) % NUM_SLOT_WORDS;
+        auto word = slots[word_index];
+        if (i == 0)
+          word &= (~0ull << bit);
+        else if (i == NUM_SLOT_WORDS)
+          word &= ~(~0ull << bit);
+        if (word)
+          return word_index * 64 + std::countr_zero(word);
+      }
+      return Policy::MAX_PRICE_LEVELS;
+    }
+
+    /// First occupied slot at or before slot, wrapping around.
+    static auto prevOccupiedSlot(const PriceSlots &slots, size_t slot) noexcept -> size_t
+    {
+      const auto bit = slot % 64;
+      const auto at_or_below = (bit == 63 ? ~0ull : (1ull << (bit + 1)) - 1);
+      for (size_t i = 0; i <= NUM_SLOT_WORDS; ++i)
+      {
+        const auto word_index = (slot / 64 + NUM_SLOT_WORDS - i % NUM_SLOT_WORDS) % NUM_SLOT_WORDS;
+        auto word = slots[word_index];
+        if (i == 0)
+          word &= at_or_below;
+        else if (i == NUM_SLOT_WORDS)
+          word &= ~at_or_below;
+        if (word)
+          return word_index * 64 + 63 - std::countl_zero(word);
+      }
+      return Policy::MAX_PRICE_LEVELS;
+    }
+
+    /// The level new_orders_at_price has to go in front of, from the occupancy bitmap - nullptr if that disagrees with the price order.
+    auto findWorseOrdersAtPrice(const OrdersAtPrice *new_orders_at_price) const noexcept -> OrdersAtPrice *
+    {
+      const auto side = new_orders_at_price->side_;
+      const auto price = new_orders_at_price->price_;
+      const auto slot = (side == Side::BUY ? prevOccupiedSlot(bid_slots_, priceToIndex(price)) : nextOccupiedSlot(ask_slots_, priceToIndex(price)));
+      if (UNLIKELY(slot == Policy::MAX_PRICE_LEVELS))
+        return nullptr;
+
+      const auto best_orders_by_price = bestOrdersByPrice(side);
+      const auto target = price_orders_at_price_[slot];
+      if (isBetter(side, target->price_, price)) // wrapped around without finding a worse level, the new one goes last.
+        return ((target == best_orders_by_price && isBetter(side, target->prev_entry_->price_, price)) ? target : nullptr);
+      return ((target == best_orders_by_price || isBetter(side, target->prev_entry_->price_, price)) ? target : nullptr);
+    }
+
+    auto addOrdersAtPrice(OrdersAtPrice *new_orders_at_price) noexcept
+    {
+      price_orders_at_price_.at(priceToIndex(new_orders_at_price->price_)) = new_orders_at_price;
+
+      const auto best_orders_by_price = (new_orders_at_price->side_ == Side::BUY ? bids_by_price_ : asks_by_price_);
+      if (UNLIKELY(!best_orders_by_price))
+      {
+        (new_orders_at_price->side_ == Side::BUY ? bids_by_price_ : asks_by_price_) = new_orders_at_price;
+        new_orders_at_price->prev_entry_ = new_orders_at_price->next_entry_ = new_orders_at_price;
+      } else
+      {
+        OrdersAtPrice *target = nullptr;
+        if constexpr (BITMAP_LADDER)
+          target = findWorseOrdersAtPrice(new_orders_at_price);
+
+        if (target)
+        { // add new_orders_at_price before target.
+          new_orders_at_price->prev_entry_ = target->prev_entry_;
+          new_orders_at_price->next_entry_ = target;
+          target->prev_entry_->next_entry_ = new_orders_at_price;
+          target->prev_entry_ = new_orders_at_price;
+
+          if (isBetter(new_orders_at_price->side_, new_orders_at_price->price_, best_orders_by_price->price_))
+            (new_orders_at_price->side_ == Side::BUY ? bids_by_price_ : asks_by_price_) = new_orders_at_price;
+        } else
+        {
+          addOrdersAtPriceByWalk(new_orders_at_price, best_orders_by_price);
+        }
+      }
+
+      if constexpr (BITMAP_LADDER)
+      {
+        const auto slot = priceToIndex(new_orders_at_price->price_);
+        (new_orders_at_price->side_ == Side::BUY ? bid_slots_ : ask_slots_)[slot / 64] |= (1ull << (slot % 64));
+      }
+    }
+
+    auto addOrdersAtPriceByWalk(OrdersAtPrice *new_orders_at_price, OrdersAtPrice *best_orders_by_price) noexcept
+    {
+      auto target = best_orders_by_price;
+      bool add_after = ((new_orders_at_price->side_ == Side::SELL && new_orders_at_price->price_ > target->price_) ||
+                        (new_orders_at_price->side_ == Side::BUY && new_orders_at_price->price_ < target->price_));
+      if (add_after)
+      {
+        target = target->next_entry_;
+        add_after = ((new_orders_at_price->side_ == Side::SELL && new_orders_at_price->price_ > target->price_) ||
+                     (new_orders_at_price->side_ == Side::BUY && new_orders_at_price->price_ < target->price_));
+      }
+      while (add_after && target != best_orders_by_price)
+      {
+        add_after = ((new_orders_at_price->side_ == Side::SELL && new_orders_at_price->price_ > target->price_) ||
+                     (new_orders_at_price->side_ == Side::BUY && new_orders_at_price->price_ < target->price_));
+        if (add_after)
+          target = target->next_entry_;
+      }
+
+      if (add_after)
+      { // add new_orders_at_price after target.
+        if (target == best_orders_by_price)
+        {
+          target = best_orders_by_price->prev_entry_;
+        }
+        new_orders_at_price->prev_entry_ = target;
+        target->next_entry_->prev_entry_ = new_orders_at_price;
+        new_orders_at_price->next_entry_ = target->next_entry_;
+        target->next_entry_ = new_orders_at_price;
+      } else
+      { // add new_orders_at_price before target.
+        new_orders_at_price->prev_entry_ = target->prev_entry_;
+        new_orders_at_price->next_entry_ = target;
+        target->prev_entry_->next_entry_ = new_orders_at_price;
+        target->prev_entry_ = new_orders_at_price;
+
+        if ((new_orders_at_price->side_ == Side::BUY && new_orders_at_price->price_ > best_orders_by_price->price_) ||
+            (new_orders_at_price->side_ == Side::SELL && new_orders_at_price->price_ < best_orders_by_price->price_))
+        {
+          target->next_entry_ = (target->next_entry_ == best_orders_by_price ? new_orders_at_price : target->next_entry_);
+          (new_orders_at_price->side_ == Side::BUY ? bids_by_price_ : asks_by_price_) = new_orders_at_price;
+        }
+      }
+    }
+
+    auto removeOrdersAtPrice(Side side, Price price) noexcept
+    {
+      const auto best_orders_by_price = (side == Side::BUY ? bids_by_price_ : asks_by_price_);
+      auto orders_at_price = getOrdersAtPrice(price);
+
+      if (UNLIKELY(orders_at_price->next_entry_ == orders_at_price))
+      { // empty side of book.
+        (side == Side::BUY ? bids_by_price_ : asks_by_price_) = nullptr;
+      } else
+      {
+        orders_at_price->prev_entry_->next_entry_ = orders_at_price->next_entry_;
+        orders_at_price->next_entry_->prev_entry_ = orders_at_price->prev_entry_;
+
+        if (orders_at_price == best_orders_by_price)
+        {
+          (side == Side::BUY ? bids_by_price_ : asks_by_price_) = orders_at_price->next_entry_;
+        }
+
+        orders_at_price->prev_entry_ = orders_at_price->next_entry_ = nullptr;
+      }
+
+      price_orders_at_price_.at(priceToIndex(price)) = nullptr;
+      if constexpr (BITMAP_LADDER)
+      {
+        const auto slot = priceToIndex(price);
+        (side == Side::BUY ? bid_slots_ : ask_slots_)[slot / 64] &= ~(1ull << (slot % 64));
+      }
+
+      orders_at_price_pool_.deallocate(orders_at_price);
+    }
+  };
+}
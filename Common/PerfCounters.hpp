@@ -0,0 +1,116 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace Common
+{
+  /// Hardware cache and TLB miss counters of the calling thread, user space only, for benchmarks.
+  /// Opened through perf_event_open - where that is not allowed (kernel.perf_event_paranoid above 2) or there is no PMU, as in many VMs,
+  /// available() is false and every count reads 0.
+  class CacheMissCounters final
+  {
+  public:
+    enum Counter : size_t
+    {
+      L1D_READ_MISSES = 0,
+      LLC_READ_MISSES = 1,
+      DTLB_READ_MISSES = 2,
+      NUM_COUNTERS = 3
+    };
+
+    CacheMissCounters()
+    {
+      constexpr std::array<uint64_t, NUM_COUNTERS> configs = {
+          PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+          PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+          PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)};
+
+      for (size_t i = 0; i < NUM_COUNTERS; ++i)
+      {
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.config = configs[i];
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fds_[i] = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+      }
+    }
+
+    ~CacheMissCounters()
+    {
+      for (const auto fd : fds_)
+      {
+        if (fd >= 0)
+          close(fd);
+      }
+    }
+
+    /// True if every counter could be opened.
+    auto available() const noexcept
+    {
+      for (const auto fd : fds_)
+      {
+        if (fd < 0)
+          return false;
+      }
+      return true;
+    }
+
+    /// Zero and start the counters.
+    auto start() noexcept
+    {
+      for (const auto fd : fds_)
+      {
+        if (fd >= 0)
+        {
+          ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+          ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+      }
+    }
+
+    /// Stop the counters and take their values.
+    auto stop() noexcept
+    {
+      for (size_t i = 0; i < NUM_COUNTERS; ++i)
+      {
+        counts_[i] = 0;
+        if (fds_[i] >= 0)
+        {
+          ioctl(fds_[i], PERF_EVENT_IOC_DISABLE, 0);
+          if (read(fds_[i], &counts_[i], sizeof(counts_[i])) != sizeof(counts_[i]))
+            counts_[i] = 0;
+        }
+      }
+    }
+
+    /// Value of counter between the last start() and stop().
+    auto count(Counter counter) const noexcept
+    {
+      return counts_[counter];
+    }
+
+    // Deleted copy & move constructors and assignment-operators.
+    CacheMissCounters(const CacheMissCounters &) = delete;
+
+    CacheMissCounters(const CacheMissCounters &&) = delete;
+
+    CacheMissCounters &operator=(const CacheMissCounters &) = delete;
+
+    CacheMissCounters &operator=(const CacheMissCounters &&) = delete;
+
+  private:
+    std::array<int, NUM_COUNTERS> fds_ = {-1, -1, -1};
+    std::array<uint64_t, NUM_COUNTERS> counts_ = {};
+  };
+}
@@ -1,8 +1,12 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
 
 namespace Common {
+  /// Size of a cache line, used to keep data written by different threads or processes on different cache lines.
+  constexpr size_t CACHE_LINE_SIZE = 64;
+
   inline auto rdtsc() noexcept {
     unsigned int lo, hi;
     __asm__ __volatile__ ("rdtsc" : "=a" (lo), "=d" (hi));
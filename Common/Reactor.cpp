@@ -0,0 +1,127 @@
+#include "Reactor.hpp"
+
+#include <algorithm>
+#include <iostream>
+
+#include "Macros.hpp"
+#include "ThreadUtils.hpp"
+#include "Topology.hpp"
+
+namespace Common
+{
+  namespace
+  {
+    struct ReactorEntry
+    {
+      std::string name_prefix_;
+      uint32_t budget_ = 0;
+    };
+
+    std::vector<ReactorEntry> reactor_components;
+  }
+
+  auto setReactorComponents(const std::string &components) -> void
+  {
+    reactor_components.clear();
+    size_t pos = 0;
+    while (pos < components.size())
+    {
+      auto end = components.find(',', pos);
+      if (end == std::string::npos)
+        end = components.size();
+      const auto entry = components.substr(pos, end - pos);
+      const auto equals = entry.find('=');
+      ASSERT(equals != std::string::npos && equals > 0 && equals + 1 < entry.size(), "Invalid reactor entry:" + entry);
+      const auto budget = std::stoi(entry.substr(equals + 1));
+      ASSERT(budget >= 0, "Negative budget in reactor entry:" + entry);
+      reactor_components.push_back({entry.substr(0, equals), static_cast<uint32_t>(budget)});
+      pos = end + 1;
+    }
+  }
+
+  auto reactorBudget(const std::string &name) -> uint32_t
+  {
+    const ReactorEntry *best = nullptr;
+    for (const auto &entry : reactor_components)
+    {
+      if (name.rfind(entry.name_prefix_, 0) == 0 && (!best || entry.name_prefix_.size() > best->name_prefix_.size()))
+        best = &entry;
+    }
+    return (best ? best->budget_ : 0);
+  }
+
+  auto placedComponentNode(const std::string &name, int default_cpu) -> int
+  {
+    return (reactorBudget(name) ? placedNode(REACTOR_THREAD, REACTOR_CORE) : placedNode(name, default_cpu));
+  }
+
+  auto componentWaitStrategy(const std::string &name, WaitStrategy &own) -> WaitStrategy &
+  {
+    return (reactorBudget(name) ? reactor().waitStrategy() : own);
+  }
+
+  Reactor::Reactor()
+      : wait_strategy_(waitStrategyType(REACTOR_THREAD, WaitStrategyType::SPIN_PARK))
+  {
+  }
+
+  auto Reactor::add(const std::string &name, uint32_t budget, std::function<bool()> poll, std::function<bool()> has_work) -> size_t
+  {
+    ASSERT(budget, "Reactor component:" + name + " needs a budget of at least 1.");
+    std::lock_guard<std::mutex> lock(components_mutex_);
+    const auto id = next_id_++;
+    components_.push_back({id, name, budget, std::move(poll), std::move(has_work)});
+    std::cerr << "Reactor added " << name << " budget:" << budget << std::endl;
+
+    if (!thread_)
+    {
+      thread_ = createAndStartThread(REACTOR_CORE, REACTOR_THREAD, [this]() { run(); });
+      ASSERT(thread_ != nullptr, "Failed to start Reactor thread.");
+    }
+    wait_strategy_.wakeUp();
+    return id;
+  }
+
+  auto Reactor::remove(size_t id) -> void
+  {
+    std::lock_guard<std::mutex> lock(components_mutex_);
+    const auto itr = std::find_if(components_.begin(), components_.end(), [id](const auto &component) { return component.id_ == id; });
+    ASSERT(itr != components_.end(), "Reactor::remove() called with unknown id:" + std::to_string(id));
+    std::cerr << "Reactor removed " << itr->name_ << " rounds:" << itr->rounds_ << " busy polls:" << itr->busy_polls_
+              << " budget exhausted:" << itr->budget_exhausted_ << " " << wait_strategy_.toString() << std::endl;
+    components_.erase(itr);
+  }
+
+  auto Reactor::run() noexcept -> void
+  {
+    while (true)
+    {
+      bool did_work = false;
+      {
+        std::lock_guard<std::mutex> lock(components_mutex_);
+        for (auto &component : components_)
+        {
+          ++component.rounds_;
+          uint32_t polls = 0;
+          while (polls < component.budget_ && component.poll_())
+            ++polls;
+          component.busy_polls_ += polls;
+          component.budget_exhausted_ += (polls == component.budget_);
+          did_work |= (polls != 0);
+        }
+      }
+
+      wait_strategy_.afterPoll(did_work, [this]()
+      {
+        std::lock_guard<std::mutex> lock(components_mutex_);
+        return std::any_of(components_.begin(), components_.end(), [](const auto &component) { return component.has_work_(); });
+      });
+    }
+  }
+
+  auto reactor() -> Reactor &
+  {
+    static auto reactor = new Reactor();
+    return *reactor;
+  }
+}
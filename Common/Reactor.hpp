@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "WaitStrategy.hpp"
+
+namespace Common
+{
+  /// Thread name and default cpu of the reactor, ANCHOR_PLACEMENT and ANCHOR_WAIT_STRATEGY apply to it like to any other thread.
+  constexpr auto REACTOR_THREAD = "Common/Reactor";
+  constexpr int REACTOR_CORE = -1;
+
+  /// Components that give up their own thread and run in the reactor instead, "<thread name prefix>=<budget>" entries separated by commas,
+  /// e.g. "Exchange/SnapshotSynthesizer=4,Common/Logger=1". A component takes the entry with the longest prefix of its thread name, the
+  /// same names setThreadPlacement() uses, and a budget of 0 keeps it on its own thread - "Common/Logger=1,Common/Logger exchange_order=0".
+  /// The budget is how many back to back polls that find work a component gets before the reactor moves on to the next one.
+  /// Set once at startup before any component is created.
+  auto setReactorComponents(const std::string &components) -> void;
+
+  /// Budget of the component with thread name name, 0 if it runs on its own thread.
+  auto reactorBudget(const std::string &name) -> uint32_t;
+
+  /// NUMA node of the thread that ends up running the component with thread name name - the reactor's if it is in the reactor.
+  auto placedComponentNode(const std::string &name, int default_cpu) -> int;
+
+  /// What the producers into the component with thread name name have to wake - the reactor's WaitStrategy if it is in the reactor, else
+  /// own, the one its thread waits with.
+  auto componentWaitStrategy(const std::string &name, WaitStrategy &own) -> WaitStrategy &;
+
+  /// Cooperative run loop that round-robins lightweight polling components on a single thread, so auxiliary components can share a core
+  /// while the latency critical ones keep theirs. A component hands in one pass of its polling loop - poll() returns whether it found
+  /// anything to do - plus has_work(), which rechecks the queues its producers wake it through (see WaitStrategy::afterPoll()).
+  /// The reactor waits with its own WaitStrategy when a whole round found nothing, components in it point their queues' producers at
+  /// waitStrategy() instead of their own.
+  /// The thread starts with the first add() and runs until the process exits.
+  class Reactor final
+  {
+  public:
+    Reactor();
+
+    /// Returns an id for remove(). Any thread, any time.
+    auto add(const std::string &name, uint32_t budget, std::function<bool()> poll, std::function<bool()> has_work) -> size_t;
+
+    /// Once this returns the component is not being polled and never will be again. Not from the reactor thread.
+    auto remove(size_t id) -> void;
+
+    auto waitStrategy() noexcept -> WaitStrategy &
+    {
+      return wait_strategy_;
+    }
+
+    // Deleted copy & move constructors and assignment-operators.
+    Reactor(const Reactor &) = delete;
+
+    Reactor(const Reactor &&) = delete;
+
+    Reactor &operator=(const Reactor &) = delete;
+
+    Reactor &operator=(const Reactor &&) = delete;
+
+  private:
+    auto run() noexcept -> void;
+
+    struct Component
+    {
+      size_t id_ = 0;
+      std::string name_;
+      uint32_t budget_ = 1;
+      std::function<bool()> poll_;
+      std::function<bool()> has_work_;
+
+      uint64_t rounds_ = 0;
+      uint64_t busy_polls_ = 0;
+      uint64_t budget_exhausted_ = 0; // rounds it used all of its budget in, often means it needs a bigger one.
+    };
+
+    /// Taken by the reactor once per round, add() and remove() only ever wait for the round in progress.
+    std::mutex components_mutex_;
+    std::vector<Component> components_;
+    size_t next_id_ = 1;
+
+    WaitStrategy wait_strategy_;
+    std::thread *thread_ = nullptr;
+  };
+
+  /// The process' reactor, never destroyed so components can leave it during static destruction.
+  auto reactor() -> Reactor &;
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <atomic>
+#include <cstring>
+#include <type_traits>
+
+#include "Macros.hpp"
+#include "PerfUtils.hpp"
+
+namespace Common
+{
+  /// Publishes a value from a single writer thread to any number of reader threads without locks.
+  /// The writer never waits - a store is two increments of the sequence number around a copy of the value. Readers copy the value out
+  /// and retry if the sequence number was odd or changed while they were copying, so they only ever retry while a store is in progress.
+  /// T has to be trivially copyable, readers may copy it while it is being written and only throw away the torn copy afterwards.
+  template<typename T>
+  class SeqLock final
+  {
+    static_assert(std::is_trivially_copyable_v<T>, "SeqLock values are copied with memcpy.");
+
+  public:
+    SeqLock() = default;
+
+    /// Writer thread only.
+    auto store(const T &value) noexcept
+    {
+      const auto seq = seq_.load(std::memory_order_relaxed);
+      seq_.store(seq + 1, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_release);
+      memcpy(&value_, &value, sizeof(T));
+      seq_.store(seq + 2, std::memory_order_release);
+    }
+
+    /// Any thread, returns a copy of the last value stored.
+    auto load() const noexcept
+    {
+      T value;
+      while (true)
+      {
+        const auto seq = seq_.load(std::memory_order_acquire);
+        if (UNLIKELY(seq & 1))
+          continue;
+        memcpy(&value, &value_, sizeof(T));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (LIKELY(seq_.load(std::memory_order_relaxed) == seq))
+          return value;
+      }
+    }
+
+    /// Number of stores so far.
+    auto version() const noexcept
+    {
+      return seq_.load(std::memory_order_acquire) / 2;
+    }
+
+    // Deleted copy & move constructors and assignment-operators.
+    SeqLock(const SeqLock &) = delete;
+
+    SeqLock(const SeqLock &&) = delete;
+
+    SeqLock &operator=(const SeqLock &) = delete;
+
+    SeqLock &operator=(const SeqLock &&) = delete;
+
+  private:
+    /// Starts on a cache line of its own and the class is padded to whole cache lines, readers polling it never share a line with the writer's other data.
+    alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> seq_ = {0};
+    T value_ = {};
+  };
+}
@@ -0,0 +1,272 @@
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "Macros.hpp"
+#include "PerfUtils.hpp"
+
+namespace Common
+{
+  /// Open a POSIX shared memory segment (which lives under /dev/shm) and map it into this process.
+  /// When create is true any stale segment with the same name is removed first so the new mapping starts zero-filled.
+  inline auto mapSharedMemory(const std::string &name, size_t size, bool create) -> void *
+  {
+    if (create)
+      shm_unlink(name.c_str());
+
+    const auto fd = shm_open(name.c_str(), O_RDWR | (create ? O_CREAT | O_EXCL : 0), 0666);
+    ASSERT(fd != -1, "shm_open() failed for:" + name + " error:" + std::string(strerror(errno)));
+
+    if (create)
+    {
+      ASSERT(ftruncate(fd, size) == 0, "ftruncate() failed for:" + name + " error:" + std::string(strerror(errno)));
+    } else
+    {
+      struct stat st;
+      ASSERT(fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) >= size,
+             "Shared memory segment:" + name + " is smaller than expected size:" + std::to_string(size));
+    }
+
+    auto ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    ASSERT(ptr != MAP_FAILED, "mmap() failed for:" + name + " error:" + std::string(strerror(errno)));
+
+    return ptr;
+  }
+
+  /// Single producer single consumer queue living in a shared memory segment, so the producer and the consumer can be in different processes.
+  /// Offers the same interface as LFQueue, num_elems has to be a power of 2.
+  template<typename T>
+  class ShmSPSCQueue final
+  {
+  public:
+    ShmSPSCQueue(const std::string &name, std::size_t num_elems, bool create)
+        : name_(name)
+        , num_elems_(num_elems)
+        , mapped_size_(sizeof(Header) + num_elems * sizeof(T))
+        , is_owner_(create)
+    {
+      ASSERT(num_elems && !(num_elems & (num_elems - 1)), "ShmSPSCQueue size has to be a power of 2:" + std::to_string(num_elems));
+      header_ = static_cast<Header *>(mapSharedMemory(name_, mapped_size_, create));
+      store_ = reinterpret_cast<T *>(header_ + 1);
+
+      if (create)
+        header_->num_elems_ = num_elems_;
+      ASSERT(header_->num_elems_ == num_elems_, "ShmSPSCQueue:" + name_ + " was created with a different size:" + std::to_string(header_->num_elems_));
+    }
+
+    ~ShmSPSCQueue()
+    {
+      munmap(header_, mapped_size_);
+      header_ = nullptr;
+      store_ = nullptr;
+
+      if (is_owner_)
+        shm_unlink(name_.c_str());
+    }
+
+    auto getNextToWriteTo() noexcept
+    {
+      auto next_write = tryGetNextToWriteTo();
+      if (UNLIKELY(next_write == nullptr))
+      {
+        FATAL("Shared memory queue:" + name_ + " is full.");
+      }
+      return next_write;
+    }
+
+    /// nullptr when the queue is full, for a producer that must not go down with a consumer in another process that stopped reading.
+    auto tryGetNextToWriteTo() noexcept -> T *
+    {
+      const auto write_index = header_->write_index_.load(std::memory_order_relaxed);
+      if (UNLIKELY(write_index - header_->read_index_.load(std::memory_order_acquire) >= num_elems_))
+        return nullptr;
+      return &store_[write_index & (num_elems_ - 1)];
+    }
+
+    auto updateWriteIndex() noexcept
+    {
+      header_->write_index_.store(header_->write_index_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    auto getNextToRead() const noexcept -> const T *
+    {
+      const auto read_index = header_->read_index_.load(std::memory_order_relaxed);
+      return (read_index != header_->write_index_.load(std::memory_order_acquire) ? &store_[read_index & (num_elems_ - 1)] : nullptr);
+    }
+
+    auto updateReadIndex() noexcept
+    {
+      header_->read_index_.store(header_->read_index_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    auto size() const noexcept
+    {
+      return static_cast<size_t>(header_->write_index_.load(std::memory_order_acquire) - header_->read_index_.load(std::memory_order_acquire));
+    }
+
+    // Deleted default, copy & move constructors and assignment-operators.
+    ShmSPSCQueue() = delete;
+
+    ShmSPSCQueue(const ShmSPSCQueue &) = delete;
+
+    ShmSPSCQueue(const ShmSPSCQueue &&) = delete;
+
+    ShmSPSCQueue &operator=(const ShmSPSCQueue &) = delete;
+
+    ShmSPSCQueue &operator=(const ShmSPSCQueue &&) = delete;
+
+  private:
+    /// The producer and consumer indices only ever increase and are kept on separate cache lines to avoid false sharing across processes.
+    struct alignas(CACHE_LINE_SIZE) Header
+    {
+      alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> write_index_ = {0};
+      alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> read_index_ = {0};
+      alignas(CACHE_LINE_SIZE) uint64_t num_elems_ = 0;
+    };
+
+    const std::string name_;
+    const size_t num_elems_;
+    const size_t mapped_size_;
+    const bool is_owner_;
+
+    Header *header_ = nullptr;
+    T *store_ = nullptr;
+  };
+
+  /// Single producer multiple consumer broadcast queue living in a shared memory segment.
+  /// The producer never waits for consumers, every consumer keeps its own read cursor in its own process.
+  /// A consumer that falls more than num_elems behind is lapped - it skips ahead to the latest element, which shows up as a gap
+  /// in the sequence numbers carried in T, exactly like a packet drop on a multicast stream.
+  template<typename T>
+  class ShmBroadcastQueue final
+  {
+  public:
+    ShmBroadcastQueue(const std::string &name, std::size_t num_elems, bool create)
+        : name_(name)
+        , num_elems_(num_elems)
+        , mapped_size_(sizeof(Header) + num_elems * sizeof(Slot))
+        , is_owner_(create)
+    {
+      ASSERT(num_elems && !(num_elems & (num_elems - 1)), "ShmBroadcastQueue size has to be a power of 2:" + std::to_string(num_elems));
+      header_ = static_cast<Header *>(mapSharedMemory(name_, mapped_size_, create));
+      slots_ = reinterpret_cast<Slot *>(header_ + 1);
+
+      if (create)
+        header_->num_elems_ = num_elems_;
+      ASSERT(header_->num_elems_ == num_elems_, "ShmBroadcastQueue:" + name_ + " was created with a different size:" + std::to_string(header_->num_elems_));
+
+      // consumers join the stream at the current position, same as subscribing to a multicast stream.
+      next_read_index_ = header_->write_index_.load(std::memory_order_acquire);
+    }
+
+    ~ShmBroadcastQueue()
+    {
+      munmap(header_, mapped_size_);
+      header_ = nullptr;
+      slots_ = nullptr;
+
+      if (is_owner_)
+        shm_unlink(name_.c_str());
+    }
+
+    /// Producer side - the slot is marked as being written to (odd sequence) till updateWriteIndex() is called.
+    auto getNextToWriteTo() noexcept
+    {
+      const auto write_index = header_->write_index_.load(std::memory_order_relaxed);
+      auto slot = &slots_[write_index & (num_elems_ - 1)];
+      slot->seq_.store(2 * write_index + 1, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_release);
+      return &slot->object_;
+    }
+
+    auto updateWriteIndex() noexcept
+    {
+      const auto write_index = header_->write_index_.load(std::memory_order_relaxed);
+      slots_[write_index & (num_elems_ - 1)].seq_.store(2 * write_index + 2, std::memory_order_release);
+      header_->write_index_.store(write_index + 1, std::memory_order_release);
+    }
+
+    /// Consumer side - returns a consistent copy of the next element, or nullptr if there is nothing new or this consumer was lapped.
+    auto getNextToRead() noexcept -> const T *
+    {
+      auto slot = &slots_[next_read_index_ & (num_elems_ - 1)];
+      const auto expected_seq = 2 * next_read_index_ + 2;
+
+      const auto seq_before = slot->seq_.load(std::memory_order_acquire);
+      if (seq_before < expected_seq) // not published yet.
+        return nullptr;
+
+      if (LIKELY(seq_before == expected_seq))
+      {
+        read_copy_ = slot->object_;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (LIKELY(slot->seq_.load(std::memory_order_relaxed) == expected_seq))
+          return &read_copy_;
+      }
+
+      // producer has wrapped around and overwritten what we were about to read, skip to the latest element.
+      ++num_overruns_;
+      next_read_index_ = header_->write_index_.load(std::memory_order_acquire);
+      return nullptr;
+    }
+
+    auto updateReadIndex() noexcept
+    {
+      ++next_read_index_;
+    }
+
+    auto size() const noexcept
+    {
+      return static_cast<size_t>(header_->write_index_.load(std::memory_order_acquire) - next_read_index_);
+    }
+
+    auto numOverruns() const noexcept
+    {
+      return num_overruns_;
+    }
+
+    // Deleted default, copy & move constructors and assignment-operators.
+    ShmBroadcastQueue() = delete;
+
+    ShmBroadcastQueue(const ShmBroadcastQueue &) = delete;
+
+    ShmBroadcastQueue(const ShmBroadcastQueue &&) = delete;
+
+    ShmBroadcastQueue &operator=(const ShmBroadcastQueue &) = delete;
+
+    ShmBroadcastQueue &operator=(const ShmBroadcastQueue &&) = delete;
+
+  private:
+    struct alignas(CACHE_LINE_SIZE) Header
+    {
+      alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> write_index_ = {0};
+      alignas(CACHE_LINE_SIZE) uint64_t num_elems_ = 0;
+    };
+
+    /// Every slot carries a sequence, 2 * index + 2 once the element at index is fully written, odd while it is being written.
+    struct Slot
+    {
+      std::atomic<uint64_t> seq_ = {0};
+      T object_;
+    };
+
+    const std::string name_;
+    const size_t num_elems_;
+    const size_t mapped_size_;
+    const bool is_owner_;
+
+    Header *header_ = nullptr;
+    Slot *slots_ = nullptr;
+
+    /// Consumer state, private to this process.
+    uint64_t next_read_index_ = 0;
+    T read_copy_;
+    size_t num_overruns_ = 0;
+  };
+}
@@ -10,21 +10,83 @@ namespace Common
   }
 
   /// Start listening for connections on the provided interface and port.
-  auto TCPServer::listen(const std::string &iface, int port) -> void 
+  auto TCPServer::listen(const std::string &iface, int port, IoUring *ring) -> void 
   {
-    epoll_fd_ = epoll_create(1);
-    ASSERT(epoll_fd_ >= 0, "epoll_create() failed error:" + std::string(std::strerror(errno)));
-
     ASSERT(listener_socket_.connect("", iface, port, true) >= 0,
            "Listener socket failed to connect. iface:" + iface + " port:" + std::to_string(port) + " error:" +
            std::string(std::strerror(errno)));
 
+    if (ring) 
+    {
+      ring_ = ring;
+      accept_op_.on_complete_ = [this](auto res, auto flags) { onAccept(res, flags); };
+      ring_->acceptMultishot(listener_socket_.socket_fd_, &accept_op_);
+      return;
+    }
+
+    epoll_fd_ = epoll_create(1);
+    ASSERT(epoll_fd_ >= 0, "epoll_create() failed error:" + std::string(std::strerror(errno)));
+
     ASSERT(addToEpollList(&listener_socket_), "epoll_ctl() failed. error:" + std::string(std::strerror(errno)));
   }
 
-  /// Publish outgoing data from the send buffer and read incoming data from the receive buffer.
-  auto TCPServer::sendAndRecv() noexcept -> void 
+  auto TCPServer::onAccept(int32_t res, uint32_t flags) noexcept -> void 
+  {
+    if (!(flags & IORING_CQE_F_MORE))
+      ring_->acceptMultishot(listener_socket_.socket_fd_, &accept_op_);
+    if (res < 0) 
+    {
+      logger_.log("%:% %() % accept failed error:%\n", __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str_), std::strerror(-res));
+      return;
+    }
+
+    ASSERT(disableNagle(res), "Failed to set no-delay on socket:" + std::to_string(res));
+    logger_.log("%:% %() % accepted socket:%\n", __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str_), res);
+
+    auto socket = new TCPSocket(logger_);
+    socket->socket_fd_ = res;
+    socket->recv_callback_ = recv_callback_;
+    socket->attach(ring_);
+    ring_sockets_.push_back(socket);
+    session(socket);
+  }
+
+  auto TCPServer::session(TCPSocket *socket) noexcept -> IoTask 
+  {
+    while (true) 
+    {
+      const auto received = co_await socket->recv();
+      if (received <= 0) 
+      {
+        logger_.log("%:% %() % session over socket:% res:%\n", __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str_),
+                    socket->socket_fd_, received);
+        // no more sends get queued for it and the descriptor is given back. The TCPSocket itself stays, the order server's session can
+        // still point at it until the client reconnects, as can a send still in flight on the ring.
+        ring_sockets_.erase(std::find(ring_sockets_.begin(), ring_sockets_.end(), socket));
+        close(socket->socket_fd_);
+        socket->socket_fd_ = -1;
+        co_return;
+      }
+      ring_received_ = true;
+      socket->recv_callback_(socket, socket->rx_time_);
+    }
+  }
+
+  /// Publish outgoing data from the send buffer and read incoming data from the receive buffer, returns whether anything was received.
+  auto TCPServer::sendAndRecv() noexcept -> bool 
   {
+    if (ring_) 
+    {
+      for (auto socket : ring_sockets_)
+        socket->sendAndRecv();
+
+      ring_received_ = false;
+      ring_->poll();
+      if (ring_received_)
+        recv_finished_callback_();
+      return ring_received_;
+    }
+
     auto recv = false;
 
     std::for_each(receive_sockets_.begin(), receive_sockets_.end(), [&recv](auto socket) 
@@ -39,11 +101,16 @@ namespace Common
     {
       socket->sendAndRecv();
     });
+
+    return recv;
   }
 
   /// Check for new connections or dead connections and update containers that track the sockets.
   auto TCPServer::poll() noexcept -> void 
   {
+    if (ring_)
+      return;
+
     const int max_events = 1 + send_sockets_.size() + receive_sockets_.size();
 
     const int n = epoll_wait(epoll_fd_, events_, max_events, 0);
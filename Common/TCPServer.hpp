@@ -10,19 +10,28 @@ namespace Common
         : listener_socket_(logger)
         , logger_(logger) {}
 
-    /// Start listening for connections on the provided interface and port.
-    auto listen(const std::string &iface, int port) -> void;
+    /// Start listening for connections on the provided interface and port. With a ring, connections are accepted by a multishot accept on
+    /// it and every accepted socket is attached to it, instead of going through epoll.
+    auto listen(const std::string &iface, int port, IoUring *ring = nullptr) -> void;
 
-    /// Check for new connections or dead connections and update containers that track the sockets.
+    /// Check for new connections or dead connections and update containers that track the sockets. Nothing to do with a ring, the
+    /// ring's completions take care of that.
     auto poll() noexcept -> void;
 
-    /// Publish outgoing data from the send buffer and read incoming data from the receive buffer.
-    auto sendAndRecv() noexcept -> void;
+    /// Publish outgoing data from the send buffer and read incoming data from the receive buffer, returns whether anything was received.
+    /// With a ring that is queueing every socket's outgoing data and a single IoUring::poll() for all of them.
+    auto sendAndRecv() noexcept -> bool;
 
   private:
     /// Add and remove socket file descriptors to and from the EPOLL list.
     auto addToEpollList(TCPSocket *socket);
 
+    /// Takes a socket accepted on the ring, attaches it and starts its session.
+    auto onAccept(int32_t res, uint32_t flags) noexcept -> void;
+
+    /// Per connection coroutine - resumed by the ring whenever data arrives, hands it to recv_callback_ until the connection closes.
+    auto session(TCPSocket *socket) noexcept -> IoTask;
+
   public:
     /// Socket on which this server is listening for new connections on.
     int epoll_fd_ = -1;
@@ -33,6 +42,12 @@ namespace Common
     /// Collection of all sockets, sockets for incoming data, sockets for outgoing data and dead connections.
     std::vector<TCPSocket *> receive_sockets_, send_sockets_;
 
+    /// io_uring mode only - the ring, every accepted socket and whether a session got data during the current sendAndRecv().
+    IoUring *ring_ = nullptr;
+    IoOperation accept_op_;
+    std::vector<TCPSocket *> ring_sockets_;
+    bool ring_received_ = false;
+
     /// Function wrapper to call back when data is available.
     std::function<void(TCPSocket *s, Nanos rx_time)> recv_callback_ = nullptr;
     /// Function wrapper to call back when all data across all TCPSockets has been read and dispatched this round.
@@ -1,5 +1,7 @@
 #include "TCPSocket.hpp"
 
+#include <utility>
+
 namespace Common 
 {
   /// Create TCPSocket with provided attributes to either listen-on / connect-to.
@@ -19,6 +21,17 @@ namespace Common
   /// Called to publish outgoing data from the buffers as well as check for and callback if data is available in the read buffers.
   auto TCPSocket::sendAndRecv() noexcept -> bool 
   {
+    if (ring_)
+    {
+      // one send in flight per socket, whatever send() appends meanwhile goes out with the next one.
+      if (!send_in_flight_ && next_send_valid_index_)
+      {
+        send_in_flight_ = next_send_valid_index_;
+        ring_->send(socket_fd_, outbound_data_.data(), send_in_flight_, &send_op_);
+      }
+      return false;
+    }
+
     char ctrl[CMSG_SPACE(sizeof(struct timeval))];
     auto cmsg = reinterpret_cast<struct cmsghdr *>(&ctrl);
 
@@ -60,10 +73,57 @@ namespace Common
   }
 
   /// Write outgoing data to the send buffers.
-  auto TCPSocket::send(const void *data, size_t len) noexcept -> void 
+  auto TCPSocket::send(const void *data, size_t len) noexcept -> bool 
   {
+    if (UNLIKELY(len > TCPBufferSize - next_send_valid_index_))
+    {
+      logger_.log("%:% %() % send buffer full socket:% len:% buffered:%\n", __FILE__, __LINE__, __FUNCTION__,
+                  Common::getCurrentTimeStr(&time_str_), socket_fd_, len, next_send_valid_index_);
+      return false;
+    }
     memcpy(outbound_data_.data() + next_send_valid_index_, data, len);
     next_send_valid_index_ += len;
+    return true;
   }
-}
 
+  auto TCPSocket::attach(IoUring *ring) noexcept -> void
+  {
+    ring_ = ring;
+    recv_op_.on_complete_ = [this](int32_t res, uint32_t flags)
+    {
+      if (res > 0)
+      {
+        ASSERT(next_rcv_valid_index_ + res <= TCPBufferSize, "TCPSocket inbound buffer full socket:" + std::to_string(socket_fd_));
+        memcpy(inbound_data_.data() + next_rcv_valid_index_, ring_->bufferOf(flags), res);
+        ring_->recycleBuffer(flags);
+        next_rcv_valid_index_ += res;
+        if (!ring_received_)
+          rx_time_ = getCurrentNanos();
+        ring_received_ += res;
+        logger_.log("%:% %() % read socket:% len:% utime:%\n", __FILE__, __LINE__, __FUNCTION__,
+                    Common::getCurrentTimeStr(&time_str_), socket_fd_, next_rcv_valid_index_, rx_time_);
+      } else if (res != -ENOBUFS) // out of provided buffers ends the multishot, it is re-armed below.
+      {
+        ring_closed_ = true;
+        ring_error_ = res;
+        logger_.log("%:% %() % closed socket:% res:%\n", __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str_), socket_fd_, res);
+      }
+
+      if (!(flags & IORING_CQE_F_MORE) && !ring_closed_)
+        ring_->recvMultishot(socket_fd_, &recv_op_);
+
+      if (recv_waiter_ && (ring_received_ || ring_closed_))
+        std::exchange(recv_waiter_, nullptr).resume();
+    };
+    send_op_.on_complete_ = [this](int32_t res, uint32_t)
+    {
+      logger_.log("%:% %() % send socket:% len:%\n", __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str_), socket_fd_, res);
+      // an error drops what was in flight, like a failed ::send() does in the non-blocking path.
+      const auto sent = (res > 0 ? static_cast<size_t>(res) : send_in_flight_);
+      memmove(outbound_data_.data(), outbound_data_.data() + sent, next_send_valid_index_ - sent);
+      next_send_valid_index_ -= sent;
+      send_in_flight_ = 0;
+    };
+    ring_->recvMultishot(socket_fd_, &recv_op_);
+  }
+}
@@ -1,9 +1,12 @@
 #pragma once
 
+#include <coroutine>
 #include <functional>
 
 #include "SocketUtils.hpp"
 #include "Logging.hpp"
+#include "HugePages.hpp"
+#include "IoUring.hpp"
 
 namespace Common 
 {
@@ -13,11 +16,9 @@ namespace Common
   struct TCPSocket 
   {
     explicit TCPSocket(Logger &logger)
-        : logger_(logger) 
-    {
-      outbound_data_.resize(TCPBufferSize);
-      inbound_data_.resize(TCPBufferSize);
-    }
+        : outbound_data_(TCPBufferSize, 0, HugePageAllocator<char>("TCPSocket outbound"))
+        , inbound_data_(TCPBufferSize, 0, HugePageAllocator<char>("TCPSocket inbound"))
+        , logger_(logger) {}
 
     /// Create TCPSocket with provided attributes to either listen-on / connect-to.
     auto connect(const std::string &ip, const std::string &iface, int port, bool is_listening) -> int;
@@ -25,8 +26,42 @@ namespace Common
     /// Called to publish outgoing data from the buffers as well as check for and callback if data is available in the read buffers.
     auto sendAndRecv() noexcept -> bool;
 
-    /// Write outgoing data to the send buffers.
-    auto send(const void *data, size_t len) noexcept -> void;
+    /// Write outgoing data to the send buffers. Returns false and writes nothing if it does not fit, a peer that stopped reading loses
+    /// what is sent to it from then on rather than the buffer being overrun.
+    auto send(const void *data, size_t len) noexcept -> bool;
+
+    /// Hand the socket's I/O over to ring - a multishot recv appends incoming data to inbound_data_ and resumes whoever waits in
+    /// co_await recv(), sendAndRecv() only queues outgoing data on the ring. Nothing happens until the ring is polled.
+    auto attach(IoUring *ring) noexcept -> void;
+
+    /// co_await socket.recv() on an attached socket resumes, from inside IoUring::poll(), once new data has been appended to
+    /// inbound_data_ - with the number of bytes appended since the last resume, 0 once the peer closed the connection or -errno.
+    struct RecvAwaitable
+    {
+      TCPSocket *socket_ = nullptr;
+
+      auto await_ready() const noexcept
+      {
+        return (socket_->ring_received_ != 0 || socket_->ring_closed_);
+      }
+
+      auto await_suspend(std::coroutine_handle<> waiter) noexcept -> void
+      {
+        socket_->recv_waiter_ = waiter;
+      }
+
+      auto await_resume() noexcept -> ssize_t
+      {
+        const auto received = socket_->ring_received_;
+        socket_->ring_received_ = 0;
+        return (received ? received : socket_->ring_error_);
+      }
+    };
+
+    auto recv() noexcept
+    {
+      return RecvAwaitable{this};
+    }
 
     /// Deleted default, copy & move constructors and assignment-operators.
     TCPSocket() = delete;
@@ -43,9 +78,9 @@ namespace Common
     int socket_fd_ = -1;
 
     /// Send and receive buffers and trackers for read/write indices.
-    std::vector<char> outbound_data_;
+    std::vector<char, HugePageAllocator<char>> outbound_data_;
     size_t next_send_valid_index_ = 0;
-    std::vector<char> inbound_data_;
+    std::vector<char, HugePageAllocator<char>> inbound_data_;
     size_t next_rcv_valid_index_ = 0;
 
     /// Socket attributes.
@@ -54,6 +89,18 @@ namespace Common
     /// Function wrapper to callback when there is data to be processed.
     std::function<void(TCPSocket *s, Nanos rx_time)> recv_callback_ = nullptr;
 
+    /// io_uring state, unused unless attach()ed. rx_time_ is when the first completion since the last resume was reaped - there is no
+    /// SO_TIMESTAMP control message on a multishot recv.
+    IoUring *ring_ = nullptr;
+    IoOperation recv_op_, send_op_;
+    std::coroutine_handle<> recv_waiter_ = nullptr;
+    ssize_t ring_received_ = 0;
+    ssize_t ring_error_ = 0;
+    bool ring_closed_ = false;
+    Nanos rx_time_ = 0;
+    /// Bytes at the front of outbound_data_ the ring is sending, send() appends behind them until the send completes.
+    size_t send_in_flight_ = 0;
+
     std::string time_str_;
     Logger &logger_;
   };
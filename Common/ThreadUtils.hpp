@@ -2,11 +2,14 @@
 
 #include <iostream>
 // #include <atomic>
+#include <future>
 #include <thread>
 #include <unistd.h>
 
 #include <sys/syscall.h>
 
+#include "Topology.hpp"
+
 namespace Common 
 {
   /// Set affinity for current thread to be pinned to the provided core_id.
@@ -20,25 +23,45 @@ namespace Common
     return (pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuset) == 0);
   }
 
+  /// Name the calling thread for top, perf and gdb. The kernel keeps at most 15 characters - longer names are cut down to the first 7
+  /// and last 8 characters of the part after the last '/', which keeps shard numbers and log file suffixes apart.
+  inline auto setThreadName(const std::string &name) noexcept
+  {
+    auto short_name = name.substr(name.rfind('/') + 1);
+    if (short_name.size() > 15)
+      short_name = short_name.substr(0, 7) + short_name.substr(short_name.size() - 8);
+
+    return (pthread_setname_np(pthread_self(), short_name.c_str()) == 0);
+  }
+
   /// Creates a thread instance, sets affinity on it, assigns it a name and
   /// passes the function to be run on that thread as well as the arguments to the function.
+  /// core_id is the component's default, an entry for name in the thread placement (setThreadPlacement()) overrides it.
+  /// The function and its arguments are copied into the thread, and this returns as soon as the thread is pinned and named, right before
+  /// it calls the function.
   template<typename T, typename... A>
-  inline auto createAndStartThread(int core_id, const std::string &name, T &&func, A &&... args) noexcept 
+  inline auto createAndStartThread(int default_core_id, const std::string &name, T &&func, A &&... args) noexcept 
   {
-    auto t = new std::thread([&]() 
+    const auto core_id = placedCpu(name, default_core_id);
+    if (core_id >= 0)
+      registerPinnedThread(name, core_id);
+
+    std::promise<void> ready;
+    auto ready_future = ready.get_future();
+    auto t = new std::thread([core_id, name, ready = std::move(ready), func = std::forward<T>(func), ...args = std::forward<A>(args)]() mutable 
     {
       if (core_id >= 0 && !setThreadCore(core_id)) 
       {
         std::cerr << "Failed to set core affinity for " << name << " " << pthread_self() << " to " << core_id << std::endl;
         exit(EXIT_FAILURE);
       }
+      setThreadName(name);
       std::cerr << "Set core affinity for " << name << " " << pthread_self() << " to " << core_id << std::endl;
+      ready.set_value();
 
-      std::forward<T>(func)((std::forward<A>(args))...);
+      func(args...);
     });
-
-    using namespace std::literals::chrono_literals;
-    std::this_thread::sleep_for(1s);
+    ready_future.wait();
 
     return t;
   }
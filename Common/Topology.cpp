@@ -0,0 +1,180 @@
+#include "Topology.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+
+#include <linux/mempolicy.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "Macros.hpp"
+
+namespace Common
+{
+  namespace
+  {
+    /// Parse a sysfs cpu list like "0-3,8-11".
+    auto parseCpuList(const std::string &list) -> std::vector<int>
+    {
+      std::vector<int> cpus;
+      size_t pos = 0;
+      while (pos < list.size())
+      {
+        auto end = list.find(',', pos);
+        if (end == std::string::npos)
+          end = list.size();
+        const auto range = list.substr(pos, end - pos);
+        const auto dash = range.find('-');
+        if (!range.empty() && range != "\n")
+        {
+          const auto first = std::stoi(range.substr(0, dash));
+          const auto last = (dash == std::string::npos ? first : std::stoi(range.substr(dash + 1)));
+          for (auto cpu = first; cpu <= last; ++cpu)
+            cpus.push_back(cpu);
+        }
+        pos = end + 1;
+      }
+      return cpus;
+    }
+
+    auto readLine(const std::string &path) -> std::string
+    {
+      std::ifstream file(path);
+      std::string line;
+      std::getline(file, line);
+      return line;
+    }
+
+    struct ThreadPlacementEntry
+    {
+      std::string name_prefix_;
+      int cpu_ = -1;
+    };
+
+    std::vector<ThreadPlacementEntry> thread_placement;
+
+    std::mutex pinned_threads_mutex;
+    std::vector<std::pair<std::string, int>> pinned_threads;
+
+    thread_local int memory_node = -1;
+  }
+
+  CpuTopology::CpuTopology()
+  {
+    for (const auto cpu : parseCpuList(readLine("/sys/devices/system/cpu/online")))
+    {
+      if (static_cast<size_t>(cpu) >= cpus_.size())
+        cpus_.resize(cpu + 1);
+      auto &info = cpus_[cpu];
+      info.cpu_ = cpu;
+      const auto topology_dir = "/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/topology/";
+      const auto package_id = readLine(topology_dir + "physical_package_id"), core_id = readLine(topology_dir + "core_id");
+      info.package_id_ = (package_id.empty() ? 0 : std::stoi(package_id));
+      info.core_id_ = (core_id.empty() ? cpu : std::stoi(core_id));
+    }
+
+    const auto nodes = parseCpuList(readLine("/sys/devices/system/node/online"));
+    num_nodes_ = std::max<int>(nodes.size(), 1);
+    for (const auto node : nodes)
+    {
+      for (const auto cpu : parseCpuList(readLine("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist")))
+      {
+        if (this->cpu(cpu))
+          cpus_[cpu].node_ = node;
+      }
+    }
+  }
+
+  auto CpuTopology::toString() const -> std::string
+  {
+    std::string str = "CpuTopology[nodes:" + std::to_string(num_nodes_);
+    for (const auto &info : cpus_)
+    {
+      if (info.cpu_ >= 0)
+        str += " cpu" + std::to_string(info.cpu_) + ":n" + std::to_string(info.node_) + "/p" + std::to_string(info.package_id_) + "/c" +
+               std::to_string(info.core_id_);
+    }
+    return str + "]";
+  }
+
+  auto cpuTopology() -> const CpuTopology &
+  {
+    static const CpuTopology topology;
+    return topology;
+  }
+
+  auto setThreadPlacement(const std::string &placement) -> void
+  {
+    thread_placement.clear();
+    size_t pos = 0;
+    while (pos < placement.size())
+    {
+      auto end = placement.find(',', pos);
+      if (end == std::string::npos)
+        end = placement.size();
+      const auto entry = placement.substr(pos, end - pos);
+      const auto equals = entry.find('=');
+      ASSERT(equals != std::string::npos && equals > 0 && equals + 1 < entry.size(), "Invalid thread placement entry:" + entry);
+      const auto cpu = std::stoi(entry.substr(equals + 1));
+      ASSERT(cpu == -1 || cpuTopology().cpu(cpu), "Thread placement entry:" + entry + " names a cpu that is not online.");
+      thread_placement.push_back({entry.substr(0, equals), cpu});
+      pos = end + 1;
+    }
+  }
+
+  auto placedCpu(const std::string &name, int default_cpu) -> int
+  {
+    const ThreadPlacementEntry *best = nullptr;
+    for (const auto &entry : thread_placement)
+    {
+      if (name.rfind(entry.name_prefix_, 0) == 0 && (!best || entry.name_prefix_.size() > best->name_prefix_.size()))
+        best = &entry;
+    }
+    return (best ? best->cpu_ : default_cpu);
+  }
+
+  auto placedNode(const std::string &name, int default_cpu) -> int
+  {
+    return cpuTopology().nodeOfCpu(placedCpu(name, default_cpu));
+  }
+
+  auto registerPinnedThread(const std::string &name, int cpu) -> void
+  {
+    std::lock_guard<std::mutex> lock(pinned_threads_mutex);
+    for (const auto &[other_name, other_cpu] : pinned_threads)
+    {
+      if (cpuTopology().samePhysicalCore(cpu, other_cpu))
+      {
+        std::cerr << "WARNING: " << name << " on cpu " << cpu << " shares a physical core with " << other_name << " on cpu " << other_cpu
+                  << std::endl;
+      }
+    }
+    pinned_threads.emplace_back(name, cpu);
+  }
+
+  MemoryNodeScope::MemoryNodeScope(int node) noexcept
+      : previous_node_(memory_node)
+  {
+    memory_node = node;
+  }
+
+  MemoryNodeScope::~MemoryNodeScope()
+  {
+    memory_node = previous_node_;
+  }
+
+  auto currentMemoryNode() noexcept -> int
+  {
+    return memory_node;
+  }
+
+  auto bindToNode(void *ptr, size_t bytes, int node) noexcept -> bool
+  {
+    if (node < 0 || node >= static_cast<int>(sizeof(unsigned long) * 8))
+      return false;
+    const unsigned long node_mask = 1UL << node;
+    return (syscall(SYS_mbind, ptr, bytes, MPOL_PREFERRED, &node_mask, sizeof(node_mask) * 8, 0) == 0);
+  }
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace Common
+{
+  /// Where a logical CPU sits, as read from sysfs.
+  struct CpuInfo
+  {
+    int cpu_ = -1;
+    int node_ = 0;       // NUMA node, 0 on machines without /sys/devices/system/node.
+    int package_id_ = 0; // socket.
+    int core_id_ = 0;    // physical core within the package, shared by SMT siblings.
+  };
+
+  /// CPU and NUMA layout of the machine, read once from /sys/devices/system/{cpu,node}.
+  class CpuTopology final
+  {
+  public:
+    CpuTopology();
+
+    /// nullptr for a cpu that is not online.
+    auto cpu(int cpu) const noexcept -> const CpuInfo *
+    {
+      return (cpu >= 0 && static_cast<size_t>(cpu) < cpus_.size() && cpus_[cpu].cpu_ == cpu ? &cpus_[cpu] : nullptr);
+    }
+
+    /// NUMA node of cpu, -1 for -1 (not pinned) or a cpu that is not online.
+    auto nodeOfCpu(int cpu) const noexcept
+    {
+      const auto info = this->cpu(cpu);
+      return (info ? info->node_ : -1);
+    }
+
+    /// Same cpu or SMT siblings on the same physical core.
+    auto samePhysicalCore(int cpu_a, int cpu_b) const noexcept
+    {
+      const auto a = cpu(cpu_a), b = cpu(cpu_b);
+      return (cpu_a == cpu_b || (a && b && a->package_id_ == b->package_id_ && a->core_id_ == b->core_id_));
+    }
+
+    auto numNodes() const noexcept
+    {
+      return num_nodes_;
+    }
+
+    auto toString() const -> std::string;
+
+    // Deleted copy & move constructors and assignment-operators.
+    CpuTopology(const CpuTopology &) = delete;
+
+    CpuTopology(const CpuTopology &&) = delete;
+
+    CpuTopology &operator=(const CpuTopology &) = delete;
+
+    CpuTopology &operator=(const CpuTopology &&) = delete;
+
+  private:
+    /// Indexed by cpu number, cpu_ is -1 for gaps in the online list.
+    std::vector<CpuInfo> cpus_;
+    int num_nodes_ = 1;
+  };
+
+  auto cpuTopology() -> const CpuTopology &;
+
+  /// Per-component thread placement, "<thread name prefix>=<cpu>" entries separated by commas, e.g.
+  /// "Exchange/MatchingEngine_0=2,Exchange/OrderServer=4,Common/Logger=-1". A thread takes the entry with the longest prefix of its name
+  /// (the name passed to createAndStartThread()), -1 leaves it floating. Threads without a matching entry keep the cpu their component
+  /// asks for. Set once at startup before any thread is created.
+  auto setThreadPlacement(const std::string &placement) -> void;
+
+  /// Cpu the thread called name runs on - its placement entry if there is one, else default_cpu.
+  auto placedCpu(const std::string &name, int default_cpu) -> int;
+
+  /// NUMA node of placedCpu(), -1 if the thread floats.
+  auto placedNode(const std::string &name, int default_cpu) -> int;
+
+  /// Record that thread name is now pinned to cpu, and warn on stderr if a thread pinned earlier shares its physical core - pinned threads
+  /// are the busy polling ones, two of them on SMT siblings steal each other's execution units.
+  auto registerPinnedThread(const std::string &name, int cpu) -> void;
+
+  /// While alive, memory from allocateHugePages() on this thread is placed on NUMA node node (-1 for no preference) - used to put a
+  /// component's queues and pools on the node of the thread that consumes them, wherever main happens to run.
+  class MemoryNodeScope final
+  {
+  public:
+    explicit MemoryNodeScope(int node) noexcept;
+
+    ~MemoryNodeScope();
+
+    // Deleted default, copy & move constructors and assignment-operators.
+    MemoryNodeScope() = delete;
+
+    MemoryNodeScope(const MemoryNodeScope &) = delete;
+
+    MemoryNodeScope(const MemoryNodeScope &&) = delete;
+
+    MemoryNodeScope &operator=(const MemoryNodeScope &) = delete;
+
+    MemoryNodeScope &operator=(const MemoryNodeScope &&) = delete;
+
+  private:
+    const int previous_node_;
+  };
+
+  /// Node of the innermost MemoryNodeScope on this thread, -1 if none.
+  auto currentMemoryNode() noexcept -> int;
+
+  /// mbind() [ptr, ptr + bytes) to node with MPOL_PREFERRED, before it is touched - pages go to node while it has free memory and
+  /// elsewhere after that, rather than failing the allocation.
+  auto bindToNode(void *ptr, size_t bytes, int node) noexcept -> bool;
+}
@@ -17,6 +17,7 @@ namespace Common
   constexpr size_t ME_MAX_NUM_CLIENTS = 256;
   constexpr size_t ME_MAX_ORDER_IDS = 1024 * 1024;
   constexpr size_t ME_MAX_PRICE_LEVELS = 256;
+  constexpr size_t ME_MAX_MATCHING_SHARDS = ME_MAX_TICKERS; // each shard owns at least one ticker.
 
   typedef uint64_t OrderId;
   constexpr auto OrderId_INVALID = std::numeric_limits<OrderId>::max();
@@ -131,6 +132,55 @@ namespace Common
     return static_cast<int>(side);
   }
 
+  /// LIMIT orders trade at price_ or better, MARKET orders ignore price_ and never rest in the book.
+  enum class OrderType : uint8_t 
+  {
+    INVALID = 0,
+    LIMIT = 1,
+    MARKET = 2
+  };
+
+  inline auto orderTypeToString(OrderType order_type) -> std::string 
+  {
+    switch (order_type) 
+    {
+      case OrderType::LIMIT:
+        return "LIMIT";
+      case OrderType::MARKET:
+        return "MARKET";
+      case OrderType::INVALID:
+        return "INVALID";
+    }
+
+    return "UNKNOWN";
+  }
+
+  /// DAY rests any unfilled quantity, IOC cancels it, FOK cancels the whole order unless it can be filled completely on arrival.
+  enum class TimeInForce : uint8_t 
+  {
+    INVALID = 0,
+    DAY = 1,
+    IOC = 2,
+    FOK = 3
+  };
+
+  inline auto timeInForceToString(TimeInForce tif) -> std::string 
+  {
+    switch (tif) 
+    {
+      case TimeInForce::DAY:
+        return "DAY";
+      case TimeInForce::IOC:
+        return "IOC";
+      case TimeInForce::FOK:
+        return "FOK";
+      case TimeInForce::INVALID:
+        return "INVALID";
+    }
+
+    return "UNKNOWN";
+  }
+
   struct RiskCfg {
     Quantity max_order_size_ = 0;
     Quantity max_position_ = 0;
@@ -149,16 +199,33 @@ namespace Common
     }
   };
 
+  /// Limits across all tickers on the worst-case notional, every working order filled and valued at the ticker's mark. 0 is no limit.
+  struct PortfolioRiskCfg {
+    double max_gross_notional_ = 0;
+    double max_net_notional_ = 0;
+
+    auto toString() const {
+      std::stringstream ss;
+      ss << "PortfolioRiskCfg{"
+         << "max-gross-notional:" << max_gross_notional_ << " "
+         << "max-net-notional:" << max_net_notional_
+         << "}";
+      return ss.str();
+    }
+  };
+
   struct TradeEngineCfg {
     Quantity clip_ = 0;
     double threshold_ = 0;
     RiskCfg risk_cfg_;
+    uint32_t levels_ = 1; // price levels a side the market maker quotes, one tick apart.
     auto toString() const {
       std::stringstream ss;
       ss << "TradeEngineCfg{"
          << "clip:" << quantityToString(clip_) << " "
          << "thresh:" << threshold_ << " "
-         << "risk:" << risk_cfg_.toString()
+         << "risk:" << risk_cfg_.toString() << " "
+         << "levels:" << levels_
          << "}";
       return ss.str();
     }
@@ -166,6 +233,82 @@ namespace Common
 
   typedef std::array<TradeEngineCfg, ME_MAX_TICKERS> TradeEngineCfgHashMap;
 
+  /// What the matching engine does when an aggressive order would trade against a resting order from the same client.
+  enum class STPMode : int8_t {
+    INVALID = 0,
+    NONE = 1,           // self-trades are allowed.
+    CANCEL_NEWEST = 2,  // the remaining quantity of the aggressive order is canceled.
+    CANCEL_OLDEST = 3,  // the resting order is canceled and matching continues.
+    DECREMENT_BOTH = 4, // both orders are reduced by the smaller of the two quantities, whichever reaches zero is canceled.
+    MAX = 5
+  };
+
+  inline auto stpModeToString(STPMode mode) -> std::string {
+    switch (mode) {
+      case STPMode::NONE:
+        return "NONE";
+      case STPMode::CANCEL_NEWEST:
+        return "CANCEL_NEWEST";
+      case STPMode::CANCEL_OLDEST:
+        return "CANCEL_OLDEST";
+      case STPMode::DECREMENT_BOTH:
+        return "DECREMENT_BOTH";
+      case STPMode::INVALID:
+        return "INVALID";
+      case STPMode::MAX:
+        return "MAX";
+    }
+    return "UNKNOWN";
+  }
+
+  inline auto stringToSTPMode(const std::string &str) -> STPMode 
+  {
+    for (auto i = static_cast<int>(STPMode::INVALID); i <= static_cast<int>(STPMode::MAX); ++i) 
+    {
+      const auto mode = static_cast<STPMode>(i);
+      if (stpModeToString(mode) == str)
+        return mode;
+    }
+    return STPMode::INVALID;
+  }
+
+  struct MatchingEngineCfg {
+    /// Publish one TRADE per price level swept by an aggressive order instead of one per resting order it traded against.
+    bool aggregate_trades_ = false;
+
+    STPMode stp_mode_ = STPMode::NONE;
+
+    auto operator==(const MatchingEngineCfg &) const -> bool = default;
+
+    auto toString() const {
+      std::stringstream ss;
+      ss << "MatchingEngineCfg{"
+         << "aggregate-trades:" << aggregate_trades_ << " "
+         << "stp-mode:" << stpModeToString(stp_mode_)
+         << "}";
+      return ss.str();
+    }
+  };
+
+  /// Limits the order server applies to every client before sequencing, each client gets its own message budget. 0 is no limit.
+  struct ClientRiskCfg {
+    Quantity max_order_size_ = 0;
+    double max_notional_ = 0;        // price * quantity of a single NEW or MODIFY, MARKET orders have no price to check.
+    double max_messages_per_sec_ = 0; // token bucket refill rate.
+    double max_message_burst_ = 0;    // token bucket depth, one second's worth of max_messages_per_sec_ when 0.
+
+    auto toString() const {
+      std::stringstream ss;
+      ss << "ClientRiskCfg{"
+         << "max-order-size:" << quantityToString(max_order_size_) << " "
+         << "max-notional:" << max_notional_ << " "
+         << "max-messages-per-sec:" << max_messages_per_sec_ << " "
+         << "max-message-burst:" << max_message_burst_
+         << "}";
+      return ss.str();
+    }
+  };
+
   enum class AlgoType : int8_t {
     INVALID = 0,
     RANDOM = 1,
@@ -200,5 +343,38 @@ namespace Common
     }
     return AlgoType::INVALID;
   }
+
+  /// Selects how co-located trading clients and the exchange talk to each other.
+  enum class TransportType : int8_t {
+    INVALID = 0,
+    SOCKET = 1, // TCP order entry and multicast market data.
+    SHM = 2,    // Shared memory rings under /dev/shm, only for processes on the same box.
+    MAX = 3
+  };
+
+  inline auto transportTypeToString(TransportType type) -> std::string {
+    switch (type) {
+      case TransportType::SOCKET:
+        return "SOCKET";
+      case TransportType::SHM:
+        return "SHM";
+      case TransportType::INVALID:
+        return "INVALID";
+      case TransportType::MAX:
+        return "MAX";
+    }
+    return "UNKNOWN";
+  }
+
+  inline auto stringToTransportType(const std::string &str) -> TransportType 
+  {
+    for (auto i = static_cast<int>(TransportType::INVALID); i <= static_cast<int>(TransportType::MAX); ++i) 
+    {
+      const auto transport_type = static_cast<TransportType>(i);
+      if (transportTypeToString(transport_type) == str)
+        return transport_type;
+    }
+    return TransportType::INVALID;
+  }
 }
 
@@ -0,0 +1,89 @@
+#include "WaitStrategy.hpp"
+
+#include <cerrno>
+#include <ctime>
+#include <vector>
+
+#include <linux/futex.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace Common
+{
+  namespace
+  {
+    struct WaitStrategyEntry
+    {
+      std::string name_prefix_;
+      WaitStrategyType type_ = WaitStrategyType::INVALID;
+    };
+
+    std::vector<WaitStrategyEntry> wait_strategies;
+  }
+
+  auto setWaitStrategies(const std::string &strategies) -> void
+  {
+    wait_strategies.clear();
+    size_t pos = 0;
+    while (pos < strategies.size())
+    {
+      auto end = strategies.find(',', pos);
+      if (end == std::string::npos)
+        end = strategies.size();
+      const auto entry = strategies.substr(pos, end - pos);
+      const auto equals = entry.find('=');
+      ASSERT(equals != std::string::npos && equals > 0, "Invalid wait strategy entry:" + entry);
+      const auto type = stringToWaitStrategyType(entry.substr(equals + 1));
+      ASSERT(type != WaitStrategyType::INVALID && type != WaitStrategyType::MAX, "Unknown wait strategy in entry:" + entry);
+      wait_strategies.push_back({entry.substr(0, equals), type});
+      pos = end + 1;
+    }
+  }
+
+  auto waitStrategyType(const std::string &name, WaitStrategyType default_type) -> WaitStrategyType
+  {
+    const WaitStrategyEntry *best = nullptr;
+    for (const auto &entry : wait_strategies)
+    {
+      if (name.rfind(entry.name_prefix_, 0) == 0 && (!best || entry.name_prefix_.size() > best->name_prefix_.size()))
+        best = &entry;
+    }
+    return (best ? best->type_ : default_type);
+  }
+
+  WaitStrategy::WaitStrategy(WaitStrategyType type, Nanos park_timeout) noexcept
+      : type_(type)
+      , park_timeout_(park_timeout)
+  {
+    ASSERT(type_ != WaitStrategyType::INVALID && type_ != WaitStrategyType::MAX, "Invalid wait strategy:" + waitStrategyTypeToString(type_));
+  }
+
+  auto WaitStrategy::yield() noexcept -> void
+  {
+    ++yields_;
+    sched_yield();
+  }
+
+  auto WaitStrategy::park() noexcept -> void
+  {
+    ++parks_;
+    const timespec timeout{static_cast<time_t>(park_timeout_ / NANOS_TO_SECS), static_cast<long>(park_timeout_ % NANOS_TO_SECS)};
+    // returns right away with EAGAIN if a producer already flipped the word back, that counts as a wakeup too.
+    const auto rc = syscall(SYS_futex, reinterpret_cast<uint32_t *>(&futex_word_), FUTEX_WAIT_PRIVATE, FUTEX_SLEEPING, &timeout, nullptr, 0);
+    if (rc == 0 || errno != ETIMEDOUT)
+      ++wakeups_;
+    futex_word_.store(FUTEX_AWAKE, std::memory_order_relaxed);
+  }
+
+  auto WaitStrategy::wake() noexcept -> void
+  {
+    syscall(SYS_futex, reinterpret_cast<uint32_t *>(&futex_word_), FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+  }
+
+  auto WaitStrategy::toString() const -> std::string
+  {
+    return "WaitStrategy[" + waitStrategyTypeToString(type_) + " busy:" + std::to_string(busy_passes_) + " empty:" + std::to_string(empty_passes_) +
+           " yields:" + std::to_string(yields_) + " parks:" + std::to_string(parks_) + " wakeups:" + std::to_string(wakeups_) + "]";
+  }
+}
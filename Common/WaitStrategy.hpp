@@ -0,0 +1,188 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+#include <immintrin.h>
+
+#include "Macros.hpp"
+#include "TimeUtils.hpp"
+
+namespace Common
+{
+  /// How a polling thread waits when a pass over its queues and sockets found nothing to do.
+  enum class WaitStrategyType : int8_t {
+    INVALID = 0,
+    BUSY_SPIN = 1,  // a single pause per empty pass - lowest wakeup latency, keeps the core (and most of its SMT sibling's issue slots) busy.
+    SPIN_YIELD = 2, // pauses backing off exponentially, then sched_yield() - gives the core to anything else runnable on it.
+    SPIN_PARK = 3,  // like SPIN_YIELD, then sleeps on a futex until a producer wakes it or the park timeout passes.
+    MAX = 4
+  };
+
+  inline auto waitStrategyTypeToString(WaitStrategyType type) -> std::string {
+    switch (type) {
+      case WaitStrategyType::BUSY_SPIN:
+        return "BUSY_SPIN";
+      case WaitStrategyType::SPIN_YIELD:
+        return "SPIN_YIELD";
+      case WaitStrategyType::SPIN_PARK:
+        return "SPIN_PARK";
+      case WaitStrategyType::INVALID:
+        return "INVALID";
+      case WaitStrategyType::MAX:
+        return "MAX";
+    }
+    return "UNKNOWN";
+  }
+
+  inline auto stringToWaitStrategyType(const std::string &str) -> WaitStrategyType
+  {
+    for (auto i = static_cast<int>(WaitStrategyType::INVALID); i <= static_cast<int>(WaitStrategyType::MAX); ++i)
+    {
+      const auto type = static_cast<WaitStrategyType>(i);
+      if (waitStrategyTypeToString(type) == str)
+        return type;
+    }
+    return WaitStrategyType::INVALID;
+  }
+
+  /// Empty passes spent pausing before SPIN_YIELD and SPIN_PARK start yielding, the pauses per pass double up to WAIT_MAX_PAUSES.
+  constexpr uint32_t WAIT_SPIN_PASSES = 1024;
+  constexpr uint32_t WAIT_MAX_PAUSES = 64;
+  /// Empty passes spent yielding before SPIN_PARK parks.
+  constexpr uint32_t WAIT_YIELD_PASSES = 128;
+  /// Longest a parked thread sleeps without being woken - bounds how late it notices socket data and timers, which cannot wake it.
+  constexpr Nanos WAIT_PARK_TIMEOUT = 1 * NANOS_TO_MILLIS;
+
+  /// Per-component wait strategies, "<thread name prefix>=<BUSY_SPIN|SPIN_YIELD|SPIN_PARK>" entries separated by commas, e.g.
+  /// "Exchange/SnapshotSynthesizer=SPIN_YIELD,Common/Logger=SPIN_PARK". A thread takes the entry with the longest prefix of its name, the
+  /// same names setThreadPlacement() uses. Set once at startup before any component is created.
+  auto setWaitStrategies(const std::string &strategies) -> void;
+
+  /// Wait strategy for the thread called name - its entry if there is one, else default_type.
+  auto waitStrategyType(const std::string &name, WaitStrategyType default_type) -> WaitStrategyType;
+
+  /// Owned by the one thread running a polling loop, which calls afterPoll() once per pass.
+  /// Producers into a parked thread's LFQueues wake it through notify() - see LFQueue::setConsumerWaitStrategy().
+  class WaitStrategy final
+  {
+  public:
+    explicit WaitStrategy(WaitStrategyType type, Nanos park_timeout = WAIT_PARK_TIMEOUT) noexcept;
+
+    auto type() const noexcept
+    {
+      return type_;
+    }
+
+    /// Only SPIN_PARK threads need producers to wake them.
+    auto parks() const noexcept
+    {
+      return (type_ == WaitStrategyType::SPIN_PARK);
+    }
+
+    /// did_work is whether the pass just finished found anything to do. has_work() is only called by SPIN_PARK right before it parks, it
+    /// has to recheck every queue whose producers call notify(), so an element written just before the park is never missed.
+    template<typename HasWork>
+    auto afterPoll(bool did_work, const HasWork &has_work) noexcept -> void
+    {
+      if (LIKELY(did_work))
+      {
+        ++busy_passes_;
+        idle_passes_ = 0;
+        return;
+      }
+
+      ++empty_passes_;
+      if (type_ == WaitStrategyType::BUSY_SPIN)
+      {
+        _mm_pause();
+        return;
+      }
+
+      if (++idle_passes_ <= WAIT_SPIN_PASSES)
+      {
+        // 1, 2, 4 ... WAIT_MAX_PAUSES pauses, a thread that just went idle still picks up new work within a few pauses.
+        const auto pauses = (idle_passes_ < 7 ? 1U << (idle_passes_ - 1) : WAIT_MAX_PAUSES);
+        for (uint32_t i = 0; i < pauses; ++i)
+          _mm_pause();
+        return;
+      }
+
+      if (type_ == WaitStrategyType::SPIN_YIELD || idle_passes_ <= WAIT_SPIN_PASSES + WAIT_YIELD_PASSES)
+      {
+        yield();
+        return;
+      }
+
+      // announce the park before rechecking, a producer writing after the recheck sees sleeping and wakes us.
+      futex_word_.store(FUTEX_SLEEPING);
+      if (has_work())
+      {
+        futex_word_.store(FUTEX_AWAKE, std::memory_order_relaxed);
+        return;
+      }
+      park();
+    }
+
+    /// For loops fed only by sockets or timers, nothing can wake a parked thread before the park timeout.
+    auto afterPoll(bool did_work) noexcept -> void
+    {
+      afterPoll(did_work, [] { return false; });
+    }
+
+    /// Called by producers right after they publish, wakes the thread if it is parked. Costs a load when it is not, the seq_cst increment
+    /// LFQueue publishes with orders it after the write.
+    auto notify() noexcept
+    {
+      if (UNLIKELY(futex_word_.load() == FUTEX_SLEEPING) && futex_word_.exchange(FUTEX_AWAKE) == FUTEX_SLEEPING)
+        wake();
+    }
+
+    /// Wake a parked thread regardless, for stop() so it sees its run flag go down right away.
+    auto wakeUp() noexcept
+    {
+      if (futex_word_.exchange(FUTEX_AWAKE) == FUTEX_SLEEPING)
+        wake();
+    }
+
+    /// Counters since construction, read them from the polling thread or after it has exited.
+    auto toString() const -> std::string;
+
+    // Deleted default, copy & move constructors and assignment-operators.
+    WaitStrategy() = delete;
+
+    WaitStrategy(const WaitStrategy &) = delete;
+
+    WaitStrategy(const WaitStrategy &&) = delete;
+
+    WaitStrategy &operator=(const WaitStrategy &) = delete;
+
+    WaitStrategy &operator=(const WaitStrategy &&) = delete;
+
+  private:
+    auto yield() noexcept -> void;
+
+    auto park() noexcept -> void;
+
+    auto wake() noexcept -> void;
+
+    static constexpr uint32_t FUTEX_AWAKE = 0;
+    static constexpr uint32_t FUTEX_SLEEPING = 1;
+
+    const WaitStrategyType type_;
+    const Nanos park_timeout_;
+
+    /// Empty passes since the last one that did work.
+    uint32_t idle_passes_ = 0;
+
+    uint64_t busy_passes_ = 0;
+    uint64_t empty_passes_ = 0;
+    uint64_t yields_ = 0;
+    uint64_t parks_ = 0;
+    uint64_t wakeups_ = 0; // parks ended by a producer rather than the timeout.
+
+    /// Written by producers, on its own cache line so notify() does not share one with the polling thread's counters.
+    alignas(64) std::atomic<uint32_t> futex_word_ = {FUTEX_AWAKE};
+  };
+}
@@ -0,0 +1,358 @@
+#include "XdpSocket.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+
+#include <arpa/inet.h>
+#include <linux/bpf.h>
+#include <net/if.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "HugePages.hpp"
+
+namespace Common
+{
+  namespace
+  {
+    /// Untagged Ethernet, IPv4, UDP - the only frames the XDP program redirects. The IP header is 20 bytes plus options, IHL tells.
+    constexpr size_t ETH_HEADER_SIZE = 14;
+    constexpr size_t MIN_IP_HEADER_SIZE = 20;
+    constexpr size_t UDP_HEADER_SIZE = 8;
+
+    /// Key of the ports map, destination address and port of a feed - both in network byte order, the way they are in the headers.
+    struct PortKey
+    {
+      uint32_t ip_ = 0;
+      uint32_t port_ = 0;
+    };
+
+    constexpr uint32_t COMPLETION_RING_SIZE = 64; // nothing is ever transmitted, the ring only has to exist.
+
+    auto bpf(int cmd, bpf_attr &attr) -> int
+    {
+      return static_cast<int>(syscall(SYS_bpf, cmd, &attr, sizeof(attr)));
+    }
+
+    auto createMap(uint32_t type, uint32_t key_size, uint32_t max_entries) -> int
+    {
+      bpf_attr attr{};
+      attr.map_type = type;
+      attr.key_size = key_size;
+      attr.value_size = sizeof(uint32_t);
+      attr.max_entries = max_entries;
+      return bpf(BPF_MAP_CREATE, attr);
+    }
+
+    auto updateMap(int map_fd, const void *key, uint32_t value) -> bool
+    {
+      bpf_attr attr{};
+      attr.map_fd = map_fd;
+      attr.key = reinterpret_cast<uint64_t>(key);
+      attr.value = reinterpret_cast<uint64_t>(&value);
+      attr.flags = BPF_ANY;
+      return !bpf(BPF_MAP_UPDATE_ELEM, attr);
+    }
+
+    auto insn(uint8_t code, uint8_t dst, uint8_t src, int16_t off, int32_t imm) -> bpf_insn
+    {
+      bpf_insn i{};
+      i.code = code;
+      i.dst_reg = dst;
+      i.src_reg = src;
+      i.off = off;
+      i.imm = imm;
+      return i;
+    }
+  }
+
+  XdpSocket::~XdpSocket()
+  {
+    // closing the link detaches the program, the interface is back to normal from here.
+    for (auto fd : {link_fd_, prog_fd_, ports_map_fd_, xsks_map_fd_, xsk_fd_})
+    {
+      if (fd >= 0)
+        close(fd);
+    }
+    for (auto ring : {&rx_ring_, &completion_ring_, &fill_ring_})
+    {
+      if (ring->map_)
+        munmap(ring->map_, ring->map_size_);
+    }
+    if (umem_)
+      deallocateHugePages(umem_);
+  }
+
+  auto XdpSocket::fail(const std::string &what) -> bool
+  {
+    logger_.log("%:% %() % % failed iface:% error:%\n", __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str_), what, iface_,
+                std::strerror(errno));
+    return false;
+  }
+
+  auto XdpSocket::mapRing(Ring &ring, const xdp_ring_offset &offsets, uint32_t size, size_t desc_size, off_t pgoff) -> bool
+  {
+    ring.map_size_ = offsets.desc + size * desc_size;
+    ring.map_ = mmap(nullptr, ring.map_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, xsk_fd_, pgoff);
+    if (ring.map_ == MAP_FAILED)
+    {
+      ring.map_ = nullptr;
+      return false;
+    }
+    const auto base = static_cast<char *>(ring.map_);
+    ring.producer_ = reinterpret_cast<uint32_t *>(base + offsets.producer);
+    ring.consumer_ = reinterpret_cast<uint32_t *>(base + offsets.consumer);
+    ring.flags_ = reinterpret_cast<uint32_t *>(base + offsets.flags);
+    ring.descs_ = base + offsets.desc;
+    ring.mask_ = size - 1;
+    return true;
+  }
+
+  auto XdpSocket::init(const std::string &iface) -> bool
+  {
+    iface_ = iface;
+    ifindex_ = static_cast<int>(if_nametoindex(iface.c_str()));
+    if (!ifindex_)
+      return fail("if_nametoindex()");
+
+    xsk_fd_ = socket(AF_XDP, SOCK_RAW, 0);
+    if (xsk_fd_ < 0)
+      return fail("socket(AF_XDP)");
+
+    umem_ = static_cast<char *>(allocateHugePages(static_cast<size_t>(XDP_NUM_FRAMES) * XDP_FRAME_SIZE, "XdpSocket UMEM", true));
+    xdp_umem_reg umem_reg{};
+    umem_reg.addr = reinterpret_cast<uint64_t>(umem_);
+    umem_reg.len = static_cast<uint64_t>(XDP_NUM_FRAMES) * XDP_FRAME_SIZE;
+    umem_reg.chunk_size = XDP_FRAME_SIZE;
+    if (setsockopt(xsk_fd_, SOL_XDP, XDP_UMEM_REG, &umem_reg, sizeof(umem_reg)))
+      return fail("XDP_UMEM_REG");
+
+    const uint32_t fill_size = XDP_NUM_FRAMES, completion_size = COMPLETION_RING_SIZE, rx_size = XDP_RX_RING_SIZE;
+    if (setsockopt(xsk_fd_, SOL_XDP, XDP_UMEM_FILL_RING, &fill_size, sizeof(fill_size)) ||
+        setsockopt(xsk_fd_, SOL_XDP, XDP_UMEM_COMPLETION_RING, &completion_size, sizeof(completion_size)) ||
+        setsockopt(xsk_fd_, SOL_XDP, XDP_RX_RING, &rx_size, sizeof(rx_size)))
+      return fail("XDP ring setup");
+
+    xdp_mmap_offsets offsets{};
+    socklen_t offsets_len = sizeof(offsets);
+    if (getsockopt(xsk_fd_, SOL_XDP, XDP_MMAP_OFFSETS, &offsets, &offsets_len))
+      return fail("XDP_MMAP_OFFSETS");
+    if (!mapRing(fill_ring_, offsets.fr, fill_size, sizeof(uint64_t), XDP_UMEM_PGOFF_FILL_RING) ||
+        !mapRing(completion_ring_, offsets.cr, completion_size, sizeof(uint64_t), XDP_UMEM_PGOFF_COMPLETION_RING) ||
+        !mapRing(rx_ring_, offsets.rx, rx_size, sizeof(xdp_desc), XDP_PGOFF_RX_RING))
+      return fail("XDP ring mmap()");
+
+    // every frame starts out in the fill ring, the kernel takes one per received frame and poll() gives it straight back.
+    const auto fill_descs = static_cast<uint64_t *>(fill_ring_.descs_);
+    for (uint32_t i = 0; i < XDP_NUM_FRAMES; ++i)
+      fill_descs[i] = static_cast<uint64_t>(i) * XDP_FRAME_SIZE;
+    std::atomic_ref<uint32_t>(*fill_ring_.producer_).store(*fill_ring_.producer_ + XDP_NUM_FRAMES, std::memory_order_release);
+
+    sockaddr_xdp addr{};
+    addr.sxdp_family = AF_XDP;
+    addr.sxdp_ifindex = ifindex_;
+    addr.sxdp_queue_id = XDP_QUEUE_ID;
+    addr.sxdp_flags = XDP_ZEROCOPY | XDP_USE_NEED_WAKEUP;
+    zero_copy_ = !bind(xsk_fd_, reinterpret_cast<sockaddr *>(&addr), sizeof(addr));
+    if (!zero_copy_)
+    {
+      // no zero-copy support in the driver, or generic XDP - the kernel copies each frame into the UMEM instead.
+      addr.sxdp_flags = XDP_COPY | XDP_USE_NEED_WAKEUP;
+      if (bind(xsk_fd_, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)))
+        return fail("bind(AF_XDP)");
+    }
+
+    if (!loadProgram())
+      return false;
+
+    logger_.log("%:% %() % AF_XDP socket on iface:% queue:% zero_copy:%\n", __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str_),
+                iface_, XDP_QUEUE_ID, zero_copy_);
+    return true;
+  }
+
+  /// Hand assembled, there is no BPF toolchain in the build:
+  ///   if (frame is untagged IPv4, IHL >= 5, not a later fragment, carrying UDP && ports[{ip dest address, udp dest port}])
+  ///     return bpf_redirect_map(xsks, rx_queue_index, XDP_PASS);
+  ///   return XDP_PASS;
+  auto XdpSocket::loadProgram() -> bool
+  {
+    xsks_map_fd_ = createMap(BPF_MAP_TYPE_XSKMAP, sizeof(uint32_t), XDP_QUEUE_ID + 1);
+    ports_map_fd_ = createMap(BPF_MAP_TYPE_HASH, sizeof(PortKey), XDP_MAX_PORTS);
+    if (xsks_map_fd_ < 0 || ports_map_fd_ < 0)
+      return fail("BPF_MAP_CREATE");
+    if (!updateMap(xsks_map_fd_, &XDP_QUEUE_ID, static_cast<uint32_t>(xsk_fd_)))
+      return fail("XSKMAP update");
+
+    std::vector<bpf_insn> insns;
+    std::vector<size_t> jumps_to_pass;
+    const auto jumpToPass = [&](bpf_insn jump)
+    {
+      jumps_to_pass.push_back(insns.size());
+      insns.push_back(jump);
+    };
+    const auto loadMapFd = [&](uint8_t dst, int map_fd)
+    {
+      insns.push_back(insn(BPF_LD | BPF_DW | BPF_IMM, dst, BPF_PSEUDO_MAP_FD, 0, map_fd));
+      insns.push_back(insn(0, 0, 0, 0, 0));
+    };
+
+    insns.push_back(insn(BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_6, BPF_REG_1, 0, 0));                    // r6 = ctx
+    insns.push_back(insn(BPF_LDX | BPF_MEM | BPF_W, BPF_REG_2, BPF_REG_6, offsetof(xdp_md, data), 0));     // r2 = data
+    insns.push_back(insn(BPF_LDX | BPF_MEM | BPF_W, BPF_REG_3, BPF_REG_6, offsetof(xdp_md, data_end), 0)); // r3 = data_end
+    insns.push_back(insn(BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_4, BPF_REG_2, 0, 0));
+    insns.push_back(insn(BPF_ALU64 | BPF_ADD | BPF_K, BPF_REG_4, 0, 0, ETH_HEADER_SIZE + MIN_IP_HEADER_SIZE));
+    jumpToPass(insn(BPF_JMP | BPF_JGT | BPF_X, BPF_REG_4, BPF_REG_3, 0, 0));                            // fixed IP header past data_end
+    insns.push_back(insn(BPF_LDX | BPF_MEM | BPF_H, BPF_REG_5, BPF_REG_2, 12, 0));
+    jumpToPass(insn(BPF_JMP | BPF_JNE | BPF_K, BPF_REG_5, 0, 0, htons(0x0800)));                        // ethertype IPv4
+    insns.push_back(insn(BPF_LDX | BPF_MEM | BPF_B, BPF_REG_5, BPF_REG_2, ETH_HEADER_SIZE, 0));
+    insns.push_back(insn(BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_4, BPF_REG_5, 0, 0));
+    insns.push_back(insn(BPF_ALU64 | BPF_AND | BPF_K, BPF_REG_4, 0, 0, 0xf0));
+    jumpToPass(insn(BPF_JMP | BPF_JNE | BPF_K, BPF_REG_4, 0, 0, 0x40));                                 // version 4
+    insns.push_back(insn(BPF_ALU64 | BPF_AND | BPF_K, BPF_REG_5, 0, 0, 0x0f));
+    jumpToPass(insn(BPF_JMP | BPF_JLT | BPF_K, BPF_REG_5, 0, 0, MIN_IP_HEADER_SIZE / 4));              // IHL below the minimum
+    insns.push_back(insn(BPF_ALU64 | BPF_LSH | BPF_K, BPF_REG_5, 0, 0, 2));                             // r5 = IP header size, 20 - 60
+    insns.push_back(insn(BPF_LDX | BPF_MEM | BPF_H, BPF_REG_4, BPF_REG_2, ETH_HEADER_SIZE + 6, 0));
+    jumpToPass(insn(BPF_JMP | BPF_JSET | BPF_K, BPF_REG_4, 0, 0, htons(0x1fff)));                       // later fragment, no UDP header
+    insns.push_back(insn(BPF_LDX | BPF_MEM | BPF_B, BPF_REG_4, BPF_REG_2, ETH_HEADER_SIZE + 9, 0));
+    jumpToPass(insn(BPF_JMP | BPF_JNE | BPF_K, BPF_REG_4, 0, 0, IPPROTO_UDP));
+    insns.push_back(insn(BPF_LDX | BPF_MEM | BPF_W, BPF_REG_4, BPF_REG_2, ETH_HEADER_SIZE + 16, 0));  // ip dest address
+    insns.push_back(insn(BPF_STX | BPF_MEM | BPF_W, BPF_REG_10, BPF_REG_4, -8, 0));
+    insns.push_back(insn(BPF_ALU64 | BPF_ADD | BPF_X, BPF_REG_2, BPF_REG_5, 0, 0));
+    insns.push_back(insn(BPF_ALU64 | BPF_ADD | BPF_K, BPF_REG_2, 0, 0, ETH_HEADER_SIZE));               // r2 = udp header
+    insns.push_back(insn(BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_4, BPF_REG_2, 0, 0));
+    insns.push_back(insn(BPF_ALU64 | BPF_ADD | BPF_K, BPF_REG_4, 0, 0, UDP_HEADER_SIZE));
+    jumpToPass(insn(BPF_JMP | BPF_JGT | BPF_X, BPF_REG_4, BPF_REG_3, 0, 0));                            // udp header past data_end
+    insns.push_back(insn(BPF_LDX | BPF_MEM | BPF_H, BPF_REG_5, BPF_REG_2, 2, 0));                       // udp dest port
+    insns.push_back(insn(BPF_STX | BPF_MEM | BPF_W, BPF_REG_10, BPF_REG_5, -4, 0));
+    insns.push_back(insn(BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_2, BPF_REG_10, 0, 0));
+    insns.push_back(insn(BPF_ALU64 | BPF_ADD | BPF_K, BPF_REG_2, 0, 0, -8));                            // r2 = &PortKey
+    loadMapFd(BPF_REG_1, ports_map_fd_);
+    insns.push_back(insn(BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_map_lookup_elem));
+    jumpToPass(insn(BPF_JMP | BPF_JEQ | BPF_K, BPF_REG_0, 0, 0, 0));                                    // not one of our feeds
+    insns.push_back(insn(BPF_LDX | BPF_MEM | BPF_W, BPF_REG_2, BPF_REG_6, offsetof(xdp_md, rx_queue_index), 0));
+    loadMapFd(BPF_REG_1, xsks_map_fd_);
+    insns.push_back(insn(BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_3, 0, 0, XDP_PASS));
+    insns.push_back(insn(BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_redirect_map));
+    insns.push_back(insn(BPF_JMP | BPF_EXIT, 0, 0, 0, 0));
+    const auto pass = insns.size();
+    insns.push_back(insn(BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_0, 0, 0, XDP_PASS));
+    insns.push_back(insn(BPF_JMP | BPF_EXIT, 0, 0, 0, 0));
+    for (auto jump : jumps_to_pass)
+      insns[jump].off = static_cast<int16_t>(pass - jump - 1);
+
+    static char verifier_log[16 * 1024];
+    static const char license[] = "GPL";
+    bpf_attr prog_attr{};
+    prog_attr.prog_type = BPF_PROG_TYPE_XDP;
+    prog_attr.insns = reinterpret_cast<uint64_t>(insns.data());
+    prog_attr.insn_cnt = static_cast<uint32_t>(insns.size());
+    prog_attr.license = reinterpret_cast<uint64_t>(license);
+    prog_attr.log_buf = reinterpret_cast<uint64_t>(verifier_log);
+    prog_attr.log_size = sizeof(verifier_log);
+    prog_attr.log_level = 1;
+    prog_fd_ = bpf(BPF_PROG_LOAD, prog_attr);
+    if (prog_fd_ < 0)
+    {
+      logger_.log("%:% %() % verifier log:\n%\n", __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str_), verifier_log);
+      return fail("BPF_PROG_LOAD");
+    }
+
+    // no mode flags - native XDP if the driver has it, generic (skb) XDP otherwise, e.g. on loopback and veth.
+    bpf_attr link_attr{};
+    link_attr.link_create.prog_fd = static_cast<uint32_t>(prog_fd_);
+    link_attr.link_create.target_ifindex = static_cast<uint32_t>(ifindex_);
+    link_attr.link_create.attach_type = BPF_XDP;
+    link_fd_ = bpf(BPF_LINK_CREATE, link_attr);
+    if (link_fd_ < 0)
+      return fail("BPF_LINK_CREATE (another XDP program on the interface?)");
+    return true;
+  }
+
+  auto XdpSocket::addPort(const std::string &ip, int port, std::function<void(char *data, size_t len)> handler) -> void
+  {
+    removePort(ip, port);
+    port_handlers_.push_back({inet_addr(ip.c_str()), static_cast<uint16_t>(port), std::move(handler)});
+    ASSERT(port_handlers_.size() <= XDP_MAX_PORTS, "Too many ports on XdpSocket iface:" + iface_);
+    const PortKey key{inet_addr(ip.c_str()), htons(static_cast<uint16_t>(port))};
+    ASSERT(updateMap(ports_map_fd_, &key, 1), "XDP ports map update failed ip:" + ip + " port:" + std::to_string(port) +
+           " error:" + std::string(std::strerror(errno)));
+  }
+
+  auto XdpSocket::removePort(const std::string &ip, int port) -> void
+  {
+    const PortKey key{inet_addr(ip.c_str()), htons(static_cast<uint16_t>(port))};
+    const auto itr = std::find_if(port_handlers_.begin(), port_handlers_.end(),
+                                  [&key, port](const auto &entry) { return entry.ip_ == key.ip_ && entry.port_ == port; });
+    if (itr == port_handlers_.end())
+      return;
+    port_handlers_.erase(itr);
+
+    bpf_attr attr{};
+    attr.map_fd = ports_map_fd_;
+    attr.key = reinterpret_cast<uint64_t>(&key);
+    bpf(BPF_MAP_DELETE_ELEM, attr);
+  }
+
+  auto XdpSocket::poll() noexcept -> bool
+  {
+    ++polls_;
+    const auto rx_consumer = *rx_ring_.consumer_;
+    const auto rx_producer = std::atomic_ref<uint32_t>(*rx_ring_.producer_).load(std::memory_order_acquire);
+    if (rx_consumer == rx_producer)
+    {
+      // drivers that stop when the fill ring ran dry ask to be kicked, never the case in copy mode with every frame in the fill ring.
+      if (UNLIKELY(std::atomic_ref<uint32_t>(*fill_ring_.flags_).load(std::memory_order_relaxed) & XDP_RING_NEED_WAKEUP))
+      {
+        recvfrom(xsk_fd_, nullptr, 0, MSG_DONTWAIT, nullptr, nullptr);
+        ++wakeups_;
+      }
+      return false;
+    }
+
+    const auto rx_descs = static_cast<const xdp_desc *>(rx_ring_.descs_);
+    const auto fill_descs = static_cast<uint64_t *>(fill_ring_.descs_);
+    auto fill_producer = *fill_ring_.producer_;
+    for (auto i = rx_consumer; i != rx_producer; ++i)
+    {
+      const auto &desc = rx_descs[i & rx_ring_.mask_];
+      const auto frame = umem_ + desc.addr;
+
+      // the XDP program already checked the ethertype, IP version, header length, fragment offset and protocol - the UDP header starts
+      // wherever IHL puts it.
+      const auto ip = reinterpret_cast<const uint8_t *>(frame) + ETH_HEADER_SIZE;
+      const size_t payload_offset = ETH_HEADER_SIZE + (ip[0] & 0x0f) * 4 + UDP_HEADER_SIZE;
+      const auto udp = reinterpret_cast<const uint8_t *>(frame) + payload_offset - UDP_HEADER_SIZE;
+      uint32_t ip_dest;
+      memcpy(&ip_dest, ip + 16, sizeof(ip_dest));
+      const uint16_t port = (udp[2] << 8) | udp[3];
+      const size_t udp_len = (udp[4] << 8) | udp[5];
+      const auto itr = std::find_if(port_handlers_.begin(), port_handlers_.end(),
+                                    [ip_dest, port](const auto &entry) { return entry.ip_ == ip_dest && entry.port_ == port; });
+      if (LIKELY(desc.len >= payload_offset && udp_len >= UDP_HEADER_SIZE && udp_len - UDP_HEADER_SIZE <= desc.len - payload_offset &&
+                 itr != port_handlers_.end()))
+      {
+        // frames shorter than the Ethernet minimum are padded, the payload length comes from the UDP header.
+        itr->handler_(frame + payload_offset, udp_len - UDP_HEADER_SIZE);
+      } else
+      {
+        ++dropped_frames_;
+      }
+
+      fill_descs[fill_producer++ & fill_ring_.mask_] = desc.addr & ~static_cast<uint64_t>(XDP_FRAME_SIZE - 1);
+    }
+    std::atomic_ref<uint32_t>(*rx_ring_.consumer_).store(rx_producer, std::memory_order_release);
+    std::atomic_ref<uint32_t>(*fill_ring_.producer_).store(fill_producer, std::memory_order_release);
+    frames_ += rx_producer - rx_consumer;
+    return true;
+  }
+
+  auto XdpSocket::toString() const -> std::string
+  {
+    return "XdpSocket[" + iface_ + " zero_copy:" + std::to_string(zero_copy_) + " polls:" + std::to_string(polls_) + " frames:" +
+           std::to_string(frames_) + " dropped:" + std::to_string(dropped_frames_) + " wakeups:" + std::to_string(wakeups_) + "]";
+  }
+}
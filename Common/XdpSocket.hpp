@@ -0,0 +1,148 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <linux/if_xdp.h>
+
+#include "Macros.hpp"
+#include "Logging.hpp"
+
+namespace Common
+{
+  /// How multicast market data is received.
+  enum class McastRxType : int8_t {
+    INVALID = 0,
+    SOCKET = 1, // non-blocking recv() on each joined UDP socket, every packet through the kernel's IP / UDP stack.
+    XDP = 2,    // an XDP program redirects the feed's UDP ports into an AF_XDP socket's UMEM, headers are parsed in user space.
+    MAX = 3
+  };
+
+  inline auto mcastRxTypeToString(McastRxType type) -> std::string {
+    switch (type) {
+      case McastRxType::SOCKET:
+        return "SOCKET";
+      case McastRxType::XDP:
+        return "XDP";
+      case McastRxType::INVALID:
+        return "INVALID";
+      case McastRxType::MAX:
+        return "MAX";
+    }
+    return "UNKNOWN";
+  }
+
+  inline auto stringToMcastRxType(const std::string &str) -> McastRxType
+  {
+    for (auto i = static_cast<int>(McastRxType::INVALID); i <= static_cast<int>(McastRxType::MAX); ++i)
+    {
+      const auto type = static_cast<McastRxType>(i);
+      if (mcastRxTypeToString(type) == str)
+        return type;
+    }
+    return McastRxType::INVALID;
+  }
+
+  /// UMEM frames and ring sizes, all powers of 2. Frames go straight back to the fill ring once their payload has been handed out.
+  constexpr uint32_t XDP_NUM_FRAMES = 4096;
+  constexpr uint32_t XDP_FRAME_SIZE = 2048;
+  constexpr uint32_t XDP_RX_RING_SIZE = 2048;
+  /// The socket binds to a single rx queue - on a multi-queue NIC steer the feed's ports to it, e.g. with an ethtool ntuple rule.
+  constexpr uint32_t XDP_QUEUE_ID = 0;
+  constexpr uint32_t XDP_MAX_PORTS = 64;
+
+  /// AF_XDP receive socket on one interface queue, with the XDP program that feeds it. The program redirects untagged IPv4 UDP frames
+  /// whose destination address and port were added with addPort() into the socket and passes everything else on to the kernel, so the
+  /// rest of the traffic on the interface - other groups on the same port included - is unaffected.
+  /// poll() parses the Ethernet / IP / UDP headers of each received frame and hands the UDP payload, still in the UMEM frame, to the
+  /// port's handler - the only copy is the kernel's into the UMEM in copy mode (generic XDP on veth / loopback), none in zero-copy mode.
+  /// An interface queue has a single AF_XDP socket, so only one process on the box can receive a given feed this way and the frames it
+  /// takes never reach anyone else's UDP sockets.
+  class XdpSocket final
+  {
+  public:
+    explicit XdpSocket(Logger &logger)
+        : logger_(logger) {}
+
+    ~XdpSocket();
+
+    /// Create the UMEM and the socket, bind it to iface (zero-copy if the driver can, copy mode otherwise) and attach the XDP program.
+    /// Returns false, with the reason logged, if any of it is not supported here - the caller falls back to plain sockets then.
+    auto init(const std::string &iface) -> bool;
+
+    /// Start redirecting UDP frames for multicast group ip and port into this socket, their payloads go to handler from poll(). Data is
+    /// only valid for the duration of the call.
+    auto addPort(const std::string &ip, int port, std::function<void(char *data, size_t len)> handler) -> void;
+
+    /// Frames for ip and port go back to the kernel's UDP stack.
+    auto removePort(const std::string &ip, int port) -> void;
+
+    /// Dispatch every frame received since the last call, returns whether there were any.
+    auto poll() noexcept -> bool;
+
+    /// Counters since init(), read them from the polling thread or after it has exited.
+    auto toString() const -> std::string;
+
+    // Deleted default, copy & move constructors and assignment-operators.
+    XdpSocket() = delete;
+
+    XdpSocket(const XdpSocket &) = delete;
+
+    XdpSocket(const XdpSocket &&) = delete;
+
+    XdpSocket &operator=(const XdpSocket &) = delete;
+
+    XdpSocket &operator=(const XdpSocket &&) = delete;
+
+  private:
+    auto fail(const std::string &what) -> bool;
+
+    auto loadProgram() -> bool;
+
+    /// Producer / consumer / flags and descriptors of one of the socket's mmap()ed rings.
+    struct Ring
+    {
+      void *map_ = nullptr;
+      size_t map_size_ = 0;
+      uint32_t *producer_ = nullptr;
+      uint32_t *consumer_ = nullptr;
+      uint32_t *flags_ = nullptr;
+      void *descs_ = nullptr;
+      uint32_t mask_ = 0;
+    };
+
+    auto mapRing(Ring &ring, const xdp_ring_offset &offsets, uint32_t size, size_t desc_size, off_t pgoff) -> bool;
+
+    struct PortHandler
+    {
+      uint32_t ip_ = 0;   // network byte order.
+      uint16_t port_ = 0; // host byte order.
+      std::function<void(char *data, size_t len)> handler_;
+    };
+
+    std::string iface_;
+    int ifindex_ = 0;
+    int xsk_fd_ = -1;
+    bool zero_copy_ = false;
+
+    char *umem_ = nullptr;
+    Ring fill_ring_, completion_ring_, rx_ring_;
+
+    int xsks_map_fd_ = -1;
+    int ports_map_fd_ = -1;
+    int prog_fd_ = -1;
+    int link_fd_ = -1;
+
+    std::vector<PortHandler> port_handlers_;
+
+    uint64_t polls_ = 0;
+    uint64_t frames_ = 0;
+    uint64_t dropped_frames_ = 0; // redirected to us but not a UDP frame for a group and port with a handler, e.g. right after removePort().
+    uint64_t wakeups_ = 0;
+
+    std::string time_str_;
+    Logger &logger_;
+  };
+}
@@ -5,7 +5,8 @@
 #include "OrderServer/OrderServer.hpp"
 
 Common::Logger *logger = nullptr;
-Exchange::MatchingEngine *matching_engine = nullptr;
+std::vector<Exchange::MatchingEngine *> matching_engines;
+std::vector<Exchange::MEJournal *> journals;
 Exchange::MarketDataPublisher *market_data_publisher = nullptr;
 Exchange::OrderServer *order_server = nullptr;
 
@@ -16,8 +17,16 @@ void signal_handler(int)
 
   delete logger;
   logger = nullptr;
-  delete matching_engine;
-  matching_engine = nullptr;
+  for (auto &matching_engine : matching_engines) 
+  {
+    delete matching_engine;
+    matching_engine = nullptr;
+  }
+  for (auto &journal : journals) 
+  {
+    delete journal;
+    journal = nullptr;
+  }
   delete market_data_publisher;
   market_data_publisher = nullptr;
   delete order_server;
@@ -30,37 +39,214 @@ void signal_handler(int)
 
 int main(int, char **) 
 {
+  // ANCHOR_HUGE_PAGES=OFF|2M|1G picks the largest page size the pools, queues, order books and socket buffers are put on, falling back to
+  // smaller ones when the hugetlb pool runs out. ANCHOR_MLOCK=1 also locks them in memory. ANCHOR_SNAPSHOT_DIR (see below) keeps everything on
+  // transparent huge pages - the snapshot child reads the books copy-on-write and would get SIGBUS on hugetlb pages once the pool runs dry.
+  // Has to be set before anything allocates, the logger included.
+  Common::HugePageCfg huge_page_cfg;
+  const auto huge_pages_env = std::getenv("ANCHOR_HUGE_PAGES");
+  if (huge_pages_env)
+    huge_page_cfg.mode_ = Common::stringToHugePageMode(huge_pages_env);
+  ASSERT(huge_page_cfg.mode_ != Common::HugePageMode::INVALID && huge_page_cfg.mode_ != Common::HugePageMode::MAX,
+         "Invalid ANCHOR_HUGE_PAGES:" + std::string(huge_pages_env ? huge_pages_env : ""));
+  const auto mlock_env = std::getenv("ANCHOR_MLOCK");
+  huge_page_cfg.lock_ = (mlock_env && std::atoi(mlock_env));
+  huge_page_cfg.fork_safe_ = (std::getenv("ANCHOR_SNAPSHOT_DIR") != nullptr);
+  Common::setHugePageCfg(huge_page_cfg);
+
+  // ANCHOR_PLACEMENT=<thread name prefix>=<cpu>,... moves threads off their default cpus, e.g.
+  // "Exchange/MatchingEngine_0=8,Exchange/OrderServer=10,Common/Logger=-1". Every queue is bound to the NUMA node of the thread reading it
+  // and every component's books, pools and buffers to the node of its own thread.
+  const auto placement_env = std::getenv("ANCHOR_PLACEMENT");
+  if (placement_env)
+    Common::setThreadPlacement(placement_env);
+
+  // ANCHOR_WAIT_STRATEGY=<thread name prefix>=<BUSY_SPIN|SPIN_YIELD|SPIN_PARK>,... picks how each polling thread waits when idle, same thread
+  // names. The matching engines, order server and publisher busy spin by default, the snapshot synthesizer and the loggers park.
+  const auto wait_strategy_env = std::getenv("ANCHOR_WAIT_STRATEGY");
+  if (wait_strategy_env)
+    Common::setWaitStrategies(wait_strategy_env);
+
+  // ANCHOR_REACTOR=<thread name prefix>=<budget>,... moves components off their own threads into a single reactor thread that polls them
+  // in turn, e.g. "Exchange/SnapshotSynthesizer=4,Common/Logger=1" leaves the matching engines, order server and publisher on their cores
+  // and runs the rest on one. The order server and publisher can join too, a reactor holding them should busy spin
+  // ("Common/Reactor=BUSY_SPIN" in ANCHOR_WAIT_STRATEGY) - a parked one makes the matching engines wake it. The matching engines always
+  // keep their own threads.
+  const auto reactor_env = std::getenv("ANCHOR_REACTOR");
+  if (reactor_env)
+    Common::setReactorComponents(reactor_env);
+
   logger = new Common::Logger("exchange_main.log");
 
   std::signal(SIGINT, signal_handler);
 
   const int sleep_time = 100 * 1000;
 
-  Exchange::ClientRequestLFQueue client_requests(ME_MAX_CLIENT_UPDATES);
-  Exchange::ClientResponseLFQueue client_responses(ME_MAX_CLIENT_UPDATES);
-  Exchange::MEMarketUpdateLFQueue market_updates(ME_MAX_MARKET_UPDATES);
-
   std::string time_str;
 
-  logger->log("%:% %() % Starting Matching Engine...\n", __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str));
-  matching_engine = new Exchange::MatchingEngine(&client_requests, &client_responses, &market_updates);
-  matching_engine->start();
+  // ANCHOR_MATCHING_SHARDS=N splits the tickers across N matching engine threads, ticker_id % N picks the shard.
+  const auto shards_env = std::getenv("ANCHOR_MATCHING_SHARDS");
+  const size_t num_shards = (shards_env ? std::atoi(shards_env) : 1);
+  ASSERT(num_shards >= 1 && num_shards <= ME_MAX_MATCHING_SHARDS,
+         "ANCHOR_MATCHING_SHARDS has to be between 1 and " + std::to_string(ME_MAX_MATCHING_SHARDS));
+
+  // ANCHOR_AGGREGATE_TRADES=1 publishes one TRADE per price level swept instead of one per resting order traded against.
+  MatchingEngineCfg matching_engine_cfg;
+  const auto aggregate_trades_env = std::getenv("ANCHOR_AGGREGATE_TRADES");
+  matching_engine_cfg.aggregate_trades_ = (aggregate_trades_env && std::atoi(aggregate_trades_env));
+  // ANCHOR_STP_MODE=NONE|CANCEL_NEWEST|CANCEL_OLDEST|DECREMENT_BOTH picks the self-trade prevention mode.
+  const auto stp_mode_env = std::getenv("ANCHOR_STP_MODE");
+  if (stp_mode_env)
+    matching_engine_cfg.stp_mode_ = stringToSTPMode(stp_mode_env);
+  ASSERT(matching_engine_cfg.stp_mode_ != STPMode::INVALID && matching_engine_cfg.stp_mode_ != STPMode::MAX,
+         "Invalid ANCHOR_STP_MODE:" + std::string(stp_mode_env ? stp_mode_env : ""));
+  logger->log("%:% %() % %\n", __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str), matching_engine_cfg.toString());
+
+  // ANCHOR_CLIENT_MAX_ORDER_SIZE / ANCHOR_CLIENT_MAX_NOTIONAL limit every single order and ANCHOR_CLIENT_MAX_MSG_RATE (per second) /
+  // ANCHOR_CLIENT_MAX_MSG_BURST throttle every client's requests, all in the order server and unlimited when not set.
+  ClientRiskCfg client_risk_cfg;
+  const auto client_max_order_size_env = std::getenv("ANCHOR_CLIENT_MAX_ORDER_SIZE");
+  if (client_max_order_size_env)
+    client_risk_cfg.max_order_size_ = static_cast<Quantity>(std::atoi(client_max_order_size_env));
+  const auto client_max_notional_env = std::getenv("ANCHOR_CLIENT_MAX_NOTIONAL");
+  if (client_max_notional_env)
+    client_risk_cfg.max_notional_ = std::atof(client_max_notional_env);
+  const auto client_max_msg_rate_env = std::getenv("ANCHOR_CLIENT_MAX_MSG_RATE");
+  if (client_max_msg_rate_env)
+    client_risk_cfg.max_messages_per_sec_ = std::atof(client_max_msg_rate_env);
+  const auto client_max_msg_burst_env = std::getenv("ANCHOR_CLIENT_MAX_MSG_BURST");
+  if (client_max_msg_burst_env)
+    client_risk_cfg.max_message_burst_ = std::atof(client_max_msg_burst_env);
+  logger->log("%:% %() % %\n", __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str), client_risk_cfg.toString());
+  logger->log("%:% %() % % placement:%\n", __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str),
+              Common::cpuTopology().toString(), (placement_env ? placement_env : "default"));
+
+  // ANCHOR_JOURNAL_DIR turns on the matching engine journal, every shard writes its own segments for this session into that directory.
+  // ANCHOR_JOURNAL_SYNC=NONE|ASYNC|SYNC and ANCHOR_JOURNAL_SYNC_INTERVAL_MS pick how often and how journal pages are pushed to disk.
+  const auto journal_dir_env = std::getenv("ANCHOR_JOURNAL_DIR");
+  const auto journal_sync_env = std::getenv("ANCHOR_JOURNAL_SYNC");
+  const auto journal_sync_policy = Exchange::stringToJournalSyncPolicy(journal_sync_env ? journal_sync_env : "ASYNC");
+  const auto journal_sync_interval_env = std::getenv("ANCHOR_JOURNAL_SYNC_INTERVAL_MS");
+  const Nanos journal_sync_interval = (journal_sync_interval_env ? std::atoi(journal_sync_interval_env) : 10) * NANOS_TO_MILLIS;
+  const auto journal_session = std::to_string(Common::getCurrentNanos());
+
+  // ANCHOR_SNAPSHOT_DIR turns on warm restarts - every shard recovers from its latest snapshot plus the journal tail on startup and then
+  // writes a snapshot every ANCHOR_SNAPSHOT_INTERVAL_S seconds (0 for only the one taken after recovery). Needs ANCHOR_JOURNAL_DIR.
+  const auto snapshot_dir_env = std::getenv("ANCHOR_SNAPSHOT_DIR");
+  const std::string snapshot_dir = (snapshot_dir_env ? snapshot_dir_env : "");
+  ASSERT(snapshot_dir.empty() || journal_dir_env, "ANCHOR_SNAPSHOT_DIR needs ANCHOR_JOURNAL_DIR.");
+  const auto snapshot_interval_env = std::getenv("ANCHOR_SNAPSHOT_INTERVAL_S");
+  const Nanos snapshot_interval = (snapshot_interval_env ? std::atoi(snapshot_interval_env) : 60) * NANOS_TO_SECS;
+
+  Exchange::ClientRequestLFQueues client_requests;
+  Exchange::ClientResponseLFQueues client_responses;
+  Exchange::MEMarketUpdateLFQueues market_updates;
+  // shard 0 keeps the original matching engine core, extra shards go after the cores used by the exchange and a co-located client.
+  const auto matching_engine_core = [](size_t shard_id) { return (shard_id ? 5 + static_cast<int>(shard_id) : 1); };
+  const auto matching_engine_node = [&](size_t shard_id)
+  {
+    return Common::placedNode(Exchange::matchingEngineThreadName(shard_id), matching_engine_core(shard_id));
+  };
+  const auto order_server_node = Common::placedComponentNode(Exchange::ORDER_SERVER_THREAD, Exchange::ORDER_SERVER_CORE);
+  const auto market_data_publisher_node = Common::placedComponentNode(Exchange::MARKET_DATA_PUBLISHER_THREAD, Exchange::MARKET_DATA_PUBLISHER_CORE);
+
+  for (size_t shard_id = 0; shard_id < num_shards; ++shard_id) 
+  {
+    {
+      Common::MemoryNodeScope memory_node(matching_engine_node(shard_id));
+      client_requests.push_back(new Exchange::ClientRequestLFQueue(ME_MAX_CLIENT_UPDATES, "ClientRequestLFQueue"));
+    }
+    {
+      Common::MemoryNodeScope memory_node(order_server_node);
+      client_responses.push_back(new Exchange::ClientResponseLFQueue(ME_MAX_CLIENT_UPDATES, "ClientResponseLFQueue"));
+    }
+    {
+      Common::MemoryNodeScope memory_node(market_data_publisher_node);
+      market_updates.push_back(new Exchange::MEMarketUpdateLFQueue(ME_MAX_MARKET_UPDATES, "MEMarketUpdateLFQueue"));
+    }
+  }
+
+  // ANCHOR_TRANSPORT=SHM switches order entry and market data to shared memory rings for clients running on this box.
+  const auto transport_env = std::getenv("ANCHOR_TRANSPORT");
+  const auto transport_type = Common::stringToTransportType(transport_env ? transport_env : "SOCKET");
+  ASSERT(transport_type == Common::TransportType::SOCKET || transport_type == Common::TransportType::SHM,
+         "Unknown ANCHOR_TRANSPORT:" + std::string(transport_env ? transport_env : ""));
+  logger->log("%:% %() % Using transport:%\n", __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str),
+              Common::transportTypeToString(transport_type));
+
+  // ANCHOR_IO_ENGINE=IO_URING moves TCP order entry from per socket recvmsg() / send() calls to io_uring, falls back to SOCKET when this
+  // kernel does not support what it needs.
+  const auto io_engine_env = std::getenv("ANCHOR_IO_ENGINE");
+  auto io_engine = Common::stringToIoEngineType(io_engine_env ? io_engine_env : "SOCKET");
+  ASSERT(io_engine == Common::IoEngineType::SOCKET || io_engine == Common::IoEngineType::IO_URING,
+         "Unknown ANCHOR_IO_ENGINE:" + std::string(io_engine_env ? io_engine_env : ""));
+  if (io_engine == Common::IoEngineType::IO_URING && !Common::IoUring::supported()) 
+  {
+    logger->log("%:% %() % io_uring not available, falling back to SOCKET\n", __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str));
+    io_engine = Common::IoEngineType::SOCKET;
+  }
+  logger->log("%:% %() % Using io engine:%\n", __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str),
+              Common::ioEngineTypeToString(io_engine));
 
   const std::string mkt_pub_iface = "lo";
   const std::string snap_pub_ip = "233.252.14.1", inc_pub_ip = "233.252.14.3";
   const int snap_pub_port = 20000, inc_pub_port = 20001;
 
-  logger->log("%:% %() % Starting Market Data Publisher...\n", __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str));
-  market_data_publisher = new Exchange::MarketDataPublisher(&market_updates, mkt_pub_iface, snap_pub_ip, snap_pub_port, inc_pub_ip, inc_pub_port);
-  market_data_publisher->start();
-
   const std::string order_gw_iface = "lo";
   const int order_gw_port = 12345;
 
+  // The matching engine shards, the market data publisher and the order server only share the queues, so they are constructed in
+  // parallel - most of that time goes into pre-faulting their loggers, pools and socket buffers. Each one on a thread of its own, for its
+  // MemoryNodeScope. logger is not thread safe, so only this thread logs.
+  matching_engines.assign(num_shards, nullptr);
+  journals.assign(num_shards, nullptr);
+  std::vector<std::thread> constructors;
+  for (size_t shard_id = 0; shard_id < num_shards; ++shard_id) 
+  {
+    constructors.emplace_back([&, shard_id]()
+    {
+      Common::MemoryNodeScope memory_node(matching_engine_node(shard_id));
+      if (journal_dir_env) 
+      {
+        const auto journal_prefix = std::string(journal_dir_env) + "/me_journal_" + journal_session + "_" + std::to_string(shard_id);
+        journals[shard_id] = new Exchange::MEJournal(journal_prefix, shard_id, num_shards, matching_engine_cfg, journal_sync_policy,
+                                                     journal_sync_interval);
+        journals[shard_id]->start();
+      }
+      matching_engines[shard_id] = new Exchange::MatchingEngine(client_requests[shard_id], client_responses[shard_id], market_updates[shard_id],
+                                                                shard_id, num_shards, matching_engine_core(shard_id), matching_engine_cfg,
+                                                                journals[shard_id], snapshot_dir, snapshot_interval);
+    });
+  }
+  constructors.emplace_back([&]()
+  {
+    Common::MemoryNodeScope memory_node(market_data_publisher_node);
+    market_data_publisher = new Exchange::MarketDataPublisher(market_updates, mkt_pub_iface, snap_pub_ip, snap_pub_port, inc_pub_ip, inc_pub_port, transport_type);
+  });
+  constructors.emplace_back([&]()
+  {
+    Common::MemoryNodeScope memory_node(order_server_node);
+    order_server = new Exchange::OrderServer(client_requests, client_responses, order_gw_iface, order_gw_port, transport_type, io_engine,
+                                             client_risk_cfg);
+  });
+  for (auto &constructor : constructors)
+    constructor.join();
+
+  for (size_t shard_id = 0; shard_id < num_shards; ++shard_id) 
+  {
+    logger->log("%:% %() % Starting Matching Engine shard:% of:% on core:%...\n", __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str),
+                shard_id, num_shards, Common::placedCpu(Exchange::matchingEngineThreadName(shard_id), matching_engine_core(shard_id)));
+    matching_engines[shard_id]->start();
+  }
+
+  logger->log("%:% %() % Starting Market Data Publisher...\n", __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str));
+  market_data_publisher->start();
+
   logger->log("%:% %() % Starting Order Server...\n", __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str));
-  order_server = new Exchange::OrderServer(&client_requests, &client_responses, order_gw_iface, order_gw_port);
   order_server->start();
 
+  logger->log("%:% %() % Memory backing %", __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str), Common::hugePageReport());
+
   while (true) 
   {
     logger->log("%:% %() % Sleeping for a few milliseconds..\n", __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str));
@@ -0,0 +1,142 @@
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+
+#include "Matcher/MatchingEngine.hpp"
+#include "Matcher/MEJournal.hpp"
+
+/// Replays one matching engine shard's journal straight into a MatchingEngine, without the order server, the sequencer or market data.
+/// Usage: MEJournalReplay <journal-prefix> [MAX|PACED] [output-file], e.g. MEJournalReplay /data/journal/me_journal_<session>_<shard> MAX
+///
+/// MAX feeds the requests back to back, PACED reproduces the gaps between them as the original matching engine saw them.
+/// The requests go through a MatchingEngine configured exactly like the one that wrote the journal, which is never started - the rebuilt
+/// books end up in exchange_matching_engine_<shard>.log when it is destroyed, same as on a clean exchange shutdown.
+/// A journal written after a warm restart starts from the snapshot its header names, which is restored first. Without that snapshot the
+/// replay would match against the wrong books, so it refuses to run.
+///
+/// Every client response and market update is folded into a hash, two replays of the same journal have to print the same hash and
+/// a matching change that moves it changed behaviour. With an output-file every output is also written there for diffing.
+/// Reports throughput and the latency of every request - processClientRequest() plus publishing its outputs.
+
+/// FNV-1a, over the bytes of the packed output structs.
+auto hashBytes(uint64_t hash, const void *data, size_t size) noexcept
+{
+  const auto bytes = static_cast<const uint8_t *>(data);
+  for (size_t i = 0; i < size; ++i)
+  {
+    hash ^= bytes[i];
+    hash *= 0x100000001b3;
+  }
+  return hash;
+}
+
+int main(int argc, char **argv)
+{
+  if (argc < 2 || argc > 4)
+    FATAL("USAGE MEJournalReplay <journal-prefix> [MAX|PACED] [output-file]");
+
+  const std::string pacing = (argc > 2 ? argv[2] : "MAX");
+  ASSERT(pacing == "MAX" || pacing == "PACED", "Unknown pacing:" + pacing);
+  const auto paced = (pacing == "PACED");
+
+  std::ofstream output_file;
+  if (argc > 3)
+  {
+    output_file.open(argv[3]);
+    ASSERT(output_file.is_open(), "Could not open output file:" + std::string(argv[3]));
+  }
+
+  Exchange::MEJournalReader journal_reader(argv[1]);
+  const auto header = journal_reader.header();
+  ASSERT(header != nullptr, "No journal found at:" + std::string(argv[1]));
+
+  std::cout << "Replaying journal:" << argv[1] << " shard:" << header->shard_id_ << " of:" << header->num_shards_
+            << " " << header->cfg_.toString() << " pacing:" << pacing << std::endl;
+
+  Exchange::ClientRequestLFQueue client_requests(ME_MAX_CLIENT_UPDATES);
+  Exchange::ClientResponseLFQueue client_responses(ME_MAX_CLIENT_UPDATES);
+  Exchange::MEMarketUpdateLFQueue market_updates(ME_MAX_MARKET_UPDATES);
+
+  auto matching_engine = new Exchange::MatchingEngine(&client_requests, &client_responses, &market_updates,
+                                                      header->shard_id_, header->num_shards_, -1, header->cfg_, nullptr, "", 0);
+
+  const std::string start_snapshot = header->start_snapshot_;
+  if (start_snapshot.empty())
+  {
+    std::cout << "Starting from empty books." << std::endl;
+  } else
+  {
+    ASSERT(std::filesystem::exists(start_snapshot), "Journal:" + std::string(argv[1]) + " is of a warm restarted session, it starts from " +
+                                                    "snapshot:" + start_snapshot + " which is gone - can not replay it against the right books.");
+    const auto snapshot_header = matching_engine->restoreSnapshot(start_snapshot);
+    ASSERT(snapshot_header.journal_seq_ == 0, "Snapshot:" + start_snapshot + " is not from before the first request of this journal.");
+    std::cout << "Starting from snapshot:" << start_snapshot << " orders:" << snapshot_header.num_orders_ << std::endl;
+  }
+
+  std::vector<uint64_t> cycles;
+  size_t num_responses = 0, num_market_updates = 0;
+  uint64_t hash = 0xcbf29ce484222325;
+  Nanos first_record_time = 0, replay_start_time = 0;
+
+  const auto start_time = Common::getCurrentNanos();
+  const auto start_cycles = Common::rdtsc();
+  for (auto record = journal_reader.next(); record; record = journal_reader.next())
+  {
+    if (paced)
+    {
+      if (!first_record_time)
+      {
+        first_record_time = record->time_;
+        replay_start_time = Common::getCurrentNanos();
+      }
+      while (Common::getCurrentNanos() - replay_start_time < record->time_ - first_record_time);
+    }
+
+    const auto request_start = Common::rdtsc();
+    matching_engine->processClientRequest(&record->request_);
+    matching_engine->publishOutputs();
+    cycles.push_back(Common::rdtsc() - request_start);
+
+    for (auto client_response = client_responses.getNextToRead(); client_responses.size() && client_response;
+         client_response = client_responses.getNextToRead())
+    {
+      hash = hashBytes(hash, client_response, sizeof(*client_response));
+      if (output_file.is_open())
+        output_file << client_response->toString() << "\n";
+      ++num_responses;
+      client_responses.updateReadIndex();
+    }
+    for (auto market_update = market_updates.getNextToRead(); market_updates.size() && market_update;
+         market_update = market_updates.getNextToRead())
+    {
+      hash = hashBytes(hash, market_update, sizeof(*market_update));
+      if (output_file.is_open())
+        output_file << market_update->toString() << "\n";
+      ++num_market_updates;
+      market_updates.updateReadIndex();
+    }
+  }
+  const auto elapsed = Common::getCurrentNanos() - start_time;
+  const auto elapsed_cycles = Common::rdtsc() - start_cycles;
+
+  delete matching_engine;
+
+  std::cout << "Replayed requests:" << cycles.size() << " last-seq:" << journal_reader.lastSeq()
+            << " client-responses:" << num_responses << " market-updates:" << num_market_updates << std::endl;
+  std::cout << "Output hash:" << std::hex << hash << std::dec << std::endl;
+
+  if (cycles.empty())
+    return 0;
+
+  // rdtsc cycles are converted to nanoseconds with the rate measured over the whole replay.
+  const auto nanos_per_cycle = static_cast<double>(elapsed) / static_cast<double>(elapsed_cycles);
+  std::sort(cycles.begin(), cycles.end());
+  const auto percentile = [&](double p) { return static_cast<uint64_t>(cycles[static_cast<size_t>(p * (cycles.size() - 1))] * nanos_per_cycle); };
+
+  std::cout << "Elapsed:" << elapsed / NANOS_TO_MILLIS << "ms"
+            << " requests/sec:" << static_cast<uint64_t>(cycles.size() * static_cast<double>(NANOS_TO_SECS) / elapsed) << std::endl;
+  std::cout << "Latency ns p50:" << percentile(0.5) << " p90:" << percentile(0.9) << " p99:" << percentile(0.99)
+            << " p99.9:" << percentile(0.999) << " max:" << percentile(1.0) << std::endl;
+
+  return 0;
+}
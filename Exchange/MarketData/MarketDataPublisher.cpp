@@ -1,41 +1,68 @@
 #include "MarketDataPublisher.hpp"
 #include "../../Common/PerfUtils.hpp"
 
+#include <algorithm>
+
 namespace Exchange 
 {
-  MarketDataPublisher::MarketDataPublisher(MEMarketUpdateLFQueue *market_updates, const std::string &iface,
+  MarketDataPublisher::MarketDataPublisher(const MEMarketUpdateLFQueues &market_updates, const std::string &iface,
                                            const std::string &snapshot_ip, int snapshot_port,
-                                           const std::string &incremental_ip, int incremental_port)
+                                           const std::string &incremental_ip, int incremental_port,
+                                           TransportType transport_type)
       : outgoing_md_updates_(market_updates)
       , snapshot_md_updates_(ME_MAX_MARKET_UPDATES)
       , run_(false)
+      , wait_strategy_(Common::waitStrategyType(MARKET_DATA_PUBLISHER_THREAD, Common::WaitStrategyType::BUSY_SPIN))
       , logger_("exchange_market_data_publisher.log")
+      , transport_type_(transport_type)
       , incremental_socket_(logger_) 
   {
-    ASSERT(incremental_socket_.init(incremental_ip, iface, incremental_port, /*is_listening*/ false) >= 0,
-           "Unable to create incremental mcast socket. error:" + std::string(std::strerror(errno)));
-    snapshot_synthesizer_ = new SnapshotSynthesizer(&snapshot_md_updates_, iface, snapshot_ip, snapshot_port);
+    if (transport_type_ == TransportType::SHM) 
+    {
+      shm_incremental_updates_ = new ShmMDPMarketUpdateQueue(shmIncrementalQueueName(), SHM_MARKET_UPDATE_QUEUE_SIZE, /*create*/ true);
+    } else 
+    {
+      ASSERT(incremental_socket_.init(incremental_ip, iface, incremental_port, /*is_listening*/ false) >= 0,
+             "Unable to create incremental mcast socket. error:" + std::string(std::strerror(errno)));
+    }
+    snapshot_synthesizer_ = new SnapshotSynthesizer(&snapshot_md_updates_, iface, snapshot_ip, snapshot_port, transport_type_);
+
+    for (auto market_updates : outgoing_md_updates_)
+      market_updates->setConsumerWaitStrategy(&Common::componentWaitStrategy(MARKET_DATA_PUBLISHER_THREAD, wait_strategy_));
   }
 
-  auto MarketDataPublisher::run() noexcept -> void 
+  auto MarketDataPublisher::poll() noexcept -> bool
   {
-    logger_.log("%:% %() %\n", __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str_));
-    while (run_) 
+    bool did_work = false;
+    // merge the updates from all the matching engine shards into the single incremental stream, this is where the sequence numbers are assigned
+    // so consumers still see one gap-free stream. Updates for any one ticker come from one shard and keep their relative order.
+    for (auto outgoing_md_updates : outgoing_md_updates_) 
     {
-      for (auto market_update = outgoing_md_updates_->getNextToRead();
-           outgoing_md_updates_->size() && market_update; market_update = outgoing_md_updates_->getNextToRead()) 
+      for (auto market_update = outgoing_md_updates->getNextToRead();
+           outgoing_md_updates->size() && market_update; market_update = outgoing_md_updates->getNextToRead()) 
       {
         TTT_MEASURE(T5_MarketDataPublisher_LfQueue_read, logger_);
 
         logger_.log("%:% %() % Sending seq:% %\n", __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str_), next_inc_seq_num_,
                     market_update->toString().c_str());
 
-        START_MEASURE(Exchange_McastSocket_send);
-        incremental_socket_.send(&next_inc_seq_num_, sizeof(next_inc_seq_num_));
-        incremental_socket_.send(market_update, sizeof(MEMarketUpdate));
-        END_MEASURE(Exchange_McastSocket_send, logger_);
-        
-        outgoing_md_updates_->updateReadIndex();
+        if (transport_type_ == TransportType::SHM) 
+        {
+          START_MEASURE(Exchange_ShmBroadcastQueue_write);
+          auto next_shm_write = shm_incremental_updates_->getNextToWriteTo();
+          next_shm_write->seq_num_ = next_inc_seq_num_;
+          next_shm_write->me_market_update_ = *market_update;
+          shm_incremental_updates_->updateWriteIndex();
+          END_MEASURE(Exchange_ShmBroadcastQueue_write, logger_);
+        } else 
+        {
+          START_MEASURE(Exchange_McastSocket_send);
+          incremental_socket_.send(&next_inc_seq_num_, sizeof(next_inc_seq_num_));
+          incremental_socket_.send(market_update, sizeof(MEMarketUpdate));
+          END_MEASURE(Exchange_McastSocket_send, logger_);
+        }
+
+        outgoing_md_updates->updateReadIndex();
         TTT_MEASURE(T6_MarketDataPublisher_UDP_write, logger_);
 
         auto next_write = snapshot_md_updates_.getNextToWriteTo();
@@ -44,10 +71,26 @@ namespace Exchange
         snapshot_md_updates_.updateWriteIndex();
 
         ++next_inc_seq_num_;
+        did_work = true;
       }
+    }
 
+    if (transport_type_ == TransportType::SOCKET)
       incremental_socket_.sendAndRecv();
-    }
+
+    return did_work;
+  }
+
+  auto MarketDataPublisher::hasWork() const noexcept -> bool
+  {
+    return std::any_of(outgoing_md_updates_.begin(), outgoing_md_updates_.end(), [](auto market_updates) { return market_updates->size() != 0; });
   }
-}
 
+  auto MarketDataPublisher::run() noexcept -> void 
+  {
+    logger_.log("%:% %() %\n", __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str_));
+    while (run_) 
+      wait_strategy_.afterPoll(poll(), [this]() { return hasWork(); });
+    logger_.log("%:% %() % %\n", __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str_), wait_strategy_.toString());
+  }
+}
@@ -6,16 +6,23 @@
 
 #include "../../Common/MCastSocket.hpp"
 #include "../../Common/Logging.hpp"
+#include "../../Common/Reactor.hpp"
 #include "SnapshotSynthesizer.hpp"
+#include "ShmMarketData.hpp"
 
 namespace Exchange 
 {
+  /// Thread name and default cpu, ANCHOR_PLACEMENT can move it.
+  constexpr auto MARKET_DATA_PUBLISHER_THREAD = "Exchange/MarketDataPublisher";
+  constexpr int MARKET_DATA_PUBLISHER_CORE = 0;
+
   class MarketDataPublisher 
   {
   public:
-    MarketDataPublisher(MEMarketUpdateLFQueue *market_updates, const std::string &iface,
+    MarketDataPublisher(const MEMarketUpdateLFQueues &market_updates, const std::string &iface,
                         const std::string &snapshot_ip, int snapshot_port,
-                        const std::string &incremental_ip, int incremental_port);
+                        const std::string &incremental_ip, int incremental_port,
+                        TransportType transport_type);
 
     ~MarketDataPublisher() 
     {
@@ -26,13 +33,19 @@ namespace Exchange
 
       delete snapshot_synthesizer_;
       snapshot_synthesizer_ = nullptr;
+
+      delete shm_incremental_updates_;
+      shm_incremental_updates_ = nullptr;
     }
 
     auto start() 
     {
       run_ = true;
 
-      ASSERT(Common::createAndStartThread(0, "Exchange/MarketDataPublisher", [this]() { run(); }) != nullptr, "Failed to start MarketData thread.");
+      if (const auto budget = Common::reactorBudget(MARKET_DATA_PUBLISHER_THREAD))
+        reactor_id_ = Common::reactor().add(MARKET_DATA_PUBLISHER_THREAD, budget, [this]() { return poll(); }, [this]() { return hasWork(); });
+      else
+        ASSERT(Common::createAndStartThread(MARKET_DATA_PUBLISHER_CORE, MARKET_DATA_PUBLISHER_THREAD, [this]() { run(); }) != nullptr, "Failed to start MarketData thread.");
 
       snapshot_synthesizer_->start();
     }
@@ -40,10 +53,26 @@ namespace Exchange
     auto stop() -> void 
     {
       run_ = false;
+      if (reactor_id_)
+      {
+        Common::reactor().remove(reactor_id_);
+        reactor_id_ = 0;
+      } else
+      {
+        wait_strategy_.wakeUp();
+      }
 
       snapshot_synthesizer_->stop();
     }
 
+    /// One pass of the publisher - sends out everything the matching engines queued and hands it to the snapshot synthesizer, returns
+    /// whether there was anything.
+    auto poll() noexcept -> bool;
+
+    /// Whether the matching engines have updates queued, they wake a parked publisher.
+    auto hasWork() const noexcept -> bool;
+
+    /// Main run loop for this thread, unless the publisher runs in the reactor.
     auto run() noexcept -> void;
 
     // Deleted default, copy & move constructors and assignment-operators.
@@ -59,16 +88,23 @@ namespace Exchange
 
   private:
     size_t next_inc_seq_num_ = 1;
-    MEMarketUpdateLFQueue *outgoing_md_updates_ = nullptr;
+
+    /// Lock free queues of market updates from the matching engine, one per shard.
+    const MEMarketUpdateLFQueues outgoing_md_updates_;
 
     MDPMarketUpdateLFQueue snapshot_md_updates_;
 
-    volatile bool run_ = false;
+    std::atomic<bool> run_ = {false};
+    Common::WaitStrategy wait_strategy_;
+    size_t reactor_id_ = 0; // non-zero when poll() runs in the reactor instead of a thread of its own.
 
     std::string time_str_;
     Logger logger_;
 
+    const TransportType transport_type_;
+
     Common::McastSocket incremental_socket_;
+    ShmMDPMarketUpdateQueue *shm_incremental_updates_ = nullptr;
 
     SnapshotSynthesizer *snapshot_synthesizer_ = nullptr;
   };
@@ -96,5 +96,8 @@ namespace Exchange
 
   typedef Common::LFQueue<Exchange::MEMarketUpdate> MEMarketUpdateLFQueue;
   typedef Common::LFQueue<Exchange::MDPMarketUpdate> MDPMarketUpdateLFQueue;
+
+  /// One queue per matching engine shard, indexed by shard id.
+  typedef std::vector<MEMarketUpdateLFQueue *> MEMarketUpdateLFQueues;
 }
 
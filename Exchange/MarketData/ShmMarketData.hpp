@@ -0,0 +1,24 @@
+#pragma once
+
+#include "../../Common/Types.hpp"
+#include "../../Common/ShmQueue.hpp"
+
+#include "MarketUpdate.hpp"
+
+namespace Exchange
+{
+  /// Shared memory market data - one broadcast ring each for the incremental and the snapshot streams, readers keep their own cursors.
+  constexpr size_t SHM_MARKET_UPDATE_QUEUE_SIZE = 256 * 1024;
+
+  typedef Common::ShmBroadcastQueue<MDPMarketUpdate> ShmMDPMarketUpdateQueue;
+
+  inline auto shmIncrementalQueueName() -> std::string
+  {
+    return "/anchor_market_data_incremental";
+  }
+
+  inline auto shmSnapshotQueueName() -> std::string
+  {
+    return "/anchor_market_data_snapshot";
+  }
+}
@@ -3,33 +3,60 @@
 namespace Exchange 
 {
   SnapshotSynthesizer::SnapshotSynthesizer(MDPMarketUpdateLFQueue *market_updates, const std::string &iface,
-                                           const std::string &snapshot_ip, int snapshot_port)
+                                           const std::string &snapshot_ip, int snapshot_port, TransportType transport_type)
       : snapshot_md_updates_(market_updates)
       , logger_("exchange_snapshot_synthesizer.log")
+      , wait_strategy_(Common::waitStrategyType(SNAPSHOT_SYNTHESIZER_THREAD, Common::WaitStrategyType::SPIN_PARK))
+      , transport_type_(transport_type)
       , snapshot_socket_(logger_)
       , order_pool_(ME_MAX_ORDER_IDS) 
   {
-    ASSERT(snapshot_socket_.init(snapshot_ip, iface, snapshot_port, /*is_listening*/ false) >= 0,
-           "Unable to create snapshot mcast socket. error:" + std::string(std::strerror(errno)));
+    if (transport_type_ == TransportType::SHM) 
+    {
+      shm_snapshot_updates_ = new ShmMDPMarketUpdateQueue(shmSnapshotQueueName(), SHM_MARKET_UPDATE_QUEUE_SIZE, /*create*/ true);
+    } else 
+    {
+      ASSERT(snapshot_socket_.init(snapshot_ip, iface, snapshot_port, /*is_listening*/ false) >= 0,
+             "Unable to create snapshot mcast socket. error:" + std::string(std::strerror(errno)));
+    }
     for(auto& orders : ticker_orders_)
       orders.fill(nullptr);
+
+    // the publisher pays for a futex wakeup when it writes into a parked synthesizer's queue, after its own send has gone out.
+    snapshot_md_updates_->setConsumerWaitStrategy(&Common::componentWaitStrategy(SNAPSHOT_SYNTHESIZER_THREAD, wait_strategy_));
   }
 
   SnapshotSynthesizer::~SnapshotSynthesizer() 
   {
     stop();
+
+    delete shm_snapshot_updates_;
+    shm_snapshot_updates_ = nullptr;
   }
 
   void SnapshotSynthesizer::start() 
   {
     run_ = true;
-    ASSERT(Common::createAndStartThread(-1, "Exchange/SnapshotSynthesizer", [this]() { run(); }) != nullptr,
+    if (const auto budget = Common::reactorBudget(SNAPSHOT_SYNTHESIZER_THREAD))
+    {
+      reactor_id_ = Common::reactor().add(SNAPSHOT_SYNTHESIZER_THREAD, budget, [this]() { return poll(); }, [this]() { return hasWork(); });
+      return;
+    }
+    ASSERT(Common::createAndStartThread(-1, SNAPSHOT_SYNTHESIZER_THREAD, [this]() { run(); }) != nullptr,
            "Failed to start SnapshotSynthesizer thread.");
   }
 
   void SnapshotSynthesizer::stop() 
   {
     run_ = false;
+    if (reactor_id_)
+    {
+      Common::reactor().remove(reactor_id_);
+      reactor_id_ = 0;
+    } else
+    {
+      wait_strategy_.wakeUp();
+    }
   }
 
   auto SnapshotSynthesizer::addToSnapshot(const MDPMarketUpdate *market_update) 
@@ -54,6 +81,7 @@ namespace Exchange
 
         order->quantity_ = me_market_update.quantity_;
         order->price_ = me_market_update.price_;
+        order->priority_ = me_market_update.priority_;
       }
         break;
       case MarketUpdateType::CANCEL: 
@@ -79,13 +107,25 @@ namespace Exchange
     last_inc_seq_num_ = market_update->seq_num_;
   }
 
+  auto SnapshotSynthesizer::sendSnapshotUpdate(const MDPMarketUpdate &market_update) noexcept -> void 
+  {
+    if (transport_type_ == TransportType::SHM) 
+    {
+      *(shm_snapshot_updates_->getNextToWriteTo()) = market_update;
+      shm_snapshot_updates_->updateWriteIndex();
+    } else 
+    {
+      snapshot_socket_.send(&market_update, sizeof(MDPMarketUpdate));
+    }
+  }
+
   auto SnapshotSynthesizer::publishSnapshot() 
   {
     size_t snapshot_size = 0;
 
     const MDPMarketUpdate start_market_update{snapshot_size++, {MarketUpdateType::SNAPSHOT_START, last_inc_seq_num_}};
     logger_.log("%:% %() % %\n", __FILE__, __LINE__, __FUNCTION__, getCurrentTimeStr(&time_str_), start_market_update.toString());
-    snapshot_socket_.send(&start_market_update, sizeof(MDPMarketUpdate));
+    sendSnapshotUpdate(start_market_update);
 
     for (size_t ticker_id = 0; ticker_id < ticker_orders_.size(); ++ticker_id) 
     {
@@ -97,7 +137,7 @@ namespace Exchange
 
       const MDPMarketUpdate clear_market_update{snapshot_size++, me_market_update};
       logger_.log("%:% %() % %\n", __FILE__, __LINE__, __FUNCTION__, getCurrentTimeStr(&time_str_), clear_market_update.toString());
-      snapshot_socket_.send(&clear_market_update, sizeof(MDPMarketUpdate));
+      sendSnapshotUpdate(clear_market_update);
 
       for (const auto order: orders) 
       {
@@ -105,40 +145,49 @@ namespace Exchange
         {
           const MDPMarketUpdate market_update{snapshot_size++, *order};
           logger_.log("%:% %() % %\n", __FILE__, __LINE__, __FUNCTION__, getCurrentTimeStr(&time_str_), market_update.toString());
-          snapshot_socket_.send(&market_update, sizeof(MDPMarketUpdate));
-          snapshot_socket_.sendAndRecv();
+          sendSnapshotUpdate(market_update);
+          if (transport_type_ == TransportType::SOCKET)
+            snapshot_socket_.sendAndRecv();
         }
       }
     }
 
     const MDPMarketUpdate end_market_update{snapshot_size++, {MarketUpdateType::SNAPSHOT_END, last_inc_seq_num_}};
     logger_.log("%:% %() % %\n", __FILE__, __LINE__, __FUNCTION__, getCurrentTimeStr(&time_str_), end_market_update.toString());
-    snapshot_socket_.send(&end_market_update, sizeof(MDPMarketUpdate));
-    snapshot_socket_.sendAndRecv();
+    sendSnapshotUpdate(end_market_update);
+    if (transport_type_ == TransportType::SOCKET)
+      snapshot_socket_.sendAndRecv();
 
     logger_.log("%:% %() % Published snapshot of % orders.\n", __FILE__, __LINE__, __FUNCTION__, getCurrentTimeStr(&time_str_), snapshot_size - 1);
   }
 
-  void SnapshotSynthesizer::run() {
-    logger_.log("%:% %() %\n", __FILE__, __LINE__, __FUNCTION__, getCurrentTimeStr(&time_str_));
-    while (run_) 
+  auto SnapshotSynthesizer::poll() noexcept -> bool
+  {
+    bool did_work = false;
+    for (auto market_update = snapshot_md_updates_->getNextToRead(); snapshot_md_updates_->size() && market_update; market_update = snapshot_md_updates_->getNextToRead()) 
     {
-      for (auto market_update = snapshot_md_updates_->getNextToRead(); snapshot_md_updates_->size() && market_update; market_update = snapshot_md_updates_->getNextToRead()) 
-      {
-        logger_.log("%:% %() % Processing %\n", __FILE__, __LINE__, __FUNCTION__, getCurrentTimeStr(&time_str_),
-                    market_update->toString().c_str());
+      logger_.log("%:% %() % Processing %\n", __FILE__, __LINE__, __FUNCTION__, getCurrentTimeStr(&time_str_),
+                  market_update->toString().c_str());
 
-        addToSnapshot(market_update);
+      addToSnapshot(market_update);
 
-        snapshot_md_updates_->updateReadIndex();
-      }
+      snapshot_md_updates_->updateReadIndex();
+      did_work = true;
+    }
 
-      if (getCurrentNanos() - last_snapshot_time_ > 60 * NANOS_TO_SECS) 
-      {
-        last_snapshot_time_ = getCurrentNanos();
-        publishSnapshot();
-      }
+    if (getCurrentNanos() - last_snapshot_time_ > 60 * NANOS_TO_SECS) 
+    {
+      last_snapshot_time_ = getCurrentNanos();
+      publishSnapshot();
     }
+
+    return did_work;
   }
-}
 
+  void SnapshotSynthesizer::run() {
+    logger_.log("%:% %() %\n", __FILE__, __LINE__, __FUNCTION__, getCurrentTimeStr(&time_str_));
+    while (run_) 
+      wait_strategy_.afterPoll(poll(), [this]() { return hasWork(); });
+    logger_.log("%:% %() % %\n", __FILE__, __LINE__, __FUNCTION__, getCurrentTimeStr(&time_str_), wait_strategy_.toString());
+  }
+}
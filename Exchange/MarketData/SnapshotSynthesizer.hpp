@@ -7,19 +7,25 @@
 #include "../../Common/MCastSocket.hpp"
 #include "../../Common/MemoryPool.hpp"
 #include "../../Common/Logging.hpp"
+#include "../../Common/WaitStrategy.hpp"
+#include "../../Common/Reactor.hpp"
 
 #include "MarketUpdate.hpp"
+#include "ShmMarketData.hpp"
 // #include "../Matcher/MatchingEngineOrder.hpp"
 
 using namespace Common;
 
 namespace Exchange 
 {
+  /// Thread name, the synthesizer floats and parks by default - it only has to keep up with the publisher and send a snapshot a minute.
+  constexpr auto SNAPSHOT_SYNTHESIZER_THREAD = "Exchange/SnapshotSynthesizer";
+
   class SnapshotSynthesizer 
   {
   public:
     SnapshotSynthesizer(MDPMarketUpdateLFQueue *market_updates, const std::string &iface,
-                        const std::string &snapshot_ip, int snapshot_port);
+                        const std::string &snapshot_ip, int snapshot_port, TransportType transport_type);
 
     ~SnapshotSynthesizer();
 
@@ -31,6 +37,17 @@ namespace Exchange
 
     auto publishSnapshot();
 
+    /// One pass of the synthesizer - applies everything the publisher queued and sends out a snapshot once a minute, returns whether
+    /// there were any updates. A snapshot goes out in one go, in the reactor everything else waits for it.
+    auto poll() noexcept -> bool;
+
+    /// Whether the publisher has updates queued, it wakes a parked synthesizer.
+    auto hasWork() const noexcept
+    {
+      return (snapshot_md_updates_->size() != 0);
+    }
+
+    /// Main run loop for this thread, unless the synthesizer runs in the reactor.
     auto run() -> void;
 
     // Deleted default, copy & move constructors and assignment-operators.
@@ -49,11 +66,19 @@ namespace Exchange
 
     Logger logger_;
 
-    volatile bool run_ = false;
+    std::atomic<bool> run_ = {false};
+    Common::WaitStrategy wait_strategy_;
+    size_t reactor_id_ = 0; // non-zero when poll() runs in the reactor instead of a thread of its own.
 
     std::string time_str_;
 
+    const TransportType transport_type_;
+
     McastSocket snapshot_socket_;
+    ShmMDPMarketUpdateQueue *shm_snapshot_updates_ = nullptr;
+
+    /// Publish one message of the snapshot on whichever transport this synthesizer was configured with.
+    auto sendSnapshotUpdate(const MDPMarketUpdate &market_update) noexcept -> void;
 
     std::array<std::array<MEMarketUpdate *, ME_MAX_ORDER_IDS>, ME_MAX_TICKERS> ticker_orders_;
     size_t last_inc_seq_num_ = 0;
@@ -0,0 +1,288 @@
+#include "MEJournal.hpp"
+
+#include <algorithm>
+#include <filesystem>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "../../Common/ThreadUtils.hpp"
+
+namespace Exchange
+{
+  MEJournal::MEJournal(const std::string &path_prefix, size_t shard_id, size_t num_shards, const MatchingEngineCfg &cfg,
+                       JournalSyncPolicy sync_policy, Nanos sync_interval)
+      : path_prefix_(path_prefix)
+      , shard_id_(shard_id)
+      , num_shards_(num_shards)
+      , cfg_(cfg)
+      , sync_policy_(sync_policy)
+      , sync_interval_(sync_interval)
+      , spare_segments_(ME_JOURNAL_MAX_PENDING_SEGMENTS)
+      , retired_segments_(ME_JOURNAL_MAX_PENDING_SEGMENTS)
+      , logger_("exchange_me_journal_" + std::to_string(shard_id) + ".log")
+  {
+    ASSERT(sync_policy_ != JournalSyncPolicy::INVALID && sync_policy_ != JournalSyncPolicy::MAX,
+           "Invalid journal sync policy:" + journalSyncPolicyToString(sync_policy_));
+
+    auto segment = openSegment();
+    segment->header_->first_seq_ = next_seq_;
+    current_segment_.store(segment, std::memory_order_release);
+
+    logger_.log("%:% %() % Journaling to % sync-policy:% sync-interval:% %\n", __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str_),
+                path_prefix_, journalSyncPolicyToString(sync_policy_), sync_interval_, cfg_.toString());
+  }
+
+  MEJournal::~MEJournal()
+  {
+    stop();
+    if (flusher_thread_)
+    {
+      flusher_thread_->join();
+      delete flusher_thread_;
+      flusher_thread_ = nullptr;
+    }
+
+    for (auto segment = retired_segments_.getNextToRead(); retired_segments_.size() && segment; segment = retired_segments_.getNextToRead())
+    {
+      closeSegment(*segment, false);
+      retired_segments_.updateReadIndex();
+    }
+    closeSegment(current_segment_.load(std::memory_order_acquire), false);
+    current_segment_ = nullptr;
+
+    // pre-allocated segments that were never written to are not part of the journal.
+    for (auto segment = spare_segments_.getNextToRead(); spare_segments_.size() && segment; segment = spare_segments_.getNextToRead())
+    {
+      closeSegment(*segment, true);
+      spare_segments_.updateReadIndex();
+    }
+
+    logger_.log("%:% %() % Closed journal % last-seq:%\n", __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str_),
+                path_prefix_, next_seq_ - 1);
+  }
+
+  auto MEJournal::start() -> void
+  {
+    run_ = true;
+    flusher_thread_ = Common::createAndStartThread(-1, "Exchange/MEJournal_" + std::to_string(shard_id_), [this]() { run(); });
+    ASSERT(flusher_thread_ != nullptr, "Failed to start MEJournal thread.");
+  }
+
+  auto MEJournal::stop() -> void
+  {
+    run_ = false;
+  }
+
+  /// Creates, pre-allocates and maps a new segment file, MAP_POPULATE pre-faults the pages so appending to it never page faults.
+  auto MEJournal::openSegment() noexcept -> Segment *
+  {
+    // the writer and the flusher can both get here, each keeps the index it claimed rather than re-reading the shared counter.
+    const auto segment_index = next_segment_index_.fetch_add(1);
+    auto segment = new Segment();
+    segment->path_ = meJournalSegmentPath(path_prefix_, segment_index);
+
+    const auto fd = open(segment->path_.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+    ASSERT(fd != -1, "open() failed for journal segment:" + segment->path_ + " error:" + std::string(strerror(errno)));
+    ASSERT(posix_fallocate(fd, 0, ME_JOURNAL_SEGMENT_SIZE) == 0, "posix_fallocate() failed for journal segment:" + segment->path_);
+
+    auto ptr = mmap(nullptr, ME_JOURNAL_SEGMENT_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+    close(fd);
+    ASSERT(ptr != MAP_FAILED, "mmap() failed for journal segment:" + segment->path_ + " error:" + std::string(strerror(errno)));
+
+    segment->data_ = static_cast<char *>(ptr);
+    segment->header_ = new(segment->data_) MEJournalSegmentHeader();
+    segment->header_->shard_id_ = shard_id_;
+    segment->header_->num_shards_ = num_shards_;
+    segment->header_->segment_index_ = segment_index;
+    segment->header_->cfg_ = cfg_;
+
+    return segment;
+  }
+
+  /// Flusher thread - msync the pages appended to since the last call.
+  auto MEJournal::syncSegment(Segment *segment) noexcept -> void
+  {
+    const auto write_offset = segment->write_offset_.load(std::memory_order_acquire);
+    if (sync_policy_ == JournalSyncPolicy::NONE || write_offset == segment->synced_offset_)
+      return;
+
+    static const auto page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    const auto sync_start = segment->synced_offset_ - (segment->synced_offset_ % page_size);
+    if (msync(segment->data_ + sync_start, write_offset - sync_start, (sync_policy_ == JournalSyncPolicy::SYNC ? MS_SYNC : MS_ASYNC)))
+    {
+      logger_.log("%:% %() % msync() failed for % error:%\n", __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str_),
+                  segment->path_, strerror(errno));
+      return;
+    }
+    segment->synced_offset_ = write_offset;
+  }
+
+  auto MEJournal::closeSegment(Segment *segment, bool remove) noexcept -> void
+  {
+    if (!remove)
+      syncSegment(segment);
+
+    munmap(segment->data_, ME_JOURNAL_SEGMENT_SIZE);
+    if (remove)
+      unlink(segment->path_.c_str());
+
+    logger_.log("%:% %() % Closed segment % written:% removed:%\n", __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str_),
+                segment->path_, segment->write_offset_.load(std::memory_order_relaxed), remove);
+    delete segment;
+  }
+
+  /// Matching engine thread - switch to a segment pre-allocated by the flusher and hand the full one back to it to be unmapped.
+  /// Only if the flusher has fallen behind does the writer have to create the next segment itself.
+  auto MEJournal::rollSegment(Segment *segment) noexcept -> Segment *
+  {
+    Segment *next_segment = nullptr;
+    if (LIKELY(spare_segments_.size()))
+    {
+      next_segment = *spare_segments_.getNextToRead();
+      spare_segments_.updateReadIndex();
+    } else
+    {
+      next_segment = openSegment();
+      ++num_unprepared_rolls_;
+    }
+    next_segment->header_->first_seq_ = next_seq_;
+    current_segment_.store(next_segment, std::memory_order_release);
+
+    ASSERT(retired_segments_.size() < ME_JOURNAL_MAX_PENDING_SEGMENTS, "Journal flusher fell behind by too many segments:" + path_prefix_);
+    *retired_segments_.getNextToWriteTo() = segment;
+    retired_segments_.updateWriteIndex();
+
+    return next_segment;
+  }
+
+  /// Flusher thread - keeps one spare segment ready for the writer, syncs the journal and releases full segments.
+  auto MEJournal::run() noexcept -> void
+  {
+    logger_.log("%:% %() %\n", __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str_));
+    size_t num_unprepared_rolls = 0;
+    while (run_)
+    {
+      if (!spare_segments_.size())
+      {
+        *spare_segments_.getNextToWriteTo() = openSegment();
+        spare_segments_.updateWriteIndex();
+      }
+
+      for (auto segment = retired_segments_.getNextToRead(); retired_segments_.size() && segment; segment = retired_segments_.getNextToRead())
+      {
+        closeSegment(*segment, false);
+        retired_segments_.updateReadIndex();
+      }
+
+      syncSegment(current_segment_.load(std::memory_order_acquire));
+
+      if (UNLIKELY(num_unprepared_rolls_ != num_unprepared_rolls))
+      {
+        num_unprepared_rolls = num_unprepared_rolls_;
+        logger_.log("%:% %() % Writer had to create % segments itself\n", __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str_),
+                    num_unprepared_rolls);
+      }
+
+      std::this_thread::sleep_for(std::chrono::nanoseconds(sync_interval_));
+    }
+  }
+
+  auto MEJournal::setStartSnapshot(const std::string &path) noexcept -> void
+  {
+    ASSERT(next_seq_ == 1, "Journal:" + path_prefix_ + " already has requests, it can not start from snapshot:" + path);
+    ASSERT(path.size() < ME_SNAPSHOT_MAX_PATH_SIZE, "Snapshot path too long for the journal header:" + path);
+    auto header = current_segment_.load(std::memory_order_relaxed)->header_;
+    strncpy(header->start_snapshot_, path.c_str(), sizeof(header->start_snapshot_) - 1);
+  }
+
+  MEJournalReader::MEJournalReader(const std::string &path_prefix)
+  {
+    const auto path = std::filesystem::path(path_prefix);
+    const auto dir = (path.has_parent_path() ? path.parent_path() : std::filesystem::path("."));
+    const auto file_prefix = path.filename().string() + "_";
+
+    std::vector<std::pair<uint64_t, std::string>> segments;
+    for (const auto &entry : std::filesystem::directory_iterator(dir))
+    {
+      const auto file_name = entry.path().filename().string();
+      if (file_name.rfind(file_prefix, 0) != 0 || entry.path().extension() != ".bin")
+        continue;
+
+      const auto fd = open(entry.path().c_str(), O_RDONLY);
+      ASSERT(fd != -1, "open() failed for journal segment:" + entry.path().string() + " error:" + std::string(strerror(errno)));
+      MEJournalSegmentHeader header;
+      ASSERT(pread(fd, &header, sizeof(header), 0) == sizeof(header), "Could not read header of journal segment:" + entry.path().string());
+      close(fd);
+
+      ASSERT(header.magic_ == ME_JOURNAL_MAGIC && header.version_ == ME_JOURNAL_VERSION, "Not a journal segment:" + entry.path().string());
+      if (!header.first_seq_) // pre-allocated but never written to.
+        continue;
+
+      if (segments.empty() || header.first_seq_ < first_header_.first_seq_)
+        first_header_ = header;
+      segments.emplace_back(header.first_seq_, entry.path().string());
+    }
+
+    std::sort(segments.begin(), segments.end());
+    for (const auto &segment : segments)
+      segments_.push_back(segment.second);
+
+    if (!segments_.empty())
+      mapSegment(0);
+  }
+
+  MEJournalReader::~MEJournalReader()
+  {
+    unmapSegment();
+  }
+
+  auto MEJournalReader::mapSegment(size_t index) noexcept -> void
+  {
+    unmapSegment();
+    segment_index_ = index;
+
+    const auto fd = open(segments_[index].c_str(), O_RDONLY);
+    ASSERT(fd != -1, "open() failed for journal segment:" + segments_[index] + " error:" + std::string(strerror(errno)));
+    auto ptr = mmap(nullptr, ME_JOURNAL_SEGMENT_SIZE, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    ASSERT(ptr != MAP_FAILED, "mmap() failed for journal segment:" + segments_[index] + " error:" + std::string(strerror(errno)));
+
+    data_ = static_cast<const char *>(ptr);
+    read_offset_ = ME_JOURNAL_HEADER_SIZE;
+  }
+
+  auto MEJournalReader::unmapSegment() noexcept -> void
+  {
+    if (data_)
+      munmap(const_cast<char *>(data_), ME_JOURNAL_SEGMENT_SIZE);
+    data_ = nullptr;
+  }
+
+  auto MEJournalReader::next() noexcept -> const MEJournalRecord *
+  {
+    while (data_)
+    {
+      if (read_offset_ + sizeof(MEJournalRecord) <= ME_JOURNAL_SEGMENT_SIZE)
+      {
+        const auto record = reinterpret_cast<const MEJournalRecord *>(data_ + read_offset_);
+        if (record->seq_ == next_seq_)
+        {
+          read_offset_ += sizeof(MEJournalRecord);
+          ++next_seq_;
+          return record;
+        }
+      }
+
+      // end of this segment, carry on in the next one only if it picks up exactly where this one stopped.
+      if (segment_index_ + 1 < segments_.size())
+      {
+        mapSegment(segment_index_ + 1);
+        if (reinterpret_cast<const MEJournalSegmentHeader *>(data_)->first_seq_ == next_seq_)
+          continue;
+      }
+      unmapSegment();
+    }
+    return nullptr;
+  }
+}
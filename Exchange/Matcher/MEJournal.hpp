@@ -0,0 +1,273 @@
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../../Common/Types.hpp"
+#include "../../Common/Macros.hpp"
+#include "../../Common/LFQueue.hpp"
+#include "../../Common/Logging.hpp"
+#include "../../Common/TimeUtils.hpp"
+
+#include "../OrderServer/ClientRequest.hpp"
+
+#include "MESnapshot.hpp"
+
+using namespace Common;
+
+namespace Exchange
+{
+  /// Every journal segment is a pre-allocated file of this size, a MEJournalRecord is 48 bytes so that is ~1.4M requests per segment.
+  constexpr size_t ME_JOURNAL_SEGMENT_SIZE = 64 * 1024 * 1024;
+
+  /// Records start after a header block of this size at the beginning of every segment.
+  constexpr size_t ME_JOURNAL_HEADER_SIZE = 512;
+
+  /// Maximum number of pre-allocated and retired segments queued between the matching engine thread and the flusher thread.
+  constexpr size_t ME_JOURNAL_MAX_PENDING_SEGMENTS = 16;
+
+  /// The matching engine reads the clock for the first request of every batch of back-to-back requests and at most every this many
+  /// requests within a batch, the records in between carry the same time.
+  constexpr size_t ME_JOURNAL_STAMP_REQUESTS = 64;
+
+  constexpr uint64_t ME_JOURNAL_MAGIC = 0x4c4e524a5248434e;
+  constexpr uint32_t ME_JOURNAL_VERSION = 3;
+
+  /// How the flusher thread pushes journal pages to disk. Records are in the page cache as soon as they are appended, so they survive
+  /// the exchange process dying with any policy, the policy only decides what survives the box going down.
+  enum class JournalSyncPolicy : int8_t {
+    INVALID = 0,
+    NONE = 1,  // leave it to the kernel's writeback.
+    ASYNC = 2, // msync(MS_ASYNC) newly appended pages every sync interval.
+    SYNC = 3,  // msync(MS_SYNC) newly appended pages every sync interval.
+    MAX = 4
+  };
+
+  inline auto journalSyncPolicyToString(JournalSyncPolicy policy) -> std::string {
+    switch (policy) {
+      case JournalSyncPolicy::NONE:
+        return "NONE";
+      case JournalSyncPolicy::ASYNC:
+        return "ASYNC";
+      case JournalSyncPolicy::SYNC:
+        return "SYNC";
+      case JournalSyncPolicy::INVALID:
+        return "INVALID";
+      case JournalSyncPolicy::MAX:
+        return "MAX";
+    }
+    return "UNKNOWN";
+  }
+
+  inline auto stringToJournalSyncPolicy(const std::string &str) -> JournalSyncPolicy
+  {
+    for (auto i = static_cast<int>(JournalSyncPolicy::INVALID); i <= static_cast<int>(JournalSyncPolicy::MAX); ++i)
+    {
+      const auto policy = static_cast<JournalSyncPolicy>(i);
+      if (journalSyncPolicyToString(policy) == str)
+        return policy;
+    }
+    return JournalSyncPolicy::INVALID;
+  }
+
+  /// Written when a segment is created, first_seq_ is only set once the matching engine starts appending to it - segments that were
+  /// pre-allocated but never used have first_seq_ == 0. Carries everything needed to rebuild the shard's order books from the journal.
+  struct MEJournalSegmentHeader
+  {
+    uint64_t magic_ = ME_JOURNAL_MAGIC;
+    uint32_t version_ = ME_JOURNAL_VERSION;
+    uint32_t shard_id_ = 0;
+    uint32_t num_shards_ = 0;
+    uint64_t segment_index_ = 0;
+    uint64_t first_seq_ = 0;
+    MatchingEngineCfg cfg_;
+
+    /// Snapshot of the books before the first request, written by a warm restart - empty if the session started from empty books.
+    char start_snapshot_[ME_SNAPSHOT_MAX_PATH_SIZE] = {};
+  };
+  static_assert(sizeof(MEJournalSegmentHeader) <= ME_JOURNAL_HEADER_SIZE);
+
+#pragma pack(push, 1)
+
+  /// seq_ starts at 1 and is written after request_, a record is only valid if its seq_ is the one following the previous record.
+  /// time_ is when the matching engine picked up the batch the request arrived in, it lets a replay reproduce the original pacing.
+  struct MEJournalRecord
+  {
+    uint64_t seq_ = 0;
+    Nanos time_ = 0;
+    MEClientRequest request_;
+  };
+
+#pragma pack(pop)
+
+  /// Path of a segment file, path_prefix identifies one matching engine shard in one exchange session.
+  inline auto meJournalSegmentPath(const std::string &path_prefix, uint64_t segment_index) -> std::string
+  {
+    return path_prefix + "_" + std::to_string(segment_index) + ".bin";
+  }
+
+  /// Write-ahead log of every MEClientRequest a matching engine shard processes, in processing order.
+  /// The matching engine thread appends into a memory-mapped, pre-allocated and pre-faulted segment, which is a copy and a couple of stores.
+  /// The flusher thread does everything that needs a syscall - msync-ing appended pages according to the sync policy, pre-allocating
+  /// the segments the writer rolls over to and unmapping full ones.
+  class MEJournal final
+  {
+  public:
+    MEJournal(const std::string &path_prefix, size_t shard_id, size_t num_shards, const MatchingEngineCfg &cfg,
+              JournalSyncPolicy sync_policy, Nanos sync_interval);
+
+    ~MEJournal();
+
+    auto start() -> void;
+
+    auto stop() -> void;
+
+    /// Called by the matching engine thread before processing the request, time is the stamp of the batch it arrived in.
+    auto append(const MEClientRequest *client_request, Nanos time) noexcept
+    {
+      auto segment = current_segment_.load(std::memory_order_relaxed);
+      auto write_offset = segment->write_offset_.load(std::memory_order_relaxed);
+      if (UNLIKELY(write_offset + sizeof(MEJournalRecord) > ME_JOURNAL_SEGMENT_SIZE))
+      {
+        segment = rollSegment(segment);
+        write_offset = segment->write_offset_.load(std::memory_order_relaxed);
+      }
+
+      auto record = reinterpret_cast<MEJournalRecord *>(segment->data_ + write_offset);
+      record->time_ = time;
+      record->request_ = *client_request;
+      std::atomic_signal_fence(std::memory_order_release);
+      record->seq_ = next_seq_++;
+      segment->write_offset_.store(write_offset + sizeof(MEJournalRecord), std::memory_order_release);
+    }
+
+    auto run() noexcept -> void;
+
+    /// Called by the matching engine thread after a warm restart, before the first append - records the snapshot the books were restored
+    /// to in the first segment's header, so a replay of this journal can start from the same books.
+    auto setStartSnapshot(const std::string &path) noexcept -> void;
+
+    auto pathPrefix() const noexcept -> const std::string &
+    {
+      return path_prefix_;
+    }
+
+    /// Sequence number of the last appended request, only meaningful on the matching engine thread.
+    auto lastSeq() const noexcept
+    {
+      return next_seq_ - 1;
+    }
+
+    // Deleted default, copy & move constructors and assignment-operators.
+    MEJournal() = delete;
+
+    MEJournal(const MEJournal &) = delete;
+
+    MEJournal(const MEJournal &&) = delete;
+
+    MEJournal &operator=(const MEJournal &) = delete;
+
+    MEJournal &operator=(const MEJournal &&) = delete;
+
+  private:
+    struct Segment
+    {
+      std::string path_;
+      char *data_ = nullptr;
+      MEJournalSegmentHeader *header_ = nullptr;
+
+      /// Published by the writer, read by the flusher.
+      std::atomic<size_t> write_offset_ = {ME_JOURNAL_HEADER_SIZE};
+
+      /// Flusher only.
+      size_t synced_offset_ = ME_JOURNAL_HEADER_SIZE;
+    };
+
+    auto openSegment() noexcept -> Segment *;
+
+    auto syncSegment(Segment *segment) noexcept -> void;
+
+    auto closeSegment(Segment *segment, bool remove) noexcept -> void;
+
+    auto rollSegment(Segment *segment) noexcept -> Segment *;
+
+    const std::string path_prefix_;
+    const size_t shard_id_;
+    const size_t num_shards_;
+    const MatchingEngineCfg cfg_;
+    const JournalSyncPolicy sync_policy_;
+    const Nanos sync_interval_;
+
+    std::atomic<uint64_t> next_segment_index_ = {0};
+
+    /// Writer state.
+    std::atomic<Segment *> current_segment_ = {nullptr};
+    uint64_t next_seq_ = 1;
+    std::atomic<size_t> num_unprepared_rolls_ = {0};
+
+    /// Flusher -> writer, pre-allocated segments ready to be rolled over to.
+    LFQueue<Segment *> spare_segments_;
+
+    /// Writer -> flusher, full segments to be synced and unmapped.
+    LFQueue<Segment *> retired_segments_;
+
+    std::atomic<bool> run_ = {false};
+    std::thread *flusher_thread_ = nullptr;
+
+    std::string time_str_;
+    Logger logger_;
+  };
+
+  /// Reads back the records of one matching engine shard's journal in sequence order, used to rebuild the order books.
+  /// Segments are ordered by the first sequence number written to them. Reading stops at the first record that does not carry the
+  /// next sequence number - the end of the journal, or a record the exchange was in the middle of writing when it died.
+  class MEJournalReader final
+  {
+  public:
+    explicit MEJournalReader(const std::string &path_prefix);
+
+    ~MEJournalReader();
+
+    /// Header of the first segment, nullptr if there is no journal at path_prefix.
+    auto header() const noexcept -> const MEJournalSegmentHeader *
+    {
+      return (segments_.empty() ? nullptr : &first_header_);
+    }
+
+    /// Next record or nullptr at the end of the journal.
+    auto next() noexcept -> const MEJournalRecord *;
+
+    auto lastSeq() const noexcept
+    {
+      return next_seq_ - 1;
+    }
+
+    // Deleted default, copy & move constructors and assignment-operators.
+    MEJournalReader() = delete;
+
+    MEJournalReader(const MEJournalReader &) = delete;
+
+    MEJournalReader(const MEJournalReader &&) = delete;
+
+    MEJournalReader &operator=(const MEJournalReader &) = delete;
+
+    MEJournalReader &operator=(const MEJournalReader &&) = delete;
+
+  private:
+    auto mapSegment(size_t index) noexcept -> void;
+
+    auto unmapSegment() noexcept -> void;
+
+    /// Paths of the used segments sorted by first sequence number.
+    std::vector<std::string> segments_;
+    MEJournalSegmentHeader first_header_;
+
+    size_t segment_index_ = 0;
+    const char *data_ = nullptr;
+    size_t read_offset_ = 0;
+
+    uint64_t next_seq_ = 1;
+  };
+}
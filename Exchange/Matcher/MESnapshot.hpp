@@ -0,0 +1,110 @@
+#pragma once
+
+#include <array>
+#include <cstring>
+#include <unistd.h>
+
+#include "../../Common/Types.hpp"
+#include "../../Common/TimeUtils.hpp"
+
+using namespace Common;
+
+namespace Exchange
+{
+  constexpr uint64_t ME_SNAPSHOT_MAGIC = 0x4e5350534843414e;
+  constexpr uint32_t ME_SNAPSHOT_VERSION = 1;
+
+  /// Large enough for any journal path prefix the exchange builds.
+  constexpr size_t ME_SNAPSHOT_MAX_PATH_SIZE = 256;
+
+  /// A snapshot file is a MESnapshotHeader, followed by a MESnapshotBook for every order book the shard owns, each one followed by
+  /// its resting orders - bids then asks, best price first and in queue priority order within a price level.
+  /// The header is written last, a file whose header does not carry ME_SNAPSHOT_MAGIC was never finished and is ignored.
+  struct MESnapshotHeader
+  {
+    uint64_t magic_ = 0;
+    uint32_t version_ = ME_SNAPSHOT_VERSION;
+    uint32_t shard_id_ = 0;
+    uint32_t num_shards_ = 0;
+    MatchingEngineCfg cfg_;
+    Nanos created_ = 0;
+
+    /// The snapshot holds the state after the request with this sequence number in the journal at journal_prefix_ was processed.
+    uint64_t journal_seq_ = 0;
+    char journal_prefix_[ME_SNAPSHOT_MAX_PATH_SIZE] = {};
+
+    uint64_t num_books_ = 0;
+    uint64_t num_orders_ = 0;
+  };
+
+#pragma pack(push, 1)
+
+  struct MESnapshotBook
+  {
+    TickerId ticker_id_ = TickerId_INVALID;
+    OrderId next_market_order_id_ = OrderId_INVALID;
+    uint64_t num_orders_ = 0;
+  };
+
+  struct MESnapshotOrder
+  {
+    ClientId client_id_ = ClientId_INVALID;
+    OrderId client_order_id_ = OrderId_INVALID;
+    OrderId market_order_id_ = OrderId_INVALID;
+    Side side_ = Side::INVALID;
+    Price price_ = Price_INVALID;
+    Quantity quantity_ = Quantity_INVALID;
+    Priority priority_ = Priority_INVALID;
+  };
+
+#pragma pack(pop)
+
+  /// Buffered writes to a snapshot file. Does not allocate, so it is safe to use in a child forked from the multi-threaded exchange.
+  class MESnapshotWriter final
+  {
+  public:
+    explicit MESnapshotWriter(int fd) noexcept
+        : fd_(fd) {}
+
+    auto flush() noexcept
+    {
+      for (size_t written = 0; ok_ && written < size_; )
+      {
+        const auto n = write(fd_, buffer_.data() + written, size_ - written);
+        ok_ = (n > 0);
+        written += (ok_ ? n : 0);
+      }
+      size_ = 0;
+    }
+
+    auto append(const void *data, size_t size) noexcept
+    {
+      if (UNLIKELY(size_ + size > buffer_.size()))
+        flush();
+      memcpy(buffer_.data() + size_, data, size);
+      size_ += size;
+    }
+
+    auto ok() const noexcept
+    {
+      return ok_;
+    }
+
+    // Deleted default, copy & move constructors and assignment-operators.
+    MESnapshotWriter() = delete;
+
+    MESnapshotWriter(const MESnapshotWriter &) = delete;
+
+    MESnapshotWriter(const MESnapshotWriter &&) = delete;
+
+    MESnapshotWriter &operator=(const MESnapshotWriter &) = delete;
+
+    MESnapshotWriter &operator=(const MESnapshotWriter &&) = delete;
+
+  private:
+    const int fd_;
+    std::array<char, 64 * 1024> buffer_;
+    size_t size_ = 0;
+    bool ok_ = true;
+  };
+}
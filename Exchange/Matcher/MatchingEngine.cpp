@@ -1,17 +1,39 @@
 #include "MatchingEngine.hpp"
 
+#include <filesystem>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
 namespace Exchange 
 {
   MatchingEngine::MatchingEngine(ClientRequestLFQueue *client_requests, ClientResponseLFQueue *client_responses,
-                                 MEMarketUpdateLFQueue *market_updates)
-      : incoming_requests_(client_requests)
+                                 MEMarketUpdateLFQueue *market_updates,
+                                 size_t shard_id, size_t num_shards, int core_id,
+                                 const MatchingEngineCfg &cfg, MEJournal *journal,
+                                 const std::string &snapshot_dir, Nanos snapshot_interval)
+      : shard_id_(shard_id)
+      , num_shards_(num_shards)
+      , core_id_(core_id)
+      , cfg_(cfg)
+      , incoming_requests_(client_requests)
       , outgoing_ogw_responses_(client_responses)
       , outgoing_md_updates_(market_updates)
-      , logger_("exchange_matching_engine.log") 
+      , journal_(journal)
+      , snapshot_dir_(snapshot_dir)
+      , snapshot_interval_(snapshot_dir.empty() ? 0 : snapshot_interval)
+      , wait_strategy_(Common::waitStrategyType(matchingEngineThreadName(shard_id), Common::WaitStrategyType::BUSY_SPIN))
+      , logger_("exchange_matching_engine_" + std::to_string(shard_id) + ".log") 
   {
-    for(size_t i = 0; i < ticker_order_book_.size(); ++i) 
+    ASSERT(num_shards && shard_id < num_shards, "Invalid shard:" + std::to_string(shard_id) + " of:" + std::to_string(num_shards));
+    ASSERT(snapshot_dir_.empty() || journal_, "Snapshots need the journal, the journal tail is replayed on top of them.");
+    incoming_requests_->setConsumerWaitStrategy(&wait_strategy_);
+
+    ticker_order_book_.fill(nullptr);
+    for(size_t i = shard_id; i < ticker_order_book_.size(); i += num_shards) 
     {
-      ticker_order_book_[i] = new MEOrderBook(i, &logger_, this);
+      ticker_order_book_[i] = new MEOrderBook(i, &logger_, this, cfg);
     }
 
     /* C++20 range-based for loop
@@ -29,9 +51,13 @@ namespace Exchange
     using namespace std::literals::chrono_literals;
     std::this_thread::sleep_for(1s);
 
+    if (snapshot_pid_)
+      waitpid(snapshot_pid_, nullptr, 0);
+
     incoming_requests_ = nullptr;
     outgoing_ogw_responses_ = nullptr;
     outgoing_md_updates_ = nullptr;
+    journal_ = nullptr;
 
     for(auto& order_book : ticker_order_book_) 
     {
@@ -43,12 +69,251 @@ namespace Exchange
   auto MatchingEngine::start() -> void 
   {
     run_ = true;
-    ASSERT(Common::createAndStartThread(1, "Exchange/MatchingEngine", [this]() { run(); }) != nullptr, "Failed to start MatchingEngine thread.");
+    ASSERT(Common::createAndStartThread(core_id_, matchingEngineThreadName(shard_id_), [this]() { run(); }) != nullptr,
+           "Failed to start MatchingEngine thread.");
   }
 
   auto MatchingEngine::stop() -> void 
   {
     run_ = false;
+    wait_strategy_.wakeUp();
   }
-}
 
+  auto MatchingEngine::snapshotPath(Nanos created) const -> std::string 
+  {
+    return snapshot_dir_ + "/me_snapshot_" + std::to_string(shard_id_) + "_" + std::to_string(created) + ".bin";
+  }
+
+  /// The newest complete snapshot written by a shard with the same layout, empty if there is none.
+  auto MatchingEngine::latestSnapshotPath() const -> std::string 
+  {
+    const auto file_prefix = "me_snapshot_" + std::to_string(shard_id_) + "_";
+    std::string latest_path;
+    Nanos latest_created = 0;
+    for (const auto &entry : std::filesystem::directory_iterator(snapshot_dir_)) 
+    {
+      const auto file_name = entry.path().filename().string();
+      if (file_name.rfind(file_prefix, 0) != 0 || entry.path().extension() != ".bin")
+        continue;
+
+      MESnapshotHeader header;
+      const auto fd = open(entry.path().c_str(), O_RDONLY);
+      const auto header_ok = (fd != -1 && pread(fd, &header, sizeof(header), 0) == sizeof(header) && header.magic_ == ME_SNAPSHOT_MAGIC &&
+                              header.version_ == ME_SNAPSHOT_VERSION && header.shard_id_ == shard_id_ && header.num_shards_ == num_shards_);
+      if (fd != -1)
+        close(fd);
+
+      if (header_ok && header.created_ > latest_created) 
+      {
+        latest_created = header.created_;
+        latest_path = entry.path().string();
+      }
+    }
+    return latest_path;
+  }
+
+  auto MatchingEngine::writeSnapshot(const char *path, const char *tmp_path, Nanos created) const noexcept -> bool 
+  {
+    const auto fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1)
+      return false;
+
+    MESnapshotHeader header;
+    header.shard_id_ = shard_id_;
+    header.num_shards_ = num_shards_;
+    header.cfg_ = cfg_;
+    header.created_ = created;
+    header.journal_seq_ = journal_->lastSeq();
+    strncpy(header.journal_prefix_, journal_->pathPrefix().c_str(), sizeof(header.journal_prefix_) - 1);
+
+    MESnapshotWriter writer(fd);
+    writer.append(&header, sizeof(header)); // placeholder without the magic, rewritten once everything else made it to the file.
+
+    for (size_t ticker_id = 0; ticker_id < ticker_order_book_.size(); ++ticker_id) 
+    {
+      const auto order_book = ticker_order_book_[ticker_id];
+      if (!order_book)
+        continue;
+
+      MESnapshotBook snapshot_book;
+      snapshot_book.ticker_id_ = ticker_id;
+      order_book->forEachOrder([&snapshot_book](const MEOrder &) { ++snapshot_book.num_orders_; });
+      snapshot_book.next_market_order_id_ = order_book->nextMarketOrderId();
+      writer.append(&snapshot_book, sizeof(snapshot_book));
+
+      order_book->forEachOrder([&writer](const MEOrder &order) 
+      {
+        const MESnapshotOrder snapshot_order{order.client_id_, order.client_order_id_, order.market_order_id_, order.side_,
+                                             order.price_, order.quantity_, order.priority_};
+        writer.append(&snapshot_order, sizeof(snapshot_order));
+      });
+
+      ++header.num_books_;
+      header.num_orders_ += snapshot_book.num_orders_;
+    }
+    writer.flush();
+
+    header.magic_ = ME_SNAPSHOT_MAGIC;
+    const auto ok = (writer.ok() && pwrite(fd, &header, sizeof(header), 0) == sizeof(header) && fsync(fd) == 0);
+    close(fd);
+
+    return (ok && rename(tmp_path, path) == 0);
+  }
+
+  /// Fork a child that writes the snapshot from its copy-on-write view of the books while this thread carries on matching.
+  /// The parent only pays for fork() itself, the previous child is reaped when the next snapshot is due.
+  auto MatchingEngine::checkSnapshot() noexcept -> void 
+  {
+    const auto now = Common::getCurrentNanos();
+    if (LIKELY(now - last_snapshot_time_ < snapshot_interval_))
+      return;
+
+    if (snapshot_pid_) 
+    {
+      int status = 0;
+      const auto ret = waitpid(snapshot_pid_, &status, WNOHANG);
+      if (ret == 0) // still writing the last one.
+        return;
+
+      const auto ok = (ret == snapshot_pid_ && WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS);
+      logger_.log("%:% %() % Snapshot % ok:%\n", __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str_), snapshot_path_, ok);
+      if (ok) 
+      {
+        // the snapshot this session's journal starts from stays, a replay of the journal needs it.
+        if (!last_snapshot_path_.empty() && last_snapshot_path_ != start_snapshot_path_)
+          unlink(last_snapshot_path_.c_str());
+        last_snapshot_path_ = snapshot_path_;
+      }
+      snapshot_pid_ = 0;
+    }
+
+    snapshot_path_ = snapshotPath(now);
+    snapshot_tmp_path_ = snapshot_path_ + ".tmp";
+
+    START_MEASURE(Exchange_MatchingEngine_fork);
+    const auto pid = fork();
+    if (pid == 0)
+      _exit(writeSnapshot(snapshot_path_.c_str(), snapshot_tmp_path_.c_str(), now) ? EXIT_SUCCESS : EXIT_FAILURE);
+    END_MEASURE(Exchange_MatchingEngine_fork, logger_);
+
+    if (UNLIKELY(pid < 0))
+      logger_.log("%:% %() % fork() failed error:%\n", __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str_), strerror(errno));
+    snapshot_pid_ = (pid > 0 ? pid : 0);
+    last_snapshot_time_ = now;
+  }
+
+  auto MatchingEngine::restoreSnapshot(const std::string &path) noexcept -> MESnapshotHeader 
+  {
+    const auto fd = open(path.c_str(), O_RDONLY);
+    ASSERT(fd != -1, "open() failed for snapshot:" + path + " error:" + std::string(strerror(errno)));
+    const auto size = static_cast<size_t>(lseek(fd, 0, SEEK_END));
+    auto ptr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+    close(fd);
+    ASSERT(ptr != MAP_FAILED, "mmap() failed for snapshot:" + path + " error:" + std::string(strerror(errno)));
+
+    ASSERT(size >= sizeof(MESnapshotHeader), "Truncated snapshot:" + path);
+
+    const auto data = static_cast<const char *>(ptr);
+    const auto header = *reinterpret_cast<const MESnapshotHeader *>(data);
+    ASSERT(header.magic_ == ME_SNAPSHOT_MAGIC && header.version_ == ME_SNAPSHOT_VERSION, "Not a complete snapshot:" + path);
+    ASSERT(header.shard_id_ == shard_id_ && header.num_shards_ == num_shards_,
+           "Snapshot:" + path + " is of shard:" + std::to_string(header.shard_id_) + " of:" + std::to_string(header.num_shards_));
+    ASSERT(header.cfg_ == cfg_, "Snapshot:" + path + " was written with " + header.cfg_.toString() + " not " + cfg_.toString());
+
+    size_t offset = sizeof(MESnapshotHeader);
+    for (uint64_t i = 0; i < header.num_books_; ++i) 
+    {
+      const auto snapshot_book = reinterpret_cast<const MESnapshotBook *>(data + offset);
+      offset += sizeof(MESnapshotBook);
+      ASSERT(offset + snapshot_book->num_orders_ * sizeof(MESnapshotOrder) <= size, "Truncated snapshot:" + path);
+
+      auto order_book = ticker_order_book_.at(snapshot_book->ticker_id_);
+      ASSERT(order_book != nullptr, "Snapshot:" + path + " has a book for ticker:" + std::to_string(snapshot_book->ticker_id_) +
+                                    " which shard:" + std::to_string(shard_id_) + " does not own.");
+      order_book->restore(snapshot_book, reinterpret_cast<const MESnapshotOrder *>(data + offset));
+      offset += snapshot_book->num_orders_ * sizeof(MESnapshotOrder);
+    }
+    munmap(ptr, size);
+
+    return header;
+  }
+
+  /// Warm restart - load the latest snapshot, replay the tail of the journal it was taken from and publish the recovered books.
+  /// Nothing from the replay reaches clients, the replayed requests were answered by the previous session.
+  /// A fresh snapshot is written before any new request is processed, so the previous session's journal is not needed again. After a
+  /// warm restart this session's journal starts from that snapshot, its header says so.
+  auto MatchingEngine::recover() noexcept -> void 
+  {
+    const auto start_time = Common::getCurrentNanos();
+    const auto snapshot_path = latestSnapshotPath();
+    size_t num_replayed = 0;
+
+    if (!snapshot_path.empty()) 
+    {
+      const auto header = restoreSnapshot(snapshot_path);
+
+      MEJournalReader journal_reader(header.journal_prefix_);
+      for (auto record = journal_reader.next(); record; record = journal_reader.next()) 
+      {
+        if (record->seq_ <= header.journal_seq_)
+          continue;
+
+        processClientRequest(&record->request_);
+        num_pending_responses_ = num_pending_md_updates_ = 0;
+        ++num_replayed;
+      }
+
+      logger_.log("%:% %() % Recovered from snapshot:% orders:% journal:% seq:% replayed:% last-seq:%\n", __FILE__, __LINE__, __FUNCTION__,
+                  Common::getCurrentTimeStr(&time_str_), snapshot_path, header.num_orders_, header.journal_prefix_, header.journal_seq_,
+                  num_replayed, journal_reader.lastSeq());
+
+      publishBooks();
+    }
+
+    const auto now = Common::getCurrentNanos();
+    last_snapshot_path_ = snapshotPath(now);
+    ASSERT(writeSnapshot(last_snapshot_path_.c_str(), (last_snapshot_path_ + ".tmp").c_str(), now),
+           "Could not write snapshot:" + last_snapshot_path_ + " error:" + std::string(strerror(errno)));
+    last_snapshot_time_ = now;
+
+    if (!snapshot_path.empty()) 
+    {
+      // absolute, MEJournalReplay may well run from some other directory.
+      start_snapshot_path_ = last_snapshot_path_;
+      journal_->setStartSnapshot(std::filesystem::absolute(start_snapshot_path_).string());
+    }
+
+    logger_.log("%:% %() % Recovery done in %ms, snapshot:% journal-start:%\n", __FILE__, __LINE__, __FUNCTION__,
+                Common::getCurrentTimeStr(&time_str_), (now - start_time) / NANOS_TO_MILLIS, last_snapshot_path_,
+                (start_snapshot_path_.empty() ? "empty-books" : start_snapshot_path_));
+  }
+
+  /// Publish every recovered order as an ADD so the market data publisher and the snapshot synthesizer start from the recovered books.
+  /// The market update queue is drained by the publisher as it starts up, so this waits for room instead of overrunning it.
+  auto MatchingEngine::publishBooks() noexcept -> void 
+  {
+    for (const auto order_book : ticker_order_book_) 
+    {
+      if (!order_book)
+        continue;
+
+      order_book->forEachOrder([this](const MEOrder &order) 
+      {
+        if (UNLIKELY(num_pending_md_updates_ == pending_md_updates_.size())) 
+        {
+          while (outgoing_md_updates_->size() + num_pending_md_updates_ > ME_MAX_MARKET_UPDATES / 2) 
+          {
+            using namespace std::literals::chrono_literals;
+            std::this_thread::sleep_for(1ms);
+          }
+          publishMarketUpdates();
+        }
+
+        const MEMarketUpdate market_update{MarketUpdateType::ADD, order.market_order_id_, order.ticker_id_, order.side_,
+                                           order.price_, order.quantity_, order.priority_};
+        sendMarketUpdate(&market_update);
+      });
+    }
+    publishOutputs();
+  }
+}
@@ -2,22 +2,43 @@
 
 // #include "../../Common/ThreadUtils.hpp"
 // #include "../../Common/LFQueue.hpp"
+#include <sys/types.h>
+
 #include "../../Common/Macros.hpp"
+#include "../../Common/WaitStrategy.hpp"
 
 #include "../OrderServer/ClientRequest.hpp"
 #include "../OrderServer/ClientResponse.hpp"
 #include "../MarketData/MarketUpdate.hpp"
 
 #include "MatchingEngineOrderBook.hpp"
+#include "MEJournal.hpp"
 
 namespace Exchange 
 {
+  /// Maximum number of client responses or market updates buffered before they are published to the output queues.
+  constexpr size_t ME_MAX_OUTPUT_BATCH_SIZE = 1024;
+
+  /// A busy matching engine checks whether a snapshot is due once every this many requests.
+  constexpr size_t ME_SNAPSHOT_CHECK_REQUESTS = 1024;
+
+  /// Name of the thread of matching engine shard shard_id, for ANCHOR_PLACEMENT.
+  inline auto matchingEngineThreadName(size_t shard_id)
+  {
+    return "Exchange/MatchingEngine_" + std::to_string(shard_id);
+  }
+
+  /// A MatchingEngine instance is one shard - it owns the order books for ticker_id % num_shards == shard_id and runs on its own core.
+  /// The FIFOSequencer routes each request to its shard, every shard has its own request, response and market update queues.
   class MatchingEngine final 
   {
   public:
     MatchingEngine(ClientRequestLFQueue *client_requests,
                    ClientResponseLFQueue *client_responses,
-                   MEMarketUpdateLFQueue *market_updates);
+                   MEMarketUpdateLFQueue *market_updates,
+                   size_t shard_id, size_t num_shards, int core_id,
+                   const MatchingEngineCfg &cfg, MEJournal *journal,
+                   const std::string &snapshot_dir, Nanos snapshot_interval);
 
     ~MatchingEngine();
 
@@ -28,13 +49,20 @@ namespace Exchange
     auto processClientRequest(const MEClientRequest *client_request) noexcept 
     {
       auto order_book = ticker_order_book_[client_request->ticker_id_];
+      ASSERT(order_book != nullptr, "Shard:" + std::to_string(shard_id_) + " does not own ticker:" + std::to_string(client_request->ticker_id_));
       switch (client_request->type_) 
       {
         case ClientRequestType::NEW: 
         {
+          if (UNLIKELY(client_request->order_type_ == OrderType::INVALID || client_request->tif_ == TimeInForce::INVALID)) 
+          {
+            FATAL("Received invalid order-type:" + orderTypeToString(client_request->order_type_) +
+                  " time-in-force:" + timeInForceToString(client_request->tif_));
+          }
           START_MEASURE(Exchange_MEOrderBook_add);
           order_book->add(client_request->client_id_, client_request->order_id_, client_request->ticker_id_,
-                           client_request->side_, client_request->price_, client_request->quantity_);
+                           client_request->side_, client_request->price_, client_request->quantity_,
+                           client_request->order_type_, client_request->tif_);
           END_MEASURE(Exchange_MEOrderBook_add, logger_);
         }
           break;
@@ -47,6 +75,15 @@ namespace Exchange
         }
           break;
 
+        case ClientRequestType::MODIFY: 
+        {
+          START_MEASURE(Exchange_MEOrderBook_modify);
+          order_book->modify(client_request->client_id_, client_request->order_id_, client_request->ticker_id_,
+                             client_request->price_, client_request->quantity_);
+          END_MEASURE(Exchange_MEOrderBook_modify, logger_);
+        }
+          break;
+
         default: 
         {
           FATAL("Received invalid client-request-type:" + clientRequestTypeToString(client_request->type_));
@@ -55,43 +92,111 @@ namespace Exchange
       }
     }
 
+    auto publishClientResponses() noexcept 
+    {
+      outgoing_ogw_responses_->writeBatch(pending_responses_.data(), num_pending_responses_);
+      TTT_MEASURE(T4t_MatchingEngine_LFQueue_write, logger_);
+      num_pending_responses_ = 0;
+    }
+
+    auto publishMarketUpdates() noexcept 
+    {
+      outgoing_md_updates_->writeBatch(pending_md_updates_.data(), num_pending_md_updates_);
+      TTT_MEASURE(T4_MatchingEngine_LFQueue_write, logger_);
+      num_pending_md_updates_ = 0;
+    }
+
+    /// Client responses and market updates are buffered while a client request is processed, a sweep through many resting orders
+    /// is then published with one queue commit per output stream in publishOutputs().
     auto sendClientResponse(const MEClientResponse *client_response) noexcept 
     {
+#if !defined(NDEBUG)
       logger_.log("%:% %() % Sending %\n", __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str_), client_response->toString());
-      auto next_write = outgoing_ogw_responses_->getNextToWriteTo();
-      *next_write = std::move(*client_response);
-      outgoing_ogw_responses_->updateWriteIndex();
-      TTT_MEASURE(T4t_MatchingEngine_LFQueue_write, logger_);
+#endif
+      if (UNLIKELY(num_pending_responses_ == pending_responses_.size()))
+        publishClientResponses();
+      pending_responses_[num_pending_responses_++] = *client_response;
     }
 
     auto sendMarketUpdate(const MEMarketUpdate *market_update) noexcept 
     {
+#if !defined(NDEBUG)
       logger_.log("%:% %() % Sending %\n", __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str_), market_update->toString());
-      auto next_write = outgoing_md_updates_->getNextToWriteTo();
-      *next_write = *market_update;
-      outgoing_md_updates_->updateWriteIndex();
-      TTT_MEASURE(T4_MatchingEngine_LFQueue_write, logger_);
+#endif
+      if (UNLIKELY(num_pending_md_updates_ == pending_md_updates_.size()))
+        publishMarketUpdates();
+      pending_md_updates_[num_pending_md_updates_++] = *market_update;
+    }
+
+    auto publishOutputs() noexcept 
+    {
+#if !defined(NDEBUG)
+      logger_.log("%:% %() % Publishing % responses % market updates\n", __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str_),
+                  num_pending_responses_, num_pending_md_updates_);
+#endif
+      if (LIKELY(num_pending_responses_))
+        publishClientResponses();
+      if (LIKELY(num_pending_md_updates_))
+        publishMarketUpdates();
     }
 
     auto run() noexcept 
     {
       logger_.log("%:% %() %\n", __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str_));
+      if (!snapshot_dir_.empty())
+        recover();
+
+      size_t num_requests = 0;
+      size_t num_batch_requests = 0;
+      Nanos batch_time = 0;
       while (run_) 
       {
+        // snapshots are only considered when idle or every ME_SNAPSHOT_CHECK_REQUESTS requests, so a busy engine does not read the clock per request.
+        if (snapshot_interval_ && (!incoming_requests_->size() || !(++num_requests % ME_SNAPSHOT_CHECK_REQUESTS)))
+          checkSnapshot();
+
         const auto me_client_request = incoming_requests_->getNextToRead();
         if (LIKELY(me_client_request)) 
         {
           TTT_MEASURE(T3_MatchingEngine_LFQueue_read, logger_);
+#if !defined(NDEBUG)
           logger_.log("%:% %() % Processing %\n", __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str_),
                       me_client_request->toString());
+#endif
+          if (journal_) 
+          {
+            // journal records are stamped once per batch of back-to-back requests rather than reading the clock per request.
+            if (!(num_batch_requests++ % ME_JOURNAL_STAMP_REQUESTS))
+              batch_time = Common::getCurrentNanos();
+            START_MEASURE(Exchange_MEJournal_append);
+            journal_->append(me_client_request, batch_time);
+            END_MEASURE(Exchange_MEJournal_append, logger_);
+          }
           START_MEASURE(Exchange_MatchingEngine_processClientRequest);
           processClientRequest(me_client_request);
           END_MEASURE(Exchange_MatchingEngine_processClientRequest, logger_);
           incoming_requests_->updateReadIndex();
+
+          START_MEASURE(Exchange_MatchingEngine_publishOutputs);
+          publishOutputs();
+          END_MEASURE(Exchange_MatchingEngine_publishOutputs, logger_);
+        } else
+        {
+          num_batch_requests = 0;
         }
+        wait_strategy_.afterPoll(me_client_request != nullptr, [this]() { return incoming_requests_->size() != 0; });
       }
+      logger_.log("%:% %() % %\n", __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str_), wait_strategy_.toString());
     }
 
+    /// Write a snapshot of all order books owned by this shard to path, returns false on any error.
+    /// Does not allocate or log, it runs in a child forked from the matching engine thread.
+    auto writeSnapshot(const char *path, const char *tmp_path, Nanos created) const noexcept -> bool;
+
+    /// Load the order books from the snapshot at path and return its header, nothing is published. Used by a warm restart, and by
+    /// MEJournalReplay to start from the same books the journal's session started from.
+    auto restoreSnapshot(const std::string &path) noexcept -> MESnapshotHeader;
+
     // Deleted default, copy & move constructors and assignment-operators.
     MatchingEngine() = delete;
 
@@ -104,13 +209,49 @@ namespace Exchange
     MatchingEngine &operator=(const MatchingEngine &&) = delete;
 
   private:
+    auto snapshotPath(Nanos created) const -> std::string;
+
+    auto latestSnapshotPath() const -> std::string;
+
+    auto checkSnapshot() noexcept -> void;
+
+    auto recover() noexcept -> void;
+
+    auto publishBooks() noexcept -> void;
+
+    const size_t shard_id_;
+    const size_t num_shards_;
+    const int core_id_;
+    const MatchingEngineCfg cfg_;
+
+    /// Only the order books owned by this shard are allocated, the rest are nullptr.
     OrderBookHashMap ticker_order_book_;
 
     ClientRequestLFQueue *incoming_requests_ = nullptr;
     ClientResponseLFQueue *outgoing_ogw_responses_ = nullptr;
     MEMarketUpdateLFQueue *outgoing_md_updates_ = nullptr;
 
-    volatile bool run_ = false;
+    /// Every request is appended to the journal before it is processed, nullptr if journaling is off.
+    MEJournal *journal_ = nullptr;
+
+    /// Snapshots of all the books are written to snapshot_dir_ from a forked child every snapshot_interval_ and on startup after recovery.
+    /// Off if snapshot_dir_ is empty, periodic snapshots are off if snapshot_interval_ is 0.
+    const std::string snapshot_dir_;
+    const Nanos snapshot_interval_;
+    Nanos last_snapshot_time_ = 0;
+    pid_t snapshot_pid_ = 0;
+    std::string snapshot_path_, snapshot_tmp_path_, last_snapshot_path_;
+
+    /// The snapshot written after a warm restart, the journal of this session starts from it. Kept when newer snapshots replace it.
+    std::string start_snapshot_path_;
+
+    std::array<MEClientResponse, ME_MAX_OUTPUT_BATCH_SIZE> pending_responses_;
+    size_t num_pending_responses_ = 0;
+    std::array<MEMarketUpdate, ME_MAX_OUTPUT_BATCH_SIZE> pending_md_updates_;
+    size_t num_pending_md_updates_ = 0;
+
+    std::atomic<bool> run_ = {false};
+    Common::WaitStrategy wait_strategy_;
 
     std::string time_str_;
     Logger logger_;
@@ -1,6 +1,22 @@
 #include "MatchingEngineOrder.hpp"
 
 namespace Exchange {
+  MEOrderStore::MEOrderStore(size_t capacity)
+      : quantity_(capacity + 1, 0, HugePageAllocator<Quantity>("MEOrderStore quantity"))
+      , prev_(capacity + 1, NONE, HugePageAllocator<MEOrderIndex>("MEOrderStore prev"))
+      , next_(capacity + 1, NONE, HugePageAllocator<MEOrderIndex>("MEOrderStore next"))
+      , client_id_(capacity + 1, ClientId_INVALID, HugePageAllocator<ClientId>("MEOrderStore client id"))
+      , price_(capacity + 1, Price_INVALID, HugePageAllocator<Price>("MEOrderStore price"))
+      , side_(capacity + 1, Side::INVALID, HugePageAllocator<Side>("MEOrderStore side"))
+      , info_(capacity + 1, Info(), HugePageAllocator<Info>("MEOrderStore info"))
+      , free_indices_(HugePageAllocator<MEOrderIndex>("MEOrderStore free indices")) 
+  {
+    ASSERT(capacity < std::numeric_limits<MEOrderIndex>::max(), "MEOrderStore capacity too large for 32 bit indices:" + std::to_string(capacity));
+    free_indices_.reserve(capacity);
+    for (auto index = static_cast<MEOrderIndex>(capacity); index != NONE; --index)
+      free_indices_.push_back(index);
+  }
+
   auto MEOrder::toString() const -> std::string {
     std::stringstream ss;
     ss << "MEOrder" << "["
@@ -11,9 +27,7 @@ namespace Exchange {
        << "side:" << sideToString(side_) << " "
        << "price:" << priceToString(price_) << " "
        << "quantity:" << quantityToString(quantity_) << " "
-       << "prio:" << priorityToString(priority_) << " "
-       << "prev:" << orderIdToString(prev_order_ ? prev_order_->market_order_id_ : OrderId_INVALID) << " "
-       << "next:" << orderIdToString(next_order_ ? next_order_->market_order_id_ : OrderId_INVALID) << "]";
+       << "prio:" << priorityToString(priority_) << "]";
 
     return ss.str();
   }
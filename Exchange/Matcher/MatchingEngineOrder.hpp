@@ -2,12 +2,16 @@
 
 #include <array>
 #include <sstream>
+#include <vector>
 #include "../../Common/Types.hpp"
+#include "../../Common/HugePages.hpp"
+#include "../../Common/OrderBookCore.hpp"
 
 using namespace Common;
 
 namespace Exchange 
 {
+  /// A resting order as a whole, as handed out by MEOrderStore::order() - the book itself keeps the fields in separate arrays.
   struct MEOrder 
   {
     TickerId ticker_id_ = TickerId_INVALID;
@@ -19,29 +23,122 @@ namespace Exchange
     Quantity quantity_ = Quantity_INVALID;
     Priority priority_ = Priority_INVALID;
 
-    MEOrder *prev_order_ = nullptr;
-    MEOrder *next_order_ = nullptr;
+    auto toString() const -> std::string;
+  };
 
-    // only needed for use with MemPool.
-    MEOrder() = default;
+  /// Position of an order in an MEOrderStore. The links between orders are these 32 bit indices instead of 64 bit pointers, and 0 is
+  /// never handed out so zero filled memory reads as no order.
+  typedef uint32_t MEOrderIndex;
+  constexpr MEOrderIndex MEOrderIndex_INVALID = 0;
 
-    MEOrder(TickerId ticker_id, ClientId client_id, OrderId client_order_id, OrderId market_order_id, Side side, Price price,
-                     Quantity quantity, Priority priority, MEOrder *prev_order, MEOrder *next_order) noexcept
-        : ticker_id_(ticker_id)
-        , client_id_(client_id)
-        , client_order_id_(client_order_id)
-        , market_order_id_(market_order_id)
-        , side_(side)
-        , price_(price)
-        , quantity_(quantity)
-        , priority_(priority)
-        , prev_order_(prev_order)
-        , next_order_(next_order) {}
+  /// The resting orders of an MEOrderBook as a structure of arrays - walking a price level and filling orders touches the quantity and
+  /// link arrays, 12 bytes per order, instead of pulling in a whole ~80 byte order per step. The client id array is only read when
+  /// self-trade prevention is on, price and side when orders are added and removed, the rest when an order is reported on.
+  /// Freed indices are reused last in first out so the most recently touched, likely still cached, slots are handed out first.
+  class MEOrderStore final 
+  {
+  public:
+    typedef MEOrderIndex Handle;
+    static constexpr Handle NONE = MEOrderIndex_INVALID;
 
-    auto toString() const -> std::string;
+    explicit MEOrderStore(size_t capacity);
+
+    auto allocate(TickerId ticker_id, ClientId client_id, OrderId client_order_id, OrderId market_order_id, Side side, Price price,
+                  Quantity quantity, Priority priority) noexcept 
+    {
+      ASSERT(!free_indices_.empty(), "MEOrderStore out of space.");
+      const auto index = free_indices_.back();
+      free_indices_.pop_back();
+
+      quantity_[index] = quantity;
+      prev_[index] = next_[index] = NONE;
+      client_id_[index] = client_id;
+      price_[index] = price;
+      side_[index] = side;
+      info_[index] = {ticker_id, client_order_id, market_order_id, priority};
+
+      return index;
+    }
+
+    auto deallocate(MEOrderIndex index) noexcept 
+    {
+#if !defined (NDEBUG)
+      ASSERT(index != NONE && index < quantity_.size() && free_indices_.size() < quantity_.size() - 1,
+             "Order being deallocated does not belong to this store index:" + std::to_string(index));
+#endif
+      free_indices_.push_back(index);
+    }
+
+    auto quantity(MEOrderIndex index) const noexcept { return quantity_[index]; }
+
+    auto setQuantity(MEOrderIndex index, Quantity quantity) noexcept { quantity_[index] = quantity; }
+
+    auto prev(MEOrderIndex index) const noexcept { return prev_[index]; }
+
+    auto next(MEOrderIndex index) const noexcept { return next_[index]; }
+
+    auto setPrev(MEOrderIndex index, MEOrderIndex prev_index) noexcept { prev_[index] = prev_index; }
+
+    auto setNext(MEOrderIndex index, MEOrderIndex next_index) noexcept { next_[index] = next_index; }
+
+    auto clientId(MEOrderIndex index) const noexcept { return client_id_[index]; }
+
+    auto price(MEOrderIndex index) const noexcept { return price_[index]; }
+
+    auto side(MEOrderIndex index) const noexcept { return side_[index]; }
+
+    auto tickerId(MEOrderIndex index) const noexcept { return info_[index].ticker_id_; }
+
+    auto clientOrderId(MEOrderIndex index) const noexcept { return info_[index].client_order_id_; }
+
+    auto marketOrderId(MEOrderIndex index) const noexcept { return info_[index].market_order_id_; }
+
+    auto priority(MEOrderIndex index) const noexcept { return info_[index].priority_; }
+
+    auto order(MEOrderIndex index) const noexcept -> MEOrder 
+    {
+      return {tickerId(index), clientId(index), clientOrderId(index), marketOrderId(index), side(index), price(index), quantity(index),
+              priority(index)};
+    }
+
+    // Deleted default, copy & move constructors and assignment-operators.
+    MEOrderStore() = delete;
+
+    MEOrderStore(const MEOrderStore &) = delete;
+
+    MEOrderStore(const MEOrderStore &&) = delete;
+
+    MEOrderStore &operator=(const MEOrderStore &) = delete;
+
+    MEOrderStore &operator=(const MEOrderStore &&) = delete;
+
+  private:
+    /// Fields only needed when an order is reported on.
+    struct Info 
+    {
+      TickerId ticker_id_ = TickerId_INVALID;
+      OrderId client_order_id_ = OrderId_INVALID;
+      OrderId market_order_id_ = OrderId_INVALID;
+      Priority priority_ = Priority_INVALID;
+    };
+
+    template<typename T>
+    using Array = std::vector<T, HugePageAllocator<T>>;
+
+    Array<Quantity> quantity_;
+    Array<MEOrderIndex> prev_;
+    Array<MEOrderIndex> next_;
+
+    Array<ClientId> client_id_;
+    Array<Price> price_;
+    Array<Side> side_;
+
+    Array<Info> info_;
+
+    Array<MEOrderIndex> free_indices_;
   };
 
-  typedef std::array<MEOrder *, ME_MAX_ORDER_IDS> OrderHashMap;
+  typedef std::array<MEOrderIndex, ME_MAX_ORDER_IDS> OrderHashMap;
   typedef std::array<OrderHashMap, ME_MAX_NUM_CLIENTS> ClientOrderHashMap;
 
   struct MEOrdersAtPrice 
@@ -49,14 +146,19 @@ namespace Exchange
     Side side_ = Side::INVALID;
     Price price_ = Price_INVALID;
 
-    MEOrder *first_me_order_ = nullptr;
+    /// Sum of the quantity and number of the orders at this price level, kept up to date so FOK checks and level summaries do not have
+    /// to walk the orders.
+    uint64_t total_quantity_ = 0;
+    uint32_t num_orders_ = 0;
+
+    MEOrderIndex first_me_order_ = MEOrderIndex_INVALID;
 
     MEOrdersAtPrice *prev_entry_ = nullptr;
     MEOrdersAtPrice *next_entry_ = nullptr;
 
     MEOrdersAtPrice() = default;
 
-    MEOrdersAtPrice(Side side, Price price, MEOrder *first_me_order, MEOrdersAtPrice *prev_entry, MEOrdersAtPrice *next_entry)
+    MEOrdersAtPrice(Side side, Price price, MEOrderIndex first_me_order, MEOrdersAtPrice *prev_entry, MEOrdersAtPrice *next_entry)
         : side_(side)
         , price_(price)
         , first_me_order_(first_me_order)
@@ -69,7 +171,9 @@ namespace Exchange
       ss << "MEOrdersAtPrice["
          << "side:" << sideToString(side_) << " "
          << "price:" << priceToString(price_) << " "
-         << "first_me_order:" << (first_me_order_ ? first_me_order_->toString() : "null") << " "
+         << "total_quantity:" << total_quantity_ << " "
+         << "num_orders:" << num_orders_ << " "
+         << "first_me_order:" << first_me_order_ << " "
          << "prev:" << priceToString(prev_entry_ ? prev_entry_->price_ : Price_INVALID) << " "
          << "next:" << priceToString(next_entry_ ? next_entry_->price_ : Price_INVALID) << "]";
 
@@ -77,6 +181,21 @@ namespace Exchange
     }
   };
 
-  typedef std::array<MEOrdersAtPrice *, ME_MAX_PRICE_LEVELS> OrdersAtPriceHashMap;
+  /// OrderBookCore policy of MEOrderBook.
+  struct MEOrderBookPolicy
+  {
+    typedef MEOrderStore OrderStore;
+    typedef MEOrdersAtPrice OrdersAtPrice;
+    typedef Common::BitmapLadder Ladder;
+
+    static constexpr size_t MAX_PRICE_LEVELS = ME_MAX_PRICE_LEVELS;
+    static constexpr size_t MAX_ORDERS = ME_MAX_ORDER_IDS;
+    static constexpr bool TRACK_AGGREGATES = true;
+
+    static auto firstOrder(MEOrdersAtPrice *orders_at_price) noexcept -> MEOrderIndex &
+    {
+      return orders_at_price->first_me_order_;
+    }
+  };
 }
 
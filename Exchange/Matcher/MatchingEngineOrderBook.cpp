@@ -2,11 +2,12 @@
 #include "MatchingEngine.hpp"
 
 namespace Exchange {
-  MEOrderBook::MEOrderBook(TickerId ticker_id, Logger *logger, MatchingEngine *matching_engine)
+  MEOrderBook::MEOrderBook(TickerId ticker_id, Logger *logger, MatchingEngine *matching_engine, const MatchingEngineCfg &cfg)
       : ticker_id_(ticker_id)
       , matching_engine_(matching_engine)
-      , orders_at_price_pool_(ME_MAX_PRICE_LEVELS)
-      , order_pool_(ME_MAX_ORDER_IDS)
+      , cfg_(cfg)
+      , stp_enabled_(cfg.stp_mode_ != STPMode::NONE)
+      , orders_(core_.orders())
       , logger_(logger) {}
 
   MEOrderBook::~MEOrderBook() {
@@ -14,36 +15,37 @@ namespace Exchange {
                 toString(false, true));
 
     matching_engine_ = nullptr;
-    bids_by_price_ = asks_by_price_ = nullptr;
     for (auto &itr: cid_oid_to_order_) 
     {
-      itr.fill(nullptr);
+      itr.fill(MEOrderIndex_INVALID);
     }
   }
 
-  auto MEOrderBook::match(TickerId ticker_id, ClientId client_id, Side side, OrderId client_order_id, OrderId new_market_order_id, MEOrder* itr, Quantity* leaves_quantity) noexcept {
-    const auto order = itr;
-    const auto order_quantity = order->quantity_;
+  auto MEOrderBook::match(TickerId ticker_id, ClientId client_id, Side side, OrderId client_order_id, OrderId new_market_order_id, MEOrderIndex order, Quantity* leaves_quantity) noexcept {
+    const auto order_quantity = orders_.quantity(order);
     const auto fill_quantity = std::min(*leaves_quantity, order_quantity);
 
     *leaves_quantity -= fill_quantity;
-    order->quantity_ -= fill_quantity;
+    core_.setQuantity(order, order_quantity - fill_quantity);
 
     client_response_ = {ClientResponseType::FILLED, client_id, ticker_id, client_order_id,
-                        new_market_order_id, side, itr->price_, fill_quantity, *leaves_quantity};
+                        new_market_order_id, side, orders_.price(order), fill_quantity, *leaves_quantity};
     matching_engine_->sendClientResponse(&client_response_);
 
-    client_response_ = {ClientResponseType::FILLED, order->client_id_, ticker_id, order->client_order_id_,
-                        order->market_order_id_, order->side_, itr->price_, fill_quantity, order->quantity_};
+    client_response_ = {ClientResponseType::FILLED, orders_.clientId(order), ticker_id, orders_.clientOrderId(order),
+                        orders_.marketOrderId(order), orders_.side(order), orders_.price(order), fill_quantity, orders_.quantity(order)};
     matching_engine_->sendClientResponse(&client_response_);
 
-    market_update_ = {MarketUpdateType::TRADE, OrderId_INVALID, ticker_id, side, itr->price_, fill_quantity, Priority_INVALID};
-    matching_engine_->sendMarketUpdate(&market_update_);
+    if (!cfg_.aggregate_trades_) 
+    {
+      market_update_ = {MarketUpdateType::TRADE, OrderId_INVALID, ticker_id, side, orders_.price(order), fill_quantity, Priority_INVALID};
+      matching_engine_->sendMarketUpdate(&market_update_);
+    }
 
-    if (!order->quantity_) 
+    if (!orders_.quantity(order)) 
     {
-      market_update_ = {MarketUpdateType::CANCEL, order->market_order_id_, ticker_id, order->side_,
-                        order->price_, order_quantity, Priority_INVALID};
+      market_update_ = {MarketUpdateType::CANCEL, orders_.marketOrderId(order), ticker_id, orders_.side(order),
+                        orders_.price(order), order_quantity, Priority_INVALID};
       matching_engine_->sendMarketUpdate(&market_update_);
       
       START_MEASURE(Exchange_MEOrderBook_removeOrder);
@@ -51,61 +53,190 @@ namespace Exchange {
       END_MEASURE(Exchange_MEOrderBook_removeOrder, (*logger_));
     } else 
     {
-      market_update_ = {MarketUpdateType::MODIFY, order->market_order_id_, ticker_id, order->side_,
-                        order->price_, order->quantity_, order->priority_};
+      market_update_ = {MarketUpdateType::MODIFY, orders_.marketOrderId(order), ticker_id, orders_.side(order),
+                        orders_.price(order), orders_.quantity(order), orders_.priority(order)};
+      matching_engine_->sendMarketUpdate(&market_update_);
+    }
+  }
+
+  /// Called instead of match() when the resting order itr belongs to the client behind the aggressive order, applies cfg_.stp_mode_.
+  /// Nothing trades and nothing is published as a TRADE, both clients are told what happened to their orders. price is what the
+  /// aggressive order is reported at, Price_INVALID for MARKET orders.
+  auto MEOrderBook::preventSelfTrade(ClientId client_id, OrderId client_order_id, TickerId ticker_id, Side side, Price price,
+                                     OrderId new_market_order_id, MEOrderIndex order, Quantity *leaves_quantity) noexcept 
+  {
+    auto cancel_quantity = *leaves_quantity; // CANCEL_NEWEST
+    auto decrement_quantity = orders_.quantity(order); // CANCEL_OLDEST
+    if (cfg_.stp_mode_ == STPMode::DECREMENT_BOTH)
+      cancel_quantity = decrement_quantity = std::min(*leaves_quantity, orders_.quantity(order));
+    else if (cfg_.stp_mode_ == STPMode::CANCEL_NEWEST)
+      decrement_quantity = 0;
+    else
+      cancel_quantity = 0;
+
+    logger_->log("%:% %() % STP:% client:% aggressor:%/% resting:%/% cancel:% decrement:%\n", __FILE__, __LINE__, __FUNCTION__,
+                 Common::getCurrentTimeStr(&time_str_), stpModeToString(cfg_.stp_mode_), client_id, client_order_id, *leaves_quantity,
+                 orders_.clientOrderId(order), orders_.quantity(order), cancel_quantity, decrement_quantity);
+
+    *leaves_quantity -= cancel_quantity;
+    if (!*leaves_quantity) 
+    {
+      client_response_ = {ClientResponseType::CANCELED, client_id, ticker_id, client_order_id, new_market_order_id,
+                          side, price, Quantity_INVALID, cancel_quantity};
+      matching_engine_->sendClientResponse(&client_response_);
+    } else if (cancel_quantity) 
+    {
+      // DECREMENT_BOTH with more left of the aggressive order than of the resting one, it carries on matching with less.
+      client_response_ = {ClientResponseType::MODIFIED, client_id, ticker_id, client_order_id, new_market_order_id,
+                          side, price, 0, *leaves_quantity};
+      matching_engine_->sendClientResponse(&client_response_);
+    }
+
+    if (!decrement_quantity)
+      return;
+
+    const auto order_quantity = orders_.quantity(order);
+    core_.setQuantity(order, order_quantity - decrement_quantity);
+
+    if (!orders_.quantity(order)) 
+    {
+      client_response_ = {ClientResponseType::CANCELED, orders_.clientId(order), ticker_id, orders_.clientOrderId(order), orders_.marketOrderId(order),
+                          orders_.side(order), orders_.price(order), Quantity_INVALID, order_quantity};
+      matching_engine_->sendClientResponse(&client_response_);
+
+      market_update_ = {MarketUpdateType::CANCEL, orders_.marketOrderId(order), ticker_id, orders_.side(order),
+                        orders_.price(order), order_quantity, Priority_INVALID};
+      matching_engine_->sendMarketUpdate(&market_update_);
+
+      START_MEASURE(Exchange_MEOrderBook_removeOrder);
+      removeOrder(order);
+      END_MEASURE(Exchange_MEOrderBook_removeOrder, (*logger_));
+    } else 
+    {
+      // the resting order keeps its queue priority, same as an in-place quantity decrease through modify().
+      client_response_ = {ClientResponseType::MODIFIED, orders_.clientId(order), ticker_id, orders_.clientOrderId(order), orders_.marketOrderId(order),
+                          orders_.side(order), orders_.price(order), 0, orders_.quantity(order)};
+      matching_engine_->sendClientResponse(&client_response_);
+
+      market_update_ = {MarketUpdateType::MODIFY, orders_.marketOrderId(order), ticker_id, orders_.side(order),
+                        orders_.price(order), orders_.quantity(order), orders_.priority(order)};
       matching_engine_->sendMarketUpdate(&market_update_);
     }
   }
 
-  auto MEOrderBook::checkForMatch(ClientId client_id, OrderId client_order_id, TickerId ticker_id, Side side, Price price, Quantity quantity, Quantity new_market_order_id) noexcept {
+  auto MEOrderBook::publishLevelTrade(TickerId ticker_id, Side side, Price price, Quantity quantity) noexcept 
+  {
+    market_update_ = {MarketUpdateType::TRADE, OrderId_INVALID, ticker_id, side, price, quantity, Priority_INVALID};
+    matching_engine_->sendMarketUpdate(&market_update_);
+  }
+
+  /// With cfg_.aggregate_trades_ the quantity traded at each price level is summed up and published as one TRADE once the sweep
+  /// moves past that level, so it only ever contains what actually traded and never what self-trade prevention took out.
+  auto MEOrderBook::checkForMatch(ClientId client_id, OrderId client_order_id, TickerId ticker_id, Side side, Price limit_price, Price price,
+                                  Quantity quantity, Quantity new_market_order_id) noexcept {
     auto leaves_quantity = quantity;
+    auto level_price = Price_INVALID;
+    Quantity level_quantity = 0;
 
     if (side == Side::BUY) 
     {
-      while (leaves_quantity && asks_by_price_) 
+      while (leaves_quantity && core_.bestOrdersByPrice(Side::SELL)) 
       {
-        const auto ask_itr = asks_by_price_->first_me_order_;
-        if (LIKELY(price < ask_itr->price_)) 
+        const auto asks_by_price = core_.bestOrdersByPrice(Side::SELL);
+        const auto ask_itr = asks_by_price->first_me_order_;
+        if (LIKELY(limit_price < asks_by_price->price_)) 
         {
           break;
         }
+        if (UNLIKELY(stp_enabled_ && orders_.clientId(ask_itr) == client_id)) 
+        {
+          preventSelfTrade(client_id, client_order_id, ticker_id, side, price, new_market_order_id, ask_itr, &leaves_quantity);
+          continue;
+        }
+        if (cfg_.aggregate_trades_ && asks_by_price->price_ != level_price) 
+        {
+          if (level_quantity)
+            publishLevelTrade(ticker_id, side, level_price, level_quantity);
+          level_price = asks_by_price->price_;
+          level_quantity = 0;
+        }
+        const auto leaves_before_match = leaves_quantity;
         START_MEASURE(Exchange_MEOrderBook_match);
         match(ticker_id, client_id, side, client_order_id, new_market_order_id, ask_itr, &leaves_quantity);
         END_MEASURE(Exchange_MEOrderBook_match, (*logger_));
+        level_quantity += leaves_before_match - leaves_quantity;
       }
     }
     if (side == Side::SELL) 
     {
-      while (leaves_quantity && bids_by_price_) 
+      while (leaves_quantity && core_.bestOrdersByPrice(Side::BUY)) 
       {
-        const auto bid_itr = bids_by_price_->first_me_order_;
-        if (LIKELY(price > bid_itr->price_)) {
+        const auto bids_by_price = core_.bestOrdersByPrice(Side::BUY);
+        const auto bid_itr = bids_by_price->first_me_order_;
+        if (LIKELY(limit_price > bids_by_price->price_)) {
           break;
         }
+        if (UNLIKELY(stp_enabled_ && orders_.clientId(bid_itr) == client_id)) 
+        {
+          preventSelfTrade(client_id, client_order_id, ticker_id, side, price, new_market_order_id, bid_itr, &leaves_quantity);
+          continue;
+        }
+        if (cfg_.aggregate_trades_ && bids_by_price->price_ != level_price) 
+        {
+          if (level_quantity)
+            publishLevelTrade(ticker_id, side, level_price, level_quantity);
+          level_price = bids_by_price->price_;
+          level_quantity = 0;
+        }
+        const auto leaves_before_match = leaves_quantity;
         START_MEASURE(Exchange_MEOrderBook_match);
         match(ticker_id, client_id, side, client_order_id, new_market_order_id, bid_itr, &leaves_quantity);
         END_MEASURE(Exchange_MEOrderBook_match, (*logger_));
+        level_quantity += leaves_before_match - leaves_quantity;
       }
     }
 
+    if (cfg_.aggregate_trades_ && level_quantity)
+      publishLevelTrade(ticker_id, side, level_price, level_quantity);
+
     return leaves_quantity;
   }
 
-  auto MEOrderBook::add(ClientId client_id, OrderId client_order_id, TickerId ticker_id, Side side, Price price, Quantity quantity) noexcept -> void {
+  auto MEOrderBook::add(ClientId client_id, OrderId client_order_id, TickerId ticker_id, Side side, Price price, Quantity quantity,
+                        OrderType order_type, TimeInForce tif) noexcept -> void {
     const auto new_market_order_id = generateNewMarketOrderId();
-    client_response_ = {ClientResponseType::ACCEPTED, client_id, ticker_id, client_order_id, new_market_order_id, side, price, 0, quantity};
+    client_response_ = {ClientResponseType::ACCEPTED, client_id, ticker_id, client_order_id, new_market_order_id, side, price, 0, quantity,
+                        RejectReason::INVALID, ClientRequestType::NEW};
     matching_engine_->sendClientResponse(&client_response_);
 
-    START_MEASURE(Exchange_MEOrderBook_checkForMatch);
-    const auto leaves_quantity = checkForMatch(client_id, client_order_id, ticker_id, side, price, quantity, new_market_order_id);
-    END_MEASURE(Exchange_MEOrderBook_checkForMatch, (*logger_));
-    
+    // MARKET orders have no price limit, they trade against whatever is available on the other side. Responses never carry the
+    // sentinel limit, a MARKET order that is canceled is reported without a price.
+    const auto limit_price = (order_type == OrderType::MARKET ?
+                              (side == Side::BUY ? std::numeric_limits<Price>::max() : std::numeric_limits<Price>::min()) : price);
+    const auto response_price = (order_type == OrderType::MARKET ? Price_INVALID : price);
+
+    auto leaves_quantity = quantity;
+    if (tif != TimeInForce::FOK || canFill(client_id, side, limit_price, quantity)) 
+    {
+      START_MEASURE(Exchange_MEOrderBook_checkForMatch);
+      leaves_quantity = checkForMatch(client_id, client_order_id, ticker_id, side, limit_price, response_price, quantity, new_market_order_id);
+      END_MEASURE(Exchange_MEOrderBook_checkForMatch, (*logger_));
+    }
+
+    if (UNLIKELY(leaves_quantity && (order_type == OrderType::MARKET || tif != TimeInForce::DAY))) 
+    {
+      // IOC, FOK and MARKET orders never rest, whatever did not trade is canceled right away and never shows up in market data.
+      client_response_ = {ClientResponseType::CANCELED, client_id, ticker_id, client_order_id, new_market_order_id,
+                          side, response_price, Quantity_INVALID, leaves_quantity};
+      matching_engine_->sendClientResponse(&client_response_);
+      return;
+    }
+
     if (LIKELY(leaves_quantity)) 
     {
       const auto priority = getNextPriority(price);
 
-      auto order = order_pool_.allocate(ticker_id, client_id, client_order_id, new_market_order_id, side, price, leaves_quantity, priority, nullptr,
-                                        nullptr);
+      auto order = core_.allocateOrder(ticker_id, client_id, client_order_id, new_market_order_id, side, price, leaves_quantity, priority);
       
       START_MEASURE(Exchange_MEOrderBook_addOrder);
       addOrder(order);
@@ -119,24 +250,25 @@ namespace Exchange {
   auto MEOrderBook::cancel(ClientId client_id, OrderId order_id, TickerId ticker_id) noexcept -> void 
   {
     auto is_cancelable = (client_id < cid_oid_to_order_.size());
-    MEOrder *exchange_order = nullptr;
+    auto exchange_order = MEOrderIndex_INVALID;
     if (LIKELY(is_cancelable)) 
     {
       auto &co_itr = cid_oid_to_order_.at(client_id);
       exchange_order = co_itr.at(order_id);
-      is_cancelable = (exchange_order != nullptr);
+      is_cancelable = (exchange_order != MEOrderIndex_INVALID);
     }
 
     if (UNLIKELY(!is_cancelable)) 
     {
       client_response_ = {ClientResponseType::CANCEL_REJECTED, client_id, ticker_id, order_id, OrderId_INVALID,
-                          Side::INVALID, Price_INVALID, Quantity_INVALID, Quantity_INVALID};
+                          Side::INVALID, Price_INVALID, Quantity_INVALID, Quantity_INVALID, RejectReason::INVALID, ClientRequestType::CANCEL};
     } else 
     {
-      client_response_ = {ClientResponseType::CANCELED, client_id, ticker_id, order_id, exchange_order->market_order_id_,
-                          exchange_order->side_, exchange_order->price_, Quantity_INVALID, exchange_order->quantity_};
-      market_update_ = {MarketUpdateType::CANCEL, exchange_order->market_order_id_, ticker_id, exchange_order->side_, exchange_order->price_, 0,
-                        exchange_order->priority_};
+      client_response_ = {ClientResponseType::CANCELED, client_id, ticker_id, order_id, orders_.marketOrderId(exchange_order),
+                          orders_.side(exchange_order), orders_.price(exchange_order), Quantity_INVALID, orders_.quantity(exchange_order),
+                          RejectReason::INVALID, ClientRequestType::CANCEL};
+      market_update_ = {MarketUpdateType::CANCEL, orders_.marketOrderId(exchange_order), ticker_id, orders_.side(exchange_order), orders_.price(exchange_order), 0,
+                        orders_.priority(exchange_order)};
       
       START_MEASURE(Exchange_MEOrderBook_removeOrder);
       removeOrder(exchange_order);
@@ -148,6 +280,86 @@ namespace Exchange {
     matching_engine_->sendClientResponse(&client_response_);
   }
 
+  /// Replace the price and / or quantity of a live order with a single response and a single market update.
+  /// A quantity decrease at the same price is done in place and keeps queue priority, anything else re-queues the order at the back
+  /// of the (new) price level and can trade against the other side just like a new order would.
+  auto MEOrderBook::modify(ClientId client_id, OrderId order_id, TickerId ticker_id, Price price, Quantity quantity) noexcept -> void 
+  {
+    auto exchange_order = MEOrderIndex_INVALID;
+    if (LIKELY(client_id < cid_oid_to_order_.size() && order_id < ME_MAX_ORDER_IDS))
+      exchange_order = cid_oid_to_order_.at(client_id).at(order_id);
+
+    if (UNLIKELY(!exchange_order || !quantity || quantity == Quantity_INVALID || price == Price_INVALID)) 
+    {
+      client_response_ = {ClientResponseType::MODIFY_REJECTED, client_id, ticker_id, order_id, OrderId_INVALID,
+                          Side::INVALID, Price_INVALID, Quantity_INVALID, Quantity_INVALID, RejectReason::INVALID, ClientRequestType::MODIFY};
+      matching_engine_->sendClientResponse(&client_response_);
+      return;
+    }
+
+    const auto market_order_id = orders_.marketOrderId(exchange_order);
+    const auto side = orders_.side(exchange_order);
+
+    if (price == orders_.price(exchange_order) && quantity <= orders_.quantity(exchange_order)) 
+    {
+      core_.setQuantity(exchange_order, quantity);
+
+      client_response_ = {ClientResponseType::MODIFIED, client_id, ticker_id, order_id, market_order_id, side, price, 0, quantity,
+                          RejectReason::INVALID, ClientRequestType::MODIFY};
+      matching_engine_->sendClientResponse(&client_response_);
+
+      market_update_ = {MarketUpdateType::MODIFY, market_order_id, ticker_id, side, price, quantity, orders_.priority(exchange_order)};
+      matching_engine_->sendMarketUpdate(&market_update_);
+      return;
+    }
+
+    const auto old_price = orders_.price(exchange_order);
+    const auto old_quantity = orders_.quantity(exchange_order);
+    START_MEASURE(Exchange_MEOrderBook_removeOrder);
+    removeOrder(exchange_order);
+    END_MEASURE(Exchange_MEOrderBook_removeOrder, (*logger_));
+
+    client_response_ = {ClientResponseType::MODIFIED, client_id, ticker_id, order_id, market_order_id, side, price, 0, quantity,
+                        RejectReason::INVALID, ClientRequestType::MODIFY};
+    matching_engine_->sendClientResponse(&client_response_);
+
+    START_MEASURE(Exchange_MEOrderBook_checkForMatch);
+    const auto leaves_quantity = checkForMatch(client_id, order_id, ticker_id, side, price, price, quantity, market_order_id);
+    END_MEASURE(Exchange_MEOrderBook_checkForMatch, (*logger_));
+
+    if (LIKELY(leaves_quantity)) 
+    {
+      const auto priority = getNextPriority(price);
+
+      auto order = core_.allocateOrder(ticker_id, client_id, order_id, market_order_id, side, price, leaves_quantity, priority);
+
+      START_MEASURE(Exchange_MEOrderBook_addOrder);
+      addOrder(order);
+      END_MEASURE(Exchange_MEOrderBook_addOrder, (*logger_));
+
+      market_update_ = {MarketUpdateType::MODIFY, market_order_id, ticker_id, side, price, leaves_quantity, priority};
+    } else 
+    {
+      // fully filled on the way in, the resting order disappears from the book.
+      market_update_ = {MarketUpdateType::CANCEL, market_order_id, ticker_id, side, old_price, old_quantity, Priority_INVALID};
+    }
+    matching_engine_->sendMarketUpdate(&market_update_);
+  }
+
+  auto MEOrderBook::restore(const MESnapshotBook *snapshot_book, const MESnapshotOrder *snapshot_orders) noexcept -> void 
+  {
+    ASSERT(!core_.bestOrdersByPrice(Side::BUY) && !core_.bestOrdersByPrice(Side::SELL), "Restoring into a non-empty book for ticker:" + std::to_string(ticker_id_));
+
+    for (uint64_t i = 0; i < snapshot_book->num_orders_; ++i) 
+    {
+      const auto &snapshot_order = snapshot_orders[i];
+      auto order = core_.allocateOrder(ticker_id_, snapshot_order.client_id_, snapshot_order.client_order_id_, snapshot_order.market_order_id_,
+                                        snapshot_order.side_, snapshot_order.price_, snapshot_order.quantity_, snapshot_order.priority_);
+      addOrder(order);
+    }
+    next_market_order_id_ = snapshot_book->next_market_order_id_;
+  }
+
   auto MEOrderBook::toString(bool detailed, bool validity_check) const -> std::string 
   {
     std::stringstream ss;
@@ -158,28 +370,28 @@ namespace Exchange {
       Quantity quantity = 0;
       size_t num_orders = 0;
 
-      for (auto o_itr = itr->first_me_order_;; o_itr = o_itr->next_order_) 
+      for (auto o_itr = itr->first_me_order_;; o_itr = orders_.next(o_itr)) 
       {
-        quantity += o_itr->quantity_;
+        quantity += orders_.quantity(o_itr);
         ++num_orders;
-        if (o_itr->next_order_ == itr->first_me_order_)
+        if (orders_.next(o_itr) == itr->first_me_order_)
           break;
       }
       sprintf(buf, " <px:%3s p:%3s n:%3s> %-3s @ %-5s(%-4s)",
               priceToString(itr->price_).c_str(), priceToString(itr->prev_entry_->price_).c_str(), priceToString(itr->next_entry_->price_).c_str(),
               priceToString(itr->price_).c_str(), quantityToString(quantity).c_str(), std::to_string(num_orders).c_str());
       ss << buf;
-      for (auto o_itr = itr->first_me_order_;; o_itr = o_itr->next_order_) 
+      for (auto o_itr = itr->first_me_order_;; o_itr = orders_.next(o_itr)) 
       {
         if (detailed) 
         {
           sprintf(buf, "[oid:%s q:%s p:%s n:%s] ",
-                  orderIdToString(o_itr->market_order_id_).c_str(), quantityToString(o_itr->quantity_).c_str(),
-                  orderIdToString(o_itr->prev_order_ ? o_itr->prev_order_->market_order_id_ : OrderId_INVALID).c_str(),
-                  orderIdToString(o_itr->next_order_ ? o_itr->next_order_->market_order_id_ : OrderId_INVALID).c_str());
+                  orderIdToString(orders_.marketOrderId(o_itr)).c_str(), quantityToString(orders_.quantity(o_itr)).c_str(),
+                  orderIdToString(orders_.marketOrderId(orders_.prev(o_itr))).c_str(),
+                  orderIdToString(orders_.marketOrderId(orders_.next(o_itr))).c_str());
           ss << buf;
         }
-        if (o_itr->next_order_ == itr->first_me_order_)
+        if (orders_.next(o_itr) == itr->first_me_order_)
           break;
       }
 
@@ -187,6 +399,11 @@ namespace Exchange {
 
       if (sanity_check)
       {
+        if (quantity != itr->total_quantity_ || num_orders != itr->num_orders_) 
+        {
+          FATAL("Price level total quantity:" + std::to_string(itr->total_quantity_) + " num orders:" + std::to_string(itr->num_orders_) +
+                " does not match orders:" + quantityToString(quantity) + "/" + std::to_string(num_orders) + " itr:" + itr->toString());
+        }
         if ((side == Side::SELL && last_price >= itr->price_) || (side == Side::BUY && last_price <= itr->price_)) 
         {
           FATAL("Bids/Asks not sorted by ascending/descending prices last:" + priceToString(last_price) + " itr:" + itr->toString());
@@ -197,12 +414,13 @@ namespace Exchange {
 
     ss << "Ticker:" << tickerIdToString(ticker_id_) << std::endl;
     {
-      auto ask_itr = asks_by_price_;
+      const auto asks_by_price = core_.bestOrdersByPrice(Side::SELL);
+      auto ask_itr = asks_by_price;
       auto last_ask_price = std::numeric_limits<Price>::min();
       for (size_t count = 0; ask_itr; ++count) 
       {
         ss << "ASKS L:" << count << " => ";
-        auto next_ask_itr = (ask_itr->next_entry_ == asks_by_price_ ? nullptr : ask_itr->next_entry_);
+        auto next_ask_itr = (ask_itr->next_entry_ == asks_by_price ? nullptr : ask_itr->next_entry_);
         printer(ss, ask_itr, Side::SELL, last_ask_price, validity_check);
         ask_itr = next_ask_itr;
       }
@@ -211,12 +429,13 @@ namespace Exchange {
     ss << std::endl << "                          X" << std::endl << std::endl;
 
     {
-      auto bid_itr = bids_by_price_;
+      const auto bids_by_price = core_.bestOrdersByPrice(Side::BUY);
+      auto bid_itr = bids_by_price;
       auto last_bid_price = std::numeric_limits<Price>::max();
       for (size_t count = 0; bid_itr; ++count) 
       {
         ss << "BIDS L:" << count << " => ";
-        auto next_bid_itr = (bid_itr->next_entry_ == bids_by_price_ ? nullptr : bid_itr->next_entry_);
+        auto next_bid_itr = (bid_itr->next_entry_ == bids_by_price ? nullptr : bid_itr->next_entry_);
         printer(ss, bid_itr, Side::BUY, last_bid_price, validity_check);
         bid_itr = next_bid_itr;
       }
@@ -7,6 +7,7 @@
 #include "../MarketData/MarketUpdate.hpp"
 
 #include "MatchingEngineOrder.hpp"
+#include "MESnapshot.hpp"
 
 using namespace Common;
 
@@ -17,16 +18,46 @@ namespace Exchange
   class MEOrderBook final 
   {
   public:
-    explicit MEOrderBook(TickerId ticker_id, Logger *logger, MatchingEngine *matching_engine);
+    explicit MEOrderBook(TickerId ticker_id, Logger *logger, MatchingEngine *matching_engine, const MatchingEngineCfg &cfg);
 
     ~MEOrderBook();
 
-    auto add(ClientId client_id, OrderId client_order_id, TickerId ticker_id, Side side, Price price, Quantity quantity) noexcept -> void;
+    auto add(ClientId client_id, OrderId client_order_id, TickerId ticker_id, Side side, Price price, Quantity quantity,
+             OrderType order_type, TimeInForce tif) noexcept -> void;
 
     auto cancel(ClientId client_id, OrderId order_id, TickerId ticker_id) noexcept -> void;
 
+    auto modify(ClientId client_id, OrderId order_id, TickerId ticker_id, Price price, Quantity quantity) noexcept -> void;
+
     auto toString(bool detailed, bool validity_check) const -> std::string;
 
+    /// Visits every resting order as an MEOrder - bids then asks, best price first and in queue priority order within a price level.
+    template<typename F>
+    auto forEachOrder(F &&f) const noexcept 
+    {
+      core_.forEachOrder([this, &f](MEOrderIndex order) { f(orders_.order(order)); });
+    }
+
+    auto nextMarketOrderId() const noexcept 
+    {
+      return next_market_order_id_;
+    }
+
+    /// Rebuild an empty book from a snapshot, orders have to be in the order forEachOrder() visits them in.
+    auto restore(const MESnapshotBook *snapshot_book, const MESnapshotOrder *snapshot_orders) noexcept -> void;
+
+    /// Puts the whole book, cid_oid_to_order_ included, on transparent huge pages. Not pre-faulted - cid_oid_to_order_ has a row of
+    /// ME_MAX_ORDER_IDS entries for every possible client and only the rows of clients that send orders are ever touched.
+    static auto operator new(size_t size) -> void *
+    {
+      return allocateHugePages(size, "MEOrderBook", false);
+    }
+
+    static auto operator delete(void *ptr) noexcept -> void
+    {
+      deallocateHugePages(ptr);
+    }
+
     // Deleted default, copy & move constructors and assignment-operators.
     MEOrderBook() = delete;
 
@@ -43,15 +74,15 @@ namespace Exchange
 
     MatchingEngine *matching_engine_ = nullptr;
 
-    ClientOrderHashMap cid_oid_to_order_;
+    const MatchingEngineCfg cfg_;
 
-    MemPool<MEOrdersAtPrice> orders_at_price_pool_;
-    MEOrdersAtPrice *bids_by_price_ = nullptr;
-    MEOrdersAtPrice *asks_by_price_ = nullptr;
+    /// Cached from cfg_, with it off the match loop never reads the client id of the resting orders it sweeps.
+    const bool stp_enabled_ = false;
 
-    OrdersAtPriceHashMap price_orders_at_price_;
+    ClientOrderHashMap cid_oid_to_order_;
 
-    MemPool<MEOrder> order_pool_;
+    OrderBookCore<MEOrderBookPolicy> core_;
+    MEOrderStore &orders_;
 
     MEClientResponse client_response_;
     MEMarketUpdate market_update_;
@@ -66,157 +97,73 @@ namespace Exchange
       return next_market_order_id_++;
     }
 
-    auto priceToIndex(Price price) const noexcept 
+    auto getNextPriority(Price price) noexcept 
     {
-      return (price % ME_MAX_PRICE_LEVELS);
-    }
+      const auto orders_at_price = core_.getOrdersAtPrice(price);
+      if (!orders_at_price)
+        return 1lu;
 
-    auto getOrdersAtPrice(Price price) const noexcept -> MEOrdersAtPrice * 
-    {
-      return price_orders_at_price_.at(priceToIndex(price));
+      return orders_.priority(orders_.prev(orders_at_price->first_me_order_)) + 1;
     }
 
-    auto addOrdersAtPrice(MEOrdersAtPrice *new_orders_at_price) noexcept 
+    /// Check if there is at least quantity available on the other side at limit_price or better, this only visits price levels, not orders.
+    /// With self-trade prevention on, client_id's own resting orders do not count - CANCEL_OLDEST skips them, while under
+    /// CANCEL_NEWEST and DECREMENT_BOTH reaching one of them ends the fill, so only the quantity queued ahead of it counts.
+    auto canFill(ClientId client_id, Side side, Price limit_price, Quantity quantity) const noexcept 
     {
-      price_orders_at_price_.at(priceToIndex(new_orders_at_price->price_)) = new_orders_at_price;
-
-      const auto best_orders_by_price = (new_orders_at_price->side_ == Side::BUY ? bids_by_price_ : asks_by_price_);
-      if (UNLIKELY(!best_orders_by_price)) 
-      {
-        (new_orders_at_price->side_ == Side::BUY ? bids_by_price_ : asks_by_price_) = new_orders_at_price;
-        new_orders_at_price->prev_entry_ = new_orders_at_price->next_entry_ = new_orders_at_price;
-      } else 
+      const auto best_orders_by_price = core_.bestOrdersByPrice(side == Side::BUY ? Side::SELL : Side::BUY);
+      uint64_t available_quantity = 0;
+      for (auto orders_at_price = best_orders_by_price; orders_at_price; ) 
       {
-        auto target = best_orders_by_price;
-        bool add_after = ((new_orders_at_price->side_ == Side::SELL && new_orders_at_price->price_ > target->price_) ||
-                          (new_orders_at_price->side_ == Side::BUY && new_orders_at_price->price_ < target->price_));
-        if (add_after) 
-        {
-          target = target->next_entry_;
-          add_after = ((new_orders_at_price->side_ == Side::SELL && new_orders_at_price->price_ > target->price_) ||
-                       (new_orders_at_price->side_ == Side::BUY && new_orders_at_price->price_ < target->price_));
-        }
-        while (add_after && target != best_orders_by_price) 
-        {
-          add_after = ((new_orders_at_price->side_ == Side::SELL && new_orders_at_price->price_ > target->price_) ||
-                       (new_orders_at_price->side_ == Side::BUY && new_orders_at_price->price_ < target->price_));
-          if (add_after)
-            target = target->next_entry_;
-        }
+        if ((side == Side::BUY && orders_at_price->price_ > limit_price) || (side == Side::SELL && orders_at_price->price_ < limit_price))
+          break;
 
-        if (add_after) 
-        { // add new_orders_at_price after target.
-          if (target == best_orders_by_price) 
+        if (UNLIKELY(stp_enabled_)) 
+        {
+          auto order = orders_at_price->first_me_order_;
+          do 
           {
-            target = best_orders_by_price->prev_entry_;
-          }
-          new_orders_at_price->prev_entry_ = target;
-          target->next_entry_->prev_entry_ = new_orders_at_price;
-          new_orders_at_price->next_entry_ = target->next_entry_;
-          target->next_entry_ = new_orders_at_price;
+            if (orders_.clientId(order) != client_id)
+              available_quantity += orders_.quantity(order);
+            else if (cfg_.stp_mode_ != STPMode::CANCEL_OLDEST)
+              return (available_quantity >= quantity);
+            if (available_quantity >= quantity)
+              return true;
+            order = orders_.next(order);
+          } while (order != orders_at_price->first_me_order_);
         } else 
-        { // add new_orders_at_price before target.
-          new_orders_at_price->prev_entry_ = target->prev_entry_;
-          new_orders_at_price->next_entry_ = target;
-          target->prev_entry_->next_entry_ = new_orders_at_price;
-          target->prev_entry_ = new_orders_at_price;
-
-          if ((new_orders_at_price->side_ == Side::BUY && new_orders_at_price->price_ > best_orders_by_price->price_) ||
-              (new_orders_at_price->side_ == Side::SELL && new_orders_at_price->price_ < best_orders_by_price->price_)) 
-          {
-            target->next_entry_ = (target->next_entry_ == best_orders_by_price ? new_orders_at_price : target->next_entry_);
-            (new_orders_at_price->side_ == Side::BUY ? bids_by_price_ : asks_by_price_) = new_orders_at_price;
-          }
-        }
-      }
-    }
-
-    auto removeOrdersAtPrice(Side side, Price price) noexcept 
-    {
-      const auto best_orders_by_price = (side == Side::BUY ? bids_by_price_ : asks_by_price_);
-      auto orders_at_price = getOrdersAtPrice(price);
-
-      if (UNLIKELY(orders_at_price->next_entry_ == orders_at_price)) 
-      { // empty side of book.
-        (side == Side::BUY ? bids_by_price_ : asks_by_price_) = nullptr;
-      } else 
-      {
-        orders_at_price->prev_entry_->next_entry_ = orders_at_price->next_entry_;
-        orders_at_price->next_entry_->prev_entry_ = orders_at_price->prev_entry_;
-
-        if (orders_at_price == best_orders_by_price) 
         {
-          (side == Side::BUY ? bids_by_price_ : asks_by_price_) = orders_at_price->next_entry_;
+          available_quantity += orders_at_price->total_quantity_;
         }
+        if (available_quantity >= quantity)
+          return true;
 
-        orders_at_price->prev_entry_ = orders_at_price->next_entry_ = nullptr;
+        orders_at_price = (orders_at_price->next_entry_ == best_orders_by_price ? nullptr : orders_at_price->next_entry_);
       }
-
-      price_orders_at_price_.at(priceToIndex(price)) = nullptr;
-
-      orders_at_price_pool_.deallocate(orders_at_price);
+      return false;
     }
 
-    auto getNextPriority(Price price) noexcept 
-    {
-      const auto orders_at_price = getOrdersAtPrice(price);
-      if (!orders_at_price)
-        return 1lu;
+    auto match(TickerId ticker_id, ClientId client_id, Side side, OrderId client_order_id, OrderId new_market_order_id, MEOrderIndex order, Quantity* leaves_quantity) noexcept;
 
-      return orders_at_price->first_me_order_->prev_order_->priority_ + 1;
-    }
+    auto preventSelfTrade(ClientId client_id, OrderId client_order_id, TickerId ticker_id, Side side, Price price, OrderId new_market_order_id,
+                          MEOrderIndex order, Quantity *leaves_quantity) noexcept;
 
-    auto match(TickerId ticker_id, ClientId client_id, Side side, OrderId client_order_id, OrderId new_market_order_id, MEOrder* bid_itr, Quantity* leaves_quantity) noexcept;
+    auto publishLevelTrade(TickerId ticker_id, Side side, Price price, Quantity quantity) noexcept;
 
-    auto checkForMatch(ClientId client_id, OrderId client_order_id, TickerId ticker_id, Side side, Price price, Quantity quantity, Quantity new_market_order_id) noexcept;
+    /// Match an aggressive order against the other side up to limit_price, price is what the order is reported at in responses.
+    auto checkForMatch(ClientId client_id, OrderId client_order_id, TickerId ticker_id, Side side, Price limit_price, Price price,
+                       Quantity quantity, Quantity new_market_order_id) noexcept;
 
-    auto removeOrder(MEOrder *order) noexcept 
+    auto removeOrder(MEOrderIndex order) noexcept 
     {
-      auto orders_at_price = getOrdersAtPrice(order->price_);
-
-      if (order->prev_order_ == order) 
-      { // only one element.
-        removeOrdersAtPrice(order->side_, order->price_);
-      } else 
-      { // remove the link.
-        const auto order_before = order->prev_order_;
-        const auto order_after = order->next_order_;
-        order_before->next_order_ = order_after;
-        order_after->prev_order_ = order_before;
-
-        if (orders_at_price->first_me_order_ == order) 
-        {
-          orders_at_price->first_me_order_ = order_after;
-        }
-
-        order->prev_order_ = order->next_order_ = nullptr;
-      }
-
-      cid_oid_to_order_.at(order->client_id_).at(order->client_order_id_) = nullptr;
-      order_pool_.deallocate(order);
+      cid_oid_to_order_.at(orders_.clientId(order)).at(orders_.clientOrderId(order)) = MEOrderIndex_INVALID;
+      core_.removeOrder(order);
     }
 
-    auto addOrder(MEOrder *order) noexcept 
+    auto addOrder(MEOrderIndex order) noexcept 
     {
-      const auto orders_at_price = getOrdersAtPrice(order->price_);
-
-      if (!orders_at_price) 
-      {
-        order->next_order_ = order->prev_order_ = order;
-
-        auto new_orders_at_price = orders_at_price_pool_.allocate(order->side_, order->price_, order, nullptr, nullptr);
-        addOrdersAtPrice(new_orders_at_price);
-      } else 
-      {
-        auto first_order = (orders_at_price ? orders_at_price->first_me_order_ : nullptr);
-
-        first_order->prev_order_->next_order_ = order;
-        order->prev_order_ = first_order->prev_order_;
-        order->next_order_ = first_order;
-        first_order->prev_order_ = order;
-      }
-
-      cid_oid_to_order_.at(order->client_id_).at(order->client_order_id_) = order;
+      core_.addOrder(order);
+      cid_oid_to_order_.at(orders_.clientId(order)).at(orders_.clientOrderId(order)) = order;
     }
   };
 
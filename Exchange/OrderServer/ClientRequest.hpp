@@ -13,7 +13,11 @@ namespace Exchange
   {
     INVALID = 0,
     NEW = 1,
-    CANCEL = 2
+    CANCEL = 2,
+    MODIFY = 3, // replace price_ and quantity_ of a live order, keeps queue priority only if the price is unchanged and the quantity does not go up.
+    // session requests, answered by the order server itself. They are not part of the request sequence, their seq_num_ is the argument.
+    SEQUENCE_RESET = 4, // the client's next request has sequence number seq_num_, also moves the session to the connection it came on.
+    RESEND_REQUEST = 5  // send the responses from sequence number seq_num_ on again.
   };
 
   inline std::string clientRequestTypeToString(ClientRequestType type) 
@@ -24,12 +28,23 @@ namespace Exchange
         return "NEW";
       case ClientRequestType::CANCEL:
         return "CANCEL";
+      case ClientRequestType::MODIFY:
+        return "MODIFY";
+      case ClientRequestType::SEQUENCE_RESET:
+        return "SEQUENCE_RESET";
+      case ClientRequestType::RESEND_REQUEST:
+        return "RESEND_REQUEST";
       case ClientRequestType::INVALID:
         return "INVALID";
     }
     return "UNKNOWN";
   }
 
+  inline auto isSessionRequestType(ClientRequestType type) noexcept -> bool
+  {
+    return (type == ClientRequestType::SEQUENCE_RESET || type == ClientRequestType::RESEND_REQUEST);
+  }
+
 #pragma pack(push, 1)
 
   struct MEClientRequest 
@@ -42,6 +57,8 @@ namespace Exchange
     Side side_ = Side::INVALID;
     Price price_ = Price_INVALID;
     Quantity quantity_ = Quantity_INVALID;
+    OrderType order_type_ = OrderType::INVALID;
+    TimeInForce tif_ = TimeInForce::INVALID;
 
     auto toString() const 
     {
@@ -55,6 +72,8 @@ namespace Exchange
          << " side:" << sideToString(side_)
          << " quantity:" << quantityToString(quantity_)
          << " price:" << priceToString(price_)
+         << " order_type:" << orderTypeToString(order_type_)
+         << " tif:" << timeInForceToString(tif_)
          << "]";
       return ss.str();
     }
@@ -80,5 +99,8 @@ namespace Exchange
 #pragma pack(pop)
 
   typedef LFQueue<MEClientRequest> ClientRequestLFQueue;
+
+  /// One queue per matching engine shard, indexed by shard id.
+  typedef std::vector<ClientRequestLFQueue *> ClientRequestLFQueues;
 }
 
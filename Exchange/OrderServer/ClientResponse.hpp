@@ -5,6 +5,8 @@
 #include "../../Common/Types.hpp"
 #include "../../Common/LFQueue.hpp"
 
+#include "ClientRequest.hpp"
+
 using namespace Common;
 
 namespace Exchange 
@@ -15,7 +17,11 @@ namespace Exchange
     ACCEPTED = 1,
     CANCELED = 2,
     FILLED = 3,
-    CANCEL_REJECTED = 4
+    CANCEL_REJECTED = 4,
+    MODIFIED = 5,
+    MODIFY_REJECTED = 6,
+    REJECTED = 7, // refused by the order server before sequencing, for any request type - reject_reason_ says why.
+    SEQUENCE_RESET = 8 // session response, not part of the response sequence - the next response has sequence number seq_num_.
   };
 
   inline std::string clientResponseTypeToString(ClientResponseType type) 
@@ -30,12 +36,75 @@ namespace Exchange
         return "FILLED";
       case ClientResponseType::CANCEL_REJECTED:
         return "CANCEL_REJECTED";
+      case ClientResponseType::MODIFIED:
+        return "MODIFIED";
+      case ClientResponseType::MODIFY_REJECTED:
+        return "MODIFY_REJECTED";
+      case ClientResponseType::REJECTED:
+        return "REJECTED";
+      case ClientResponseType::SEQUENCE_RESET:
+        return "SEQUENCE_RESET";
       case ClientResponseType::INVALID:
         return "INVALID";
     }
     return "UNKNOWN";
   }
 
+  /// Why the order server rejected a request, INVALID on every other response.
+  enum class RejectReason : uint8_t 
+  {
+    INVALID = 0,
+    INVALID_REQUEST_TYPE = 1,
+    INVALID_TICKER = 2,
+    INVALID_SIDE = 3,
+    INVALID_ORDER_TYPE = 4,
+    INVALID_TIF = 5,
+    INVALID_PRICE = 6,
+    INVALID_QUANTITY = 7,
+    ORDER_TOO_LARGE = 8,
+    NOTIONAL_TOO_LARGE = 9,
+    THROTTLED = 10, // over the message rate - for a session request also a second one within a pass, not part of the response sequence then.
+    INVALID_SEQ_NUM = 11, // the client has to send a SEQUENCE_RESET, every request is rejected until it does.
+    INVALID_SESSION = 12, // the ClientId is in session on another connection, not part of the response sequence. A SEQUENCE_RESET moves it.
+    MAX = 13
+  };
+
+  inline std::string rejectReasonToString(RejectReason reason) 
+  {
+    switch (reason) 
+    {
+      case RejectReason::INVALID_REQUEST_TYPE:
+        return "INVALID_REQUEST_TYPE";
+      case RejectReason::INVALID_TICKER:
+        return "INVALID_TICKER";
+      case RejectReason::INVALID_SIDE:
+        return "INVALID_SIDE";
+      case RejectReason::INVALID_ORDER_TYPE:
+        return "INVALID_ORDER_TYPE";
+      case RejectReason::INVALID_TIF:
+        return "INVALID_TIF";
+      case RejectReason::INVALID_PRICE:
+        return "INVALID_PRICE";
+      case RejectReason::INVALID_QUANTITY:
+        return "INVALID_QUANTITY";
+      case RejectReason::ORDER_TOO_LARGE:
+        return "ORDER_TOO_LARGE";
+      case RejectReason::NOTIONAL_TOO_LARGE:
+        return "NOTIONAL_TOO_LARGE";
+      case RejectReason::THROTTLED:
+        return "THROTTLED";
+      case RejectReason::INVALID_SEQ_NUM:
+        return "INVALID_SEQ_NUM";
+      case RejectReason::INVALID_SESSION:
+        return "INVALID_SESSION";
+      case RejectReason::INVALID:
+        return "INVALID";
+      case RejectReason::MAX:
+        return "MAX";
+    }
+    return "UNKNOWN";
+  }
+
 #pragma pack(push, 1)
 
   struct MEClientResponse 
@@ -49,6 +118,11 @@ namespace Exchange
     Price price_ = Price_INVALID;
     Quantity exec_quantity_ = Quantity_INVALID;
     Quantity leaves_quantity_ = Quantity_INVALID;
+    RejectReason reject_reason_ = RejectReason::INVALID;
+    /// Which request this response answers - INVALID for fills, for the rest of an IOC and for what self-trade prevention does, which
+    /// can look just like the answer to a CANCEL or MODIFY on the same order. The order server rejects without going through the
+    /// matching engine, so a REJECTED can overtake the responses to earlier requests of the same order.
+    ClientRequestType request_type_ = ClientRequestType::INVALID;
 
     auto toString() const 
     {
@@ -63,8 +137,10 @@ namespace Exchange
          << " side:" << sideToString(side_)
          << " exec_quantity:" << quantityToString(exec_quantity_)
          << " leaves_quantity:" << quantityToString(leaves_quantity_)
-         << " price:" << priceToString(price_)
-         << "]";
+         << " price:" << priceToString(price_);
+      if (type_ == ClientResponseType::REJECTED)
+        ss << " request:" << clientRequestTypeToString(request_type_) << " reason:" << rejectReasonToString(reject_reason_);
+      ss << "]";
       return ss.str();
     }
   };
@@ -89,5 +165,8 @@ namespace Exchange
 #pragma pack(pop)
 
   typedef LFQueue<MEClientResponse> ClientResponseLFQueue;
+
+  /// One queue per matching engine shard, indexed by shard id.
+  typedef std::vector<ClientResponseLFQueue *> ClientResponseLFQueues;
 }
 
@@ -0,0 +1,145 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdlib>
+
+#include "../../Common/Macros.hpp"
+#include "../../Common/TimeUtils.hpp"
+#include "../../Common/Types.hpp"
+
+#include "ClientRequest.hpp"
+#include "ClientResponse.hpp"
+
+namespace Exchange
+{
+  /// Pre-trade checks the order server runs on every request before it is sequenced - field validation, the per client order size and
+  /// notional limits and a token bucket per client on the message rate. A request that fails never reaches the matching engines, so a
+  /// misbehaving client cannot crash them or use up their capacity for everybody else.
+  class ClientRiskGate final
+  {
+  public:
+    explicit ClientRiskGate(const ClientRiskCfg &cfg)
+        : cfg_(cfg)
+        , max_tokens_(cfg.max_message_burst_ ? cfg.max_message_burst_ : cfg.max_messages_per_sec_)
+    {
+      ASSERT(cfg_.max_messages_per_sec_ >= 0 && cfg_.max_message_burst_ >= 0 && cfg_.max_notional_ >= 0,
+             "Invalid client risk limits:" + cfg_.toString());
+      ASSERT(!cfg_.max_message_burst_ || cfg_.max_messages_per_sec_, "A message burst needs a message rate:" + cfg_.toString());
+      for (auto &bucket : buckets_)
+        bucket.tokens_ = max_tokens_;
+    }
+
+    /// RejectReason::INVALID when request can be sequenced, why it has to be rejected otherwise. client_id_ has to be valid, rx_time is
+    /// when the request arrived. Every request takes a token, including ones failing the other checks.
+    auto check(const MEClientRequest &request, Nanos rx_time) noexcept -> RejectReason
+    {
+      const auto reason = checkRequest(request, rx_time);
+      ++rejects_[static_cast<size_t>(reason)];
+      return reason;
+    }
+
+    /// SEQUENCE_RESET and RESEND_REQUEST only take a token, RejectReason::THROTTLED when there is none left. Not sequenced, but a resend
+    /// can replay thousands of responses, so they count against the same message rate as everything else.
+    auto checkSessionRequest(const MEClientRequest &request, Nanos rx_time) noexcept -> RejectReason
+    {
+      const auto reason = (takeToken(request.client_id_, rx_time) ? RejectReason::INVALID : RejectReason::THROTTLED);
+      ++rejects_[static_cast<size_t>(reason)];
+      return reason;
+    }
+
+    auto toString() const
+    {
+      std::stringstream ss;
+      ss << "ClientRiskGate[" << cfg_.toString() << " accepted:" << rejects_[static_cast<size_t>(RejectReason::INVALID)];
+      for (size_t i = static_cast<size_t>(RejectReason::INVALID) + 1; i < static_cast<size_t>(RejectReason::MAX); ++i)
+      {
+        if (rejects_[i])
+          ss << " " << rejectReasonToString(static_cast<RejectReason>(i)) << ":" << rejects_[i];
+      }
+      ss << "]";
+      return ss.str();
+    }
+
+    // Deleted default, copy & move constructors and assignment-operators.
+    ClientRiskGate() = delete;
+
+    ClientRiskGate(const ClientRiskGate &) = delete;
+
+    ClientRiskGate(const ClientRiskGate &&) = delete;
+
+    ClientRiskGate &operator=(const ClientRiskGate &) = delete;
+
+    ClientRiskGate &operator=(const ClientRiskGate &&) = delete;
+
+  private:
+    auto takeToken(ClientId client_id, Nanos rx_time) noexcept -> bool
+    {
+      if (!cfg_.max_messages_per_sec_)
+        return true;
+
+      // refill for the time since the last request, capped at the bucket depth - a client that was quiet can burst, but not more.
+      auto &bucket = buckets_[client_id];
+      if (rx_time > bucket.last_rx_time_)
+      {
+        bucket.tokens_ = std::min(max_tokens_, bucket.tokens_ + (rx_time - bucket.last_rx_time_) * cfg_.max_messages_per_sec_ / NANOS_TO_SECS);
+        bucket.last_rx_time_ = rx_time;
+      }
+      if (UNLIKELY(bucket.tokens_ < 1))
+        return false;
+      bucket.tokens_ -= 1;
+      return true;
+    }
+
+    auto checkRequest(const MEClientRequest &request, Nanos rx_time) noexcept -> RejectReason
+    {
+      if (UNLIKELY(!takeToken(request.client_id_, rx_time)))
+        return RejectReason::THROTTLED;
+
+      if (UNLIKELY(request.type_ != ClientRequestType::NEW && request.type_ != ClientRequestType::CANCEL &&
+                   request.type_ != ClientRequestType::MODIFY))
+        return RejectReason::INVALID_REQUEST_TYPE;
+      if (UNLIKELY(request.ticker_id_ >= ME_MAX_TICKERS))
+        return RejectReason::INVALID_TICKER;
+      if (request.type_ == ClientRequestType::CANCEL)
+        return RejectReason::INVALID;
+
+      if (request.type_ == ClientRequestType::NEW)
+      {
+        if (UNLIKELY(request.side_ != Side::BUY && request.side_ != Side::SELL))
+          return RejectReason::INVALID_SIDE;
+        if (UNLIKELY(request.order_type_ != OrderType::LIMIT && request.order_type_ != OrderType::MARKET))
+          return RejectReason::INVALID_ORDER_TYPE;
+        if (UNLIKELY(request.tif_ != TimeInForce::DAY && request.tif_ != TimeInForce::IOC && request.tif_ != TimeInForce::FOK))
+          return RejectReason::INVALID_TIF;
+      }
+
+      const auto has_price = (request.type_ == ClientRequestType::MODIFY || request.order_type_ == OrderType::LIMIT);
+      if (UNLIKELY(has_price && request.price_ == Price_INVALID))
+        return RejectReason::INVALID_PRICE;
+      if (UNLIKELY(!request.quantity_ || request.quantity_ == Quantity_INVALID))
+        return RejectReason::INVALID_QUANTITY;
+      if (UNLIKELY(cfg_.max_order_size_ && request.quantity_ > cfg_.max_order_size_))
+        return RejectReason::ORDER_TOO_LARGE;
+      if (UNLIKELY(has_price && cfg_.max_notional_ &&
+                   static_cast<double>(std::abs(request.price_)) * request.quantity_ > cfg_.max_notional_))
+        return RejectReason::NOTIONAL_TOO_LARGE;
+
+      return RejectReason::INVALID;
+    }
+
+    const ClientRiskCfg cfg_;
+    const double max_tokens_;
+
+    struct TokenBucket
+    {
+      double tokens_ = 0;
+      Nanos last_rx_time_ = 0;
+    };
+
+    /// Hash map from ClientId -> that client's message budget.
+    std::array<TokenBucket, ME_MAX_NUM_CLIENTS> buckets_;
+
+    /// Counts by RejectReason, the accepted ones under RejectReason::INVALID.
+    std::array<uint64_t, static_cast<size_t>(RejectReason::MAX)> rejects_ = {};
+  };
+}
@@ -16,9 +16,12 @@ namespace Exchange
   class FIFOSequencer 
   {
   public:
-    FIFOSequencer(ClientRequestLFQueue *client_requests, Logger *logger)
+    FIFOSequencer(const ClientRequestLFQueues &client_requests, Logger *logger)
         : incoming_requests_(client_requests)
-        , logger_(logger) {}
+        , logger_(logger) 
+    {
+      ASSERT(!incoming_requests_.empty(), "FIFOSequencer needs at least one matching engine shard.");
+    }
 
     ~FIFOSequencer() {}
 
@@ -47,9 +50,11 @@ namespace Exchange
         logger_->log("%:% %() % Writing RX:% Req:% to FIFO.\n", __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str_),
                      client_request.recv_time_, client_request.request_.toString());
 #endif
-        auto next_write = incoming_requests_->getNextToWriteTo();
+        // route to the matching engine shard which owns this ticker, requests for the same ticker stay in FIFO order.
+        auto shard_requests = incoming_requests_[client_request.request_.ticker_id_ % incoming_requests_.size()];
+        auto next_write = shard_requests->getNextToWriteTo();
         *next_write = std::move(client_request.request_);
-        incoming_requests_->updateWriteIndex();
+        shard_requests->updateWriteIndex();
         TTT_MEASURE(T2_OrderServer_LFQueue_write, (*logger_));
       }
 
@@ -68,7 +73,7 @@ namespace Exchange
     FIFOSequencer &operator=(const FIFOSequencer &&) = delete;
 
   private:
-    ClientRequestLFQueue *incoming_requests_ = nullptr;
+    const ClientRequestLFQueues incoming_requests_;
 
     std::string time_str_;
     Logger *logger_ = nullptr;
@@ -1,40 +1,307 @@
 #include "OrderServer.hpp"
 #include "FIFOSequencer.hpp"
 
+#include <algorithm>
 #include <chrono>
 #include <thread>
 
 namespace Exchange
 {
-  OrderServer::OrderServer(ClientRequestLFQueue *client_requests, 
-                           ClientResponseLFQueue *client_responses, 
-                           const std::string &iface, int port)
+  OrderServer::OrderServer(const ClientRequestLFQueues &client_requests, 
+                           const ClientResponseLFQueues &client_responses, 
+                           const std::string &iface, int port,
+                           TransportType transport_type,
+                           Common::IoEngineType io_engine,
+                           const ClientRiskCfg &client_risk_cfg)
     : iface_(iface)
     , port_(port)
     , outgoing_responses_(client_responses)
+    , wait_strategy_(Common::waitStrategyType(ORDER_SERVER_THREAD, Common::WaitStrategyType::BUSY_SPIN))
     , logger_("exchange_order_server.log")
     , tcp_server_(logger_)
     , fifo_sequencer_(client_requests, &logger_)
+    , transport_type_(transport_type)
+    , risk_gate_(client_risk_cfg)
     {
       cid_next_outgoing_seq_num_.fill(1);
       cid_next_exp_seq_num_.fill(1);
       cid_tcp_socket_.fill(nullptr);
+      cid_session_request_pass_.fill(0);
+      cid_response_history_.fill(nullptr);
+      cid_shm_session_id_.fill(0);
+      cid_shm_requests_.fill(nullptr);
+      cid_shm_responses_.fill(nullptr);
+      for (auto responses : outgoing_responses_)
+        responses->setConsumerWaitStrategy(&Common::componentWaitStrategy(ORDER_SERVER_THREAD, wait_strategy_));
       tcp_server_.recv_callback_ = [this](auto socket, auto rx_time)
                                    { recvCallback(socket, rx_time); };
       tcp_server_.recv_finished_callback_ = [this](){ recvFinishedCallback(); };
+      if (transport_type_ == TransportType::SOCKET && io_engine == Common::IoEngineType::IO_URING)
+        ring_ = new Common::IoUring(ORDER_SERVER_THREAD);
   }
 
   auto OrderServer::start() -> void
   {
     run_ = true;
-    tcp_server_.listen(iface_, port_);
-    ASSERT(Common::createAndStartThread(2, "Exchange/OrderServer", 
+    if (transport_type_ == TransportType::SHM) 
+    {
+      shm_session_table_ = static_cast<ShmSessionTable *>(
+          Common::mapSharedMemory(shmSessionTableName(), sizeof(ShmSessionTable), /*create*/ true));
+    } else 
+    {
+      tcp_server_.listen(iface_, port_, ring_);
+    }
+    if (const auto budget = Common::reactorBudget(ORDER_SERVER_THREAD))
+    {
+      reactor_id_ = Common::reactor().add(ORDER_SERVER_THREAD, budget, [this]() { return poll(); }, [this]() { return hasWork(); });
+      return;
+    }
+    ASSERT(Common::createAndStartThread(ORDER_SERVER_CORE, ORDER_SERVER_THREAD, 
       [this](){ run(); }), "Failed to start OrderServer thread");
   }
 
   auto OrderServer::stop() -> void
   {
     run_ = false;
+    if (reactor_id_)
+    {
+      Common::reactor().remove(reactor_id_);
+      reactor_id_ = 0;
+    } else
+    {
+      wait_strategy_.wakeUp();
+    }
+  }
+
+  /// Map the rings of any client that (re)connected and drop the rings of any client that went away.
+  auto OrderServer::checkShmSessions() noexcept -> void
+  {
+    for (size_t client_id = 0; client_id < ME_MAX_NUM_CLIENTS; ++client_id)
+    {
+      const auto session_id = shm_session_table_->client_session_id_[client_id].load(std::memory_order_acquire);
+      if (LIKELY(session_id == cid_shm_session_id_[client_id]))
+        continue;
+
+      delete cid_shm_requests_[client_id];
+      cid_shm_requests_[client_id] = nullptr;
+      delete cid_shm_responses_[client_id];
+      cid_shm_responses_[client_id] = nullptr;
+
+      cid_shm_session_id_[client_id] = session_id;
+      if (session_id)
+      {
+        // a new session's requests start from the first sequence number, same as a new TCP connection on the client side. The response
+        // stream carries on like it does for a TCP reconnect - the client's SEQUENCE_RESET tells it where, and a RESEND_REQUEST gets it
+        // whatever was sent while it was away.
+        cid_shm_requests_[client_id] = new ShmClientRequestQueue(shmClientRequestQueueName(client_id), SHM_ORDER_QUEUE_SIZE, /*create*/ false);
+        cid_shm_responses_[client_id] = new ShmClientResponseQueue(shmClientResponseQueueName(client_id), SHM_ORDER_QUEUE_SIZE, /*create*/ false);
+        cid_next_exp_seq_num_[client_id] = 1;
+        if (!cid_response_history_[client_id])
+          startSession(client_id);
+      }
+
+      logger_.log("%:% %() % Shared memory session ClientId:% session:%\n", __FILE__, __LINE__, __FUNCTION__,
+                  Common::getCurrentTimeStr(&time_str_), client_id, session_id);
+    }
+  }
+
+  auto OrderServer::pollSharedMemory() noexcept -> bool
+  {
+    const auto session_changes = shm_session_table_->session_changes_.load(std::memory_order_acquire);
+    if (UNLIKELY(session_changes != shm_last_session_changes_))
+    {
+      shm_last_session_changes_ = session_changes;
+      checkShmSessions();
+    }
+
+    bool have_requests = false;
+    for (size_t client_id = 0; client_id < ME_MAX_NUM_CLIENTS; ++client_id)
+    {
+      auto requests = cid_shm_requests_[client_id];
+      if (LIKELY(requests == nullptr))
+        continue;
+
+      for (auto request = requests->getNextToRead(); request; request = requests->getNextToRead())
+      {
+        TTT_MEASURE(T1_OrderServer_ShmSPSCQueue_read, logger_);
+        logger_.log("%:% %() % Received %\n", __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str_), request->toString());
+
+        auto &next_exp_seq_num = cid_next_exp_seq_num_[client_id];
+        if (UNLIKELY(request->me_client_request_.client_id_ != client_id))
+        {
+          // the ring is the session, a request with some other ClientId on it is a broken client - nothing it could resync.
+          logger_.log("%:% %() % Incorrect ClientId on ring:% %\n", __FILE__, __LINE__, __FUNCTION__,
+                      Common::getCurrentTimeStr(&time_str_), client_id, request->toString());
+        } else if (UNLIKELY(isSessionRequest(request->me_client_request_)))
+        {
+          onSessionRequest(request, nullptr, getCurrentNanos());
+        } else if (UNLIKELY(request->seq_num_ != next_exp_seq_num))
+        {
+          logger_.log("%:% %() % Incorrect sequence number on ring:% SeqNum expected:% received:%\n", __FILE__, __LINE__, __FUNCTION__,
+                      Common::getCurrentTimeStr(&time_str_), client_id, next_exp_seq_num, request->seq_num_);
+          rejectClientRequest(request->me_client_request_, RejectReason::INVALID_SEQ_NUM);
+        } else
+        {
+          ++next_exp_seq_num;
+          const auto rx_time = getCurrentNanos();
+          START_MEASURE(Exchange_ClientRiskGate_check);
+          const auto reject_reason = risk_gate_.check(request->me_client_request_, rx_time);
+          END_MEASURE(Exchange_ClientRiskGate_check, logger_);
+          if (UNLIKELY(reject_reason != RejectReason::INVALID))
+          {
+            rejectClientRequest(request->me_client_request_, reject_reason);
+          } else
+          {
+            START_MEASURE(Exchange_FIFOSequencer_addClientRequest);
+            fifo_sequencer_.addClientRequest(rx_time, request->me_client_request_);
+            END_MEASURE(Exchange_FIFOSequencer_addClientRequest, logger_);
+          }
+          have_requests = true;
+        }
+        requests->updateReadIndex();
+      }
+    }
+
+    if (have_requests)
+      recvFinishedCallback();
+    return have_requests;
+  }
+
+  auto OrderServer::startSession(ClientId client_id) noexcept -> void
+  {
+    if (!cid_response_history_[client_id])
+      cid_response_history_[client_id] = new OMClientResponse[ME_MAX_RESPONSE_HISTORY];
+    std::fill(cid_response_history_[client_id], cid_response_history_[client_id] + ME_MAX_RESPONSE_HISTORY, OMClientResponse{});
+  }
+
+  auto OrderServer::onSessionRequest(const OMClientRequest *request, Common::TCPSocket *socket, Nanos rx_time) noexcept -> void
+  {
+    const auto client_id = request->me_client_request_.client_id_;
+    logger_.log("%:% %() % Session request % socket:%\n", __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str_),
+                request->toString(), (socket ? socket->socket_fd_ : -1));
+
+    // every answer can replay up to ME_MAX_RESPONSE_HISTORY responses, a client flooding them would flood its connection in turn.
+    if (UNLIKELY(cid_session_request_pass_[client_id] == passes_ ||
+                 risk_gate_.checkSessionRequest(request->me_client_request_, rx_time) != RejectReason::INVALID))
+    {
+      rejectClientRequest(request->me_client_request_, RejectReason::THROTTLED, false, socket);
+      return;
+    }
+    cid_session_request_pass_[client_id] = passes_;
+
+    if (request->me_client_request_.type_ == ClientRequestType::SEQUENCE_RESET)
+    {
+      if (socket && cid_tcp_socket_[client_id] != socket)
+      {
+        // the client reconnected, its responses go to the new connection from here on.
+        logger_.log("%:% %() % Moving ClientId:% from socket:% to socket:%\n", __FILE__, __LINE__, __FUNCTION__,
+                    Common::getCurrentTimeStr(&time_str_), client_id, cid_tcp_socket_[client_id]->socket_fd_, socket->socket_fd_);
+        cid_tcp_socket_[client_id] = socket;
+      }
+      cid_next_exp_seq_num_[client_id] = request->seq_num_;
+
+      // tell the client where the response stream is, so it can ask for anything it missed.
+      resendClientResponses(client_id, cid_next_outgoing_seq_num_[client_id]);
+      return;
+    }
+
+    if (socket && cid_tcp_socket_[client_id] != socket)
+    {
+      rejectClientRequest(request->me_client_request_, RejectReason::INVALID_SESSION, false, socket);
+      return;
+    }
+    resendClientResponses(client_id, request->seq_num_);
+  }
+
+  auto OrderServer::resendClientResponses(ClientId client_id, size_t seq_num) noexcept -> void
+  {
+    const auto next_outgoing_seq_num = cid_next_outgoing_seq_num_[client_id];
+    const auto oldest_seq_num = (next_outgoing_seq_num > ME_MAX_RESPONSE_HISTORY ? next_outgoing_seq_num - ME_MAX_RESPONSE_HISTORY : 1);
+    const auto first_seq_num = std::min(std::max(seq_num, oldest_seq_num), next_outgoing_seq_num);
+
+    // nothing to replay, or the start of it is gone - a SEQUENCE_RESET takes the client to the first response it can still get.
+    if (first_seq_num != seq_num || first_seq_num == next_outgoing_seq_num)
+    {
+      const MEClientResponse reset{ClientResponseType::SEQUENCE_RESET, client_id, TickerId_INVALID, OrderId_INVALID, OrderId_INVALID,
+                                   Side::INVALID, Price_INVALID, Quantity_INVALID, Quantity_INVALID, RejectReason::INVALID};
+      writeClientResponse(client_id, cid_tcp_socket_[client_id], first_seq_num, &reset);
+    }
+
+    for (auto seq = first_seq_num; seq < next_outgoing_seq_num; ++seq)
+    {
+      const auto &response = cid_response_history_[client_id][seq & (ME_MAX_RESPONSE_HISTORY - 1)];
+      ASSERT(response.seq_num_ == seq, "Missing response history for ClientId:" + std::to_string(client_id) + " seq:" + std::to_string(seq));
+      writeClientResponse(client_id, cid_tcp_socket_[client_id], seq, &response.me_client_response_);
+    }
+
+    logger_.log("%:% %() % ClientId:% asked from seq:% resent from seq:% next seq:%\n", __FILE__, __LINE__, __FUNCTION__,
+                Common::getCurrentTimeStr(&time_str_), client_id, seq_num, first_seq_num, next_outgoing_seq_num);
+  }
+
+  auto OrderServer::writeClientResponse(ClientId client_id, Common::TCPSocket *socket, size_t seq_num,
+                                        const MEClientResponse *client_response) noexcept -> void
+  {
+    if (transport_type_ == TransportType::SHM) 
+    {
+      if (UNLIKELY(cid_shm_responses_[client_id] == nullptr))
+      {
+        // the client went away with orders still working, their fills and cancels stay in the history for its next session to ask for.
+        logger_.log("%:% %() % No shared memory session for ClientId:% dropping seq:% %\n", __FILE__, __LINE__, __FUNCTION__,
+                    Common::getCurrentTimeStr(&time_str_), client_id, seq_num, client_response->toString());
+        return;
+      }
+      START_MEASURE(Exchange_ShmSPSCQueue_write);
+      auto next_write = cid_shm_responses_[client_id]->tryGetNextToWriteTo();
+      if (UNLIKELY(next_write == nullptr))
+      {
+        // the client stopped draining its ring, only it pays for that - it finds the gap once it reads again and asks for a resend.
+        logger_.log("%:% %() % Response ring full for ClientId:% dropping seq:% %\n", __FILE__, __LINE__, __FUNCTION__,
+                    Common::getCurrentTimeStr(&time_str_), client_id, seq_num, client_response->toString());
+        return;
+      }
+      *next_write = {seq_num, *client_response};
+      cid_shm_responses_[client_id]->updateWriteIndex();
+      END_MEASURE(Exchange_ShmSPSCQueue_write, logger_);
+      TTT_MEASURE(T6t_OrderServer_ShmSPSCQueue_write, logger_);
+    } else 
+    {
+      ASSERT(socket != nullptr, "Dont have a TCPSocket for ClientId:" + std::to_string(client_id));
+      START_MEASURE(Exchange_TCPSocket_send);
+      // a single write, a response either fits in the send buffer or is dropped whole.
+      const OMClientResponse om_response{seq_num, *client_response};
+      socket->send(&om_response, sizeof(om_response));
+      END_MEASURE(Exchange_TCPSocket_send, logger_);
+      TTT_MEASURE(T6t_OrderServer_TCP_write, logger_);
+    }
+  }
+
+  auto OrderServer::sendClientResponse(const MEClientResponse *client_response) noexcept -> void
+  {
+    const auto client_id = client_response->client_id_;
+    auto &next_outgoing_seq_num = cid_next_outgoing_seq_num_[client_id];
+    logger_.log("%:% %() % Processing cid:% seq:% %\n", __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str_),
+                client_id, next_outgoing_seq_num, client_response->toString());
+
+    writeClientResponse(client_id, cid_tcp_socket_[client_id], next_outgoing_seq_num, client_response);
+    cid_response_history_[client_id][next_outgoing_seq_num & (ME_MAX_RESPONSE_HISTORY - 1)] = {next_outgoing_seq_num, *client_response};
+    ++next_outgoing_seq_num;
+  }
+
+  auto OrderServer::rejectClientRequest(const MEClientRequest &request, RejectReason reason, bool sequenced,
+                                        Common::TCPSocket *socket) noexcept -> void
+  {
+    logger_.log("%:% %() % Rejecting % reason:%\n", __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str_),
+                request.toString(), rejectReasonToString(reason));
+    const MEClientResponse reject{ClientResponseType::REJECTED, request.client_id_, request.ticker_id_, request.order_id_, OrderId_INVALID,
+                                  request.side_, request.price_, 0, 0, reason, request.type_};
+    if (!sequenced)
+    {
+      // a refused session request, or the response stream belongs to the client's session on its other connection - either way the
+      // reject goes where the request came from, without a sequence number.
+      writeClientResponse(request.client_id_, socket, 0, &reject);
+      return;
+    }
+    sendClientResponse(&reject);
   }
 
   OrderServer::~OrderServer()
@@ -42,5 +309,19 @@ namespace Exchange
     stop();
     using namespace std::literals::chrono_literals;
     std::this_thread::sleep_for(1s);
+
+    for (size_t client_id = 0; client_id < ME_MAX_NUM_CLIENTS; ++client_id)
+    {
+      delete cid_shm_requests_[client_id];
+      delete cid_shm_responses_[client_id];
+      delete[] cid_response_history_[client_id];
+    }
+    if (shm_session_table_)
+    {
+      munmap(shm_session_table_, sizeof(ShmSessionTable));
+      shm_unlink(shmSessionTableName().c_str());
+    }
+    delete ring_;
+    ring_ = nullptr;
   }
 }
\ No newline at end of file
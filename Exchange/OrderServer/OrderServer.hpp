@@ -5,56 +5,91 @@
 // #include "../../Common/ThreadUtils.hpp"
 #include "../../Common/Macros.hpp"
 #include "../../Common/TCPServer.hpp"
+#include "../../Common/IoUring.hpp"
+#include "../../Common/WaitStrategy.hpp"
+#include "../../Common/Reactor.hpp"
 
 #include "ClientRequest.hpp"
 #include "ClientResponse.hpp"
 #include "FIFOSequencer.hpp"
+#include "ClientRiskGate.hpp"
+#include "ShmOrderSession.hpp"
 
 namespace Exchange 
 {
+  /// Thread name and default cpu, ANCHOR_PLACEMENT can move it.
+  constexpr auto ORDER_SERVER_THREAD = "Exchange/OrderServer";
+  constexpr int ORDER_SERVER_CORE = 2;
+
+  /// Responses kept per client for RESEND_REQUEST, a power of 2. Older ones are gone - the client is told with a SEQUENCE_RESET past them.
+  constexpr size_t ME_MAX_RESPONSE_HISTORY = 4 * 1024;
+  static_assert((ME_MAX_RESPONSE_HISTORY & (ME_MAX_RESPONSE_HISTORY - 1)) == 0, "ME_MAX_RESPONSE_HISTORY has to be a power of 2.");
+
   class OrderServer 
   {
   public:
-    OrderServer(ClientRequestLFQueue *client_requests, 
-                ClientResponseLFQueue *client_responses, 
-                const std::string &iface, int port);
+    OrderServer(const ClientRequestLFQueues &client_requests, 
+                const ClientResponseLFQueues &client_responses, 
+                const std::string &iface, int port,
+                TransportType transport_type,
+                Common::IoEngineType io_engine,
+                const ClientRiskCfg &client_risk_cfg);
 
     ~OrderServer();
 
     auto start() -> void;
     auto stop() -> void;
 
-    /// Main run loop for this thread - accepts new client connections, receives client requests from them and sends client responses to them.
-    auto run() noexcept 
+    /// One pass of the order server - accepts new client connections, receives client requests from them and sends client responses to
+    /// them. Returns whether there was anything to do.
+    auto poll() noexcept -> bool
     {
-      logger_.log("%:% %() %\n", __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str_));
-      while (run_) 
+      ++passes_;
+      bool did_work = false;
+      if (transport_type_ == TransportType::SHM) 
+      {
+        did_work = pollSharedMemory();
+      } else 
       {
         tcp_server_.poll();
 
-        tcp_server_.sendAndRecv();
+        did_work = tcp_server_.sendAndRecv();
+      }
 
-        for (auto client_response = outgoing_responses_->getNextToRead(); outgoing_responses_->size() && client_response; client_response = outgoing_responses_->getNextToRead()) 
+      // merge the responses from all the matching engine shards, every client still sees a single stream of sequence numbers.
+      for (auto outgoing_responses : outgoing_responses_) 
+      {
+        for (auto client_response = outgoing_responses->getNextToRead(); outgoing_responses->size() && client_response; client_response = outgoing_responses->getNextToRead()) 
         {
           TTT_MEASURE(T5t_OrderServer_LFQueue_read, logger_);
-          auto &next_outgoing_seq_num = cid_next_outgoing_seq_num_[client_response->client_id_];
-          logger_.log("%:% %() % Processing cid:% seq:% %\n", __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str_),
-                      client_response->client_id_, next_outgoing_seq_num, client_response->toString());
-
-          ASSERT(cid_tcp_socket_[client_response->client_id_] != nullptr,
-                 "Dont have a TCPSocket for ClientId:" + std::to_string(client_response->client_id_));
-          START_MEASURE(Exchange_TCPSocket_send);
-          cid_tcp_socket_[client_response->client_id_]->send(&next_outgoing_seq_num, sizeof(next_outgoing_seq_num));
-          cid_tcp_socket_[client_response->client_id_]->send(client_response, sizeof(MEClientResponse));
-          END_MEASURE(Exchange_TCPSocket_send, logger_);
-          outgoing_responses_->updateReadIndex();
-          TTT_MEASURE(T6t_OrderServer_TCP_write, logger_);
-          ++next_outgoing_seq_num;
+          sendClientResponse(client_response);
+          outgoing_responses->updateReadIndex();
+          did_work = true;
         }
       }
+
+      return did_work;
+    }
+
+    /// Whether the matching engines have responses queued - client requests arrive on sockets or shared memory rings, only the matching
+    /// engines' responses can wake a parked order server.
+    auto hasWork() const noexcept
+    {
+      return std::any_of(outgoing_responses_.begin(), outgoing_responses_.end(), [](auto responses) { return responses->size() != 0; });
     }
 
-    /// Read client request from the TCP receive buffer, check for sequence gaps and forward it to the FIFO sequencer.
+    /// Main run loop for this thread, unless the order server runs in the reactor.
+    auto run() noexcept 
+    {
+      logger_.log("%:% %() %\n", __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str_));
+      while (run_) 
+        wait_strategy_.afterPoll(poll(), [this]() { return hasWork(); });
+      logger_.log("%:% %() % % % %\n", __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str_), wait_strategy_.toString(),
+                  risk_gate_.toString(), (ring_ ? ring_->toString() : ""));
+    }
+
+    /// Read client request from the TCP receive buffer, answer session requests, reject requests with a sequence gap or from the wrong
+    /// connection, run the rest through the risk gate and forward them to the FIFO sequencer.
     auto recvCallback(TCPSocket *socket, Nanos rx_time) noexcept 
     {
       TTT_MEASURE(T1_OrderServer_TCP_read, logger_);
@@ -69,31 +104,56 @@ namespace Exchange
           auto request = reinterpret_cast<const OMClientRequest *>(socket->inbound_data_.data() + i);
           logger_.log("%:% %() % Received %\n", __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str_), request->toString());
 
+          if (UNLIKELY(request->me_client_request_.client_id_ >= ME_MAX_NUM_CLIENTS))
+          {
+            // nowhere to send a reject to, there is no response stream for this ClientId.
+            logger_.log("%:% %() % Received ClientRequest with invalid ClientId:% on socket:%\n", __FILE__, __LINE__, __FUNCTION__,
+                        Common::getCurrentTimeStr(&time_str_), request->me_client_request_.client_id_, socket->socket_fd_);
+            continue;
+          }
+
           if (UNLIKELY(cid_tcp_socket_[request->me_client_request_.client_id_] == nullptr)) 
           { 
             // first message from this ClientId.
             cid_tcp_socket_[request->me_client_request_.client_id_] = socket;
+            startSession(request->me_client_request_.client_id_);
           }
 
-          if (cid_tcp_socket_[request->me_client_request_.client_id_] != socket) 
+          if (UNLIKELY(isSessionRequest(request->me_client_request_)))
+          {
+            onSessionRequest(request, socket, rx_time);
+            continue;
+          }
+
+          if (UNLIKELY(cid_tcp_socket_[request->me_client_request_.client_id_] != socket))
           { 
-            // TODO - change this to send a reject back to the client.
             logger_.log("%:% %() % Received ClientRequest from ClientId:% on different socket:% expected:%\n", __FILE__, __LINE__, __FUNCTION__,
                         Common::getCurrentTimeStr(&time_str_), request->me_client_request_.client_id_, socket->socket_fd_,
                         cid_tcp_socket_[request->me_client_request_.client_id_]->socket_fd_);
+            rejectClientRequest(request->me_client_request_, RejectReason::INVALID_SESSION, false, socket);
             continue;
           }
 
           auto &next_exp_seq_num = cid_next_exp_seq_num_[request->me_client_request_.client_id_];
-          if (request->seq_num_ != next_exp_seq_num) 
+          if (UNLIKELY(request->seq_num_ != next_exp_seq_num))
           { 
-            // TODO - change this to send a reject back to the client.
+            // the expected sequence number stays where it is, the client has to send a SEQUENCE_RESET to carry on.
             logger_.log("%:% %() % Incorrect sequence number. ClientId:% SeqNum expected:% received:%\n", __FILE__, __LINE__, __FUNCTION__,
                         Common::getCurrentTimeStr(&time_str_), request->me_client_request_.client_id_, next_exp_seq_num, request->seq_num_);
+            rejectClientRequest(request->me_client_request_, RejectReason::INVALID_SEQ_NUM);
             continue;
           }
 
           ++next_exp_seq_num;
+          START_MEASURE(Exchange_ClientRiskGate_check);
+          const auto reject_reason = risk_gate_.check(request->me_client_request_, rx_time);
+          END_MEASURE(Exchange_ClientRiskGate_check, logger_);
+          if (UNLIKELY(reject_reason != RejectReason::INVALID))
+          {
+            rejectClientRequest(request->me_client_request_, reject_reason);
+            continue;
+          }
+
           START_MEASURE(Exchange_FIFOSequencer_addClientRequest);
           fifo_sequencer_.addClientRequest(rx_time, request->me_client_request_);
           END_MEASURE(Exchange_FIFOSequencer_addClientRequest, logger_);
@@ -103,6 +163,10 @@ namespace Exchange
       }
     }
 
+    /// Shared memory equivalent of poll() and sendAndRecv() - picks up new client sessions and drains all the client request rings, returns
+    /// whether there were any requests.
+    auto pollSharedMemory() noexcept -> bool;
+
     /// End of reading incoming messages across all the TCP connections, sequence and publish the client requests to the matching engine.
     auto recvFinishedCallback() noexcept 
     {
@@ -126,10 +190,12 @@ namespace Exchange
     const std::string iface_;
     const int port_ = 0;
 
-    /// Lock free queue of outgoing client responses to be sent out to connected clients.
-    ClientResponseLFQueue *outgoing_responses_ = nullptr;
+    /// Lock free queues of outgoing client responses to be sent out to connected clients, one per matching engine shard.
+    const ClientResponseLFQueues outgoing_responses_;
 
-    volatile bool run_ = false;
+    std::atomic<bool> run_ = {false};
+    Common::WaitStrategy wait_strategy_;
+    size_t reactor_id_ = 0; // non-zero when poll() runs in the reactor instead of a thread of its own.
 
     std::string time_str_;
     Logger logger_;
@@ -143,11 +209,67 @@ namespace Exchange
     /// Hash map from ClientId -> TCP socket / client connection.
     std::array<Common::TCPSocket *, ME_MAX_NUM_CLIENTS> cid_tcp_socket_;
 
+    /// Passes of poll() so far and hash map from ClientId -> the pass its last session request was answered in. Whatever a resend
+    /// replays is only flushed at the end of the pass, so a client gets a single one per pass.
+    uint64_t passes_ = 0;
+    std::array<uint64_t, ME_MAX_NUM_CLIENTS> cid_session_request_pass_;
+
+    /// Hash map from ClientId -> the last ME_MAX_RESPONSE_HISTORY responses sent, indexed by sequence number modulo the size. Allocated
+    /// when the client's first session starts.
+    std::array<OMClientResponse *, ME_MAX_NUM_CLIENTS> cid_response_history_;
+
     /// TCP server instance listening for new client connections.
     Common::TCPServer tcp_server_;
 
+    /// All of the TCP server's I/O goes through this ring with Common::IoEngineType::IO_URING, nullptr otherwise.
+    Common::IoUring *ring_ = nullptr;
+
     /// FIFO sequencer responsible for making sure incoming client requests are processed in the order in which they were received.
     FIFOSequencer fifo_sequencer_;
+
+    /// Selects between the TCP server and the shared memory session table and rings below.
+    const TransportType transport_type_;
+
+    /// Session table the co-located clients register in, new sessions are noticed through a change in session_changes_.
+    ShmSessionTable *shm_session_table_ = nullptr;
+    uint64_t shm_last_session_changes_ = 0;
+
+    /// Hash map from ClientId -> session id and the request / response rings for that shared memory session.
+    std::array<uint64_t, ME_MAX_NUM_CLIENTS> cid_shm_session_id_;
+    std::array<ShmClientRequestQueue *, ME_MAX_NUM_CLIENTS> cid_shm_requests_;
+    std::array<ShmClientResponseQueue *, ME_MAX_NUM_CLIENTS> cid_shm_responses_;
+
+    /// Pre-trade checks on every client request before it reaches the FIFO sequencer.
+    ClientRiskGate risk_gate_;
+
+    auto checkShmSessions() noexcept -> void;
+
+    /// Empty response history for a client whose session starts from the first sequence number.
+    auto startSession(ClientId client_id) noexcept -> void;
+
+    static auto isSessionRequest(const MEClientRequest &request) noexcept -> bool
+    {
+      return isSessionRequestType(request.type_);
+    }
+
+    /// SEQUENCE_RESET and RESEND_REQUEST, socket is the connection it came on - nullptr for shared memory. Throttled like any other
+    /// request and to one per client per pass, the rest are rejected outside of the response sequence.
+    auto onSessionRequest(const OMClientRequest *request, Common::TCPSocket *socket, Nanos rx_time) noexcept -> void;
+
+    /// Replay the kept responses from seq_num on, with their original sequence numbers.
+    auto resendClientResponses(ClientId client_id, size_t seq_num) noexcept -> void;
+
+    /// Write a response with sequence number seq_num to the client's shared memory ring, or to socket for TCP.
+    auto writeClientResponse(ClientId client_id, Common::TCPSocket *socket, size_t seq_num, const MEClientResponse *client_response) noexcept -> void;
+
+    /// Send a response on the client's session, with the next sequence number of that client's response stream.
+    auto sendClientResponse(const MEClientResponse *client_response) noexcept -> void;
+
+    /// Answer a request the order server refused with a REJECTED response straight from the order server. Sequenced on the client's
+    /// session, unless sequenced is false - then it goes to socket, the connection the request came on (nullptr for shared memory), with
+    /// sequence number 0.
+    auto rejectClientRequest(const MEClientRequest &request, RejectReason reason, bool sequenced = true,
+                             Common::TCPSocket *socket = nullptr) noexcept -> void;
   };
 }
 
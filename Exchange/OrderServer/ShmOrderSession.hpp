@@ -0,0 +1,43 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+
+#include "../../Common/Types.hpp"
+#include "../../Common/ShmQueue.hpp"
+
+#include "ClientRequest.hpp"
+#include "ClientResponse.hpp"
+
+namespace Exchange
+{
+  /// Shared memory order entry - every client owns a pair of SPSC rings, requests towards the exchange and responses back from it.
+  constexpr size_t SHM_ORDER_QUEUE_SIZE = 256 * 1024;
+
+  typedef Common::ShmSPSCQueue<OMClientRequest> ShmClientRequestQueue;
+  typedef Common::ShmSPSCQueue<OMClientResponse> ShmClientResponseQueue;
+
+  inline auto shmSessionTableName() -> std::string
+  {
+    return "/anchor_order_sessions";
+  }
+
+  inline auto shmClientRequestQueueName(ClientId client_id) -> std::string
+  {
+    return "/anchor_client_requests_" + std::to_string(client_id);
+  }
+
+  inline auto shmClientResponseQueueName(ClientId client_id) -> std::string
+  {
+    return "/anchor_client_responses_" + std::to_string(client_id);
+  }
+
+  /// Created by the OrderServer, clients create their rings and then publish a non-zero session id in their slot (zero on disconnect).
+  /// Every connect and disconnect also bumps session_changes_, so the OrderServer only rescans the table when something changed.
+  /// This is the shared memory equivalent of accepting a TCP connection, the OrderServer only has to read memory to discover new clients.
+  struct ShmSessionTable
+  {
+    std::atomic<uint64_t> session_changes_ = {0};
+    std::array<std::atomic<uint64_t>, ME_MAX_NUM_CLIENTS> client_session_id_;
+  };
+}
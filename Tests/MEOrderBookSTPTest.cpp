@@ -0,0 +1,291 @@
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "Exchange/Matcher/MatchingEngine.hpp"
+
+/// Checks what every self-trade prevention mode does when a client's order would cross one of its own resting orders - which side gets
+/// canceled or decremented, what both are told and that nothing trades - and that a random order flow in which clients do cross
+/// themselves produces self fills with NONE and never with any other mode. Exits with a failure at the first check that does not hold.
+
+using namespace Exchange;
+
+constexpr ClientId CLIENT_1 = 1;
+constexpr ClientId CLIENT_2 = 2;
+constexpr Price PRICE = 100;
+
+/// A matching engine owning only ticker 0, driven one request at a time on the calling thread.
+class TestEngine
+{
+public:
+  explicit TestEngine(STPMode stp_mode)
+      : client_requests_(ME_MAX_CLIENT_UPDATES)
+      , client_responses_(ME_MAX_CLIENT_UPDATES)
+      , market_updates_(ME_MAX_MARKET_UPDATES)
+  {
+    MatchingEngineCfg cfg;
+    cfg.stp_mode_ = stp_mode;
+    matching_engine_ = new MatchingEngine(&client_requests_, &client_responses_, &market_updates_, 0, ME_MAX_TICKERS, -1, cfg, nullptr, "", 0);
+  }
+
+  ~TestEngine()
+  {
+    delete matching_engine_;
+  }
+
+  /// Process request and collect the responses and market updates it produced.
+  auto send(const MEClientRequest &request) -> void
+  {
+    responses_.clear();
+    market_updates_out_.clear();
+
+    matching_engine_->processClientRequest(&request);
+    matching_engine_->publishOutputs();
+
+    for (auto response = client_responses_.getNextToRead(); response; response = client_responses_.getNextToRead())
+    {
+      responses_.push_back(*response);
+      client_responses_.updateReadIndex();
+    }
+    for (auto market_update = market_updates_.getNextToRead(); market_update; market_update = market_updates_.getNextToRead())
+    {
+      market_updates_out_.push_back(*market_update);
+      market_updates_.updateReadIndex();
+    }
+  }
+
+  auto newOrder(ClientId client_id, OrderId order_id, Side side, Price price, Quantity quantity,
+                OrderType order_type = OrderType::LIMIT, TimeInForce tif = TimeInForce::DAY) -> void
+  {
+    send({ClientRequestType::NEW, client_id, 0, order_id, side, price, quantity, order_type, tif});
+  }
+
+  auto cancelOrder(ClientId client_id, OrderId order_id) -> void
+  {
+    send({ClientRequestType::CANCEL, client_id, 0, order_id, Side::INVALID, Price_INVALID, Quantity_INVALID, OrderType::INVALID,
+          TimeInForce::INVALID});
+  }
+
+  auto responses() const -> const std::vector<MEClientResponse> &
+  {
+    return responses_;
+  }
+
+  auto marketUpdates() const -> const std::vector<MEMarketUpdate> &
+  {
+    return market_updates_out_;
+  }
+
+  // Deleted default, copy & move constructors and assignment-operators.
+  TestEngine() = delete;
+
+  TestEngine(const TestEngine &) = delete;
+
+  TestEngine(const TestEngine &&) = delete;
+
+  TestEngine &operator=(const TestEngine &) = delete;
+
+  TestEngine &operator=(const TestEngine &&) = delete;
+
+private:
+  ClientRequestLFQueue client_requests_;
+  ClientResponseLFQueue client_responses_;
+  MEMarketUpdateLFQueue market_updates_;
+  MatchingEngine *matching_engine_ = nullptr;
+
+  std::vector<MEClientResponse> responses_;
+  std::vector<MEMarketUpdate> market_updates_out_;
+};
+
+auto checkResponse(const MEClientResponse &response, ClientResponseType type, ClientId client_id, OrderId order_id, Price price,
+                   Quantity exec_quantity, Quantity leaves_quantity, const std::string &what) -> void
+{
+  ASSERT(response.type_ == type && response.client_id_ == client_id && response.client_order_id_ == order_id && response.price_ == price &&
+         response.exec_quantity_ == exec_quantity && response.leaves_quantity_ == leaves_quantity,
+         what + " unexpected " + response.toString());
+}
+
+auto checkResponses(const TestEngine &engine, size_t num_responses, const std::string &what) -> void
+{
+  ASSERT(engine.responses().size() == num_responses,
+         what + " expected " + std::to_string(num_responses) + " responses, got " + std::to_string(engine.responses().size()));
+}
+
+auto countTrades(const TestEngine &engine) -> size_t
+{
+  size_t num_trades = 0;
+  for (const auto &market_update : engine.marketUpdates())
+    num_trades += (market_update.type_ == MarketUpdateType::TRADE);
+  return num_trades;
+}
+
+/// CLIENT_1 rests 10 and CLIENT_2 rests 5 behind it at PRICE, then CLIENT_1 sends a buy of quantity at PRICE.
+auto setUpCross(TestEngine &engine) -> void
+{
+  engine.newOrder(CLIENT_1, 0, Side::SELL, PRICE, 10);
+  engine.newOrder(CLIENT_2, 0, Side::SELL, PRICE, 5);
+}
+
+auto testNone() -> void
+{
+  TestEngine engine(STPMode::NONE);
+  setUpCross(engine);
+  engine.newOrder(CLIENT_1, 1, Side::BUY, PRICE, 8);
+
+  checkResponses(engine, 3, "NONE");
+  checkResponse(engine.responses()[0], ClientResponseType::ACCEPTED, CLIENT_1, 1, PRICE, 0, 8, "NONE aggressor");
+  checkResponse(engine.responses()[1], ClientResponseType::FILLED, CLIENT_1, 1, PRICE, 8, 0, "NONE aggressor");
+  checkResponse(engine.responses()[2], ClientResponseType::FILLED, CLIENT_1, 0, PRICE, 8, 2, "NONE resting");
+  ASSERT(countTrades(engine) == 1, "NONE should publish the self trade.");
+}
+
+auto testCancelNewest() -> void
+{
+  TestEngine engine(STPMode::CANCEL_NEWEST);
+  setUpCross(engine);
+  engine.newOrder(CLIENT_1, 1, Side::BUY, PRICE, 8);
+
+  checkResponses(engine, 2, "CANCEL_NEWEST");
+  checkResponse(engine.responses()[0], ClientResponseType::ACCEPTED, CLIENT_1, 1, PRICE, 0, 8, "CANCEL_NEWEST aggressor");
+  checkResponse(engine.responses()[1], ClientResponseType::CANCELED, CLIENT_1, 1, PRICE, Quantity_INVALID, 8, "CANCEL_NEWEST aggressor");
+  ASSERT(engine.marketUpdates().empty(), "CANCEL_NEWEST should leave the book alone.");
+
+  // the resting order is untouched, all 10 of it can still be canceled.
+  engine.cancelOrder(CLIENT_1, 0);
+  checkResponses(engine, 1, "CANCEL_NEWEST");
+  checkResponse(engine.responses()[0], ClientResponseType::CANCELED, CLIENT_1, 0, PRICE, Quantity_INVALID, 10, "CANCEL_NEWEST resting");
+}
+
+auto testCancelOldest() -> void
+{
+  TestEngine engine(STPMode::CANCEL_OLDEST);
+  setUpCross(engine);
+  engine.newOrder(CLIENT_1, 1, Side::BUY, PRICE, 8);
+
+  // the own resting order goes, the aggressor carries on and trades with CLIENT_2 and what is left of it rests.
+  checkResponses(engine, 4, "CANCEL_OLDEST");
+  checkResponse(engine.responses()[0], ClientResponseType::ACCEPTED, CLIENT_1, 1, PRICE, 0, 8, "CANCEL_OLDEST aggressor");
+  checkResponse(engine.responses()[1], ClientResponseType::CANCELED, CLIENT_1, 0, PRICE, Quantity_INVALID, 10, "CANCEL_OLDEST resting");
+  checkResponse(engine.responses()[2], ClientResponseType::FILLED, CLIENT_1, 1, PRICE, 5, 3, "CANCEL_OLDEST aggressor");
+  checkResponse(engine.responses()[3], ClientResponseType::FILLED, CLIENT_2, 0, PRICE, 5, 0, "CANCEL_OLDEST other client");
+  ASSERT(countTrades(engine) == 1, "CANCEL_OLDEST should only trade against the other client.");
+
+  engine.cancelOrder(CLIENT_1, 1);
+  checkResponses(engine, 1, "CANCEL_OLDEST");
+  checkResponse(engine.responses()[0], ClientResponseType::CANCELED, CLIENT_1, 1, PRICE, Quantity_INVALID, 3, "CANCEL_OLDEST remainder");
+}
+
+auto testDecrementBoth() -> void
+{
+  {
+    TestEngine engine(STPMode::DECREMENT_BOTH);
+    setUpCross(engine);
+    engine.newOrder(CLIENT_1, 1, Side::BUY, PRICE, 8);
+
+    // the smaller aggressor is used up, the resting order keeps the difference and its queue position.
+    checkResponses(engine, 3, "DECREMENT_BOTH smaller aggressor");
+    checkResponse(engine.responses()[0], ClientResponseType::ACCEPTED, CLIENT_1, 1, PRICE, 0, 8, "DECREMENT_BOTH aggressor");
+    checkResponse(engine.responses()[1], ClientResponseType::CANCELED, CLIENT_1, 1, PRICE, Quantity_INVALID, 8, "DECREMENT_BOTH aggressor");
+    checkResponse(engine.responses()[2], ClientResponseType::MODIFIED, CLIENT_1, 0, PRICE, 0, 2, "DECREMENT_BOTH resting");
+    ASSERT(countTrades(engine) == 0, "DECREMENT_BOTH should not trade.");
+  }
+  {
+    TestEngine engine(STPMode::DECREMENT_BOTH);
+    setUpCross(engine);
+    engine.newOrder(CLIENT_1, 1, Side::BUY, PRICE, 13);
+
+    // the larger aggressor is told it lost 10, then trades 3 with CLIENT_2.
+    checkResponses(engine, 5, "DECREMENT_BOTH larger aggressor");
+    checkResponse(engine.responses()[0], ClientResponseType::ACCEPTED, CLIENT_1, 1, PRICE, 0, 13, "DECREMENT_BOTH aggressor");
+    checkResponse(engine.responses()[1], ClientResponseType::MODIFIED, CLIENT_1, 1, PRICE, 0, 3, "DECREMENT_BOTH aggressor");
+    checkResponse(engine.responses()[2], ClientResponseType::CANCELED, CLIENT_1, 0, PRICE, Quantity_INVALID, 10, "DECREMENT_BOTH resting");
+    checkResponse(engine.responses()[3], ClientResponseType::FILLED, CLIENT_1, 1, PRICE, 3, 0, "DECREMENT_BOTH aggressor");
+    checkResponse(engine.responses()[4], ClientResponseType::FILLED, CLIENT_2, 0, PRICE, 3, 2, "DECREMENT_BOTH other client");
+  }
+}
+
+/// Responses for MARKET orders never carry the sentinel limit price they match with.
+auto testMarketOrderPrice() -> void
+{
+  {
+    TestEngine engine(STPMode::CANCEL_NEWEST);
+    setUpCross(engine);
+    engine.newOrder(CLIENT_1, 1, Side::BUY, Price_INVALID, 8, OrderType::MARKET, TimeInForce::IOC);
+
+    checkResponses(engine, 2, "MARKET CANCEL_NEWEST");
+    checkResponse(engine.responses()[1], ClientResponseType::CANCELED, CLIENT_1, 1, Price_INVALID, Quantity_INVALID, 8,
+                  "MARKET CANCEL_NEWEST aggressor");
+  }
+  {
+    TestEngine engine(STPMode::NONE);
+    engine.newOrder(CLIENT_2, 0, Side::BUY, PRICE, 5);
+    engine.newOrder(CLIENT_1, 0, Side::SELL, Price_INVALID, 8, OrderType::MARKET, TimeInForce::IOC);
+
+    checkResponses(engine, 4, "MARKET IOC remainder");
+    checkResponse(engine.responses()[1], ClientResponseType::FILLED, CLIENT_1, 0, PRICE, 5, 3, "MARKET IOC aggressor");
+    checkResponse(engine.responses()[3], ClientResponseType::CANCELED, CLIENT_1, 0, Price_INVALID, Quantity_INVALID, 3,
+                  "MARKET IOC remainder");
+  }
+}
+
+/// Random flow in which every client trades on both sides, returns the number of fills where a client traded with itself.
+auto countSelfFills(STPMode stp_mode) -> size_t
+{
+  constexpr size_t NUM_REQUESTS = 20 * 1000;
+  constexpr ClientId NUM_CLIENTS = 4;
+
+  std::mt19937 rng(42);
+  std::array<OrderId, NUM_CLIENTS> next_order_id = {};
+  TestEngine engine(stp_mode);
+  size_t num_self_fills = 0;
+
+  for (size_t i = 0; i < NUM_REQUESTS; ++i)
+  {
+    const auto client_id = static_cast<ClientId>(rng() % NUM_CLIENTS);
+    const auto side = (rng() % 2 ? Side::BUY : Side::SELL);
+    auto &order_id = next_order_id[client_id];
+
+    if (order_id && rng() % 10 < 3)
+    {
+      engine.cancelOrder(client_id, static_cast<OrderId>(rng() % order_id));
+      continue;
+    }
+
+    const auto offset = static_cast<Price>(rng() % 10) - 3;
+    engine.newOrder(client_id, order_id++, side, (side == Side::BUY ? PRICE - offset : PRICE + offset), static_cast<Quantity>(1 + rng() % 20));
+
+    // fills come in pairs, the aggressor's followed by the resting order's.
+    const auto &responses = engine.responses();
+    for (size_t j = 0; j < responses.size(); ++j)
+    {
+      if (responses[j].type_ != ClientResponseType::FILLED)
+        continue;
+      ASSERT(j + 1 < responses.size() && responses[j + 1].type_ == ClientResponseType::FILLED, "Unpaired fill " + responses[j].toString());
+      num_self_fills += (responses[j].client_id_ == responses[j + 1].client_id_);
+      ++j;
+    }
+  }
+
+  return num_self_fills;
+}
+
+int main(int, char **)
+{
+  testNone();
+  testCancelNewest();
+  testCancelOldest();
+  testDecrementBoth();
+  testMarketOrderPrice();
+
+  const auto num_self_fills = countSelfFills(STPMode::NONE);
+  ASSERT(num_self_fills, "The random flow never crossed a client with itself, it does not test anything.");
+  std::cout << "stp-mode:NONE self-fills:" << num_self_fills << std::endl;
+  for (const auto stp_mode : {STPMode::CANCEL_NEWEST, STPMode::CANCEL_OLDEST, STPMode::DECREMENT_BOTH})
+  {
+    ASSERT(countSelfFills(stp_mode) == 0, "Self fill with stp-mode:" + stpModeToString(stp_mode));
+    std::cout << "stp-mode:" << stpModeToString(stp_mode) << " self-fills:0" << std::endl;
+  }
+
+  std::cout << "MEOrderBookSTPTest passed." << std::endl;
+  return 0;
+}
@@ -0,0 +1,440 @@
+#include <iostream>
+#include <map>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Common/OrderBookCore.hpp"
+#include "Exchange/Matcher/MatchingEngineOrder.hpp"
+
+/// Drives three OrderBookCore configurations with the same add / cancel / modify flow, matching aggressive orders against the other side
+/// the way MEOrderBook does, and checks after every operation that they produced the same fills and hold the same book - the same levels
+/// in the same order with the same quantities, and the same orders in the same queue positions:
+///   MEOrderStore with BitmapLadder and aggregates - what MEOrderBook uses.
+///   MEOrderStore with LinkedLadder.
+///   PooledOrderStore with LinkedLadder and no aggregates - pointer linked orders in a MemPool, the layout both are checked against.
+/// Prices are mostly close to the mid, with the occasional one far enough out that the live prices of a side span more than
+/// MAX_PRICE_LEVELS, which is where BitmapLadder falls back to walking the ladder. Exits with a failure at the first difference.
+
+using namespace Common;
+
+constexpr size_t NUM_OPERATIONS = 200 * 1000;
+constexpr size_t MAX_LIVE_ORDERS = 4 * 1000;
+constexpr Price MID_PRICE = 10 * 1000;
+
+struct TestMEOrderBookPolicy : Exchange::MEOrderBookPolicy
+{
+  static constexpr size_t MAX_ORDERS = 64 * 1024;
+};
+
+template<typename LadderT>
+struct TestMEPolicy : TestMEOrderBookPolicy
+{
+  typedef LadderT Ladder;
+};
+
+/// An order as MEOrderBook kept it before MEOrderStore.
+struct PooledOrder
+{
+  TickerId ticker_id_ = TickerId_INVALID;
+  ClientId client_id_ = ClientId_INVALID;
+  OrderId client_order_id_ = OrderId_INVALID;
+  OrderId market_order_id_ = OrderId_INVALID;
+  Side side_ = Side::INVALID;
+  Price price_ = Price_INVALID;
+  Quantity quantity_ = Quantity_INVALID;
+  Priority priority_ = Priority_INVALID;
+
+  PooledOrder *prev_order_ = nullptr;
+  PooledOrder *next_order_ = nullptr;
+
+  PooledOrder() = default;
+
+  PooledOrder(TickerId ticker_id, ClientId client_id, OrderId client_order_id, OrderId market_order_id, Side side, Price price,
+              Quantity quantity, Priority priority) noexcept
+      : ticker_id_(ticker_id)
+      , client_id_(client_id)
+      , client_order_id_(client_order_id)
+      , market_order_id_(market_order_id)
+      , side_(side)
+      , price_(price)
+      , quantity_(quantity)
+      , priority_(priority) {}
+};
+
+struct PooledOrdersAtPrice
+{
+  Side side_ = Side::INVALID;
+  Price price_ = Price_INVALID;
+  PooledOrder *first_order_ = nullptr;
+  PooledOrdersAtPrice *prev_entry_ = nullptr;
+  PooledOrdersAtPrice *next_entry_ = nullptr;
+
+  PooledOrdersAtPrice() = default;
+
+  PooledOrdersAtPrice(Side side, Price price, PooledOrder *first_order, PooledOrdersAtPrice *prev_entry, PooledOrdersAtPrice *next_entry)
+      : side_(side)
+      , price_(price)
+      , first_order_(first_order)
+      , prev_entry_(prev_entry)
+      , next_entry_(next_entry) {}
+};
+
+struct PooledPolicy
+{
+  typedef PooledOrderStore<PooledOrder> OrderStore;
+  typedef PooledOrdersAtPrice OrdersAtPrice;
+  typedef LinkedLadder Ladder;
+
+  static constexpr size_t MAX_PRICE_LEVELS = TestMEOrderBookPolicy::MAX_PRICE_LEVELS;
+  static constexpr size_t MAX_ORDERS = TestMEOrderBookPolicy::MAX_ORDERS;
+  static constexpr bool TRACK_AGGREGATES = false;
+
+  static auto firstOrder(PooledOrdersAtPrice *orders_at_price) noexcept -> PooledOrder *&
+  {
+    return orders_at_price->first_order_;
+  }
+};
+
+enum class OperationType : uint8_t
+{
+  ADD = 0,
+  CANCEL = 1,
+  MODIFY = 2
+};
+
+struct Operation
+{
+  OperationType type_ = OperationType::ADD;
+  OrderId order_id_ = OrderId_INVALID;
+  Side side_ = Side::INVALID;
+  Price price_ = Price_INVALID;
+  Quantity quantity_ = 0;
+};
+
+/// What a book reports for an operation, one entry per fill of an aggressive order and one for what it leaves resting.
+struct Response
+{
+  OrderId order_id_ = OrderId_INVALID;
+  OrderId resting_order_id_ = OrderId_INVALID;
+  Price price_ = Price_INVALID;
+  Quantity exec_quantity_ = 0;
+  Quantity leaves_quantity_ = 0;
+
+  auto operator==(const Response &other) const -> bool = default;
+};
+
+/// Resting order or price level as seen from outside the book.
+struct Entry
+{
+  OrderId order_id_ = OrderId_INVALID; // OrderId_INVALID for a price level.
+  Side side_ = Side::INVALID;
+  Price price_ = Price_INVALID;
+  uint64_t quantity_ = 0;
+
+  auto operator==(const Entry &other) const -> bool = default;
+
+  auto toString() const
+  {
+    return "[oid:" + orderIdToString(order_id_) + " side:" + sideToString(side_) + " price:" + priceToString(price_) +
+           " quantity:" + std::to_string(quantity_) + "]";
+  }
+};
+
+/// A minimal price-time priority book on top of OrderBookCore.
+template<typename Policy>
+class TestBook
+{
+public:
+  using Core = OrderBookCore<Policy>;
+  using Handle = typename Core::OrderHandle;
+
+  TestBook()
+      : core_(new Core()) {}
+
+  ~TestBook()
+  {
+    core_->clear();
+    delete core_;
+  }
+
+  auto apply(const Operation &operation) -> std::vector<Response>
+  {
+    std::vector<Response> responses;
+    switch (operation.type_)
+    {
+      case OperationType::ADD:
+        add(operation.order_id_, operation.side_, operation.price_, operation.quantity_, &responses);
+        break;
+      case OperationType::CANCEL:
+      {
+        const auto itr = live_orders_.find(operation.order_id_);
+        if (itr != live_orders_.end())
+        {
+          responses.push_back({operation.order_id_, OrderId_INVALID, core_->orders().price(itr->second), 0,
+                               core_->orders().quantity(itr->second)});
+          core_->removeOrder(itr->second);
+          live_orders_.erase(itr);
+        }
+      }
+        break;
+      case OperationType::MODIFY:
+      {
+        const auto itr = live_orders_.find(operation.order_id_);
+        if (itr == live_orders_.end())
+          break;
+        const auto order = itr->second;
+        if (core_->orders().price(order) == operation.price_ && operation.quantity_ <= core_->orders().quantity(order))
+        {
+          core_->setQuantity(order, operation.quantity_);
+          responses.push_back({operation.order_id_, OrderId_INVALID, operation.price_, 0, operation.quantity_});
+          break;
+        }
+        const auto side = core_->orders().side(order);
+        core_->removeOrder(order);
+        live_orders_.erase(itr);
+        add(operation.order_id_, side, operation.price_, operation.quantity_, &responses);
+      }
+        break;
+    }
+    return responses;
+  }
+
+  /// Levels best first followed by their orders in queue order, bids then asks.
+  auto entries() const -> std::vector<Entry>
+  {
+    std::vector<Entry> entries;
+    const auto &orders = core_->orders();
+    for (const auto side : {Side::BUY, Side::SELL})
+    {
+      const auto best_orders_by_price = core_->bestOrdersByPrice(side);
+      for (auto orders_at_price = best_orders_by_price; orders_at_price; )
+      {
+        entries.push_back({OrderId_INVALID, orders_at_price->side_, orders_at_price->price_, core_->levelQuantity(orders_at_price)});
+        auto order = Policy::firstOrder(orders_at_price);
+        do
+        {
+          entries.push_back({orderId(order), orders.side(order), orders.price(order), orders.quantity(order)});
+          order = orders.next(order);
+        } while (order != Policy::firstOrder(orders_at_price));
+
+        orders_at_price = (orders_at_price->next_entry_ == best_orders_by_price ? nullptr : orders_at_price->next_entry_);
+      }
+    }
+    return entries;
+  }
+
+  // Deleted copy & move constructors and assignment-operators.
+  TestBook(const TestBook &) = delete;
+
+  TestBook(const TestBook &&) = delete;
+
+  TestBook &operator=(const TestBook &) = delete;
+
+  TestBook &operator=(const TestBook &&) = delete;
+
+private:
+  Core *core_ = nullptr;
+  std::unordered_map<OrderId, Handle> live_orders_;
+
+  auto orderId(Handle order) const -> OrderId
+  {
+    if constexpr (std::is_same_v<typename Policy::OrderStore, PooledOrderStore<PooledOrder>>)
+      return order->client_order_id_;
+    else
+      return core_->orders().clientOrderId(order);
+  }
+
+  auto add(OrderId order_id, Side side, Price price, Quantity quantity, std::vector<Response> *responses) -> void
+  {
+    const auto other_side = (side == Side::BUY ? Side::SELL : Side::BUY);
+    auto leaves_quantity = quantity;
+    while (leaves_quantity && core_->bestOrdersByPrice(other_side))
+    {
+      const auto orders_at_price = core_->bestOrdersByPrice(other_side);
+      if (side == Side::BUY ? price < orders_at_price->price_ : price > orders_at_price->price_)
+        break;
+
+      const auto order = Policy::firstOrder(orders_at_price);
+      const auto order_quantity = core_->orders().quantity(order);
+      const auto fill_quantity = std::min(leaves_quantity, order_quantity);
+      leaves_quantity -= fill_quantity;
+      responses->push_back({order_id, orderId(order), orders_at_price->price_, fill_quantity, leaves_quantity});
+
+      if (fill_quantity == order_quantity)
+      {
+        live_orders_.erase(orderId(order));
+        core_->removeOrder(order);
+      } else
+      {
+        core_->setQuantity(order, order_quantity - fill_quantity);
+      }
+    }
+
+    if (leaves_quantity)
+    {
+      const auto order = core_->allocateOrder(0, 0, order_id, order_id, side, price, leaves_quantity, 0);
+      core_->addOrder(order);
+      live_orders_[order_id] = order;
+      responses->push_back({order_id, OrderId_INVALID, price, 0, leaves_quantity});
+    }
+  }
+};
+
+/// Live prices never share a price slot (price % MAX_PRICE_LEVELS), same as in the exchange where a ticker's prices stay within that
+/// many ticks - prices that would are not used.
+class OperationGenerator
+{
+public:
+  /// Next operation, based on which orders are live after the previous one.
+  auto next() -> Operation
+  {
+    while (true)
+    {
+      const auto choice = rng_() % 100;
+      if (!live_.empty() && (live_.size() >= MAX_LIVE_ORDERS || choice < 30))
+        return {OperationType::CANCEL, randomLiveOrder(), Side::INVALID, Price_INVALID, 0};
+
+      if (!live_.empty() && choice < 45)
+      {
+        const auto order_id = randomLiveOrder();
+        const auto &order = live_.at(order_id);
+        // half of them a quantity decrease in place, the other half a move that can cross.
+        const auto price = (rng_() % 2 ? order.price_ : randomPrice(order.side_));
+        if (price != Price_INVALID)
+        {
+          return {OperationType::MODIFY, order_id, Side::INVALID, price,
+                  static_cast<Quantity>(1 + rng_() % (price == order.price_ ? order.quantity_ : 100))};
+        }
+      }
+
+      const auto side = (rng_() % 2 ? Side::BUY : Side::SELL);
+      const auto price = randomPrice(side);
+      if (price != Price_INVALID)
+        return {OperationType::ADD, next_order_id_++, side, price, static_cast<Quantity>(1 + rng_() % 100)};
+    }
+  }
+
+  /// Keep track of which orders are live after an operation, from the responses of any one of the books.
+  auto onResponses(const Operation &operation, const std::vector<Response> &responses) -> void
+  {
+    const auto side = (operation.type_ == OperationType::ADD ? operation.side_ :
+                       live_.count(operation.order_id_) ? live_.at(operation.order_id_).side_ : Side::INVALID);
+    if (operation.type_ != OperationType::ADD)
+      removeLive(operation.order_id_);
+    if (operation.type_ == OperationType::CANCEL)
+      return;
+
+    for (const auto &response : responses)
+    {
+      if (response.resting_order_id_ != OrderId_INVALID)
+      {
+        auto &resting_order = live_.at(response.resting_order_id_);
+        resting_order.quantity_ -= response.exec_quantity_;
+        if (!resting_order.quantity_)
+          removeLive(response.resting_order_id_);
+      } else if (response.leaves_quantity_)
+      {
+        live_[operation.order_id_] = {side, response.price_, response.leaves_quantity_};
+        ++slot_prices_[slot(response.price_)][response.price_];
+      }
+    }
+  }
+
+private:
+  struct LiveOrder
+  {
+    Side side_ = Side::INVALID;
+    Price price_ = Price_INVALID;
+    Quantity quantity_ = 0;
+  };
+
+  std::mt19937 rng_{42};
+  OrderId next_order_id_ = 1;
+  std::map<OrderId, LiveOrder> live_;
+  std::map<size_t, std::map<Price, size_t>> slot_prices_;
+
+  static auto slot(Price price) -> size_t
+  {
+    return price % TestMEOrderBookPolicy::MAX_PRICE_LEVELS;
+  }
+
+  auto randomLiveOrder() -> OrderId
+  {
+    auto itr = live_.begin();
+    std::advance(itr, rng_() % live_.size());
+    return itr->first;
+  }
+
+  /// Mostly within 20 ticks of the mid on either side so orders cross, one in fifty up to 400 ticks out on its own side.
+  auto randomPrice(Side side) -> Price
+  {
+    const auto far = (rng_() % 50 == 0);
+    const auto offset = static_cast<Price>(far ? rng_() % 400 : rng_() % 40) - (far ? 0 : 20);
+    const auto price = (side == Side::BUY ? MID_PRICE - offset : MID_PRICE + offset);
+
+    const auto itr = slot_prices_.find(slot(price));
+    if (itr != slot_prices_.end() && (itr->second.size() > 1 || !itr->second.count(price)))
+      return Price_INVALID;
+    return price;
+  }
+
+  auto removeLive(OrderId order_id) -> void
+  {
+    const auto itr = live_.find(order_id);
+    if (itr == live_.end())
+      return;
+    auto &prices = slot_prices_[slot(itr->second.price_)];
+    if (!--prices[itr->second.price_])
+      prices.erase(itr->second.price_);
+    if (prices.empty())
+      slot_prices_.erase(slot(itr->second.price_));
+    live_.erase(itr);
+  }
+};
+
+auto entriesToString(const std::vector<Entry> &entries) -> std::string
+{
+  std::string str;
+  for (const auto &entry : entries)
+    str += entry.toString() + "\n";
+  return str;
+}
+
+int main(int, char **)
+{
+  TestBook<TestMEPolicy<BitmapLadder>> bitmap_book;
+  TestBook<TestMEPolicy<LinkedLadder>> linked_book;
+  TestBook<PooledPolicy> pooled_book;
+
+  OperationGenerator generator;
+  size_t num_fills = 0, max_entries = 0;
+  for (size_t i = 0; i < NUM_OPERATIONS; ++i)
+  {
+    const auto operation = generator.next();
+    const auto pooled_responses = pooled_book.apply(operation);
+    const auto bitmap_responses = bitmap_book.apply(operation);
+    const auto linked_responses = linked_book.apply(operation);
+    ASSERT(bitmap_responses == pooled_responses && linked_responses == pooled_responses,
+           "Responses differ at operation " + std::to_string(i));
+    generator.onResponses(operation, pooled_responses);
+
+    const auto pooled_entries = pooled_book.entries();
+    const auto bitmap_entries = bitmap_book.entries();
+    const auto linked_entries = linked_book.entries();
+    ASSERT(bitmap_entries == pooled_entries, "BitmapLadder book differs at operation " + std::to_string(i) + "\nexpected:\n" +
+           entriesToString(pooled_entries) + "got:\n" + entriesToString(bitmap_entries));
+    ASSERT(linked_entries == pooled_entries, "LinkedLadder book differs at operation " + std::to_string(i) + "\nexpected:\n" +
+           entriesToString(pooled_entries) + "got:\n" + entriesToString(linked_entries));
+
+    for (const auto &response : pooled_responses)
+      num_fills += (response.resting_order_id_ != OrderId_INVALID);
+    max_entries = std::max(max_entries, pooled_entries.size());
+  }
+
+  ASSERT(num_fills, "No order ever crossed, matching was not tested.");
+  std::cout << "operations:" << NUM_OPERATIONS << " fills:" << num_fills << " max-entries:" << max_entries << std::endl;
+  std::cout << "OrderBookCoreTest passed." << std::endl;
+  return 0;
+}
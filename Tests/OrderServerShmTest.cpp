@@ -0,0 +1,168 @@
+#include <chrono>
+#include <iostream>
+#include <thread>
+
+#include "Common/Topology.hpp"
+#include "Exchange/Matcher/MatchingEngine.hpp"
+#include "Exchange/OrderServer/OrderServer.hpp"
+
+/// Checks that a shared memory client which goes away with an order still resting does not take the order server down when that order
+/// trades, and that the fill is waiting in the client's response stream when it comes back. The order server runs on a thread of its own
+/// like in the exchange, the matching engine is driven from the test's thread. Exits with a failure at the first check that does not hold.
+
+using namespace Exchange;
+
+constexpr ClientId CLIENT_1 = 1;
+constexpr ClientId CLIENT_2 = 2;
+constexpr Price PRICE = 100;
+
+/// What the order gateway does for a shared memory session - owns the rings, registers them in the session table and sequences its requests.
+class TestShmClient
+{
+public:
+  explicit TestShmClient(ClientId client_id)
+      : client_id_(client_id)
+      , requests_(shmClientRequestQueueName(client_id), SHM_ORDER_QUEUE_SIZE, /*create*/ true)
+      , responses_(shmClientResponseQueueName(client_id), SHM_ORDER_QUEUE_SIZE, /*create*/ true)
+  {
+    session_table_ = static_cast<ShmSessionTable *>(Common::mapSharedMemory(shmSessionTableName(), sizeof(ShmSessionTable), /*create*/ false));
+    session_table_->client_session_id_.at(client_id_).store(static_cast<uint64_t>(Common::getCurrentNanos()), std::memory_order_release);
+    session_table_->session_changes_.fetch_add(1, std::memory_order_release);
+  }
+
+  ~TestShmClient()
+  {
+    session_table_->client_session_id_.at(client_id_).store(0, std::memory_order_release);
+    session_table_->session_changes_.fetch_add(1, std::memory_order_release);
+    munmap(session_table_, sizeof(ShmSessionTable));
+  }
+
+  auto sessionRequest(ClientRequestType type, size_t seq_num) -> void
+  {
+    send(seq_num, {type, client_id_, TickerId_INVALID, OrderId_INVALID, Side::INVALID, Price_INVALID, Quantity_INVALID, OrderType::INVALID,
+                   TimeInForce::INVALID});
+  }
+
+  auto newOrder(OrderId order_id, Side side, Price price, Quantity quantity) -> void
+  {
+    send(next_seq_num_++, {ClientRequestType::NEW, client_id_, 0, order_id, side, price, quantity, OrderType::LIMIT, TimeInForce::DAY});
+  }
+
+  /// The next response on the ring, fails the test if none shows up within a few seconds.
+  auto receive(const std::string &what) -> OMClientResponse
+  {
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    auto response = responses_.getNextToRead();
+    for (; !response && std::chrono::steady_clock::now() < deadline; response = responses_.getNextToRead())
+      std::this_thread::yield();
+    ASSERT(response != nullptr, what + " no response from the order server.");
+    const auto om_response = *response;
+    responses_.updateReadIndex();
+    return om_response;
+  }
+
+  // Deleted default, copy & move constructors and assignment-operators.
+  TestShmClient() = delete;
+
+  TestShmClient(const TestShmClient &) = delete;
+
+  TestShmClient(const TestShmClient &&) = delete;
+
+  TestShmClient &operator=(const TestShmClient &) = delete;
+
+  TestShmClient &operator=(const TestShmClient &&) = delete;
+
+private:
+  auto send(size_t seq_num, const MEClientRequest &request) -> void
+  {
+    *(requests_.getNextToWriteTo()) = {seq_num, request};
+    requests_.updateWriteIndex();
+  }
+
+  const ClientId client_id_;
+  ShmClientRequestQueue requests_;
+  ShmClientResponseQueue responses_;
+  ShmSessionTable *session_table_ = nullptr;
+  size_t next_seq_num_ = 1;
+};
+
+/// Runs whatever the order server has sequenced through the matching engine, waiting a few seconds for num_requests of them to arrive.
+auto match(ClientRequestLFQueue &client_requests, MatchingEngine &matching_engine, size_t num_requests, const std::string &what) -> void
+{
+  const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  while (num_requests && std::chrono::steady_clock::now() < deadline)
+  {
+    const auto request = client_requests.getNextToRead();
+    if (!request)
+    {
+      std::this_thread::yield();
+      continue;
+    }
+    matching_engine.processClientRequest(request);
+    matching_engine.publishOutputs();
+    client_requests.updateReadIndex();
+    --num_requests;
+  }
+  ASSERT(!num_requests, what + " requests never reached the matching engine.");
+}
+
+auto checkResponse(const OMClientResponse &response, size_t seq_num, ClientResponseType type, OrderId order_id, Quantity exec_quantity,
+                   Quantity leaves_quantity, const std::string &what) -> void
+{
+  const auto &me_response = response.me_client_response_;
+  ASSERT(response.seq_num_ == seq_num && me_response.type_ == type && me_response.client_order_id_ == order_id &&
+         me_response.exec_quantity_ == exec_quantity && me_response.leaves_quantity_ == leaves_quantity,
+         what + " unexpected " + response.toString());
+}
+
+/// Opens a session the way the order gateway does, returns the sequence number the response stream carries on from.
+auto openSession(TestShmClient &client, const std::string &what) -> size_t
+{
+  client.sessionRequest(ClientRequestType::SEQUENCE_RESET, 1);
+  const auto reset = client.receive(what + " SEQUENCE_RESET");
+  ASSERT(reset.me_client_response_.type_ == ClientResponseType::SEQUENCE_RESET, what + " unexpected " + reset.toString());
+  return reset.seq_num_;
+}
+
+int main(int, char **)
+{
+  // the order server's thread floats, this box may not have its default core.
+  Common::setThreadPlacement(std::string(ORDER_SERVER_THREAD) + "=-1");
+
+  ClientRequestLFQueue client_requests(ME_MAX_CLIENT_UPDATES);
+  ClientResponseLFQueue client_responses(ME_MAX_CLIENT_UPDATES);
+  MEMarketUpdateLFQueue market_updates(ME_MAX_MARKET_UPDATES);
+  auto matching_engine = new MatchingEngine(&client_requests, &client_responses, &market_updates, 0, 1, -1, MatchingEngineCfg{}, nullptr, "", 0);
+  auto order_server = new OrderServer({&client_requests}, {&client_responses}, "lo", 0, TransportType::SHM, Common::IoEngineType::SOCKET,
+                                      ClientRiskCfg{});
+  order_server->start();
+
+  auto client_1 = new TestShmClient(CLIENT_1);
+  ASSERT(openSession(*client_1, "CLIENT_1") == 1, "CLIENT_1 should start a new response stream.");
+  client_1->newOrder(1, Side::SELL, PRICE, 10);
+  match(client_requests, *matching_engine, 1, "CLIENT_1 sell");
+  checkResponse(client_1->receive("CLIENT_1 sell"), 1, ClientResponseType::ACCEPTED, 1, 0, 10, "CLIENT_1 sell");
+
+  // gone with its sell still resting, the fill below is for a client without a session.
+  delete client_1;
+
+  TestShmClient client_2(CLIENT_2);
+  ASSERT(openSession(client_2, "CLIENT_2") == 1, "CLIENT_2 should start a new response stream.");
+  client_2.newOrder(1, Side::BUY, PRICE, 10);
+  match(client_requests, *matching_engine, 1, "CLIENT_2 buy");
+  checkResponse(client_2.receive("CLIENT_2 buy"), 1, ClientResponseType::ACCEPTED, 1, 0, 10, "CLIENT_2 buy");
+  checkResponse(client_2.receive("CLIENT_2 buy"), 2, ClientResponseType::FILLED, 1, 10, 0, "CLIENT_2 buy");
+
+  // back again, its response stream carries on past the fill and the fill can be asked for.
+  client_1 = new TestShmClient(CLIENT_1);
+  ASSERT(openSession(*client_1, "CLIENT_1 again") == 3, "CLIENT_1's response stream should carry on past its fill.");
+  client_1->sessionRequest(ClientRequestType::RESEND_REQUEST, 2);
+  checkResponse(client_1->receive("CLIENT_1 resend"), 2, ClientResponseType::FILLED, 1, 10, 0, "CLIENT_1 resend");
+  delete client_1;
+
+  delete order_server;
+  delete matching_engine;
+
+  std::cout << "OrderServerShmTest passed." << std::endl;
+  return 0;
+}
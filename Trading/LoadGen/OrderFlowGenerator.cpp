@@ -0,0 +1,365 @@
+#include "OrderFlowGenerator.hpp"
+
+#include <cmath>
+
+namespace Trading
+{
+  auto setLoadGenCfgOption(LoadGenCfg *cfg, const std::string &key, const std::string &value) -> bool
+  {
+    if (key == "first-client")
+      cfg->first_client_id_ = std::stoul(value);
+    else if (key == "clients")
+      cfg->num_clients_ = std::stoul(value);
+    else if (key == "tickers")
+      cfg->num_tickers_ = std::stoul(value);
+    else if (key == "zipf")
+      cfg->ticker_zipf_exponent_ = std::stod(value);
+    else if (key == "arrival")
+      cfg->arrival_type_ = stringToArrivalType(value);
+    else if (key == "rate")
+      cfg->rate_ = std::stod(value);
+    else if (key == "hawkes-branching")
+      cfg->hawkes_branching_ = std::stod(value);
+    else if (key == "hawkes-decay")
+      cfg->hawkes_decay_ = std::stod(value);
+    else if (key == "cancel")
+      cfg->cancel_ratio_ = std::stod(value);
+    else if (key == "modify")
+      cfg->modify_ratio_ = std::stod(value);
+    else if (key == "aggressive")
+      cfg->aggressive_ratio_ = std::stod(value);
+    else if (key == "ioc")
+      cfg->ioc_ratio_ = std::stod(value);
+    else if (key == "price-distance-p")
+      cfg->price_distance_p_ = std::stod(value);
+    else if (key == "median-qty")
+      cfg->median_quantity_ = std::stoul(value);
+    else if (key == "qty-sigma")
+      cfg->quantity_sigma_ = std::stod(value);
+    else if (key == "mid-move")
+      cfg->mid_move_ratio_ = std::stod(value);
+    else if (key == "max-live")
+      cfg->max_live_orders_ = std::stoul(value);
+    else if (key == "max-in-flight")
+      cfg->max_in_flight_ = std::stoul(value);
+    else if (key == "seed")
+      cfg->seed_ = std::stoull(value);
+    else
+      return false;
+    return true;
+  }
+
+  ArrivalProcess::ArrivalProcess(const LoadGenCfg &cfg, uint64_t seed)
+      : type_(cfg.arrival_type_)
+      , base_rate_(cfg.rate_ * (type_ == ArrivalType::HAWKES ? 1 - cfg.hawkes_branching_ : 1) / NANOS_TO_SECS)
+      , jump_(cfg.hawkes_branching_ * cfg.hawkes_decay_ / NANOS_TO_SECS)
+      , decay_(cfg.hawkes_decay_ / NANOS_TO_SECS)
+      , rng_(seed)
+  {
+    ASSERT(type_ != ArrivalType::INVALID && type_ != ArrivalType::MAX, "Invalid arrival type:" + arrivalTypeToString(type_));
+    ASSERT(type_ == ArrivalType::FLOOD || cfg.rate_ > 0, "Arrival rate has to be positive.");
+    ASSERT(type_ != ArrivalType::HAWKES || (cfg.hawkes_branching_ >= 0 && cfg.hawkes_branching_ < 1 && cfg.hawkes_decay_ > 0),
+           "HAWKES needs a branching ratio in [0, 1) and a positive decay.");
+    advance();
+  }
+
+  auto ArrivalProcess::advance() noexcept -> void
+  {
+    switch (type_)
+    {
+      case ArrivalType::POISSON:
+        next_time_ += -std::log(1 - uniform_(rng_)) / base_rate_;
+        break;
+      case ArrivalType::HAWKES:
+        // Ogata thinning - the intensity only decays between arrivals, so the intensity right now bounds it until the next one.
+        while (true)
+        {
+          const auto max_rate = base_rate_ + excitation_;
+          const auto gap = -std::log(1 - uniform_(rng_)) / max_rate;
+          next_time_ += gap;
+          excitation_ *= std::exp(-decay_ * gap);
+          if (uniform_(rng_) * max_rate <= base_rate_ + excitation_)
+            break;
+        }
+        excitation_ += jump_;
+        break;
+      default:
+        break;
+    }
+  }
+
+  OrderFlowGenerator::OrderFlowGenerator(const LoadGenCfg &cfg)
+      : cfg_(cfg)
+      , clients_(cfg.num_clients_)
+      , ticker_mid_(cfg.num_tickers_, LOADGEN_BASE_PRICE)
+      , sample_rng_(cfg.seed_)
+      , rng_(cfg.seed_)
+      , price_distance_(cfg.price_distance_p_)
+      , quantity_(std::log(cfg.median_quantity_), cfg.quantity_sigma_)
+  {
+    ASSERT(cfg_.num_clients_ >= 1 && cfg_.first_client_id_ + cfg_.num_clients_ <= ME_MAX_NUM_CLIENTS,
+           "Simulated client ids have to be below " + std::to_string(ME_MAX_NUM_CLIENTS));
+    ASSERT(cfg_.num_tickers_ >= 1 && cfg_.num_tickers_ <= ME_MAX_TICKERS, "tickers has to be between 1 and " + std::to_string(ME_MAX_TICKERS));
+    ASSERT(cfg_.max_live_orders_ >= 1 && cfg_.max_live_orders_ < LOADGEN_MAX_ORDER_IDS,
+           "max-live has to be between 1 and " + std::to_string(LOADGEN_MAX_ORDER_IDS - 1));
+    ASSERT(cfg_.cancel_ratio_ >= 0 && cfg_.modify_ratio_ >= 0 && cfg_.cancel_ratio_ + cfg_.modify_ratio_ <= 1,
+           "cancel and modify ratios have to add up to at most 1.");
+    ASSERT(cfg_.price_distance_p_ > 0 && cfg_.price_distance_p_ <= 1, "price-distance-p has to be in (0, 1].");
+    ASSERT(cfg_.median_quantity_ >= 1, "median-qty has to be positive.");
+    ASSERT(cfg_.max_in_flight_ >= 1, "max-in-flight has to be positive.");
+
+    for (auto &client : clients_)
+    {
+      client.orders_.resize(LOADGEN_MAX_ORDER_IDS);
+      client.free_order_ids_.reserve(LOADGEN_MAX_ORDER_IDS);
+      for (OrderId order_id = LOADGEN_MAX_ORDER_IDS; order_id > 0; --order_id)
+        client.free_order_ids_.push_back(order_id - 1);
+      client.live_orders_.reserve(LOADGEN_MAX_ORDER_IDS);
+    }
+
+    double total_weight = 0;
+    for (size_t i = 0; i < cfg_.num_tickers_; ++i)
+    {
+      total_weight += 1 / std::pow(i + 1, cfg_.ticker_zipf_exponent_);
+      ticker_cdf_.push_back(total_weight);
+    }
+    for (auto &cdf : ticker_cdf_)
+      cdf /= total_weight;
+
+    ack_latencies_.reserve(LOADGEN_MAX_LATENCY_SAMPLES);
+  }
+
+  /// Picks a client and an action - cancel or modify one of its live orders or send a new one. Falls back to a new order when the client
+  /// has nothing to cancel or modify and to a cancel when it is at max-live.
+  auto OrderFlowGenerator::next(Exchange::MEClientRequest *request) noexcept -> bool
+  {
+    const auto client_index = rng_() % cfg_.num_clients_;
+    const auto client_id = static_cast<ClientId>(cfg_.first_client_id_ + client_index);
+    auto &client = clients_[client_index];
+
+    const auto action = uniform_(rng_);
+    auto ok = false;
+    if (action < cfg_.cancel_ratio_ + cfg_.modify_ratio_)
+      ok = cancelOrModify(client_id, client, action >= cfg_.cancel_ratio_, request);
+    if (!ok && client.live_orders_.size() < cfg_.max_live_orders_)
+      ok = newOrder(client_id, client, request);
+    if (!ok)
+      ok = cancelOrModify(client_id, client, false, request);
+
+    if (UNLIKELY(!ok))
+    {
+      ++stats_.skipped_;
+      return false;
+    }
+
+    ++stats_.requests_[static_cast<size_t>(request->type_)];
+    ++in_flight_;
+    return true;
+  }
+
+  auto OrderFlowGenerator::newOrder(ClientId client_id, LoadGenClient &client, Exchange::MEClientRequest *request) noexcept -> bool
+  {
+    if (UNLIKELY(client.free_order_ids_.empty()))
+      return false;
+
+    const auto ticker_u = uniform_(rng_);
+    TickerId ticker_id = 0;
+    while (ticker_id + 1 < cfg_.num_tickers_ && ticker_cdf_[ticker_id] < ticker_u)
+      ++ticker_id;
+    if (uniform_(rng_) < cfg_.mid_move_ratio_)
+      moveMid(ticker_id);
+
+    // the touch is taken to be a tick either side of the reference mid, passive orders join it or go behind it and aggressive orders cross it.
+    const auto side = (rng_() & 1 ? Side::BUY : Side::SELL);
+    const auto aggressive = (uniform_(rng_) < cfg_.aggressive_ratio_);
+    const auto distance = 1 + priceDistance();
+    const auto price = ticker_mid_[ticker_id] + sideToValue(side) * (aggressive ? distance : -distance);
+    const auto tif = (aggressive && uniform_(rng_) < cfg_.ioc_ratio_ ? TimeInForce::IOC : TimeInForce::DAY);
+
+    const auto order_id = client.free_order_ids_.back();
+    client.free_order_ids_.pop_back();
+
+    auto &order = client.orders_[order_id];
+    order.order_ = {ticker_id, order_id, side, std::clamp(price, LOADGEN_BASE_PRICE - LOADGEN_MAX_PRICE_OFFSET, LOADGEN_BASE_PRICE + LOADGEN_MAX_PRICE_OFFSET),
+                    quantity(), OMOrderState::PENDING_NEW, tif};
+    order.dead_ = false;
+    order.sent_time_ = getCurrentNanos();
+
+    *request = {Exchange::ClientRequestType::NEW, client_id, ticker_id, order_id, side, order.order_.price_, order.order_.quantity_,
+                OrderType::LIMIT, tif};
+    return true;
+  }
+
+  /// Half the modifies cut the quantity in place, which keeps queue priority, the other half re-price the order relative to the current mid.
+  auto OrderFlowGenerator::cancelOrModify(ClientId client_id, LoadGenClient &client, bool modify, Exchange::MEClientRequest *request) noexcept -> bool
+  {
+    if (client.live_orders_.empty())
+      return false;
+
+    const auto order_id = client.live_orders_[rng_() % client.live_orders_.size()];
+    auto &order = client.orders_[order_id];
+    if (order.order_.order_state_ != OMOrderState::LIVE)
+      return false;
+
+    order.sent_time_ = getCurrentNanos();
+    if (!modify)
+    {
+      order.order_.order_state_ = OMOrderState::PENDING_CANCEL;
+      *request = {Exchange::ClientRequestType::CANCEL, client_id, order.order_.ticker_id_, order_id, order.order_.side_, Price_INVALID,
+                  Quantity_INVALID, OrderType::INVALID, TimeInForce::INVALID};
+      return true;
+    }
+
+    auto price = order.order_.price_;
+    auto modify_quantity = std::max<Quantity>(1, order.order_.quantity_ / 2);
+    if (rng_() & 1)
+    {
+      price = std::clamp(ticker_mid_[order.order_.ticker_id_] - sideToValue(order.order_.side_) * (1 + priceDistance()),
+                         LOADGEN_BASE_PRICE - LOADGEN_MAX_PRICE_OFFSET, LOADGEN_BASE_PRICE + LOADGEN_MAX_PRICE_OFFSET);
+      modify_quantity = quantity();
+    }
+
+    order.order_.order_state_ = OMOrderState::PENDING_MODIFY;
+    *request = {Exchange::ClientRequestType::MODIFY, client_id, order.order_.ticker_id_, order_id, order.order_.side_, price,
+                modify_quantity, OrderType::LIMIT, order.order_.tif_};
+    return true;
+  }
+
+  /// A tick up or down, leaning back towards the base price the further the mid has wandered away from it.
+  auto OrderFlowGenerator::moveMid(TickerId ticker_id) noexcept -> void
+  {
+    auto &mid = ticker_mid_[ticker_id];
+    const auto up_probability = 0.5 - 0.5 * static_cast<double>(mid - LOADGEN_BASE_PRICE) / LOADGEN_MAX_MID_OFFSET;
+    mid += (uniform_(rng_) < up_probability ? 1 : -1);
+  }
+
+  auto OrderFlowGenerator::priceDistance() noexcept -> Price
+  {
+    return std::min(price_distance_(rng_), LOADGEN_MAX_PRICE_OFFSET);
+  }
+
+  auto OrderFlowGenerator::quantity() noexcept -> Quantity
+  {
+    return static_cast<Quantity>(std::clamp(std::round(quantity_(rng_)), 1.0, 1000.0 * cfg_.median_quantity_));
+  }
+
+  auto OrderFlowGenerator::onResponse(const Exchange::MEClientResponse *response) noexcept -> void
+  {
+    const auto client_index = static_cast<size_t>(response->client_id_ - cfg_.first_client_id_);
+    const auto type = static_cast<size_t>(response->type_);
+    if (UNLIKELY(response->client_id_ < cfg_.first_client_id_ || client_index >= cfg_.num_clients_ ||
+                 response->client_order_id_ >= LOADGEN_MAX_ORDER_IDS || !type || type >= std::size(stats_.responses_)))
+    {
+      ++stats_.unknown_responses_;
+      return;
+    }
+
+    auto &client = clients_[client_index];
+    auto &order = client.orders_[response->client_order_id_];
+    const auto state = order.order_.order_state_;
+    if (UNLIKELY(state == OMOrderState::INVALID))
+    {
+      ++stats_.unknown_responses_;
+      return;
+    }
+    ++stats_.responses_[type];
+
+    switch (response->type_)
+    {
+      case Exchange::ClientResponseType::ACCEPTED:
+        if (state == OMOrderState::PENDING_NEW)
+        {
+          order.live_index_ = client.live_orders_.size();
+          client.live_orders_.push_back(response->client_order_id_);
+          onAck(client, order);
+        }
+        break;
+      case Exchange::ClientResponseType::FILLED:
+        stats_.filled_quantity_ += response->exec_quantity_;
+        order.order_.quantity_ = response->leaves_quantity_;
+        if (!response->leaves_quantity_)
+          onDead(client, order);
+        break;
+      case Exchange::ClientResponseType::CANCELED:
+        // also sent for what is left of an IOC order and for orders canceled by self-trade prevention - with a CANCEL in flight that
+        // CANCEL is then answered with a CANCEL_REJECTED, which is its ack.
+        onDead(client, order);
+        if (state == OMOrderState::PENDING_CANCEL && response->request_type_ == Exchange::ClientRequestType::CANCEL)
+          onAck(client, order);
+        break;
+      case Exchange::ClientResponseType::MODIFIED:
+        // also sent when self-trade prevention decrements an order, resting or aggressive.
+        order.order_.price_ = response->price_;
+        order.order_.quantity_ = response->leaves_quantity_;
+        if (state == OMOrderState::PENDING_MODIFY && response->request_type_ == Exchange::ClientRequestType::MODIFY)
+          onAck(client, order);
+        break;
+      case Exchange::ClientResponseType::CANCEL_REJECTED:
+      case Exchange::ClientResponseType::MODIFY_REJECTED:
+        // the order was filled or canceled before the request reached the matching engine.
+        onDead(client, order);
+        if (state == OMOrderState::PENDING_CANCEL || state == OMOrderState::PENDING_MODIFY)
+          onAck(client, order);
+        break;
+      case Exchange::ClientResponseType::REJECTED:
+        // refused by the order server's risk gate, a rejected NEW never became an order and anything else leaves the order as it was.
+        if (response->request_type_ == Exchange::ClientRequestType::NEW)
+          onDead(client, order);
+        if (state == OMOrderState::PENDING_NEW || state == OMOrderState::PENDING_CANCEL || state == OMOrderState::PENDING_MODIFY)
+          onAck(client, order);
+        break;
+      default:
+        break;
+    }
+  }
+
+  auto OrderFlowGenerator::onAck(LoadGenClient &client, LoadGenOrder &order) noexcept -> void
+  {
+    --in_flight_;
+    ++stats_.acks_;
+
+    // reservoir sampling keeps ack_latencies_ a uniform sample of all the acks.
+    const auto latency = getCurrentNanos() - order.sent_time_;
+    ++num_acks_sampled_;
+    if (ack_latencies_.size() < LOADGEN_MAX_LATENCY_SAMPLES)
+      ack_latencies_.push_back(latency);
+    else if (const auto i = sample_rng_() % num_acks_sampled_; i < LOADGEN_MAX_LATENCY_SAMPLES)
+      ack_latencies_[i] = latency;
+
+    if (order.dead_)
+      release(client, order);
+    else
+      order.order_.order_state_ = OMOrderState::LIVE;
+  }
+
+  /// The order is filled or canceled, its id can be reused once the request in flight on it (if any) has been acked.
+  auto OrderFlowGenerator::onDead(LoadGenClient &client, LoadGenOrder &order) noexcept -> void
+  {
+    if (order.live_index_ != LOADGEN_NOT_LIVE)
+    {
+      const auto last_order_id = client.live_orders_.back();
+      client.live_orders_[order.live_index_] = last_order_id;
+      client.orders_[last_order_id].live_index_ = order.live_index_;
+      client.live_orders_.pop_back();
+      order.live_index_ = LOADGEN_NOT_LIVE;
+    }
+
+    if (order.order_.order_state_ == OMOrderState::LIVE)
+      release(client, order);
+    else
+      order.dead_ = true;
+  }
+
+  auto OrderFlowGenerator::release(LoadGenClient &client, LoadGenOrder &order) noexcept -> void
+  {
+    order.order_.order_state_ = OMOrderState::INVALID;
+    order.dead_ = false;
+    client.free_order_ids_.push_back(order.order_.order_id_);
+  }
+
+  auto OrderFlowGenerator::ackLatencies() noexcept -> const std::vector<Nanos> &
+  {
+    std::sort(ack_latencies_.begin(), ack_latencies_.end());
+    return ack_latencies_;
+  }
+}
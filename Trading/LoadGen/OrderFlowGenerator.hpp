@@ -0,0 +1,307 @@
+#pragma once
+
+#include <algorithm>
+#include <limits>
+#include <random>
+#include <sstream>
+#include <vector>
+
+#include "../../Common/Types.hpp"
+#include "../../Common/Macros.hpp"
+#include "../../Common/TimeUtils.hpp"
+
+#include "../../Exchange/OrderServer/ClientRequest.hpp"
+#include "../../Exchange/OrderServer/ClientResponse.hpp"
+
+#include "../Strategy/OMOrder.hpp"
+
+using namespace Common;
+
+namespace Trading
+{
+  /// Order ids of dead orders are reused, so a simulated client never needs more ids than this - and never goes past what the matching
+  /// engine can index by client order id.
+  constexpr size_t LOADGEN_MAX_ORDER_IDS = std::min<size_t>(16 * 1024, ME_MAX_ORDER_IDS);
+
+  /// All prices for a ticker stay within this many ticks of its base price, so they never collide in the matching engine's
+  /// ME_MAX_PRICE_LEVELS sized price level hash.
+  constexpr Price LOADGEN_MAX_PRICE_OFFSET = (ME_MAX_PRICE_LEVELS - 1) / 2;
+
+  /// The reference mid of a ticker wanders at most this many ticks away from its base price, the rest of LOADGEN_MAX_PRICE_OFFSET is book depth.
+  constexpr Price LOADGEN_MAX_MID_OFFSET = 32;
+
+  constexpr Price LOADGEN_BASE_PRICE = 1000;
+
+  constexpr size_t LOADGEN_NOT_LIVE = std::numeric_limits<size_t>::max();
+
+  /// Number of ack latencies kept for the percentiles, a uniform sample of all of them once there are more.
+  constexpr size_t LOADGEN_MAX_LATENCY_SAMPLES = 1024 * 1024;
+
+  enum class ArrivalType : int8_t {
+    INVALID = 0,
+    FLOOD = 1,   // next request as soon as flow control allows.
+    POISSON = 2, // exponential gaps at the configured rate.
+    HAWKES = 3,  // self-exciting - every arrival raises the rate for a while, which gives bursts around the same mean rate.
+    MAX = 4
+  };
+
+  inline auto arrivalTypeToString(ArrivalType type) -> std::string {
+    switch (type) {
+      case ArrivalType::FLOOD:
+        return "FLOOD";
+      case ArrivalType::POISSON:
+        return "POISSON";
+      case ArrivalType::HAWKES:
+        return "HAWKES";
+      case ArrivalType::INVALID:
+        return "INVALID";
+      case ArrivalType::MAX:
+        return "MAX";
+    }
+    return "UNKNOWN";
+  }
+
+  inline auto stringToArrivalType(const std::string &str) -> ArrivalType
+  {
+    for (auto i = static_cast<int>(ArrivalType::INVALID); i <= static_cast<int>(ArrivalType::MAX); ++i)
+    {
+      const auto type = static_cast<ArrivalType>(i);
+      if (arrivalTypeToString(type) == str)
+        return type;
+    }
+    return ArrivalType::INVALID;
+  }
+
+  struct LoadGenCfg {
+    ClientId first_client_id_ = 100;
+    size_t num_clients_ = 64;
+
+    /// Ticker i is picked with probability proportional to 1 / (i + 1)^ticker_zipf_exponent_, 0 picks them uniformly.
+    size_t num_tickers_ = ME_MAX_TICKERS;
+    double ticker_zipf_exponent_ = 1.0;
+
+    ArrivalType arrival_type_ = ArrivalType::POISSON;
+    double rate_ = 100 * 1000; // mean requests per second for POISSON and HAWKES.
+
+    /// HAWKES - expected number of arrivals each arrival triggers (< 1) and how fast that excitement decays, per second.
+    double hawkes_branching_ = 0.7;
+    double hawkes_decay_ = 1000;
+
+    /// Share of requests that cancel or modify one of the client's live orders, the rest are new orders.
+    double cancel_ratio_ = 0.4;
+    double modify_ratio_ = 0.1;
+
+    /// Share of new orders priced through the touch, and the share of those sent IOC instead of DAY.
+    double aggressive_ratio_ = 0.1;
+    double ioc_ratio_ = 0.5;
+
+    /// Distance from the touch in ticks is geometric with mean (1 - p) / p.
+    double price_distance_p_ = 0.3;
+
+    /// Order sizes are log-normal around median_quantity_.
+    Quantity median_quantity_ = 100;
+    double quantity_sigma_ = 0.8;
+
+    /// Chance that a request moves its ticker's reference mid by a tick.
+    double mid_move_ratio_ = 0.01;
+
+    /// Per client, new orders turn into cancels once a client has this many orders live.
+    size_t max_live_orders_ = 256;
+
+    /// Requests sent that have not been answered yet, across all clients. Keeps the exchange's queues from overflowing.
+    size_t max_in_flight_ = 512;
+
+    uint64_t seed_ = 42;
+
+    auto toString() const {
+      std::stringstream ss;
+      ss << "LoadGenCfg{"
+         << "first-client:" << first_client_id_ << " "
+         << "clients:" << num_clients_ << " "
+         << "tickers:" << num_tickers_ << " "
+         << "zipf:" << ticker_zipf_exponent_ << " "
+         << "arrival:" << arrivalTypeToString(arrival_type_) << " "
+         << "rate:" << rate_ << " "
+         << "hawkes-branching:" << hawkes_branching_ << " "
+         << "hawkes-decay:" << hawkes_decay_ << " "
+         << "cancel:" << cancel_ratio_ << " "
+         << "modify:" << modify_ratio_ << " "
+         << "aggressive:" << aggressive_ratio_ << " "
+         << "ioc:" << ioc_ratio_ << " "
+         << "price-distance-p:" << price_distance_p_ << " "
+         << "median-qty:" << median_quantity_ << " "
+         << "qty-sigma:" << quantity_sigma_ << " "
+         << "mid-move:" << mid_move_ratio_ << " "
+         << "max-live:" << max_live_orders_ << " "
+         << "max-in-flight:" << max_in_flight_ << " "
+         << "seed:" << seed_
+         << "}";
+      return ss.str();
+    }
+  };
+
+  /// Sets the LoadGenCfg field named key (the names toString() prints) from value, returns false for an unknown key.
+  auto setLoadGenCfgOption(LoadGenCfg *cfg, const std::string &key, const std::string &value) -> bool;
+
+  /// Arrival times of a request stream, in nanoseconds since the stream started.
+  class ArrivalProcess final
+  {
+  public:
+    ArrivalProcess(const LoadGenCfg &cfg, uint64_t seed);
+
+    /// Time of the next arrival, 0 for FLOOD.
+    auto nextTime() const noexcept
+    {
+      return static_cast<Nanos>(next_time_);
+    }
+
+    /// Move on to the arrival after nextTime().
+    auto advance() noexcept -> void;
+
+    // Deleted default, copy & move constructors and assignment-operators.
+    ArrivalProcess() = delete;
+
+    ArrivalProcess(const ArrivalProcess &) = delete;
+
+    ArrivalProcess(const ArrivalProcess &&) = delete;
+
+    ArrivalProcess &operator=(const ArrivalProcess &) = delete;
+
+    ArrivalProcess &operator=(const ArrivalProcess &&) = delete;
+
+  private:
+    const ArrivalType type_;
+
+    /// Rates in arrivals per nanosecond. HAWKES intensity is base_rate_ + excitation_, excitation_ jumps by jump_ on every arrival
+    /// and decays by decay_ per nanosecond, base_rate_ is picked so the long run mean is the configured rate.
+    const double base_rate_;
+    const double jump_;
+    const double decay_;
+    double excitation_ = 0;
+
+    double next_time_ = 0;
+
+    std::mt19937_64 rng_;
+    std::uniform_real_distribution<double> uniform_{0.0, 1.0};
+  };
+
+  struct LoadGenStats {
+    size_t requests_[4] = {};  // indexed by ClientRequestType.
+    size_t responses_[8] = {}; // indexed by ClientResponseType.
+    size_t acks_ = 0;
+    size_t skipped_ = 0;       // arrivals that had nothing valid to send, no free order ids.
+    size_t unknown_responses_ = 0;
+    uint64_t filled_quantity_ = 0;
+
+    auto totalRequests() const noexcept
+    {
+      return requests_[static_cast<size_t>(Exchange::ClientRequestType::NEW)] + requests_[static_cast<size_t>(Exchange::ClientRequestType::CANCEL)] +
+             requests_[static_cast<size_t>(Exchange::ClientRequestType::MODIFY)];
+    }
+
+    auto toString() const {
+      std::stringstream ss;
+      ss << "LoadGenStats{"
+         << "NEW:" << requests_[static_cast<size_t>(Exchange::ClientRequestType::NEW)] << " "
+         << "CANCEL:" << requests_[static_cast<size_t>(Exchange::ClientRequestType::CANCEL)] << " "
+         << "MODIFY:" << requests_[static_cast<size_t>(Exchange::ClientRequestType::MODIFY)] << " "
+         << "skipped:" << skipped_ << " acks:" << acks_;
+      for (auto i = static_cast<size_t>(Exchange::ClientResponseType::ACCEPTED); i <= static_cast<size_t>(Exchange::ClientResponseType::REJECTED); ++i)
+        ss << " " << Exchange::clientResponseTypeToString(static_cast<Exchange::ClientResponseType>(i)) << ":" << responses_[i];
+      ss << " filled-qty:" << filled_quantity_ << " unknown-responses:" << unknown_responses_
+         << "}";
+      return ss.str();
+    }
+  };
+
+  /// Generates the order flow of many simulated clients and tracks the state of their orders from the exchange's responses, so cancels
+  /// and modifies target orders that are actually live and order ids can be reused.
+  /// Every order has at most one request in flight. The response that answers a request is its ack - ACCEPTED for a NEW, CANCELED or
+  /// CANCEL_REJECTED for a CANCEL and MODIFIED or MODIFY_REJECTED for a MODIFY, told apart from what self-trade prevention sends by
+  /// their request type - and inFlight() counts requests without one yet.
+  /// Does not follow market data, prices are relative to a reference mid per ticker that random walks around LOADGEN_BASE_PRICE.
+  class OrderFlowGenerator final
+  {
+  public:
+    explicit OrderFlowGenerator(const LoadGenCfg &cfg);
+
+    /// Fills in the next request, false if there is nothing that can be sent right now.
+    auto next(Exchange::MEClientRequest *request) noexcept -> bool;
+
+    auto onResponse(const Exchange::MEClientResponse *response) noexcept -> void;
+
+    auto inFlight() const noexcept
+    {
+      return in_flight_;
+    }
+
+    auto stats() const noexcept -> const LoadGenStats &
+    {
+      return stats_;
+    }
+
+    /// Time from sending a request to receiving its ack, sorted.
+    auto ackLatencies() noexcept -> const std::vector<Nanos> &;
+
+    // Deleted default, copy & move constructors and assignment-operators.
+    OrderFlowGenerator() = delete;
+
+    OrderFlowGenerator(const OrderFlowGenerator &) = delete;
+
+    OrderFlowGenerator(const OrderFlowGenerator &&) = delete;
+
+    OrderFlowGenerator &operator=(const OrderFlowGenerator &) = delete;
+
+    OrderFlowGenerator &operator=(const OrderFlowGenerator &&) = delete;
+
+  private:
+    struct LoadGenOrder {
+      OMOrder order_;
+      bool dead_ = false;           // filled or canceled while a request on it was in flight.
+      size_t live_index_ = LOADGEN_NOT_LIVE; // position in live_orders_.
+      Nanos sent_time_ = 0;
+    };
+
+    struct LoadGenClient {
+      std::vector<LoadGenOrder> orders_;      // indexed by order id.
+      std::vector<OrderId> free_order_ids_;
+      std::vector<OrderId> live_orders_;       // accepted and not known to be dead.
+    };
+
+    auto newOrder(ClientId client_id, LoadGenClient &client, Exchange::MEClientRequest *request) noexcept -> bool;
+
+    auto cancelOrModify(ClientId client_id, LoadGenClient &client, bool modify, Exchange::MEClientRequest *request) noexcept -> bool;
+
+    auto moveMid(TickerId ticker_id) noexcept -> void;
+
+    auto priceDistance() noexcept -> Price;
+
+    auto quantity() noexcept -> Quantity;
+
+    auto onAck(LoadGenClient &client, LoadGenOrder &order) noexcept -> void;
+
+    auto onDead(LoadGenClient &client, LoadGenOrder &order) noexcept -> void;
+
+    auto release(LoadGenClient &client, LoadGenOrder &order) noexcept -> void;
+
+    const LoadGenCfg cfg_;
+
+    std::vector<LoadGenClient> clients_;
+
+    /// Cumulative distribution of ticker popularity.
+    std::vector<double> ticker_cdf_;
+    std::vector<Price> ticker_mid_;
+
+    size_t in_flight_ = 0;
+    LoadGenStats stats_;
+
+    std::vector<Nanos> ack_latencies_;
+    size_t num_acks_sampled_ = 0;
+    std::mt19937_64 sample_rng_;
+
+    std::mt19937_64 rng_;
+    std::uniform_real_distribution<double> uniform_{0.0, 1.0};
+    std::geometric_distribution<Price> price_distance_;
+    std::lognormal_distribution<double> quantity_;
+  };
+}
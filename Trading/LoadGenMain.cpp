@@ -0,0 +1,209 @@
+#include <iostream>
+
+#include "LoadGen/OrderFlowGenerator.hpp"
+#include "../Common/Logging.hpp"
+#include "../Common/TCPSocket.hpp"
+#include "../Exchange/Matcher/MatchingEngine.hpp"
+
+/// Synthetic order flow for load testing the exchange, from many simulated clients - see LoadGenCfg for the distributions.
+/// Usage: LoadGen <TCP|ME> <seconds> [option=value ...], e.g. LoadGen TCP 60 clients=128 arrival=HAWKES rate=500000 cancel=0.6
+///
+/// TCP sends to a running exchange's OrderServer, all simulated clients share one connection - 127.0.0.1:12345 on lo unless
+/// ANCHOR_ORDER_GW_IP, ANCHOR_ORDER_GW_IFACE and ANCHOR_ORDER_GW_PORT say otherwise.
+/// ME runs the matching engine in this process and feeds it directly, configured from the same ANCHOR_MATCHING_SHARDS,
+/// ANCHOR_AGGREGATE_TRADES and ANCHOR_STP_MODE variables as ExchangeMain - the ceiling of what the matching engine can take.
+/// Prints the achieved rate every second and the request counts and ack latency percentiles at the end.
+
+int main(int argc, char **argv)
+{
+  if (argc < 3)
+    FATAL("USAGE LoadGen <TCP|ME> <seconds> [option=value ...]");
+
+  const std::string target = argv[1];
+  ASSERT(target == "TCP" || target == "ME", "Unknown target:" + target);
+  const Nanos duration = std::atoi(argv[2]) * NANOS_TO_SECS;
+
+  Trading::LoadGenCfg cfg;
+  for (int i = 3; i < argc; ++i)
+  {
+    const std::string option = argv[i];
+    const auto separator = option.find('=');
+    ASSERT(separator != std::string::npos && Trading::setLoadGenCfgOption(&cfg, option.substr(0, separator), option.substr(separator + 1)),
+           "Unknown option:" + option);
+  }
+  std::cout << "LoadGen target:" << target << " " << cfg.toString() << std::endl;
+
+  Common::Logger logger("loadgen_main.log");
+  std::string time_str;
+
+  Trading::OrderFlowGenerator generator(cfg);
+  Trading::ArrivalProcess arrivals(cfg, cfg.seed_ + 1);
+
+  // TCP - one connection for every simulated client, the OrderServer keeps a sequence number per client id.
+  Common::TCPSocket tcp_socket(logger);
+  std::array<size_t, ME_MAX_NUM_CLIENTS> next_outgoing_seq_num, next_exp_seq_num;
+  next_outgoing_seq_num.fill(1);
+  next_exp_seq_num.fill(1);
+  size_t num_seq_gaps = 0;
+
+  // ME - the matching engine shards and their queues.
+  Exchange::ClientRequestLFQueues client_requests;
+  Exchange::ClientResponseLFQueues client_responses;
+  Exchange::MEMarketUpdateLFQueues market_updates;
+  std::vector<Exchange::MatchingEngine *> matching_engines;
+  size_t num_market_updates = 0;
+
+  if (target == "TCP")
+  {
+    // ANCHOR_ORDER_GW_IP, ANCHOR_ORDER_GW_IFACE and ANCHOR_ORDER_GW_PORT point the connection at an exchange that is not on this box's lo.
+    const auto order_gw_ip_env = std::getenv("ANCHOR_ORDER_GW_IP");
+    const std::string order_gw_ip = (order_gw_ip_env ? order_gw_ip_env : "127.0.0.1");
+    const auto order_gw_iface_env = std::getenv("ANCHOR_ORDER_GW_IFACE");
+    const std::string order_gw_iface = (order_gw_iface_env ? order_gw_iface_env : "lo");
+    const auto order_gw_port_env = std::getenv("ANCHOR_ORDER_GW_PORT");
+    const int order_gw_port = (order_gw_port_env ? std::atoi(order_gw_port_env) : 12345);
+    ASSERT(order_gw_port > 0 && order_gw_port <= 65535, "Invalid ANCHOR_ORDER_GW_PORT:" + std::string(order_gw_port_env ? order_gw_port_env : ""));
+    std::cout << "Connecting to ip:" << order_gw_ip << " port:" << order_gw_port << " on iface:" << order_gw_iface << std::endl;
+
+    ASSERT(tcp_socket.connect(order_gw_ip, order_gw_iface, order_gw_port, false) >= 0,
+           "Unable to connect to ip:" + order_gw_ip + " port:" + std::to_string(order_gw_port) + " on iface:" + order_gw_iface +
+           " error:" + std::string(std::strerror(errno)));
+    tcp_socket.recv_callback_ = [&](TCPSocket *socket, Nanos)
+    {
+      size_t i = 0;
+      for (; i + sizeof(Exchange::OMClientResponse) <= socket->next_rcv_valid_index_; i += sizeof(Exchange::OMClientResponse))
+      {
+        auto response = reinterpret_cast<const Exchange::OMClientResponse *>(socket->inbound_data_.data() + i);
+        const auto client_id = response->me_client_response_.client_id_;
+        if (UNLIKELY(client_id >= ME_MAX_NUM_CLIENTS || response->seq_num_ != next_exp_seq_num[client_id]))
+        {
+          logger.log("%:% %() % ERROR Unexpected response %\n", __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str),
+                     response->toString());
+          ++num_seq_gaps;
+          continue;
+        }
+        ++next_exp_seq_num[client_id];
+        generator.onResponse(&response->me_client_response_);
+      }
+      memcpy(socket->inbound_data_.data(), socket->inbound_data_.data() + i, socket->next_rcv_valid_index_ - i);
+      socket->next_rcv_valid_index_ -= i;
+    };
+  } else
+  {
+    const auto shards_env = std::getenv("ANCHOR_MATCHING_SHARDS");
+    const size_t num_shards = (shards_env ? std::atoi(shards_env) : 1);
+    ASSERT(num_shards >= 1 && num_shards <= ME_MAX_MATCHING_SHARDS,
+           "ANCHOR_MATCHING_SHARDS has to be between 1 and " + std::to_string(ME_MAX_MATCHING_SHARDS));
+
+    MatchingEngineCfg matching_engine_cfg;
+    const auto aggregate_trades_env = std::getenv("ANCHOR_AGGREGATE_TRADES");
+    matching_engine_cfg.aggregate_trades_ = (aggregate_trades_env && std::atoi(aggregate_trades_env));
+    const auto stp_mode_env = std::getenv("ANCHOR_STP_MODE");
+    if (stp_mode_env)
+      matching_engine_cfg.stp_mode_ = stringToSTPMode(stp_mode_env);
+    ASSERT(matching_engine_cfg.stp_mode_ != STPMode::INVALID && matching_engine_cfg.stp_mode_ != STPMode::MAX,
+           "Invalid ANCHOR_STP_MODE:" + std::string(stp_mode_env ? stp_mode_env : ""));
+    std::cout << "In-process matching engine shards:" << num_shards << " " << matching_engine_cfg.toString() << std::endl;
+
+    for (size_t shard_id = 0; shard_id < num_shards; ++shard_id)
+    {
+      client_requests.push_back(new Exchange::ClientRequestLFQueue(ME_MAX_CLIENT_UPDATES));
+      client_responses.push_back(new Exchange::ClientResponseLFQueue(ME_MAX_CLIENT_UPDATES));
+      market_updates.push_back(new Exchange::MEMarketUpdateLFQueue(ME_MAX_MARKET_UPDATES));
+      matching_engines.push_back(new Exchange::MatchingEngine(client_requests[shard_id], client_responses[shard_id], market_updates[shard_id],
+                                                              shard_id, num_shards, -1, matching_engine_cfg, nullptr, "", 0));
+      matching_engines.back()->start();
+    }
+  }
+
+  const auto send = [&](const Exchange::MEClientRequest &request)
+  {
+    if (target == "TCP")
+    {
+      const Exchange::OMClientRequest om_request{next_outgoing_seq_num[request.client_id_]++, request};
+      tcp_socket.send(&om_request, sizeof(om_request));
+      return;
+    }
+    auto shard_requests = client_requests[request.ticker_id_ % client_requests.size()];
+    *shard_requests->getNextToWriteTo() = request;
+    shard_requests->updateWriteIndex();
+  };
+
+  const auto poll = [&]()
+  {
+    if (target == "TCP")
+    {
+      tcp_socket.sendAndRecv();
+      return;
+    }
+    for (size_t shard_id = 0; shard_id < client_responses.size(); ++shard_id)
+    {
+      for (auto response = client_responses[shard_id]->getNextToRead(); response; response = client_responses[shard_id]->getNextToRead())
+      {
+        generator.onResponse(response);
+        client_responses[shard_id]->updateReadIndex();
+      }
+      for (auto update = market_updates[shard_id]->getNextToRead(); update; update = market_updates[shard_id]->getNextToRead())
+      {
+        ++num_market_updates;
+        market_updates[shard_id]->updateReadIndex();
+      }
+    }
+  };
+
+  // requests go out at their arrival times as long as fewer than max-in-flight are unanswered, otherwise they queue up and go out
+  // back to back once there is room again - max-lag shows how far behind the arrival schedule that got.
+  Exchange::MEClientRequest request;
+  Nanos max_lag = 0;
+  size_t last_sent = 0;
+  const auto start_time = Common::getCurrentNanos();
+  auto next_report_time = start_time + NANOS_TO_SECS;
+  for (auto now = start_time; now < start_time + duration; now = Common::getCurrentNanos())
+  {
+    poll();
+
+    while (generator.inFlight() < cfg.max_in_flight_ && arrivals.nextTime() <= now - start_time)
+    {
+      if (cfg.arrival_type_ != Trading::ArrivalType::FLOOD)
+        max_lag = std::max(max_lag, now - start_time - arrivals.nextTime());
+      if (generator.next(&request))
+        send(request);
+      arrivals.advance();
+    }
+
+    if (now >= next_report_time)
+    {
+      const auto &stats = generator.stats();
+      const auto sent = stats.totalRequests();
+      std::cout << "t:" << (now - start_time) / NANOS_TO_SECS << "s requests/sec:" << sent - last_sent << " acks:" << stats.acks_
+                << " in-flight:" << generator.inFlight() << std::endl;
+      last_sent = sent;
+      next_report_time += NANOS_TO_SECS;
+    }
+  }
+  const auto elapsed = Common::getCurrentNanos() - start_time;
+
+  // give the last requests a chance to be answered.
+  for (const auto drain_end = Common::getCurrentNanos() + NANOS_TO_SECS; generator.inFlight() && Common::getCurrentNanos() < drain_end; )
+    poll();
+
+  for (auto matching_engine : matching_engines)
+    delete matching_engine;
+
+  const auto &stats = generator.stats();
+  const auto sent = stats.totalRequests();
+  std::cout << stats.toString() << std::endl;
+  std::cout << "Elapsed:" << elapsed / NANOS_TO_MILLIS << "ms requests/sec:" << static_cast<uint64_t>(sent * static_cast<double>(NANOS_TO_SECS) / elapsed)
+            << " max-lag:" << max_lag / NANOS_TO_MICROS << "us unanswered:" << generator.inFlight() << " seq-gaps:" << num_seq_gaps
+            << " market-updates:" << num_market_updates << std::endl;
+
+  const auto &latencies = generator.ackLatencies();
+  if (!latencies.empty())
+  {
+    const auto percentile = [&](double p) { return latencies[static_cast<size_t>(p * (latencies.size() - 1))]; };
+    std::cout << "Ack latency ns p50:" << percentile(0.5) << " p90:" << percentile(0.9) << " p99:" << percentile(0.99)
+              << " p99.9:" << percentile(0.999) << " max:" << percentile(1.0) << std::endl;
+  }
+
+  return 0;
+}
@@ -5,16 +5,43 @@ namespace Trading
   MarketDataConsumer::MarketDataConsumer(Common::ClientId client_id, Exchange::MEMarketUpdateLFQueue *market_updates,
                                          const std::string &iface,
                                          const std::string &snapshot_ip, int snapshot_port,
-                                         const std::string &incremental_ip, int incremental_port)
+                                         const std::string &incremental_ip, int incremental_port,
+                                         Common::TransportType transport_type,
+                                         Common::McastRxType mcast_rx_type)
       : incoming_md_updates_(market_updates)
       , run_(false)
+      , wait_strategy_(Common::waitStrategyType(MARKET_DATA_CONSUMER_THREAD, Common::WaitStrategyType::BUSY_SPIN))
       , logger_("trading_market_data_consumer_" + std::to_string(client_id) + ".log")
       , incremental_mcast_socket_(logger_)
       , snapshot_mcast_socket_(logger_)
       , iface_(iface)
       , snapshot_ip_(snapshot_ip)
-      , snapshot_port_(snapshot_port) 
+      , snapshot_port_(snapshot_port)
+      , transport_type_(transport_type)
   {
+    if (transport_type_ == Common::TransportType::SHM) 
+    {
+      shm_incremental_updates_ = new Exchange::ShmMDPMarketUpdateQueue(Exchange::shmIncrementalQueueName(),
+                                                                        Exchange::SHM_MARKET_UPDATE_QUEUE_SIZE, /*create*/ false);
+      return;
+    }
+
+    if (mcast_rx_type == Common::McastRxType::XDP) 
+    {
+      xdp_socket_ = new Common::XdpSocket(logger_);
+      if (xdp_socket_->init(iface)) 
+      {
+        incremental_mcast_socket_.attach(xdp_socket_);
+        snapshot_mcast_socket_.attach(xdp_socket_);
+      } else 
+      {
+        logger_.log("%:% %() % AF_XDP not available on iface:%, falling back to SOCKET\n", __FILE__, __LINE__, __FUNCTION__,
+                    Common::getCurrentTimeStr(&time_str_), iface);
+        delete xdp_socket_;
+        xdp_socket_ = nullptr;
+      }
+    }
+
     auto recv_callback = [this](auto socket) 
     {
       recvCallback(socket);
@@ -30,15 +57,32 @@ namespace Trading
     snapshot_mcast_socket_.recv_callback_ = recv_callback;
   }
 
-  /// Main loop for this thread - reads and processes messages from the multicast sockets - the heavy lifting is in the recvCallback() and checkSnapshotSync() methods.
+  /// Main loop for this thread - reads and processes messages from the multicast sockets or the shared memory rings - the heavy lifting is in the onMarketUpdate() and checkSnapshotSync() methods.
   auto MarketDataConsumer::run() noexcept -> void 
   {
     logger_.log("%:% %() %\n", __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str_));
     while (run_) 
     {
-      incremental_mcast_socket_.sendAndRecv();
-      snapshot_mcast_socket_.sendAndRecv();
+      bool did_work = false;
+      if (transport_type_ == Common::TransportType::SHM) 
+      {
+        did_work = pollSharedMemory(shm_incremental_updates_, false);
+        if (shm_snapshot_updates_)
+          did_work |= pollSharedMemory(shm_snapshot_updates_, true);
+      } else if (xdp_socket_) 
+      {
+        did_work = xdp_socket_->poll();
+      } else 
+      {
+        did_work = incremental_mcast_socket_.sendAndRecv();
+        did_work |= snapshot_mcast_socket_.sendAndRecv();
+      }
+
+      // fed only by the exchange's sockets or shared memory rings, a parked consumer notices new updates at the park timeout.
+      wait_strategy_.afterPoll(did_work);
     }
+    logger_.log("%:% %() % % %\n", __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str_), wait_strategy_.toString(),
+                (xdp_socket_ ? xdp_socket_->toString() : ""));
   }
 
   /// Start the process of snapshot synchronization by subscribing to the snapshot multicast stream.
@@ -47,6 +91,14 @@ namespace Trading
     snapshot_queued_msgs_.clear();
     incremental_queued_msgs_.clear();
 
+    if (transport_type_ == Common::TransportType::SHM) 
+    {
+      // joins the snapshot ring at its current position, the next full snapshot cycle will be picked up from there.
+      shm_snapshot_updates_ = new Exchange::ShmMDPMarketUpdateQueue(Exchange::shmSnapshotQueueName(),
+                                                                     Exchange::SHM_MARKET_UPDATE_QUEUE_SIZE, /*create*/ false);
+      return;
+    }
+
     ASSERT(snapshot_mcast_socket_.init(snapshot_ip_, iface_, snapshot_port_, /*is_listening*/ true) >= 0,
            "Unable to create snapshot mcast socket. error:" + std::string(std::strerror(errno)));
     ASSERT(snapshot_mcast_socket_.join(snapshot_ip_), // IGMP multicast subscription.
@@ -161,7 +213,20 @@ namespace Trading
     incremental_queued_msgs_.clear();
     in_recovery_ = false;
 
-    snapshot_mcast_socket_.leave(snapshot_ip_, snapshot_port_);;
+    stopSnapshotSync();
+  }
+
+  /// Stop listening to the snapshot stream once synchronization is complete.
+  auto MarketDataConsumer::stopSnapshotSync() -> void 
+  {
+    if (transport_type_ == Common::TransportType::SHM) 
+    {
+      delete shm_snapshot_updates_;
+      shm_snapshot_updates_ = nullptr;
+      return;
+    }
+
+    snapshot_mcast_socket_.leave(snapshot_ip_, snapshot_port_);
   }
 
   /// Queue up a message in the *_queued_msgs_ containers, first parameter specifies if this update came from the snapshot or the incremental streams.
@@ -209,43 +274,78 @@ namespace Trading
       size_t i = 0;
       for (; i + sizeof(Exchange::MDPMarketUpdate) <= socket->next_rcv_valid_index_; i += sizeof(Exchange::MDPMarketUpdate)) 
       {
-        auto request = reinterpret_cast<const Exchange::MDPMarketUpdate *>(socket->inbound_data_.data() + i);
+        auto request = reinterpret_cast<const Exchange::MDPMarketUpdate *>(socket->rcv_data_ + i);
         logger_.log("%:% %() % Received % socket len:% %\n", __FILE__, __LINE__, __FUNCTION__,
                     Common::getCurrentTimeStr(&time_str_),
                     (is_snapshot ? "snapshot" : "incremental"), sizeof(Exchange::MDPMarketUpdate), request->toString());
 
-        const bool already_in_recovery = in_recovery_;
-        in_recovery_ = (already_in_recovery || request->seq_num_ != next_exp_inc_seq_num_);
-
-        if (UNLIKELY(in_recovery_)) 
-        {
-          if (UNLIKELY(!already_in_recovery)) 
-          { 
-            // if we just entered recovery, start the snapshot synchonization process by subscribing to the snapshot multicast stream.
-            logger_.log("%:% %() % Packet drops on % socket. SeqNum expected:% received:%\n", __FILE__, __LINE__, __FUNCTION__,
-                        Common::getCurrentTimeStr(&time_str_), (is_snapshot ? "snapshot" : "incremental"), next_exp_inc_seq_num_, request->seq_num_);
-            startSnapshotSync();
-          }
-
-          queueMessage(is_snapshot, request); // queue up the market data update message and check if snapshot recovery / synchronization can be completed successfully.
-        } else if (!is_snapshot) 
-        { 
-          // not in recovery and received a packet in the correct order and without gaps, process it.
-          logger_.log("%:% %() % %\n", __FILE__, __LINE__, __FUNCTION__,
-                      Common::getCurrentTimeStr(&time_str_), request->toString());
-
-          ++next_exp_inc_seq_num_;
-
-          auto next_write = incoming_md_updates_->getNextToWriteTo();
-          *next_write = std::move(request->me_market_update_);
-          incoming_md_updates_->updateWriteIndex();
-          TTT_MEASURE(T8_MarketDataConsumer_LFQueue_write, logger_);
-        }
+        onMarketUpdate(is_snapshot, request);
       }
-      memcpy(socket->inbound_data_.data(), socket->inbound_data_.data() + i, socket->next_rcv_valid_index_ - i);
+      memcpy(socket->rcv_data_, socket->rcv_data_ + i, socket->next_rcv_valid_index_ - i);
       socket->next_rcv_valid_index_ -= i;
     }
     END_MEASURE(Trading_MarketDataConsumer_recvCallback, logger_);
   }
+
+  /// Drain all published market data updates from a shared memory ring, same processing as the multicast path.
+  auto MarketDataConsumer::pollSharedMemory(Exchange::ShmMDPMarketUpdateQueue *queue, bool is_snapshot) noexcept -> bool 
+  {
+    bool have_updates = false;
+    for (auto request = queue->getNextToRead(); request; request = queue->getNextToRead()) 
+    {
+      TTT_MEASURE(T7_MarketDataConsumer_ShmBroadcastQueue_read, logger_);
+      logger_.log("%:% %() % Received % shm %\n", __FILE__, __LINE__, __FUNCTION__,
+                  Common::getCurrentTimeStr(&time_str_), (is_snapshot ? "snapshot" : "incremental"), request->toString());
+
+      queue->updateReadIndex();
+      have_updates = true;
+
+      if (UNLIKELY(is_snapshot && !in_recovery_)) 
+      {
+        logger_.log("%:% %() % WARN Not expecting snapshot messages.\n",
+                    __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str_));
+        continue;
+      }
+
+      onMarketUpdate(is_snapshot, request);
+
+      // a completed recovery releases the snapshot ring.
+      if (is_snapshot && !shm_snapshot_updates_)
+        break;
+    }
+    return have_updates;
+  }
+
+  /// Sequence number checks and recovery state machine for a single market data update, independent of the transport it arrived on.
+  auto MarketDataConsumer::onMarketUpdate(bool is_snapshot, const Exchange::MDPMarketUpdate *request) noexcept -> void 
+  {
+    const bool already_in_recovery = in_recovery_;
+    in_recovery_ = (already_in_recovery || request->seq_num_ != next_exp_inc_seq_num_);
+
+    if (UNLIKELY(in_recovery_)) 
+    {
+      if (UNLIKELY(!already_in_recovery)) 
+      { 
+        // if we just entered recovery, start the snapshot synchonization process by subscribing to the snapshot multicast stream.
+        logger_.log("%:% %() % Packet drops on % socket. SeqNum expected:% received:%\n", __FILE__, __LINE__, __FUNCTION__,
+                    Common::getCurrentTimeStr(&time_str_), (is_snapshot ? "snapshot" : "incremental"), next_exp_inc_seq_num_, request->seq_num_);
+        startSnapshotSync();
+      }
+
+      queueMessage(is_snapshot, request); // queue up the market data update message and check if snapshot recovery / synchronization can be completed successfully.
+    } else if (!is_snapshot) 
+    { 
+      // not in recovery and received a packet in the correct order and without gaps, process it.
+      logger_.log("%:% %() % %\n", __FILE__, __LINE__, __FUNCTION__,
+                  Common::getCurrentTimeStr(&time_str_), request->toString());
+
+      ++next_exp_inc_seq_num_;
+
+      auto next_write = incoming_md_updates_->getNextToWriteTo();
+      *next_write = std::move(request->me_market_update_);
+      incoming_md_updates_->updateWriteIndex();
+      TTT_MEASURE(T8_MarketDataConsumer_LFQueue_write, logger_);
+    }
+  }
 }
 
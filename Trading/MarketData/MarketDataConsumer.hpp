@@ -7,17 +7,25 @@
 // #include "../../Common/LFQueue.hpp"
 #include "../../Common/Macros.hpp"
 #include "../../Common/MCastSocket.hpp"
+#include "../../Common/WaitStrategy.hpp"
 
 #include "../../Exchange/MarketData/MarketUpdate.hpp"
+#include "../../Exchange/MarketData/ShmMarketData.hpp"
 
 namespace Trading 
 {
+  /// Thread name and default cpu, ANCHOR_PLACEMENT can move it.
+  constexpr auto MARKET_DATA_CONSUMER_THREAD = "Trading/MarketDataConsumer";
+  constexpr int MARKET_DATA_CONSUMER_CORE = 3;
+
   class MarketDataConsumer 
   {
   public:
     MarketDataConsumer(Common::ClientId client_id, Exchange::MEMarketUpdateLFQueue *market_updates, const std::string &iface,
                        const std::string &snapshot_ip, int snapshot_port,
-                       const std::string &incremental_ip, int incremental_port);
+                       const std::string &incremental_ip, int incremental_port,
+                       Common::TransportType transport_type,
+                       Common::McastRxType mcast_rx_type);
 
     ~MarketDataConsumer() 
     {
@@ -25,17 +33,25 @@ namespace Trading
 
       using namespace std::literals::chrono_literals;
       std::this_thread::sleep_for(5s);
+
+      delete shm_incremental_updates_;
+      shm_incremental_updates_ = nullptr;
+      delete shm_snapshot_updates_;
+      shm_snapshot_updates_ = nullptr;
+      delete xdp_socket_;
+      xdp_socket_ = nullptr;
     }
 
     auto start() 
     {
       run_ = true;
-      ASSERT(Common::createAndStartThread(3, "Trading/MarketDataConsumer", [this]() { run(); }) != nullptr, "Failed to start MarketData thread.");
+      ASSERT(Common::createAndStartThread(MARKET_DATA_CONSUMER_CORE, MARKET_DATA_CONSUMER_THREAD, [this]() { run(); }) != nullptr, "Failed to start MarketData thread.");
     }
 
     auto stop() -> void 
     {
       run_ = false;
+      wait_strategy_.wakeUp();
     }
 
     // Deleted default, copy & move constructors and assignment-operators.
@@ -53,26 +69,40 @@ namespace Trading
     size_t next_exp_inc_seq_num_ = 1;
     Exchange::MEMarketUpdateLFQueue *incoming_md_updates_ = nullptr;
 
-    volatile bool run_ = false;
+    std::atomic<bool> run_ = {false};
+    Common::WaitStrategy wait_strategy_;
 
     std::string time_str_;
     Logger logger_;
     Common::McastSocket incremental_mcast_socket_, snapshot_mcast_socket_;
 
+    /// Both multicast sockets receive through this with Common::McastRxType::XDP, nullptr otherwise.
+    Common::XdpSocket *xdp_socket_ = nullptr;
+
     bool in_recovery_ = false;
     const std::string iface_, snapshot_ip_;
     const int snapshot_port_;
     typedef std::map<size_t, Exchange::MEMarketUpdate> QueuedMarketUpdates;
     QueuedMarketUpdates snapshot_queued_msgs_, incremental_queued_msgs_;
 
+    /// Used instead of the multicast sockets when co-located with the exchange, the snapshot ring is only mapped while in recovery.
+    const Common::TransportType transport_type_;
+    Exchange::ShmMDPMarketUpdateQueue *shm_incremental_updates_ = nullptr;
+    Exchange::ShmMDPMarketUpdateQueue *shm_snapshot_updates_ = nullptr;
+
     auto run() noexcept -> void;
 
     auto recvCallback(McastSocket *socket) noexcept -> void;
 
+    auto pollSharedMemory(Exchange::ShmMDPMarketUpdateQueue *queue, bool is_snapshot) noexcept -> bool;
+
+    auto onMarketUpdate(bool is_snapshot, const Exchange::MDPMarketUpdate *request) noexcept -> void;
+
     auto queueMessage(bool is_snapshot, const Exchange::MDPMarketUpdate *request);
 
     auto startSnapshotSync() -> void;
     auto checkSnapshotSync() -> void;
+    auto stopSnapshotSync() -> void;
   };
 }
 
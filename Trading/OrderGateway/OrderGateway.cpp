@@ -5,16 +5,23 @@ namespace Trading
   OrderGateway::OrderGateway(ClientId client_id,
                              Exchange::ClientRequestLFQueue *client_requests,
                              Exchange::ClientResponseLFQueue *client_responses,
-                             std::string ip, const std::string &iface, int port)
+                             std::string ip, const std::string &iface, int port,
+                             Common::TransportType transport_type,
+                             Common::IoEngineType io_engine)
       : client_id_(client_id)
       , ip_(ip)
       , iface_(iface)
       , port_(port)
       , outgoing_requests_(client_requests)
       , incoming_responses_(client_responses)
-      , logger_("trading_order_gateway_" + std::to_string(client_id) + ".log"), tcp_socket_(logger_) 
+      , wait_strategy_(Common::waitStrategyType(ORDER_GATEWAY_THREAD, Common::WaitStrategyType::BUSY_SPIN))
+      , logger_("trading_order_gateway_" + std::to_string(client_id) + ".log"), tcp_socket_(logger_)
+      , transport_type_(transport_type)
   {
     tcp_socket_.recv_callback_ = [this](auto socket, auto rx_time) { recvCallback(socket, rx_time); };
+    outgoing_requests_->setConsumerWaitStrategy(&wait_strategy_);
+    if (transport_type_ == Common::TransportType::SOCKET && io_engine == Common::IoEngineType::IO_URING)
+      ring_ = new Common::IoUring(ORDER_GATEWAY_THREAD);
   }
 
   /// Main thread loop - sends out client requests to the exchange and reads and dispatches incoming client responses.
@@ -23,25 +30,100 @@ namespace Trading
     logger_.log("%:% %() %\n", __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str_));
     while (run_) 
     {
-      tcp_socket_.sendAndRecv();
+      bool did_work = false;
+      if (transport_type_ == Common::TransportType::SHM) 
+      {
+        for (auto response = shm_incoming_responses_->getNextToRead(); response; response = shm_incoming_responses_->getNextToRead()) 
+        {
+          TTT_MEASURE(T7t_OrderGateway_ShmSPSCQueue_read, logger_);
+          logger_.log("%:% %() % Received %\n", __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str_), response->toString());
+          onClientResponse(response);
+          shm_incoming_responses_->updateReadIndex();
+          did_work = true;
+        }
+      } else if (ring_) 
+      {
+        // queue what the previous pass wrote, then one submit and reap for both directions.
+        tcp_socket_.sendAndRecv();
+        ring_received_ = false;
+        ring_->poll();
+        did_work = ring_received_;
+      } else 
+      {
+        did_work = tcp_socket_.sendAndRecv();
+      }
 
-      for(auto client_request = outgoing_requests_->getNextToRead(); client_request; client_request = outgoing_requests_->getNextToRead()) 
+      // nothing goes out on a session the exchange has not answered yet, the requests wait in the queue till it has.
+      for(auto client_request = (sessionReady() ? outgoing_requests_->getNextToRead() : nullptr); client_request; client_request = outgoing_requests_->getNextToRead()) 
       {
         TTT_MEASURE(T8_MarketDataConsumer_LFQueue_write, logger_);
         logger_.log("%:% %() % Sending cid:% seq:% %\n", __FILE__, __LINE__, __FUNCTION__,
                     Common::getCurrentTimeStr(&time_str_), client_id_, next_outgoing_seq_num_, client_request->toString());
-        
-        START_MEASURE(Trading_TCPSocket_send);
-        tcp_socket_.send(&next_outgoing_seq_num_, sizeof(next_outgoing_seq_num_));
-        tcp_socket_.send(client_request, sizeof(Exchange::MEClientRequest));
-        END_MEASURE(Trading_TCPSocket_send, logger_);
-        
-        outgoing_requests_->updateReadIndex();
-        TTT_MEASURE(T12_OrderGateway_TCP_write, logger_);
 
+        sendClientRequest(next_outgoing_seq_num_, client_request);
+
+        outgoing_requests_->updateReadIndex();
         next_outgoing_seq_num_++;
+        did_work = true;
       }
+
+      // responses arrive on the socket or the shared memory ring, only the trade engine's requests can wake a parked gateway.
+      wait_strategy_.afterPoll(did_work, [this]() { return outgoing_requests_->size() != 0; });
     }
+    logger_.log("%:% %() % % %\n", __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str_), wait_strategy_.toString(),
+                (ring_ ? ring_->toString() : ""));
+  }
+
+  /// Create this client's request and response rings and then publish a session in the exchange's session table, which is what the OrderServer polls for.
+  auto OrderGateway::connectSharedMemory() -> void 
+  {
+    shm_outgoing_requests_ = new Exchange::ShmClientRequestQueue(Exchange::shmClientRequestQueueName(client_id_),
+                                                                  Exchange::SHM_ORDER_QUEUE_SIZE, /*create*/ true);
+    shm_incoming_responses_ = new Exchange::ShmClientResponseQueue(Exchange::shmClientResponseQueueName(client_id_),
+                                                                    Exchange::SHM_ORDER_QUEUE_SIZE, /*create*/ true);
+
+    shm_session_table_ = static_cast<Exchange::ShmSessionTable *>(
+        Common::mapSharedMemory(Exchange::shmSessionTableName(), sizeof(Exchange::ShmSessionTable), /*create*/ false));
+
+    const auto session_id = static_cast<uint64_t>(Common::getCurrentNanos());
+    shm_session_table_->client_session_id_.at(client_id_).store(session_id, std::memory_order_release);
+    shm_session_table_->session_changes_.fetch_add(1, std::memory_order_release);
+
+    logger_.log("%:% %() % Connected over shared memory cid:% session:%\n", __FILE__, __LINE__, __FUNCTION__,
+                Common::getCurrentTimeStr(&time_str_), client_id_, session_id);
+  }
+
+  /// Write a single sequenced client request to the exchange over whichever transport is in use.
+  auto OrderGateway::sendClientRequest(size_t seq_num, const Exchange::MEClientRequest *client_request) noexcept -> void 
+  {
+    if (transport_type_ == Common::TransportType::SHM) 
+    {
+      START_MEASURE(Trading_ShmSPSCQueue_write);
+      *(shm_outgoing_requests_->getNextToWriteTo()) = {seq_num, *client_request};
+      shm_outgoing_requests_->updateWriteIndex();
+      END_MEASURE(Trading_ShmSPSCQueue_write, logger_);
+      TTT_MEASURE(T12_OrderGateway_ShmSPSCQueue_write, logger_);
+      return;
+    }
+
+    START_MEASURE(Trading_TCPSocket_send);
+    const Exchange::OMClientRequest om_request{seq_num, *client_request};
+    tcp_socket_.send(&om_request, sizeof(om_request));
+    END_MEASURE(Trading_TCPSocket_send, logger_);
+    TTT_MEASURE(T12_OrderGateway_TCP_write, logger_);
+  }
+
+  auto OrderGateway::sendSessionRequest(Exchange::ClientRequestType type, size_t seq_num) noexcept -> void
+  {
+    const Exchange::MEClientRequest session_request{type, client_id_, TickerId_INVALID, OrderId_INVALID, Side::INVALID, Price_INVALID,
+                                                    Quantity_INVALID, OrderType::INVALID, TimeInForce::INVALID};
+    logger_.log("%:% %() % Sending seq:% %\n", __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str_), seq_num,
+                session_request.toString());
+    sendClientRequest(seq_num, &session_request);
+    if (type == Exchange::ClientRequestType::SEQUENCE_RESET)
+      sequence_reset_pending_ = true;
+    else
+      resend_pending_ = true;
   }
 
   /// Callback when an incoming client response is read, we perform some checks and forward it to the lock free queue connected to the trade engine.
@@ -59,32 +141,133 @@ namespace Trading
         auto response = reinterpret_cast<const Exchange::OMClientResponse *>(socket->inbound_data_.data() + i);
         logger_.log("%:% %() % Received %\n", __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str_), response->toString());
 
-        if(response->me_client_response_.client_id_ != client_id_) 
-        { 
-          // this should never happen unless there is a bug at the exchange.
-          logger_.log("%:% %() % ERROR Incorrect client id. ClientId expected:% received:%.\n", __FILE__, __LINE__, __FUNCTION__,
-                      Common::getCurrentTimeStr(&time_str_), client_id_, response->me_client_response_.client_id_);
-          continue;
+        onClientResponse(response);
+      }
+      memcpy(socket->inbound_data_.data(), socket->inbound_data_.data() + i, socket->next_rcv_valid_index_ - i);
+      socket->next_rcv_valid_index_ -= i;
+    }
+    END_MEASURE(Trading_OrderGateway_recvCallback, logger_);
+  }
+
+  auto OrderGateway::responseSession() noexcept -> Common::IoTask 
+  {
+    while (true) 
+    {
+      const auto received = co_await tcp_socket_.recv();
+      if (received <= 0) 
+      {
+        logger_.log("%:% %() % Connection closed res:%\n", __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str_), received);
+        co_return;
+      }
+      ring_received_ = true;
+      recvCallback(&tcp_socket_, tcp_socket_.rx_time_);
+    }
+  }
+
+  /// Perform client id and sequence number checks on a client response, answer the exchange's session responses and forward the rest to
+  /// the lock free queue connected to the trade engine.
+  auto OrderGateway::onClientResponse(const Exchange::OMClientResponse *response) noexcept -> void 
+  {
+    if(response->me_client_response_.client_id_ != client_id_) 
+    { 
+      // this should never happen unless there is a bug at the exchange.
+      logger_.log("%:% %() % ERROR Incorrect client id. ClientId expected:% received:%.\n", __FILE__, __LINE__, __FUNCTION__,
+                  Common::getCurrentTimeStr(&time_str_), client_id_, response->me_client_response_.client_id_);
+      return;
+    }
+    const auto &client_response = response->me_client_response_;
+    if (UNLIKELY(client_response.type_ == Exchange::ClientResponseType::SEQUENCE_RESET))
+    {
+      // the order server answers session requests in order and only one is ever out, so this is the answer to that one.
+      if (resend_pending_)
+      {
+        // the resend starts past what we asked for, those responses are older than the exchange keeps.
+        if (response->seq_num_ > next_exp_seq_num_)
+        {
+          logger_.log("%:% %() % ERROR Lost responses. ClientId:% SeqNum:% to %.\n", __FILE__, __LINE__, __FUNCTION__,
+                      Common::getCurrentTimeStr(&time_str_), client_id_, next_exp_seq_num_, response->seq_num_ - 1);
+          next_exp_seq_num_ = response->seq_num_;
         }
-        if(response->seq_num_ != next_exp_seq_num_) 
-        { 
-          // this should never happen since we use a reliable TCP protocol, unless there is a bug at the exchange.
-          logger_.log("%:% %() % ERROR Incorrect sequence number. ClientId:%. SeqNum expected:% received:%.\n", __FILE__, __LINE__, __FUNCTION__,
-                      Common::getCurrentTimeStr(&time_str_), client_id_, next_exp_seq_num_, response->seq_num_);
-          continue;
+        resend_pending_ = false;
+      } else
+      {
+        sequence_reset_pending_ = false;
+        if (response->seq_num_ > next_exp_seq_num_)
+        {
+          if (next_exp_seq_num_ == 1)
+          {
+            // took over the session of an earlier run with this ClientId, its responses are not ours to replay.
+            logger_.log("%:% %() % Joining the response stream of ClientId:% at SeqNum:%.\n", __FILE__, __LINE__, __FUNCTION__,
+                        Common::getCurrentTimeStr(&time_str_), client_id_, response->seq_num_);
+            next_exp_seq_num_ = response->seq_num_;
+          } else
+          {
+            sendSessionRequest(Exchange::ClientRequestType::RESEND_REQUEST, next_exp_seq_num_);
+          }
         }
+        session_ready_.store(true, std::memory_order_release);
+      }
+      return;
+    }
+
+    if (UNLIKELY(client_response.type_ == Exchange::ClientResponseType::REJECTED &&
+                 client_response.reject_reason_ == Exchange::RejectReason::INVALID_SESSION))
+    {
+      // not sequenced - the exchange has our session on another connection, take it over from this one.
+      logger_.log("%:% %() % ERROR Session on another connection. ClientId:%.\n", __FILE__, __LINE__, __FUNCTION__,
+                  Common::getCurrentTimeStr(&time_str_), client_id_);
+      resend_pending_ = false; // refused the same way, if there was one.
+      if (!sequence_reset_pending_)
+        sendSessionRequest(Exchange::ClientRequestType::SEQUENCE_RESET, next_outgoing_seq_num_);
+      // a refused session request is ours alone, it has no ticker or order for the trade engine. A refused order request does, the order
+      // manager learns from it that the request never reached the exchange.
+      if (Exchange::isSessionRequestType(client_response.request_type_))
+        return;
+    } else if (UNLIKELY(client_response.type_ == Exchange::ClientResponseType::REJECTED &&
+                        Exchange::isSessionRequestType(client_response.request_type_)))
+    {
+      // not sequenced either, the exchange throttled it. The next gap in the responses or INVALID_SEQ_NUM reject asks again.
+      logger_.log("%:% %() % ERROR Session request refused. ClientId:% %.\n", __FILE__, __LINE__, __FUNCTION__,
+                  Common::getCurrentTimeStr(&time_str_), client_id_, client_response.toString());
+      if (client_response.request_type_ == Exchange::ClientRequestType::SEQUENCE_RESET)
+        sequence_reset_pending_ = false;
+      else
+        resend_pending_ = false;
+      return;
+    } else
+    {
+      if (response->seq_num_ < next_exp_seq_num_)
+      {
+        // already seen, part of a resend that overlapped with what was still in flight.
+        logger_.log("%:% %() % Duplicate sequence number. ClientId:%. SeqNum expected:% received:%.\n", __FILE__, __LINE__, __FUNCTION__,
+                    Common::getCurrentTimeStr(&time_str_), client_id_, next_exp_seq_num_, response->seq_num_);
+        return;
+      }
+      if (UNLIKELY(response->seq_num_ > next_exp_seq_num_))
+      {
+        // both transports are reliable, so this is a bug or an overrun at either end - ask for the gap again and drop everything up to it.
+        logger_.log("%:% %() % ERROR Incorrect sequence number. ClientId:%. SeqNum expected:% received:%.\n", __FILE__, __LINE__, __FUNCTION__,
+                    Common::getCurrentTimeStr(&time_str_), client_id_, next_exp_seq_num_, response->seq_num_);
+        if (!resend_pending_ && !sequence_reset_pending_)
+          sendSessionRequest(Exchange::ClientRequestType::RESEND_REQUEST, next_exp_seq_num_);
+        return;
+      }
 
-        ++next_exp_seq_num_;
+      ++next_exp_seq_num_;
+      resend_pending_ = false;
 
-        auto next_write = incoming_responses_->getNextToWriteTo();
-        *next_write = std::move(response->me_client_response_);
-        incoming_responses_->updateWriteIndex();
-        TTT_MEASURE(T8t_OrderGateway_LFQueue_write, logger_);
+      if (UNLIKELY(client_response.type_ == Exchange::ClientResponseType::REJECTED &&
+                   client_response.reject_reason_ == Exchange::RejectReason::INVALID_SEQ_NUM && !sequence_reset_pending_))
+      {
+        // the exchange rejects everything after a gap in our requests, until we tell it which sequence number comes next.
+        sendSessionRequest(Exchange::ClientRequestType::SEQUENCE_RESET, next_outgoing_seq_num_);
       }
-      memcpy(socket->inbound_data_.data(), socket->inbound_data_.data() + i, socket->next_rcv_valid_index_ - i);
-      socket->next_rcv_valid_index_ -= i;
     }
-    END_MEASURE(Trading_OrderGateway_recvCallback, logger_);
+
+    auto next_write = incoming_responses_->getNextToWriteTo();
+    *next_write = std::move(response->me_client_response_);
+    incoming_responses_->updateWriteIndex();
+    TTT_MEASURE(T8t_OrderGateway_LFQueue_write, logger_);
   }
 }
 
@@ -5,19 +5,28 @@
 #include "../../Common/ThreadUtils.hpp"
 #include "../../Common/Macros.hpp"
 #include "../../Common/TCPServer.hpp"
+#include "../../Common/IoUring.hpp"
+#include "../../Common/WaitStrategy.hpp"
 
 #include "../../Exchange/OrderServer/ClientRequest.hpp"
 #include "../../Exchange/OrderServer/ClientResponse.hpp"
+#include "../../Exchange/OrderServer/ShmOrderSession.hpp"
 
 namespace Trading 
 {
+  /// Thread name and default cpu, ANCHOR_PLACEMENT can move it.
+  constexpr auto ORDER_GATEWAY_THREAD = "Trading/OrderGateway";
+  constexpr int ORDER_GATEWAY_CORE = 4;
+
   class OrderGateway 
   {
   public:
     OrderGateway(ClientId client_id,
                  Exchange::ClientRequestLFQueue *client_requests,
                  Exchange::ClientResponseLFQueue *client_responses,
-                 std::string ip, const std::string &iface, int port);
+                 std::string ip, const std::string &iface, int port,
+                 Common::TransportType transport_type,
+                 Common::IoEngineType io_engine);
 
     ~OrderGateway() 
     {
@@ -25,19 +34,52 @@ namespace Trading
 
       using namespace std::literals::chrono_literals;
       std::this_thread::sleep_for(5s);
+
+      if (shm_session_table_) 
+      {
+        shm_session_table_->client_session_id_.at(client_id_).store(0, std::memory_order_release);
+        shm_session_table_->session_changes_.fetch_add(1, std::memory_order_release);
+        munmap(shm_session_table_, sizeof(Exchange::ShmSessionTable));
+        shm_session_table_ = nullptr;
+      }
+      delete shm_outgoing_requests_;
+      shm_outgoing_requests_ = nullptr;
+      delete shm_incoming_responses_;
+      shm_incoming_responses_ = nullptr;
+      delete ring_;
+      ring_ = nullptr;
     }
 
     auto start() 
     {
       run_ = true;
-      ASSERT(tcp_socket_.connect(ip_, iface_, port_, false) >= 0,
-             "Unable to connect to ip:" + ip_ + " port:" + std::to_string(port_) + " on iface:" + iface_ + " error:" + std::string(std::strerror(errno)));
-      ASSERT(Common::createAndStartThread(4, "Trading/OrderGateway", [this]() { run(); }) != nullptr, "Failed to start OrderGateway thread.");
+      if (transport_type_ == Common::TransportType::SHM)
+        connectSharedMemory();
+      else
+      {
+        ASSERT(tcp_socket_.connect(ip_, iface_, port_, false) >= 0,
+               "Unable to connect to ip:" + ip_ + " port:" + std::to_string(port_) + " on iface:" + iface_ + " error:" + std::string(std::strerror(errno)));
+        if (ring_)
+        {
+          tcp_socket_.attach(ring_);
+          responseSession();
+        }
+      }
+      // opens the session, the trade engine's requests are held back till the exchange answers it - see sessionReady().
+      sendSessionRequest(Exchange::ClientRequestType::SEQUENCE_RESET, next_outgoing_seq_num_);
+      ASSERT(Common::createAndStartThread(ORDER_GATEWAY_CORE, ORDER_GATEWAY_THREAD, [this]() { run(); }) != nullptr, "Failed to start OrderGateway thread.");
     }
 
     auto stop() -> void 
     {
       run_ = false;
+      wait_strategy_.wakeUp();
+    }
+
+    /// Whether the exchange has answered the SEQUENCE_RESET start() opens the session with, requests are only sent from then on.
+    auto sessionReady() const noexcept
+    {
+      return session_ready_.load(std::memory_order_acquire);
     }
 
     // Deleted default, copy & move constructors and assignment-operators.
@@ -61,18 +103,46 @@ namespace Trading
     Exchange::ClientRequestLFQueue *outgoing_requests_ = nullptr;
     Exchange::ClientResponseLFQueue *incoming_responses_ = nullptr;
 
-    volatile bool run_ = false;
+    std::atomic<bool> run_ = {false};
+    Common::WaitStrategy wait_strategy_;
 
     std::string time_str_;
     Logger logger_;
 
     size_t next_outgoing_seq_num_ = 1;
     size_t next_exp_seq_num_ = 1;
+
+    /// Session request sent and not answered yet. At most one is out at a time, a SEQUENCE_RESET answer that needs a resend asks for it.
+    bool resend_pending_ = false;
+    bool sequence_reset_pending_ = false;
+    std::atomic<bool> session_ready_ = {false};
     Common::TCPSocket tcp_socket_;
 
+    /// tcp_socket_'s I/O goes through this ring with Common::IoEngineType::IO_URING, nullptr otherwise.
+    Common::IoUring *ring_ = nullptr;
+    bool ring_received_ = false;
+
+    /// Used instead of the TCP connection when co-located with the exchange, this client owns both of its rings.
+    const Common::TransportType transport_type_;
+    Exchange::ShmSessionTable *shm_session_table_ = nullptr;
+    Exchange::ShmClientRequestQueue *shm_outgoing_requests_ = nullptr;
+    Exchange::ShmClientResponseQueue *shm_incoming_responses_ = nullptr;
+
     auto run() noexcept -> void;
 
+    auto connectSharedMemory() -> void;
+
+    auto sendClientRequest(size_t seq_num, const Exchange::MEClientRequest *client_request) noexcept -> void;
+
+    /// SEQUENCE_RESET or RESEND_REQUEST to the order server, seq_num is its argument.
+    auto sendSessionRequest(Exchange::ClientRequestType type, size_t seq_num) noexcept -> void;
+
     auto recvCallback(TCPSocket *socket, Nanos rx_time) noexcept -> void;
+
+    /// Coroutine resumed by the ring whenever responses arrive on tcp_socket_, until the exchange closes the connection.
+    auto responseSession() noexcept -> Common::IoTask;
+
+    auto onClientResponse(const Exchange::OMClientResponse *response) noexcept -> void;
   };
 }
 
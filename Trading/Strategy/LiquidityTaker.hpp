@@ -44,10 +44,11 @@ namespace Trading
         {
           START_MEASURE(OrderManager_moveOrders);
           
+          // IOC so any quantity which does not trade is canceled by the exchange instead of resting till we chase it with a cancel.
           if (market_update->side_ == Side::BUY)
-            order_manager_->moveOrders(market_update->ticker_id_, bbo->ask_price_, Price_INVALID, clip);
+            order_manager_->moveOrders(market_update->ticker_id_, bbo->ask_price_, Price_INVALID, clip, TimeInForce::IOC);
           else
-            order_manager_->moveOrders(market_update->ticker_id_, Price_INVALID, bbo->bid_price_, clip);
+            order_manager_->moveOrders(market_update->ticker_id_, Price_INVALID, bbo->bid_price_, clip, TimeInForce::IOC);
           
           END_MEASURE(OrderManager_moveOrders, (*logger_));
         }
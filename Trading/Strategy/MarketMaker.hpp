@@ -38,8 +38,18 @@ namespace Trading
         const auto bid_price = bbo->bid_price_ - (fair_price - bbo->bid_price_ >= threshold ? 0 : 1);
         const auto ask_price = bbo->ask_price_ + (bbo->ask_price_ - fair_price >= threshold ? 0 : 1);
         
+        // the ladder goes one tick further from the top of the book each level, only the orders whose level moved are re-quoted.
+        const auto levels = ticker_cfg_.at(ticker_id).levels_;
+        std::array<Price, OM_MAX_LADDER_LEVELS> bid_prices, ask_prices;
+        for (uint32_t level = 0; level < levels; ++level)
+        {
+          bid_prices[level] = bid_price - level;
+          ask_prices[level] = ask_price + level;
+        }
+
         START_MEASURE(Trading_OrderManager_moveOrders);
-        order_manager_->moveOrders(ticker_id, bid_price, ask_price, clip);
+        order_manager_->moveLadder(ticker_id, Side::BUY, bid_prices.data(), levels, clip, TimeInForce::DAY);
+        order_manager_->moveLadder(ticker_id, Side::SELL, ask_prices.data(), levels, clip, TimeInForce::DAY);
         END_MEASURE(Trading_OrderManager_moveOrders, (*logger_));
       }
     }
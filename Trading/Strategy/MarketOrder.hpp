@@ -3,6 +3,7 @@
 #include <array>
 #include <sstream>
 #include "../../Common/Types.hpp"
+#include "../../Common/OrderBookCore.hpp"
 
 using namespace Common;
 
@@ -41,6 +42,11 @@ namespace Trading
     Side side_ = Side::INVALID;
     Price price_ = Price_INVALID;
 
+    /// Sum of the quantity and number of the orders at this price level, kept up to date as orders are added, modified and removed so
+    /// the BBO and snapshot levels do not have to walk the orders.
+    Quantity total_quantity_ = 0;
+    uint32_t num_orders_ = 0;
+
     MarketOrder *first_mkt_order_ = nullptr;
 
     MarketOrdersAtPrice *prev_entry_ = nullptr;
@@ -61,6 +67,8 @@ namespace Trading
       ss << "MarketOrdersAtPrice["
          << "side:" << sideToString(side_) << " "
          << "price:" << priceToString(price_) << " "
+         << "total_quantity:" << total_quantity_ << " "
+         << "num_orders:" << num_orders_ << " "
          << "first_mkt_order:" << (first_mkt_order_ ? first_mkt_order_->toString() : "null") << " "
          << "prev:" << priceToString(prev_entry_ ? prev_entry_->price_ : Price_INVALID) << " "
          << "next:" << priceToString(next_entry_ ? next_entry_->price_ : Price_INVALID) << "]";
@@ -69,7 +77,22 @@ namespace Trading
     }
   };
 
-  typedef std::array<MarketOrdersAtPrice *, ME_MAX_PRICE_LEVELS> OrdersAtPriceHashMap;
+  /// OrderBookCore policy of MarketOrderBook.
+  struct MarketOrderBookPolicy
+  {
+    typedef Common::PooledOrderStore<MarketOrder> OrderStore;
+    typedef MarketOrdersAtPrice OrdersAtPrice;
+    typedef Common::BitmapLadder Ladder;
+
+    static constexpr size_t MAX_PRICE_LEVELS = ME_MAX_PRICE_LEVELS;
+    static constexpr size_t MAX_ORDERS = ME_MAX_ORDER_IDS;
+    static constexpr bool TRACK_AGGREGATES = true;
+
+    static auto firstOrder(MarketOrdersAtPrice *orders_at_price) noexcept -> MarketOrder *&
+    {
+      return orders_at_price->first_mkt_order_;
+    }
+  };
 
   struct BestBidOffer 
   {
@@ -88,5 +111,47 @@ namespace Trading
       return ss.str();
     };
   };
-}
 
+  /// Number of price levels per side in a MarketBookSnapshot.
+  constexpr size_t MARKET_BOOK_SNAPSHOT_LEVELS = 5;
+
+  struct MarketLevel
+  {
+    Price price_ = Price_INVALID;
+    Quantity quantity_ = 0;
+    uint32_t num_orders_ = 0;
+  };
+
+  /// Consistent copy of the top of a MarketOrderBook that other threads read, see MarketOrderBook::readSnapshot().
+  struct MarketBookSnapshot
+  {
+    TickerId ticker_id_ = TickerId_INVALID;
+
+    /// Number of market updates that changed the snapshot so far, tells a reader whether anything changed since its last read.
+    uint64_t num_updates_ = 0;
+
+    BestBidOffer bbo_;
+
+    /// Best first, only the first num_bid_levels_ / num_ask_levels_ entries are valid.
+    size_t num_bid_levels_ = 0;
+    size_t num_ask_levels_ = 0;
+    std::array<MarketLevel, MARKET_BOOK_SNAPSHOT_LEVELS> bids_;
+    std::array<MarketLevel, MARKET_BOOK_SNAPSHOT_LEVELS> asks_;
+
+    auto toString() const
+    {
+      std::stringstream ss;
+      ss << "MarketBookSnapshot{"
+         << "ticker:" << tickerIdToString(ticker_id_) << " "
+         << "updates:" << num_updates_ << " "
+         << bbo_.toString() << " bids:";
+      for (size_t i = 0; i < num_bid_levels_; ++i)
+        ss << " " << quantityToString(bids_[i].quantity_) << "@" << priceToString(bids_[i].price_) << "(" << bids_[i].num_orders_ << ")";
+      ss << " asks:";
+      for (size_t i = 0; i < num_ask_levels_; ++i)
+        ss << " " << quantityToString(asks_[i].quantity_) << "@" << priceToString(asks_[i].price_) << "(" << asks_[i].num_orders_ << ")";
+      ss << "}";
+      return ss.str();
+    }
+  };
+}
@@ -6,9 +6,11 @@ namespace Trading
 {
   MarketOrderBook::MarketOrderBook(TickerId ticker_id, Logger *logger)
       : ticker_id_(ticker_id)
-      , orders_at_price_pool_(ME_MAX_PRICE_LEVELS)
-      , order_pool_(ME_MAX_ORDER_IDS)
-      , logger_(logger) {}
+      , logger_(logger) 
+  {
+    snapshot_.ticker_id_ = ticker_id;
+    published_snapshot_.store(snapshot_);
+  }
 
   MarketOrderBook::~MarketOrderBook() 
   {
@@ -16,20 +18,23 @@ namespace Trading
                  Common::getCurrentTimeStr(&time_str_), toString(false, true));
 
     trade_engine_ = nullptr;
-    bids_by_price_ = asks_by_price_ = nullptr;
     oid_to_order_.fill(nullptr);
   }
 
   auto MarketOrderBook::onMarketUpdate(const Exchange::MEMarketUpdate *market_update) noexcept -> void 
   {
-    const auto bid_updated = (bids_by_price_ && market_update->side_ == Side::BUY && market_update->price_ >= bids_by_price_->price_);
-    const auto ask_updated = (asks_by_price_ && market_update->side_ == Side::SELL && market_update->price_ <= asks_by_price_->price_);
+    const auto bids_by_price = core_.bestOrdersByPrice(Side::BUY);
+    const auto asks_by_price = core_.bestOrdersByPrice(Side::SELL);
+    auto bid_updated = (bids_by_price && market_update->side_ == Side::BUY && market_update->price_ >= bids_by_price->price_);
+    auto ask_updated = (asks_by_price && market_update->side_ == Side::SELL && market_update->price_ <= asks_by_price->price_);
+    auto bid_snapshot_updated = (market_update->side_ == Side::BUY && inSnapshot(Side::BUY, market_update->price_));
+    auto ask_snapshot_updated = (market_update->side_ == Side::SELL && inSnapshot(Side::SELL, market_update->price_));
 
     switch (market_update->type_) 
     {
       case Exchange::MarketUpdateType::ADD: 
       {
-        auto order = order_pool_.allocate(market_update->order_id_, market_update->side_, market_update->price_,
+        auto order = core_.allocateOrder(market_update->order_id_, market_update->side_, market_update->price_,
                                           market_update->quantity_, market_update->priority_, nullptr, nullptr);
         
         START_MEASURE(Trading_MarketOrderBook_addOrder);
@@ -40,7 +45,27 @@ namespace Trading
       case Exchange::MarketUpdateType::MODIFY: 
       {
         auto order = oid_to_order_.at(market_update->order_id_);
-        order->quantity_ = market_update->quantity_;
+        if (LIKELY(order->price_ == market_update->price_ && order->priority_ == market_update->priority_)) 
+        {
+          core_.setQuantity(order, market_update->quantity_);
+        } else 
+        {
+          // the order lost its queue position, possibly at a new price - the old price level may have been the best one.
+          bid_updated |= (order->side_ == Side::BUY && order->price_ >= bids_by_price->price_);
+          ask_updated |= (order->side_ == Side::SELL && order->price_ <= asks_by_price->price_);
+          bid_snapshot_updated |= (order->side_ == Side::BUY && inSnapshot(Side::BUY, order->price_));
+          ask_snapshot_updated |= (order->side_ == Side::SELL && inSnapshot(Side::SELL, order->price_));
+
+          START_MEASURE(Trading_MarketOrderBook_removeOrder);
+          removeOrder(order);
+          END_MEASURE(Trading_MarketOrderBook_removeOrder, (*logger_));
+
+          order = core_.allocateOrder(market_update->order_id_, market_update->side_, market_update->price_,
+                                       market_update->quantity_, market_update->priority_, nullptr, nullptr);
+          START_MEASURE(Trading_MarketOrderBook_addOrder);
+          addOrder(order);
+          END_MEASURE(Trading_MarketOrderBook_addOrder, (*logger_));
+        }
       }
         break;
       case Exchange::MarketUpdateType::CANCEL: 
@@ -59,28 +84,9 @@ namespace Trading
         break;
       case Exchange::MarketUpdateType::CLEAR: 
       {
-        for (auto &order: oid_to_order_) 
-        {
-          if (order)
-            order_pool_.deallocate(order);
-        }
+        core_.clear();
         oid_to_order_.fill(nullptr);
-
-        if(bids_by_price_) 
-        {
-          for(auto bid = bids_by_price_->next_entry_; bid != bids_by_price_; bid = bid->next_entry_)
-            orders_at_price_pool_.deallocate(bid);
-          orders_at_price_pool_.deallocate(bids_by_price_);
-        }
-
-        if(asks_by_price_) 
-        {
-          for(auto ask = asks_by_price_->next_entry_; ask != asks_by_price_; ask = ask->next_entry_)
-            orders_at_price_pool_.deallocate(ask);
-          orders_at_price_pool_.deallocate(asks_by_price_);
-        }
-
-        bids_by_price_ = asks_by_price_ = nullptr;
+        bid_snapshot_updated = ask_snapshot_updated = true;
       }
         break;
       case Exchange::MarketUpdateType::INVALID:
@@ -92,12 +98,43 @@ namespace Trading
     updateBestBidOffer(bid_updated, ask_updated);
     END_MEASURE(Trading_MarketOrderBook_updateBBO, (*logger_));
 
+    if (bid_snapshot_updated || ask_snapshot_updated)
+    {
+      START_MEASURE(Trading_MarketOrderBook_publishSnapshot);
+      publishSnapshot(bid_snapshot_updated, ask_snapshot_updated);
+      END_MEASURE(Trading_MarketOrderBook_publishSnapshot, (*logger_));
+    }
+
     logger_->log("%:% %() % % %", __FILE__, __LINE__, __FUNCTION__,
                  Common::getCurrentTimeStr(&time_str_), market_update->toString(), bbo_.toString());
 
     trade_engine_->onOrderBookUpdate(market_update->ticker_id_, market_update->price_, market_update->side_, this);
   }
 
+  /// Rebuilds the levels of the sides that changed in snapshot_ and publishes it to the readers.
+  auto MarketOrderBook::publishSnapshot(bool update_bids, bool update_asks) noexcept -> void
+  {
+    const auto snapshot_levels = [](MarketOrdersAtPrice *best_orders_by_price, std::array<MarketLevel, MARKET_BOOK_SNAPSHOT_LEVELS> &levels,
+                                    size_t *num_levels)
+    {
+      *num_levels = 0;
+      for (auto orders_at_price = best_orders_by_price; orders_at_price && *num_levels < MARKET_BOOK_SNAPSHOT_LEVELS; )
+      {
+        levels[(*num_levels)++] = {orders_at_price->price_, orders_at_price->total_quantity_, orders_at_price->num_orders_};
+        orders_at_price = (orders_at_price->next_entry_ == best_orders_by_price ? nullptr : orders_at_price->next_entry_);
+      }
+    };
+
+    if (update_bids)
+      snapshot_levels(core_.bestOrdersByPrice(Side::BUY), snapshot_.bids_, &snapshot_.num_bid_levels_);
+    if (update_asks)
+      snapshot_levels(core_.bestOrdersByPrice(Side::SELL), snapshot_.asks_, &snapshot_.num_ask_levels_);
+    snapshot_.bbo_ = bbo_;
+    ++snapshot_.num_updates_;
+
+    published_snapshot_.store(snapshot_);
+  }
+
   auto MarketOrderBook::toString(bool detailed, bool validity_check) const -> std::string 
   {
     std::stringstream ss;
@@ -140,6 +177,11 @@ namespace Trading
 
       if (sanity_check) 
       {
+        if (quantity != itr->total_quantity_ || num_orders != itr->num_orders_) 
+        {
+          FATAL("Price level total quantity:" + std::to_string(itr->total_quantity_) + " num orders:" + std::to_string(itr->num_orders_) +
+                " does not match orders:" + quantityToString(quantity) + "/" + std::to_string(num_orders) + " itr:" + itr->toString());
+        }
         if ((side == Side::SELL && last_price >= itr->price_) || (side == Side::BUY && last_price <= itr->price_)) 
         {
           FATAL("Bids/Asks not sorted by ascending/descending prices last:" + priceToString(last_price) + " itr:" +
@@ -151,12 +193,13 @@ namespace Trading
 
     ss << "Ticker:" << tickerIdToString(ticker_id_) << std::endl;
     {
-      auto ask_itr = asks_by_price_;
+      const auto asks_by_price = core_.bestOrdersByPrice(Side::SELL);
+      auto ask_itr = asks_by_price;
       auto last_ask_price = std::numeric_limits<Price>::min();
       for (size_t count = 0; ask_itr; ++count) 
       {
         ss << "ASKS L:" << count << " => ";
-        auto next_ask_itr = (ask_itr->next_entry_ == asks_by_price_ ? nullptr : ask_itr->next_entry_);
+        auto next_ask_itr = (ask_itr->next_entry_ == asks_by_price ? nullptr : ask_itr->next_entry_);
         printer(ss, ask_itr, Side::SELL, last_ask_price, validity_check);
         ask_itr = next_ask_itr;
       }
@@ -165,12 +208,13 @@ namespace Trading
     ss << std::endl << "                          X" << std::endl << std::endl;
 
     {
-      auto bid_itr = bids_by_price_;
+      const auto bids_by_price = core_.bestOrdersByPrice(Side::BUY);
+      auto bid_itr = bids_by_price;
       auto last_bid_price = std::numeric_limits<Price>::max();
       for (size_t count = 0; bid_itr; ++count) 
       {
         ss << "BIDS L:" << count << " => ";
-        auto next_bid_itr = (bid_itr->next_entry_ == bids_by_price_ ? nullptr : bid_itr->next_entry_);
+        auto next_bid_itr = (bid_itr->next_entry_ == bids_by_price ? nullptr : bid_itr->next_entry_);
         printer(ss, bid_itr, Side::BUY, last_bid_price, validity_check);
         bid_itr = next_bid_itr;
       }
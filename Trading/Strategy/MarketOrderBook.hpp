@@ -3,6 +3,7 @@
 #include "../../Common/Types.hpp"
 #include "../../Common/MemoryPool.hpp"
 #include "../../Common/Logging.hpp"
+#include "../../Common/SeqLock.hpp"
 
 #include "MarketOrder.hpp"
 #include "../../Exchange/MarketData/MarketUpdate.hpp"
@@ -29,12 +30,11 @@ namespace Trading
     {
       if(update_bid) 
       {
-        if(bids_by_price_) 
+        const auto bids_by_price = core_.bestOrdersByPrice(Side::BUY);
+        if(bids_by_price) 
         {
-          bbo_.bid_price_ = bids_by_price_->price_;
-          bbo_.bid_quantity_ = bids_by_price_->first_mkt_order_->quantity_;
-          for(auto order = bids_by_price_->first_mkt_order_->next_order_; order != bids_by_price_->first_mkt_order_; order = order->next_order_)
-            bbo_.bid_quantity_ += order->quantity_;
+          bbo_.bid_price_ = bids_by_price->price_;
+          bbo_.bid_quantity_ = core_.levelQuantity(bids_by_price);
         }
         else 
         {
@@ -45,12 +45,11 @@ namespace Trading
 
       if(update_ask) 
       {
-        if(asks_by_price_) 
+        const auto asks_by_price = core_.bestOrdersByPrice(Side::SELL);
+        if(asks_by_price) 
         {
-          bbo_.ask_price_ = asks_by_price_->price_;
-          bbo_.ask_quantity_ = asks_by_price_->first_mkt_order_->quantity_;
-          for(auto order = asks_by_price_->first_mkt_order_->next_order_; order != asks_by_price_->first_mkt_order_; order = order->next_order_)
-            bbo_.ask_quantity_ += order->quantity_;
+          bbo_.ask_price_ = asks_by_price->price_;
+          bbo_.ask_quantity_ = core_.levelQuantity(asks_by_price);
         }
         else 
         {
@@ -65,6 +64,13 @@ namespace Trading
       return &bbo_;
     }
 
+    /// Unlike the rest of the book this is safe to call from any thread - returns the BBO and top MARKET_BOOK_SNAPSHOT_LEVELS levels
+    /// per side as of the last market update that changed them, never a partially updated copy.
+    auto readSnapshot() const noexcept
+    {
+      return published_snapshot_.load();
+    }
+
     auto toString(bool detailed, bool validity_check) const -> std::string;
 
     // Deleted default, copy & move constructors and assignment-operators.
@@ -85,162 +91,42 @@ namespace Trading
 
     OrderHashMap oid_to_order_;
 
-    MemPool<MarketOrdersAtPrice> orders_at_price_pool_;
-    MarketOrdersAtPrice *bids_by_price_ = nullptr;
-    MarketOrdersAtPrice *asks_by_price_ = nullptr;
-
-    OrdersAtPriceHashMap price_orders_at_price_;
-
-    MemPool<MarketOrder> order_pool_;
+    OrderBookCore<MarketOrderBookPolicy> core_;
 
     BestBidOffer bbo_;
 
+    /// The trade engine thread's copy of what is published to other threads through published_snapshot_.
+    MarketBookSnapshot snapshot_;
+    SeqLock<MarketBookSnapshot> published_snapshot_;
+
     std::string time_str_;
     Logger *logger_ = nullptr;
 
-    auto priceToIndex(Price price) const noexcept 
+    /// Would a change at this price alter the levels in the current snapshot - true if it is at or better than the worst level in it,
+    /// or there is room for another level.
+    auto inSnapshot(Side side, Price price) const noexcept
     {
-      return (price % ME_MAX_PRICE_LEVELS);
+      const auto num_levels = (side == Side::BUY ? snapshot_.num_bid_levels_ : snapshot_.num_ask_levels_);
+      if (num_levels < MARKET_BOOK_SNAPSHOT_LEVELS)
+        return true;
+      const auto worst_price = (side == Side::BUY ? snapshot_.bids_ : snapshot_.asks_)[num_levels - 1].price_;
+      return (side == Side::BUY ? price >= worst_price : price <= worst_price);
     }
 
-    auto getOrdersAtPrice(Price price) const noexcept -> MarketOrdersAtPrice * 
-    {
-      return price_orders_at_price_.at(priceToIndex(price));
-    }
-
-    auto addOrdersAtPrice(MarketOrdersAtPrice *new_orders_at_price) noexcept 
-    {
-      price_orders_at_price_.at(priceToIndex(new_orders_at_price->price_)) = new_orders_at_price;
-
-      const auto best_orders_by_price = (new_orders_at_price->side_ == Side::BUY ? bids_by_price_ : asks_by_price_);
-      if (UNLIKELY(!best_orders_by_price)) 
-      {
-        (new_orders_at_price->side_ == Side::BUY ? bids_by_price_ : asks_by_price_) = new_orders_at_price;
-        new_orders_at_price->prev_entry_ = new_orders_at_price->next_entry_ = new_orders_at_price;
-      } else 
-      {
-        auto target = best_orders_by_price;
-        bool add_after = ((new_orders_at_price->side_ == Side::SELL && new_orders_at_price->price_ > target->price_) ||
-                          (new_orders_at_price->side_ == Side::BUY && new_orders_at_price->price_ < target->price_));
-        if (add_after) 
-        {
-          target = target->next_entry_;
-          add_after = ((new_orders_at_price->side_ == Side::SELL && new_orders_at_price->price_ > target->price_) ||
-                       (new_orders_at_price->side_ == Side::BUY && new_orders_at_price->price_ < target->price_));
-        }
-        while (add_after && target != best_orders_by_price) 
-        {
-          add_after = ((new_orders_at_price->side_ == Side::SELL && new_orders_at_price->price_ > target->price_) ||
-                       (new_orders_at_price->side_ == Side::BUY && new_orders_at_price->price_ < target->price_));
-          if (add_after)
-            target = target->next_entry_;
-        }
-
-        if (add_after) 
-        { // add new_orders_at_price after target.
-          if (target == best_orders_by_price) 
-          {
-            target = best_orders_by_price->prev_entry_;
-          }
-          new_orders_at_price->prev_entry_ = target;
-          target->next_entry_->prev_entry_ = new_orders_at_price;
-          new_orders_at_price->next_entry_ = target->next_entry_;
-          target->next_entry_ = new_orders_at_price;
-        } else 
-        { // add new_orders_at_price before target.
-          new_orders_at_price->prev_entry_ = target->prev_entry_;
-          new_orders_at_price->next_entry_ = target;
-          target->prev_entry_->next_entry_ = new_orders_at_price;
-          target->prev_entry_ = new_orders_at_price;
-
-          if ((new_orders_at_price->side_ == Side::BUY && new_orders_at_price->price_ > best_orders_by_price->price_) ||
-              (new_orders_at_price->side_ == Side::SELL &&
-               new_orders_at_price->price_ < best_orders_by_price->price_)) 
-          {
-            target->next_entry_ = (target->next_entry_ == best_orders_by_price ? new_orders_at_price
-                                                                               : target->next_entry_);
-            (new_orders_at_price->side_ == Side::BUY ? bids_by_price_ : asks_by_price_) = new_orders_at_price;
-          }
-        }
-      }
-    }
-
-    auto removeOrdersAtPrice(Side side, Price price) noexcept 
-    {
-      const auto best_orders_by_price = (side == Side::BUY ? bids_by_price_ : asks_by_price_);
-      auto orders_at_price = getOrdersAtPrice(price);
-
-      if (UNLIKELY(orders_at_price->next_entry_ == orders_at_price)) 
-      { // empty side of book.
-        (side == Side::BUY ? bids_by_price_ : asks_by_price_) = nullptr;
-      } else 
-      {
-        orders_at_price->prev_entry_->next_entry_ = orders_at_price->next_entry_;
-        orders_at_price->next_entry_->prev_entry_ = orders_at_price->prev_entry_;
-
-        if (orders_at_price == best_orders_by_price) 
-        {
-          (side == Side::BUY ? bids_by_price_ : asks_by_price_) = orders_at_price->next_entry_;
-        }
-
-        orders_at_price->prev_entry_ = orders_at_price->next_entry_ = nullptr;
-      }
-
-      price_orders_at_price_.at(priceToIndex(price)) = nullptr;
-
-      orders_at_price_pool_.deallocate(orders_at_price);
-    }
+    auto publishSnapshot(bool update_bids, bool update_asks) noexcept -> void;
 
     auto removeOrder(MarketOrder *order) noexcept -> void 
     {
-      auto orders_at_price = getOrdersAtPrice(order->price_);
-
-      if (order->prev_order_ == order) 
-      { // only one element.
-        removeOrdersAtPrice(order->side_, order->price_);
-      } else 
-      { // remove the link.
-        const auto order_before = order->prev_order_;
-        const auto order_after = order->next_order_;
-        order_before->next_order_ = order_after;
-        order_after->prev_order_ = order_before;
-
-        if (orders_at_price->first_mkt_order_ == order) 
-        {
-          orders_at_price->first_mkt_order_ = order_after;
-        }
-
-        order->prev_order_ = order->next_order_ = nullptr;
-      }
-
       oid_to_order_.at(order->order_id_) = nullptr;
-      order_pool_.deallocate(order);
+      core_.removeOrder(order);
     }
 
     auto addOrder(MarketOrder *order) noexcept -> void 
     {
-      const auto orders_at_price = getOrdersAtPrice(order->price_);
-
-      if (!orders_at_price) 
-      {
-        order->next_order_ = order->prev_order_ = order;
-
-        auto new_orders_at_price = orders_at_price_pool_.allocate(order->side_, order->price_, order, nullptr, nullptr);
-        addOrdersAtPrice(new_orders_at_price);
-      } else 
-      {
-        auto first_order = (orders_at_price ? orders_at_price->first_mkt_order_ : nullptr);
-
-        first_order->prev_order_->next_order_ = order;
-        order->prev_order_ = first_order->prev_order_;
-        order->next_order_ = first_order;
-        first_order->prev_order_ = order;
-      }
-
+      core_.addOrder(order);
       oid_to_order_.at(order->order_id_) = order;
     }
   };
 
   typedef std::array<MarketOrderBook *, ME_MAX_TICKERS> MarketOrderBookHashMap;
 }
-
@@ -1,8 +1,11 @@
 #pragma once
 
 #include <array>
+#include <limits>
 #include <sstream>
+#include <vector>
 #include "../../Common/Types.hpp"
+#include "../../Common/HugePages.hpp"
 
 using namespace Common;
 
@@ -14,7 +17,8 @@ namespace Trading
     PENDING_NEW = 1,
     LIVE = 2,
     PENDING_CANCEL = 3,
-    DEAD = 4
+    DEAD = 4,
+    PENDING_MODIFY = 5
   };
 
   inline auto OMOrderStateToString(OMOrderState side) -> std::string 
@@ -29,6 +33,8 @@ namespace Trading
         return "PENDING_CANCEL";
       case OMOrderState::DEAD:
         return "DEAD";
+      case OMOrderState::PENDING_MODIFY:
+        return "PENDING_MODIFY";
       case OMOrderState::INVALID:
         return "INVALID";
     }
@@ -43,6 +49,16 @@ namespace Trading
     Price price_ = Price_INVALID;
     Quantity quantity_ = Quantity_INVALID;
     OMOrderState order_state_ = OMOrderState::INVALID;
+    TimeInForce tif_ = TimeInForce::INVALID;
+    Quantity risk_quantity_ = 0; // what the RiskManager counts as still able to fill for this order.
+    Price pending_price_ = Price_INVALID; // where a PENDING_MODIFY order is moving to, price_ changes once the exchange confirms it.
+    bool accepted_ = false; // the exchange has acknowledged the NEW, a rejected MODIFY or CANCEL goes back to LIVE rather than PENDING_NEW.
+
+    /// Price the order is working at or about to.
+    auto workingPrice() const noexcept
+    {
+      return (order_state_ == OMOrderState::PENDING_MODIFY ? pending_price_ : price_);
+    }
 
     auto toString() const 
     {
@@ -53,13 +69,141 @@ namespace Trading
          << "side:" << sideToString(side_) << " "
          << "price:" << priceToString(price_) << " "
          << "quantity:" << quantityToString(quantity_) << " "
-         << "state:" << OMOrderStateToString(order_state_) << "]";
+         << "state:" << OMOrderStateToString(order_state_) << " "
+         << "tif:" << timeInForceToString(tif_) << " "
+         << "risk-qty:" << quantityToString(risk_quantity_) << " "
+         << "pending-price:" << priceToString(pending_price_) << " "
+         << "accepted:" << accepted_ << "]";
 
       return ss.str();
     }
   };
 
-  typedef std::array<OMOrder, sideToIndex(Side::MAX) + 1> OMOrderSideHashMap;
-  typedef std::array<OMOrderSideHashMap, ME_MAX_TICKERS> OMOrderTickerSideHashMap;
-}
+  /// Handle of an order in an OMOrderStore, stays the same for as long as the order is working. 0 is never handed out, so it is no order.
+  typedef uint32_t OMOrderIndex;
+  constexpr OMOrderIndex OMOrderIndex_INVALID = 0;
+
+  /// Orders a trade engine can have working at once across all tickers, and the price levels a side one ladder can ask for.
+  constexpr size_t OM_MAX_ORDERS = 4 * 1024;
+  constexpr size_t OM_MAX_LADDER_LEVELS = 16;
+
+  /// The working orders of an OrderManager in a pool, in a list per ticker and side in the order they were sent. An order is found from its
+  /// OrderId in O(1) through a table indexed by the low bits of the id - the OrderManager skips ids whose slot is still taken, so a
+  /// lookup is a single compare. Freed indices are reused last in first out, like MEOrderStore does.
+  class OMOrderStore final
+  {
+  public:
+    typedef OMOrderIndex Handle;
+    static constexpr Handle NONE = OMOrderIndex_INVALID;
+
+    /// Slots of the OrderId table, twice the capacity so skipping a taken slot is rare.
+    static constexpr size_t ORDER_ID_SLOTS = 2 * OM_MAX_ORDERS;
+    static_assert((ORDER_ID_SLOTS & (ORDER_ID_SLOTS - 1)) == 0, "ORDER_ID_SLOTS has to be a power of 2.");
+
+    OMOrderStore()
+        : orders_(OM_MAX_ORDERS + 1, OMOrder(), HugePageAllocator<OMOrder>("OMOrderStore orders"))
+        , prev_(OM_MAX_ORDERS + 1, NONE, HugePageAllocator<OMOrderIndex>("OMOrderStore prev"))
+        , next_(OM_MAX_ORDERS + 1, NONE, HugePageAllocator<OMOrderIndex>("OMOrderStore next"))
+        , order_id_index_(ORDER_ID_SLOTS, NONE, HugePageAllocator<OMOrderIndex>("OMOrderStore order ids"))
+        , free_indices_(HugePageAllocator<OMOrderIndex>("OMOrderStore free indices"))
+    {
+      static_assert(OM_MAX_ORDERS < std::numeric_limits<OMOrderIndex>::max(), "OM_MAX_ORDERS too large for 32 bit indices.");
+      free_indices_.reserve(OM_MAX_ORDERS);
+      for (auto index = static_cast<OMOrderIndex>(OM_MAX_ORDERS); index != NONE; --index)
+        free_indices_.push_back(index);
+      for (auto &sides : first_)
+        sides.fill(NONE);
+      for (auto &sides : last_)
+        sides.fill(NONE);
+    }
 
+    /// Whether order_id can be handed to a new order, its slot in the OrderId table has to be free.
+    auto orderIdAvailable(OrderId order_id) const noexcept
+    {
+      return order_id_index_[order_id & (ORDER_ID_SLOTS - 1)] == NONE;
+    }
+
+    /// Add order at the end of its ticker and side's list.
+    auto allocate(const OMOrder &order) noexcept
+    {
+      ASSERT(!free_indices_.empty(), "OMOrderStore out of space.");
+      ASSERT(orderIdAvailable(order.order_id_), "OMOrderStore OrderId slot already taken.");
+      const auto index = free_indices_.back();
+      free_indices_.pop_back();
+
+      orders_[index] = order;
+      order_id_index_[order.order_id_ & (ORDER_ID_SLOTS - 1)] = index;
+
+      auto &last = last_[order.ticker_id_][sideToIndex(order.side_)];
+      prev_[index] = last;
+      next_[index] = NONE;
+      if (last != NONE)
+        next_[last] = index;
+      else
+        first_[order.ticker_id_][sideToIndex(order.side_)] = index;
+      last = index;
+
+      return index;
+    }
+
+    auto deallocate(OMOrderIndex index) noexcept
+    {
+      const auto &order = orders_[index];
+      const auto side_index = sideToIndex(order.side_);
+      if (prev_[index] != NONE)
+        next_[prev_[index]] = next_[index];
+      else
+        first_[order.ticker_id_][side_index] = next_[index];
+      if (next_[index] != NONE)
+        prev_[next_[index]] = prev_[index];
+      else
+        last_[order.ticker_id_][side_index] = prev_[index];
+
+      order_id_index_[order.order_id_ & (ORDER_ID_SLOTS - 1)] = NONE;
+      orders_[index] = OMOrder();
+      free_indices_.push_back(index);
+    }
+
+    /// The working order with order_id, NONE if there is none.
+    auto find(OrderId order_id) const noexcept
+    {
+      const auto index = order_id_index_[order_id & (ORDER_ID_SLOTS - 1)];
+      return (index != NONE && orders_[index].order_id_ == order_id ? index : NONE);
+    }
+
+    auto order(OMOrderIndex index) noexcept { return &orders_[index]; }
+
+    auto order(OMOrderIndex index) const noexcept { return &orders_[index]; }
+
+    /// Oldest working order on a side of a ticker, follow next() from there.
+    auto first(TickerId ticker_id, Side side) const noexcept { return first_[ticker_id][sideToIndex(side)]; }
+
+    auto next(OMOrderIndex index) const noexcept { return next_[index]; }
+
+    // Deleted copy & move constructors and assignment-operators.
+    OMOrderStore(const OMOrderStore &) = delete;
+
+    OMOrderStore(const OMOrderStore &&) = delete;
+
+    OMOrderStore &operator=(const OMOrderStore &) = delete;
+
+    OMOrderStore &operator=(const OMOrderStore &&) = delete;
+
+  private:
+    template<typename T>
+    using Array = std::vector<T, HugePageAllocator<T>>;
+
+    Array<OMOrder> orders_;
+    Array<OMOrderIndex> prev_;
+    Array<OMOrderIndex> next_;
+
+    /// OrderId modulo ORDER_ID_SLOTS -> the working order with that id.
+    Array<OMOrderIndex> order_id_index_;
+
+    Array<OMOrderIndex> free_indices_;
+
+    typedef std::array<std::array<OMOrderIndex, sideToIndex(Side::MAX) + 1>, ME_MAX_TICKERS> TickerSideOrders;
+    TickerSideOrders first_;
+    TickerSideOrders last_;
+  };
+}
@@ -3,24 +3,33 @@
 
 namespace Trading 
 {
-  auto OrderManager::newOrder(OMOrder *order, TickerId ticker_id, Price price, Side side, Quantity quantity) noexcept -> void {
+  auto OrderManager::newOrder(TickerId ticker_id, Price price, Side side, Quantity quantity, TimeInForce tif) noexcept -> OMOrderIndex {
+    // ids whose slot in the lookup table still belongs to an older working order are skipped.
+    while (UNLIKELY(!orders_.orderIdAvailable(next_order_id_)))
+      ++next_order_id_;
+
     const Exchange::MEClientRequest new_request{Exchange::ClientRequestType::NEW, trade_engine_->clientId(), ticker_id,
-                                                next_order_id_, side, price, quantity};
+                                                next_order_id_, side, price, quantity, OrderType::LIMIT, tif};
     trade_engine_->sendClientRequest(&new_request);
 
-    *order = {ticker_id, next_order_id_, side, price, quantity, OMOrderState::PENDING_NEW};
+    const auto index = orders_.allocate({ticker_id, next_order_id_, side, price, quantity, OMOrderState::PENDING_NEW, tif, 0,
+                                        Price_INVALID, false});
+    auto order = orders_.order(index);
+    setRiskQuantity(order, quantity);
     ++next_order_id_;
 
     logger_->log("%:% %() % Sent new order % for %\n", __FILE__, __LINE__, __FUNCTION__,
                  Common::getCurrentTimeStr(&time_str_),
                  new_request.toString().c_str(), order->toString().c_str());
+    return index;
   }
 
-  auto OrderManager::cancelOrder(OMOrder *order) noexcept -> void 
+  auto OrderManager::cancelOrder(OMOrderIndex index) noexcept -> void 
   {
+    auto order = orders_.order(index);
     const Exchange::MEClientRequest cancel_request{Exchange::ClientRequestType::CANCEL, trade_engine_->clientId(),
                                                    order->ticker_id_, order->order_id_, order->side_, order->price_,
-                                                   order->quantity_};
+                                                   order->quantity_, OrderType::LIMIT, order->tif_};
     trade_engine_->sendClientRequest(&cancel_request);
 
     order->order_state_ = OMOrderState::PENDING_CANCEL;
@@ -29,5 +38,151 @@ namespace Trading
                  Common::getCurrentTimeStr(&time_str_),
                  cancel_request.toString().c_str(), order->toString().c_str());
   }
+
+  auto OrderManager::modifyOrder(OMOrderIndex index, Price price, Quantity quantity) noexcept -> void 
+  {
+    auto order = orders_.order(index);
+    const Exchange::MEClientRequest modify_request{Exchange::ClientRequestType::MODIFY, trade_engine_->clientId(),
+                                                   order->ticker_id_, order->order_id_, order->side_, price, quantity,
+                                                   OrderType::LIMIT, order->tif_};
+    trade_engine_->sendClientRequest(&modify_request);
+
+    order->order_state_ = OMOrderState::PENDING_MODIFY;
+    order->pending_price_ = price;
+    setRiskQuantity(order, std::max(order->risk_quantity_, quantity));
+
+    logger_->log("%:% %() % Sent modify % for %\n", __FILE__, __LINE__, __FUNCTION__,
+                 Common::getCurrentTimeStr(&time_str_),
+                 modify_request.toString().c_str(), order->toString().c_str());
+  }
+
+  auto OrderManager::moveLadder(TickerId ticker_id, Side side, const Price *prices, size_t num_levels, Quantity quantity,
+                                TimeInForce tif) noexcept -> void
+  {
+    ASSERT(num_levels <= OM_MAX_LADDER_LEVELS, "Too many ladder levels.");
+
+    if (UNLIKELY(tif != TimeInForce::DAY))
+    {
+      if (num_levels && orders_.first(ticker_id, side) == OMOrderIndex_INVALID)
+      {
+        START_MEASURE(Trading_RiskManager_checkPreTradeRisk);
+        const auto risk_result = risk_manager_.checkPreTradeRisk(ticker_id, side, quantity, prices[0]);
+        END_MEASURE(Trading_RiskManager_checkPreTradeRisk, (*logger_));
+        if (LIKELY(risk_result == RiskCheckResult::ALLOWED))
+        {
+          START_MEASURE(Trading_OrderManager_newOrder);
+          newOrder(ticker_id, prices[0], side, quantity, tif);
+          END_MEASURE(Trading_OrderManager_newOrder, (*logger_));
+        } else
+        {
+          logger_->log("%:% %() % Ticker:% Side:% Quantity:% RiskCheckResult:%\n", __FILE__, __LINE__, __FUNCTION__,
+                       Common::getCurrentTimeStr(&time_str_),
+                       tickerIdToString(ticker_id), sideToString(side), quantityToString(quantity),
+                       riskCheckResultToString(risk_result));
+        }
+      }
+      return;
+    }
+
+    // orders already working at one of the prices cover it, live ones at any other price can be moved.
+    std::array<bool, OM_MAX_LADDER_LEVELS> covered = {};
+    std::array<OMOrderIndex, OM_MAX_ORDERS> spare_orders;
+    size_t num_spare_orders = 0;
+    for (auto index = orders_.first(ticker_id, side); index != OMOrderIndex_INVALID; index = orders_.next(index))
+    {
+      const auto order = orders_.order(index);
+      if (order->order_state_ == OMOrderState::PENDING_CANCEL)
+        continue;
+
+      const auto price = order->workingPrice();
+      size_t level = 0;
+      while (level < num_levels && (covered[level] || prices[level] != price))
+        ++level;
+      if (level < num_levels)
+        covered[level] = true;
+      else if (order->order_state_ == OMOrderState::LIVE)
+        spare_orders[num_spare_orders++] = index;
+    }
+
+    size_t next_spare_order = 0;
+    for (size_t level = 0; level < num_levels; ++level)
+    {
+      if (covered[level])
+        continue;
+
+      if (next_spare_order < num_spare_orders)
+      {
+        // re-quote in place with a single MODIFY instead of a CANCEL followed by a NEW one round trip later.
+        const auto index = spare_orders[next_spare_order++];
+        START_MEASURE(Trading_RiskManager_checkPreTradeRisk);
+        const auto risk_result = risk_manager_.checkPreTradeRisk(ticker_id, side, quantity, prices[level],
+                                                                 orders_.order(index)->risk_quantity_);
+        END_MEASURE(Trading_RiskManager_checkPreTradeRisk, (*logger_));
+
+        if (LIKELY(risk_result == RiskCheckResult::ALLOWED))
+        {
+          START_MEASURE(Trading_OrderManager_modifyOrder);
+          modifyOrder(index, prices[level], quantity);
+          END_MEASURE(Trading_OrderManager_modifyOrder, (*logger_));
+          continue;
+        }
+
+        logger_->log("%:% %() % Ticker:% Side:% Quantity:% RiskCheckResult:%\n", __FILE__, __LINE__, __FUNCTION__,
+                     Common::getCurrentTimeStr(&time_str_),
+                     tickerIdToString(ticker_id), sideToString(side), quantityToString(quantity),
+                     riskCheckResultToString(risk_result));
+        START_MEASURE(Trading_OrderManager_cancelOrder);
+        cancelOrder(index);
+        END_MEASURE(Trading_OrderManager_cancelOrder, (*logger_));
+        continue;
+      }
+
+      START_MEASURE(Trading_RiskManager_checkPreTradeRisk);
+      const auto risk_result = risk_manager_.checkPreTradeRisk(ticker_id, side, quantity, prices[level]);
+      END_MEASURE(Trading_RiskManager_checkPreTradeRisk, (*logger_));
+
+      if (LIKELY(risk_result == RiskCheckResult::ALLOWED))
+      {
+        START_MEASURE(Trading_OrderManager_newOrder);
+        newOrder(ticker_id, prices[level], side, quantity, tif);
+        END_MEASURE(Trading_OrderManager_newOrder, (*logger_));
+      } else
+      {
+        // deeper levels only need more of the same limits.
+        logger_->log("%:% %() % Ticker:% Side:% Quantity:% RiskCheckResult:%\n", __FILE__, __LINE__, __FUNCTION__,
+                     Common::getCurrentTimeStr(&time_str_),
+                     tickerIdToString(ticker_id), sideToString(side), quantityToString(quantity),
+                     riskCheckResultToString(risk_result));
+        break;
+      }
+    }
+
+    for (; next_spare_order < num_spare_orders; ++next_spare_order)
+    {
+      START_MEASURE(Trading_OrderManager_cancelOrder);
+      cancelOrder(spare_orders[next_spare_order]);
+      END_MEASURE(Trading_OrderManager_cancelOrder, (*logger_));
+    }
+  }
+
+  auto OrderManager::cancelAllOrders(TickerId ticker_id) noexcept -> size_t
+  {
+    size_t num_canceled = 0;
+    for (const auto side : {Side::BUY, Side::SELL})
+    {
+      for (auto index = orders_.first(ticker_id, side); index != OMOrderIndex_INVALID; index = orders_.next(index))
+      {
+        if (orders_.order(index)->order_state_ != OMOrderState::PENDING_CANCEL)
+        {
+          cancelOrder(index);
+          ++num_canceled;
+        }
+      }
+    }
+
+    logger_->log("%:% %() % Ticker:% canceled:%\n", __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str_),
+                 tickerIdToString(ticker_id), num_canceled);
+    return num_canceled;
+  }
 }
 
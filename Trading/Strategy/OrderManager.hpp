@@ -26,7 +26,15 @@ namespace Trading
     {
       logger_->log("%:% %() % %\n", __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str_),
                    client_response->toString().c_str());
-      auto order = &(ticker_side_order_.at(client_response->ticker_id_).at(sideToIndex(client_response->side_)));
+      const auto index = orders_.find(client_response->client_order_id_);
+      if (UNLIKELY(index == OMOrderIndex_INVALID))
+      {
+        // an order this OrderManager did not send, or one that is already DEAD.
+        logger_->log("%:% %() % No working order for oid:%\n", __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str_),
+                     orderIdToString(client_response->client_order_id_));
+        return;
+      }
+      auto order = orders_.order(index);
       logger_->log("%:% %() % %\n", __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str_),
                    order->toString().c_str());
 
@@ -34,12 +42,16 @@ namespace Trading
       {
         case Exchange::ClientResponseType::ACCEPTED: 
         {
-          order->order_state_ = OMOrderState::LIVE;
+          // a cancel may already be on its way.
+          order->accepted_ = true;
+          if (order->order_state_ == OMOrderState::PENDING_NEW)
+            order->order_state_ = OMOrderState::LIVE;
         }
           break;
         case Exchange::ClientResponseType::CANCELED: 
         {
           order->order_state_ = OMOrderState::DEAD;
+          setRiskQuantity(order, 0);
         }
           break;
         case Exchange::ClientResponseType::FILLED: 
@@ -47,79 +59,106 @@ namespace Trading
           order->quantity_ = client_response->leaves_quantity_;
           if(!order->quantity_)
             order->order_state_ = OMOrderState::DEAD;
+          risk_manager_.onFill(client_response->ticker_id_, client_response->side_, client_response->exec_quantity_,
+                               client_response->price_);
+          // with a modify pending the fill may be against either quantity, so only what was counted goes down.
+          setRiskQuantity(order, order->quantity_ ?
+                                 order->risk_quantity_ - std::min(order->risk_quantity_, client_response->exec_quantity_) : 0);
         }
           break;
-        case Exchange::ClientResponseType::CANCEL_REJECTED:
-        case Exchange::ClientResponseType::INVALID: 
-          {}
+        case Exchange::ClientResponseType::MODIFIED: 
+        {
+          order->price_ = client_response->price_;
+          order->quantity_ = client_response->leaves_quantity_;
+          if (order->order_state_ == OMOrderState::PENDING_MODIFY)
+            order->order_state_ = OMOrderState::LIVE;
+          setRiskQuantity(order, order->quantity_);
+        }
           break;
-      }
-    }
-
-    auto newOrder(OMOrder *order, TickerId ticker_id, Price price, Side side, Quantity quantity) noexcept -> void;
-
-    auto cancelOrder(OMOrder *order) noexcept -> void;
-
-    auto moveOrder(OMOrder *order, TickerId ticker_id, Price price, Side side, Quantity quantity) noexcept 
-    {
-      switch (order->order_state_) 
-      {
-        case OMOrderState::LIVE: 
+        case Exchange::ClientResponseType::MODIFY_REJECTED: 
         {
-          if (order->price_ != price)
+          // a modify racing with a full fill is rejected after the fill already marked the order DEAD, otherwise the old order is still live.
+          if (order->order_state_ == OMOrderState::PENDING_MODIFY)
           {
-            START_MEASURE(Trading_OrderManager_cancelOrder);
-            cancelOrder(order);
-            END_MEASURE(Trading_OrderManager_cancelOrder, (*logger_));
+            order->order_state_ = OMOrderState::LIVE;
+            setRiskQuantity(order, order->quantity_);
           }
         }
           break;
-        case OMOrderState::INVALID:
-        case OMOrderState::DEAD: 
+        case Exchange::ClientResponseType::REJECTED: 
+        {
+          // refused by the exchange's order server, the request never reached the matching engine. The order server's rejects can
+          // overtake the matching engine's responses to earlier requests, so only a rejected NEW kills the order - a rejected MODIFY or
+          // CANCEL leaves it as it was, unless another request has been sent for it since.
+          if (client_response->request_type_ == Exchange::ClientRequestType::NEW) 
           {
-          if(LIKELY(price != Price_INVALID)) 
+            order->order_state_ = OMOrderState::DEAD;
+            setRiskQuantity(order, 0);
+          } else if ((client_response->request_type_ == Exchange::ClientRequestType::MODIFY &&
+                      order->order_state_ == OMOrderState::PENDING_MODIFY) ||
+                     (client_response->request_type_ == Exchange::ClientRequestType::CANCEL &&
+                      order->order_state_ == OMOrderState::PENDING_CANCEL)) 
           {
-            START_MEASURE(Trading_RiskManager_checkPreTradeRisk);
-            const auto risk_result = risk_manager_.checkPreTradeRisk(ticker_id, side, quantity);
-            END_MEASURE(Trading_RiskManager_checkPreTradeRisk, (*logger_));
-            
-            if(LIKELY(risk_result == RiskCheckResult::ALLOWED))
-            {
-              START_MEASURE(Trading_OrderManager_newOrder);
-              newOrder(order, ticker_id, price, side, quantity);
-              END_MEASURE(Trading_OrderManager_newOrder, (*logger_));  
-            } else
-            {
-              logger_->log("%:% %() % Ticker:% Side:% Quantity:% RiskCheckResult:%\n", __FILE__, __LINE__, __FUNCTION__,
-                           Common::getCurrentTimeStr(&time_str_),
-                           tickerIdToString(ticker_id), sideToString(side), quantityToString(quantity),
-                           riskCheckResultToString(risk_result));  
-            }
+            order->order_state_ = (order->accepted_ ? OMOrderState::LIVE : OMOrderState::PENDING_NEW);
+            setRiskQuantity(order, order->quantity_);
           }
         }
           break;
-        case OMOrderState::PENDING_NEW:
-        case OMOrderState::PENDING_CANCEL:
+        case Exchange::ClientResponseType::CANCEL_REJECTED:
+        case Exchange::ClientResponseType::SEQUENCE_RESET: // answered by the order gateway, never forwarded.
+        case Exchange::ClientResponseType::INVALID: 
+          {}
           break;
       }
+
+      // nothing more can happen to a DEAD order, its handle and OrderId are free to be reused.
+      if (order->order_state_ == OMOrderState::DEAD)
+        orders_.deallocate(index);
     }
 
-    auto moveOrders(TickerId ticker_id, Price bid_price, Price ask_price, Quantity clip) noexcept 
+    /// Send a NEW order, returns its handle. The caller has done the risk check.
+    auto newOrder(TickerId ticker_id, Price price, Side side, Quantity quantity, TimeInForce tif) noexcept -> OMOrderIndex;
+
+    auto cancelOrder(OMOrderIndex index) noexcept -> void;
+
+    auto modifyOrder(OMOrderIndex index, Price price, Quantity quantity) noexcept -> void;
+
+    /// Work one order of quantity at each of num_levels prices on a side of a ticker, with as few requests as it takes - orders already at
+    /// one of the prices are left alone, other live ones are moved to the missing prices with a MODIFY, NEW orders fill in the rest and
+    /// whatever live orders are left over are canceled. Pending orders are left alone till the exchange answers them. num_levels of 0
+    /// cancels the side. IOC / FOK orders are only working till their fills and cancel come back, so with those a side has at most one
+    /// order at prices[0] and nothing is re-quoted.
+    auto moveLadder(TickerId ticker_id, Side side, const Price *prices, size_t num_levels, Quantity quantity, TimeInForce tif) noexcept -> void;
+
+    /// A single order a side, Price_INVALID cancels that side.
+    auto moveOrders(TickerId ticker_id, Price bid_price, Price ask_price, Quantity clip, TimeInForce tif) noexcept 
     {
-      auto bid_order = &(ticker_side_order_.at(ticker_id).at(sideToIndex(Side::BUY)));
       START_MEASURE(Trading_OrderManager_moveBidOrder);
-      moveOrder(bid_order, ticker_id, bid_price, Side::BUY, clip);
+      moveLadder(ticker_id, Side::BUY, &bid_price, (bid_price != Price_INVALID), clip, tif);
       END_MEASURE(Trading_OrderManager_moveBidOrder, (*logger_));
 
-      auto ask_order = &(ticker_side_order_.at(ticker_id).at(sideToIndex(Side::SELL)));
       START_MEASURE(Trading_OrderManager_moveAskOrder);
-      moveOrder(ask_order, ticker_id, ask_price, Side::SELL, clip);
+      moveLadder(ticker_id, Side::SELL, &ask_price, (ask_price != Price_INVALID), clip, tif);
       END_MEASURE(Trading_OrderManager_moveAskOrder, (*logger_));
     }
 
-    auto getOMOrderSideHashMap(TickerId ticker_id) const
+    /// Cancel every order working on the ticker, including ones still waiting on a NEW or MODIFY. Returns how many cancels were sent.
+    auto cancelAllOrders(TickerId ticker_id) noexcept -> size_t;
+
+    auto getOrder(OMOrderIndex index) const noexcept -> const OMOrder *
     {
-      return ticker_side_order_.at(ticker_id);
+      return orders_.order(index);
+    }
+
+    /// Oldest working order on a side of a ticker, OMOrderIndex_INVALID if there is none. nextOrder() walks the rest.
+    auto firstOrder(TickerId ticker_id, Side side) const noexcept
+    {
+      return orders_.first(ticker_id, side);
+    }
+
+    auto nextOrder(OMOrderIndex index) const noexcept
+    {
+      return orders_.next(index);
     }
 
     // Deleted default, copy & move constructors and assignment-operators.
@@ -134,13 +173,21 @@ namespace Trading
     OrderManager &operator=(const OrderManager &&) = delete;
 
   private:
+    /// Keeps the RiskManager's open quantity in step with what this order can still fill.
+    auto setRiskQuantity(OMOrder *order, Quantity quantity) noexcept -> void
+    {
+      risk_manager_.updateOpenQuantity(order->ticker_id_, order->side_,
+                                       static_cast<int64_t>(quantity) - static_cast<int64_t>(order->risk_quantity_));
+      order->risk_quantity_ = quantity;
+    }
+
     TradeEngine *trade_engine_ = nullptr;
-    const RiskManager& risk_manager_;
+    RiskManager& risk_manager_;
 
     std::string time_str_;
     Common::Logger *logger_ = nullptr;
 
-    OMOrderTickerSideHashMap ticker_side_order_;
+    OMOrderStore orders_;
     OrderId next_order_id_ = 1;
   };
 }
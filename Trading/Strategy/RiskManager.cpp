@@ -1,12 +1,31 @@
 #include "RiskManager.hpp"
 
-RiskManager::RiskManager(Common::Logger *logger, const
-    PositionKeeper *position_keeper, const TradeEngineCfgHashMap &ticker_cfg)
-      : logger_(logger) 
+namespace Trading
+{
+  RiskManager::RiskManager(Common::Logger *logger, const PositionKeeper *position_keeper, const TradeEngineCfgHashMap &ticker_cfg,
+                           const PortfolioRiskCfg &portfolio_cfg)
+      : logger_(logger)
+      , portfolio_cfg_(portfolio_cfg)
   {
-    for (TickerId i = 0; i < ME_MAX_TICKERS; ++i) 
+    for (TickerId i = 0; i < ME_MAX_TICKERS; ++i)
     {
       ticker_risk_.at(i).position_info_ = position_keeper->getPositionInfo(i);
       ticker_risk_.at(i).risk_cfg_ = ticker_cfg[i].risk_cfg_;
     }
-  }
\ No newline at end of file
+  }
+
+  auto RiskManager::toString() const -> std::string
+  {
+    std::stringstream ss;
+    ss << "RiskManager[" << portfolio_cfg_.toString();
+    for (TickerId i = 0; i < ME_MAX_TICKERS; ++i)
+    {
+      const auto vec = i / RISK_LANES, lane = i % RISK_LANES;
+      if (position_[vec][lane] || open_buy_[vec][lane] || open_sell_[vec][lane])
+        ss << " " << tickerIdToString(i) << "{pos:" << position_[vec][lane] << " open-buy:" << open_buy_[vec][lane]
+           << " open-sell:" << open_sell_[vec][lane] << " mark:" << mark_[vec][lane] << "}";
+    }
+    ss << "]";
+    return ss.str();
+  }
+}
@@ -18,7 +18,9 @@ namespace Trading
     ORDER_TOO_LARGE = 1,
     POSITION_TOO_LARGE = 2,
     LOSS_TOO_LARGE = 3,
-    ALLOWED = 4
+    GROSS_NOTIONAL_TOO_LARGE = 4,
+    NET_NOTIONAL_TOO_LARGE = 5,
+    ALLOWED = 6
   };
 
   inline auto riskCheckResultToString(RiskCheckResult result) 
@@ -33,6 +35,10 @@ namespace Trading
         return "POSITION_TOO_LARGE";
       case RiskCheckResult::LOSS_TOO_LARGE:
         return "LOSS_TOO_LARGE";
+      case RiskCheckResult::GROSS_NOTIONAL_TOO_LARGE:
+        return "GROSS_NOTIONAL_TOO_LARGE";
+      case RiskCheckResult::NET_NOTIONAL_TOO_LARGE:
+        return "NET_NOTIONAL_TOO_LARGE";
       case RiskCheckResult::ALLOWED:
         return "ALLOWED";
     }
@@ -46,19 +52,6 @@ namespace Trading
 
     RiskCfg risk_cfg_;
 
-    auto checkPreTradeRisk(Side side, Quantity quantity) const noexcept 
-    {
-      // check order-size
-      if (UNLIKELY(quantity > risk_cfg_.max_order_size_))
-        return RiskCheckResult::ORDER_TOO_LARGE;
-      if (UNLIKELY(std::abs(position_info_->position_ + sideToValue(side) * static_cast<int32_t>(quantity)) > static_cast<int32_t>(risk_cfg_.max_position_)))
-        return RiskCheckResult::POSITION_TOO_LARGE;
-      if (UNLIKELY(position_info_->total_pnl_ < risk_cfg_.max_loss_))
-        return RiskCheckResult::LOSS_TOO_LARGE;
-
-      return RiskCheckResult::ALLOWED;
-    }
-
     auto toString() const 
     {
       std::stringstream ss;
@@ -73,16 +66,105 @@ namespace Trading
 
   typedef std::array<RiskInfo, ME_MAX_TICKERS> TickerRiskInfoHashMap;
 
+  /// Per ticker values the portfolio check runs over, RISK_LANES tickers to a vector - one AVX register, or a pair of SSE2 ones when the
+  /// build does not enable AVX. Only ever used as locals and members, never passed by value, so the ABI does not depend on the flags.
+  constexpr size_t RISK_LANES = 4;
+  typedef double RiskVector __attribute__((vector_size(RISK_LANES * sizeof(double))));
+  static_assert(ME_MAX_TICKERS % RISK_LANES == 0, "ME_MAX_TICKERS has to be a multiple of RISK_LANES.");
+  typedef std::array<RiskVector, ME_MAX_TICKERS / RISK_LANES> TickerRiskVectors;
+
   class RiskManager 
   {
   public:
-    RiskManager(Common::Logger *logger, const PositionKeeper *position_keeper, const TradeEngineCfgHashMap &ticker_cfg);
+    RiskManager(Common::Logger *logger, const PositionKeeper *position_keeper, const TradeEngineCfgHashMap &ticker_cfg,
+                const PortfolioRiskCfg &portfolio_cfg);
+
+    /// Checks an order for quantity at price against the worst case where every working order on its side fills, replaced_quantity is
+    /// what an order being modified already has counted as open. A modify that adds no quantity only has its size and the loss checked.
+    auto checkPreTradeRisk(TickerId ticker_id, Side side, Quantity quantity, Price price, Quantity replaced_quantity = 0) const noexcept
+    {
+      const auto &risk_info = ticker_risk_[ticker_id];
+      if (UNLIKELY(quantity > risk_info.risk_cfg_.max_order_size_))
+        return RiskCheckResult::ORDER_TOO_LARGE;
+      if (UNLIKELY(risk_info.position_info_->total_pnl_ < risk_info.risk_cfg_.max_loss_))
+        return RiskCheckResult::LOSS_TOO_LARGE;
+
+      const auto added = static_cast<double>(quantity) - static_cast<double>(replaced_quantity);
+      if (added <= 0)
+        return RiskCheckResult::ALLOWED;
+
+      const auto vec = ticker_id / RISK_LANES, lane = ticker_id % RISK_LANES;
+      const auto max_position = static_cast<double>(risk_info.risk_cfg_.max_position_);
+      if (side == Side::BUY)
+      {
+        if (UNLIKELY(position_[vec][lane] + open_buy_[vec][lane] + added > max_position))
+          return RiskCheckResult::POSITION_TOO_LARGE;
+      } else if (UNLIKELY(position_[vec][lane] - open_sell_[vec][lane] - added < -max_position))
+        return RiskCheckResult::POSITION_TOO_LARGE;
+
+      if (!portfolio_cfg_.max_gross_notional_ && !portfolio_cfg_.max_net_notional_)
+        return RiskCheckResult::ALLOWED;
+
+      // one pass over every ticker - worst long if all its buys fill, worst short if all its sells fill, at the mark (the order's own
+      // price for a ticker with no market yet).
+      RiskVector gross = {}, net_long = {}, net_short = {};
+      for (size_t i = 0; i < position_.size(); ++i)
+      {
+        auto open_buy = open_buy_[i], open_sell = open_sell_[i], mark = mark_[i];
+        if (i == vec)
+        {
+          (side == Side::BUY ? open_buy : open_sell)[lane] += added;
+          if (!mark[lane])
+            mark[lane] = static_cast<double>(price);
+        }
+        const auto long_position = position_[i] + open_buy;
+        const auto short_position = position_[i] - open_sell;
+        const auto abs_long = (long_position < 0 ? -long_position : long_position);
+        const auto abs_short = (short_position < 0 ? -short_position : short_position);
+        gross += (abs_long > abs_short ? abs_long : abs_short) * mark;
+        net_long += long_position * mark;
+        net_short += short_position * mark;
+      }
+
+      double gross_notional = 0, net_notional = 0;
+      for (size_t i = 0; i < RISK_LANES; ++i)
+      {
+        gross_notional += gross[i];
+        net_notional += (side == Side::BUY ? net_long[i] : -net_short[i]);
+      }
+      if (UNLIKELY(portfolio_cfg_.max_gross_notional_ && gross_notional > portfolio_cfg_.max_gross_notional_))
+        return RiskCheckResult::GROSS_NOTIONAL_TOO_LARGE;
+      if (UNLIKELY(portfolio_cfg_.max_net_notional_ && net_notional > portfolio_cfg_.max_net_notional_))
+        return RiskCheckResult::NET_NOTIONAL_TOO_LARGE;
+
+      return RiskCheckResult::ALLOWED;
+    }
+
+    /// Quantity that could still fill on a side changed by delta - orders count from when they are sent, and at the larger of the old
+    /// and new quantity while a modify is pending.
+    auto updateOpenQuantity(TickerId ticker_id, Side side, int64_t delta) noexcept
+    {
+      auto &open = (side == Side::BUY ? open_buy_ : open_sell_);
+      open[ticker_id / RISK_LANES][ticker_id % RISK_LANES] += static_cast<double>(delta);
+    }
+
+    auto onFill(TickerId ticker_id, Side side, Quantity exec_quantity, Price price) noexcept
+    {
+      const auto vec = ticker_id / RISK_LANES, lane = ticker_id % RISK_LANES;
+      position_[vec][lane] += sideToValue(side) * static_cast<double>(exec_quantity);
+      if (!mark_[vec][lane])
+        mark_[vec][lane] = static_cast<double>(price);
+    }
 
-    auto checkPreTradeRisk(TickerId ticker_id, Side side, Quantity quantity) const noexcept 
+    /// Notional is valued at the mid, a one sided book keeps the last mark.
+    auto updateMarkPrice(TickerId ticker_id, const BestBidOffer *bbo) noexcept
     {
-      return ticker_risk_.at(ticker_id).checkPreTradeRisk(side, quantity);
+      if (bbo->bid_price_ != Price_INVALID && bbo->ask_price_ != Price_INVALID)
+        mark_[ticker_id / RISK_LANES][ticker_id % RISK_LANES] = (bbo->bid_price_ + bbo->ask_price_) * 0.5;
     }
 
+    auto toString() const -> std::string;
+
     // Deleted default, copy & move constructors and assignment-operators.
     RiskManager() = delete;
 
@@ -99,6 +181,12 @@ namespace Trading
     Common::Logger *logger_ = nullptr;
 
     TickerRiskInfoHashMap ticker_risk_;
+    const PortfolioRiskCfg portfolio_cfg_;
+
+    /// Structure of arrays kept by OrderManager::onOrderUpdate(), so the per ticker checks are O(1) and the portfolio one vectorizes.
+    TickerRiskVectors position_ = {};
+    TickerRiskVectors open_buy_ = {};
+    TickerRiskVectors open_sell_ = {};
+    TickerRiskVectors mark_ = {};
   };
 }
-
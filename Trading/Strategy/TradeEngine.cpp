@@ -5,6 +5,7 @@ namespace Trading
   TradeEngine::TradeEngine(Common::ClientId client_id,
                            AlgoType algo_type,
                            const TradeEngineCfgHashMap &ticker_cfg,
+                           const PortfolioRiskCfg &portfolio_risk_cfg,
                            Exchange::ClientRequestLFQueue *client_requests,
                            Exchange::ClientResponseLFQueue *client_responses,
                            Exchange::MEMarketUpdateLFQueue *market_updates)
@@ -12,12 +13,16 @@ namespace Trading
       , outgoing_ogw_requests_(client_requests)
       , incoming_ogw_responses_(client_responses)
       , incoming_md_updates_(market_updates)
+      , wait_strategy_(Common::waitStrategyType(TRADE_ENGINE_THREAD, Common::WaitStrategyType::BUSY_SPIN))
       , logger_("trading_engine_" + std::to_string(client_id) + ".log")
       , feature_engine_(&logger_)
       , position_keeper_(&logger_)
       , order_manager_(&logger_, this, risk_manager_)
-      , risk_manager_(&logger_, &position_keeper_, ticker_cfg) 
+      , risk_manager_(&logger_, &position_keeper_, ticker_cfg, portfolio_risk_cfg) 
   {
+    incoming_ogw_responses_->setConsumerWaitStrategy(&wait_strategy_);
+    incoming_md_updates_->setConsumerWaitStrategy(&wait_strategy_);
+
     for (size_t i = 0; i < ticker_order_book_.size(); ++i) 
     {
       ticker_order_book_[i] = new MarketOrderBook(i, &logger_);
@@ -51,6 +56,7 @@ namespace Trading
   TradeEngine::~TradeEngine() 
   {
     run_ = false;
+    wait_strategy_.wakeUp();
 
     using namespace std::literals::chrono_literals;
     std::this_thread::sleep_for(1s);
@@ -84,6 +90,7 @@ namespace Trading
     logger_.log("%:% %() %\n", __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str_));
     while (run_) 
     {
+      bool did_work = false;
       for (auto client_response = incoming_ogw_responses_->getNextToRead(); client_response; client_response = incoming_ogw_responses_->getNextToRead()) 
       {
         TTT_MEASURE(T9t_TradeEngine_LFQueue_read, logger_);
@@ -92,6 +99,7 @@ namespace Trading
         onOrderUpdate(client_response);
         incoming_ogw_responses_->updateReadIndex();
         last_event_time_ = Common::getCurrentNanos();
+        did_work = true;
       }
 
       for (auto market_update = incoming_md_updates_->getNextToRead(); market_update; market_update = incoming_md_updates_->getNextToRead()) 
@@ -104,8 +112,12 @@ namespace Trading
         ticker_order_book_[market_update->ticker_id_]->onMarketUpdate(market_update);
         incoming_md_updates_->updateReadIndex();
         last_event_time_ = Common::getCurrentNanos();
+        did_work = true;
       }
+
+      wait_strategy_.afterPoll(did_work, [this]() { return incoming_ogw_responses_->size() || incoming_md_updates_->size(); });
     }
+    logger_.log("%:% %() % %\n", __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str_), wait_strategy_.toString());
   }
 
   auto TradeEngine::onOrderBookUpdate(TickerId ticker_id, Price price, Side side, MarketOrderBook *book) noexcept -> void 
@@ -117,6 +129,7 @@ namespace Trading
     START_MEASURE(Trading_PositionKeeper_updateBBO);
     position_keeper_.updateBestBidOffer(ticker_id, book->getBestBidOffer());
     END_MEASURE(Trading_PositionKeeper_updateBBO, logger_);
+    risk_manager_.updateMarkPrice(ticker_id, book->getBestBidOffer());
 
     START_MEASURE(Trading_FeatureEngine_onOrderBookUpdate);
     feature_engine_.onOrderBookUpdate(ticker_id, price, side, book);
@@ -23,12 +23,17 @@
 
 namespace Trading 
 {
+  /// Thread name and default cpu, ANCHOR_PLACEMENT can move it.
+  constexpr auto TRADE_ENGINE_THREAD = "Trading/TradeEngine";
+  constexpr int TRADE_ENGINE_CORE = 5;
+
   class TradeEngine 
   {
   public:
     TradeEngine(Common::ClientId client_id,
                 AlgoType algo_type,
                 const TradeEngineCfgHashMap &ticker_cfg,
+                const PortfolioRiskCfg &portfolio_risk_cfg,
                 Exchange::ClientRequestLFQueue *client_requests,
                 Exchange::ClientResponseLFQueue *client_responses,
                 Exchange::MEMarketUpdateLFQueue *market_updates);
@@ -38,7 +43,7 @@ namespace Trading
     auto start() -> void 
     {
       run_ = true;
-      ASSERT(Common::createAndStartThread(5, "Trading/TradeEngine", [this] { run(); }) != nullptr, "Failed to start TradeEngine thread.");
+      ASSERT(Common::createAndStartThread(TRADE_ENGINE_CORE, TRADE_ENGINE_THREAD, [this] { run(); }) != nullptr, "Failed to start TradeEngine thread.");
     }
 
     auto stop() -> void 
@@ -54,8 +59,10 @@ namespace Trading
 
       logger_.log("%:% %() % POSITIONS\n%\n", __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str_),
                   position_keeper_.toString());
+      logger_.log("%:% %() % %\n", __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str_), risk_manager_.toString());
 
       run_ = false;
+      wait_strategy_.wakeUp();
     }
 
     auto run() noexcept -> void;
@@ -86,6 +93,12 @@ namespace Trading
       return client_id_;
     }
 
+    /// Safe to call from any thread, see MarketOrderBook::readSnapshot().
+    auto readBookSnapshot(TickerId ticker_id) const noexcept
+    {
+      return ticker_order_book_.at(ticker_id)->readSnapshot();
+    }
+
     // Deleted default, copy & move constructors and assignment-operators.
     TradeEngine() = delete;
 
@@ -107,7 +120,8 @@ namespace Trading
     Exchange::MEMarketUpdateLFQueue *incoming_md_updates_ = nullptr;
 
     Nanos last_event_time_ = 0;
-    volatile bool run_ = false;
+    std::atomic<bool> run_ = {false};
+    Common::WaitStrategy wait_strategy_;
 
     std::string time_str_;
     Logger logger_;
@@ -16,6 +16,11 @@ int main(int argc, char **argv)
   srand(client_id);
   const auto algo_type = stringToAlgoType(argv[2]);
 
+  // ANCHOR_MM_LEVELS=<n> has the market maker quote a ladder of n price levels a side, one tick apart, instead of a single order.
+  const auto mm_levels_env = std::getenv("ANCHOR_MM_LEVELS");
+  const auto mm_levels = static_cast<uint32_t>(mm_levels_env ? std::atoi(mm_levels_env) : 1);
+  ASSERT(mm_levels >= 1 && mm_levels <= Trading::OM_MAX_LADDER_LEVELS, "Invalid ANCHOR_MM_LEVELS:" + std::to_string(mm_levels));
+
   TradeEngineCfgHashMap ticker_cfg;
   size_t next_ticker_id = 0;
   for (int i = 3; i < argc; i += 5, ++next_ticker_id) 
@@ -25,37 +30,149 @@ int main(int argc, char **argv)
         std::atof(argv[i + 1]),
                   {static_cast<Quantity>(std::atoi(argv[i + 2])),
                     static_cast<Quantity>(std::atoi(argv[i + 3])),
-                    std::atof(argv[i + 4])}};
+                    std::atof(argv[i + 4])},
+                  mm_levels};
   }
 
+  // ANCHOR_MAX_GROSS_NOTIONAL / ANCHOR_MAX_NET_NOTIONAL limit the worst-case notional across all tickers, unlimited when not set.
+  PortfolioRiskCfg portfolio_risk_cfg;
+  const auto max_gross_notional_env = std::getenv("ANCHOR_MAX_GROSS_NOTIONAL");
+  if (max_gross_notional_env)
+    portfolio_risk_cfg.max_gross_notional_ = std::atof(max_gross_notional_env);
+  const auto max_net_notional_env = std::getenv("ANCHOR_MAX_NET_NOTIONAL");
+  if (max_net_notional_env)
+    portfolio_risk_cfg.max_net_notional_ = std::atof(max_net_notional_env);
+  ASSERT(portfolio_risk_cfg.max_gross_notional_ >= 0 && portfolio_risk_cfg.max_net_notional_ >= 0,
+         "Invalid portfolio risk limits:" + portfolio_risk_cfg.toString());
+
+  // ANCHOR_HUGE_PAGES=OFF|2M|1G and ANCHOR_MLOCK=1 work as they do for the exchange.
+  Common::HugePageCfg huge_page_cfg;
+  const auto huge_pages_env = std::getenv("ANCHOR_HUGE_PAGES");
+  if (huge_pages_env)
+    huge_page_cfg.mode_ = Common::stringToHugePageMode(huge_pages_env);
+  ASSERT(huge_page_cfg.mode_ != Common::HugePageMode::INVALID && huge_page_cfg.mode_ != Common::HugePageMode::MAX,
+         "Invalid ANCHOR_HUGE_PAGES:" + std::string(huge_pages_env ? huge_pages_env : ""));
+  const auto mlock_env = std::getenv("ANCHOR_MLOCK");
+  huge_page_cfg.lock_ = (mlock_env && std::atoi(mlock_env));
+  Common::setHugePageCfg(huge_page_cfg);
+
+  // ANCHOR_PLACEMENT works as it does for the exchange, e.g. "Trading/TradeEngine=6,Trading/OrderGateway=7". Every queue is bound to the
+  // NUMA node of the thread reading it and every component's books, pools and buffers to the node of its own thread.
+  const auto placement_env = std::getenv("ANCHOR_PLACEMENT");
+  if (placement_env)
+    Common::setThreadPlacement(placement_env);
+
+  // ANCHOR_WAIT_STRATEGY works as it does for the exchange, e.g. "Trading/MarketDataConsumer=SPIN_YIELD". The trade engine, order gateway
+  // and market data consumer busy spin by default, the loggers park.
+  const auto wait_strategy_env = std::getenv("ANCHOR_WAIT_STRATEGY");
+  if (wait_strategy_env)
+    Common::setWaitStrategies(wait_strategy_env);
+
+  // ANCHOR_REACTOR works as it does for the exchange, but only the loggers can move into the reactor here, e.g. "Common/Logger=1".
+  const auto reactor_env = std::getenv("ANCHOR_REACTOR");
+  if (reactor_env)
+    Common::setReactorComponents(reactor_env);
+  const auto trade_engine_node = Common::placedNode(Trading::TRADE_ENGINE_THREAD, Trading::TRADE_ENGINE_CORE);
+  const auto order_gateway_node = Common::placedNode(Trading::ORDER_GATEWAY_THREAD, Trading::ORDER_GATEWAY_CORE);
+  const auto market_data_consumer_node = Common::placedNode(Trading::MARKET_DATA_CONSUMER_THREAD, Trading::MARKET_DATA_CONSUMER_CORE);
+
   logger = new Common::Logger("trading_main_" + std::to_string(client_id) + ".log");
   const int sleep_time = 20 * 1000;
-  Exchange::ClientRequestLFQueue client_requests(ME_MAX_CLIENT_UPDATES);
-  Exchange::ClientResponseLFQueue client_responses(ME_MAX_CLIENT_UPDATES);
-  Exchange::MEMarketUpdateLFQueue market_updates(ME_MAX_MARKET_UPDATES);
+  Exchange::ClientRequestLFQueue *client_requests = nullptr;
+  Exchange::ClientResponseLFQueue *client_responses = nullptr;
+  Exchange::MEMarketUpdateLFQueue *market_updates = nullptr;
+  {
+    Common::MemoryNodeScope memory_node(order_gateway_node);
+    client_requests = new Exchange::ClientRequestLFQueue(ME_MAX_CLIENT_UPDATES, "ClientRequestLFQueue");
+  }
+  {
+    Common::MemoryNodeScope memory_node(trade_engine_node);
+    client_responses = new Exchange::ClientResponseLFQueue(ME_MAX_CLIENT_UPDATES, "ClientResponseLFQueue");
+    market_updates = new Exchange::MEMarketUpdateLFQueue(ME_MAX_MARKET_UPDATES, "MEMarketUpdateLFQueue");
+  }
   std::string time_str;
+  logger->log("%:% %() % % placement:%\n", __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str),
+              Common::cpuTopology().toString(), (placement_env ? placement_env : "default"));
 
-  logger->log("%:% %() % Starting Trade Engine...\n", __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str));
-  trade_engine = new Trading::TradeEngine(client_id, algo_type,ticker_cfg,&client_requests, &client_responses,&market_updates);
-  trade_engine->start();
+  // ANCHOR_TRANSPORT=SHM connects to an exchange on this box over shared memory instead of TCP and multicast.
+  const auto transport_env = std::getenv("ANCHOR_TRANSPORT");
+  const auto transport_type = Common::stringToTransportType(transport_env ? transport_env : "SOCKET");
+  ASSERT(transport_type == Common::TransportType::SOCKET || transport_type == Common::TransportType::SHM,
+         "Unknown ANCHOR_TRANSPORT:" + std::string(transport_env ? transport_env : ""));
+
+  // ANCHOR_IO_ENGINE=IO_URING moves TCP order entry from per socket recvmsg() / send() calls to io_uring, falls back to SOCKET when this
+  // kernel does not support what it needs.
+  const auto io_engine_env = std::getenv("ANCHOR_IO_ENGINE");
+  auto io_engine = Common::stringToIoEngineType(io_engine_env ? io_engine_env : "SOCKET");
+  ASSERT(io_engine == Common::IoEngineType::SOCKET || io_engine == Common::IoEngineType::IO_URING,
+         "Unknown ANCHOR_IO_ENGINE:" + std::string(io_engine_env ? io_engine_env : ""));
+  if (io_engine == Common::IoEngineType::IO_URING && !Common::IoUring::supported()) 
+  {
+    logger->log("%:% %() % io_uring not available, falling back to SOCKET\n", __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str));
+    io_engine = Common::IoEngineType::SOCKET;
+  }
+  logger->log("%:% %() % Using io engine:%\n", __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str),
+              Common::ioEngineTypeToString(io_engine));
+
+  // ANCHOR_MCAST_RX=XDP receives market data through an AF_XDP socket, the market data consumer falls back to SOCKET if the interface
+  // or the kernel cannot do it - or another process already has an XDP program on the interface.
+  const auto mcast_rx_env = std::getenv("ANCHOR_MCAST_RX");
+  const auto mcast_rx_type = Common::stringToMcastRxType(mcast_rx_env ? mcast_rx_env : "SOCKET");
+  ASSERT(mcast_rx_type == Common::McastRxType::SOCKET || mcast_rx_type == Common::McastRxType::XDP,
+         "Unknown ANCHOR_MCAST_RX:" + std::string(mcast_rx_env ? mcast_rx_env : ""));
 
   const std::string order_gw_ip = "127.0.0.1";
   const std::string order_gw_iface = "lo";
   const int order_gw_port = 12345;
-  logger->log("%:% %() % Starting Order Gateway...\n", __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str));
-  order_gateway = new Trading::OrderGateway(client_id, &client_requests, &client_responses, order_gw_ip, order_gw_iface, order_gw_port);
-  order_gateway->start();
 
   const std::string mkt_data_iface = "lo";
   const std::string snapshot_ip = "233.252.14.1";
   const int snapshot_port = 20000;
   const std::string incremental_ip = "233.252.14.3";
   const int incremental_port = 20001;
+
+  // The three components only share the queues, so they are constructed in parallel, each on a thread of its own for its
+  // MemoryNodeScope. logger is not thread safe, so only this thread logs.
+  std::thread trade_engine_constructor([&]()
+  {
+    Common::MemoryNodeScope memory_node(trade_engine_node);
+    trade_engine = new Trading::TradeEngine(client_id, algo_type, ticker_cfg, portfolio_risk_cfg, client_requests, client_responses,market_updates);
+  });
+  std::thread order_gateway_constructor([&]()
+  {
+    Common::MemoryNodeScope memory_node(order_gateway_node);
+    order_gateway = new Trading::OrderGateway(client_id, client_requests, client_responses, order_gw_ip, order_gw_iface, order_gw_port, transport_type, io_engine);
+  });
+  std::thread market_data_consumer_constructor([&]()
+  {
+    Common::MemoryNodeScope memory_node(market_data_consumer_node);
+    market_data_consumer = new Trading::MarketDataConsumer(client_id, market_updates, mkt_data_iface, snapshot_ip, snapshot_port, incremental_ip, incremental_port, transport_type, mcast_rx_type);
+  });
+  trade_engine_constructor.join();
+  order_gateway_constructor.join();
+  market_data_consumer_constructor.join();
+
+  logger->log("%:% %() % Starting Trade Engine...\n", __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str));
+  trade_engine->start();
+
+  logger->log("%:% %() % Starting Order Gateway...\n", __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str));
+  order_gateway->start();
+
   logger->log("%:% %() % Starting Market Data Consumer...\n", __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str));
-  market_data_consumer = new Trading::MarketDataConsumer(client_id, &market_updates, mkt_data_iface, snapshot_ip, snapshot_port, incremental_ip, incremental_port);
   market_data_consumer->start();
 
-  usleep(10 * 1000 * 1000);
+  logger->log("%:% %() % Memory backing %", __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str), Common::hugePageReport());
+
+  // every thread is running by the time start() returns and the order gateway is connected, but requests only go out once the exchange
+  // has answered its session handshake - wait for that rather than have the first ones sit in the queue. Market data needs no wait, the
+  // consumer only hands the trade engine updates once it is in sequence with the exchange, recovering from snapshots if it has to.
+  using namespace std::literals::chrono_literals;
+  const auto session_deadline = std::chrono::steady_clock::now() + 10s;
+  while (!order_gateway->sessionReady() && std::chrono::steady_clock::now() < session_deadline)
+    std::this_thread::sleep_for(1ms);
+  ASSERT(order_gateway->sessionReady(), "Exchange did not answer the order gateway's session handshake for ClientId:" + std::to_string(client_id));
+  logger->log("%:% %() % Order Gateway session ready\n", __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str));
+
   trade_engine->initLastEventTime();
   
   if (algo_type == AlgoType::RANDOM) 
@@ -80,7 +197,7 @@ int main(int argc, char **argv)
       Exchange::MEClientRequest
       new_request{Exchange::ClientRequestType::NEW,
         client_id, ticker_id, order_id++, side, price,
-          qty};
+          qty, Common::OrderType::LIMIT, Common::TimeInForce::DAY};
       trade_engine->sendClientRequest(&new_request);
       usleep(sleep_time);
       client_requests_vec.push_back(new_request);
@@ -98,6 +215,10 @@ int main(int argc, char **argv)
   {
     logger->log("%:% %() % Waiting till no activity, been silent for % seconds...\n", __FILE__, __LINE__,
         __FUNCTION__, Common::getCurrentTimeStr(&time_str), trade_engine->silentSeconds());
+    // read from this thread through the books' published snapshots, without touching the trade engine's own state.
+    for (TickerId ticker_id = 0; ticker_id < ME_MAX_TICKERS; ++ticker_id)
+      logger->log("%:% %() % %\n", __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str),
+                  trade_engine->readBookSnapshot(ticker_id).toString());
     using namespace std::literals::chrono_literals;
     std::this_thread::sleep_for(10s);
   }
@@ -115,6 +236,9 @@ int main(int argc, char **argv)
   market_data_consumer = nullptr;
   delete order_gateway;
   order_gateway = nullptr;
+  delete client_requests;
+  delete client_responses;
+  delete market_updates;
   std::this_thread::sleep_for(10s);
   exit(EXIT_SUCCESS);
 }
\ No newline at end of file